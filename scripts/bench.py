@@ -0,0 +1,129 @@
+#! /usr/bin/env python
+#
+#  Benchmarks toks over a corpus directory.
+#
+#  Every run indexes all source files of the corpus into a fresh index with
+#  --stats and the runs are summarized: files, MB and tokens (chunks) per
+#  second, and the time of each stage. A summary can be saved and later runs
+#  compared against it.
+#
+#  $ python scripts/bench.py --toks build/toks --corpus ~/src/linux --runs 5
+#  $ python scripts/bench.py ... --save baseline.json
+#  $ python scripts/bench.py ... --baseline baseline.json
+#
+# @license GPL v2+
+#
+
+import json
+import math
+import optparse
+import os
+import subprocess
+import sys
+import tempfile
+
+EXTENSIONS = [ '.c', '.cpp', '.d', '.cs', '.vala', '.java', '.pawn', '.p',
+               '.sma', '.inl', '.h', '.cxx', '.hpp', '.hxx', '.cc', '.cp',
+               '.C', '.CPP', '.c++', '.di', '.m', '.mm', '.sqc', '.es' ]
+
+def find_sources (corpus):
+	files = []
+	for root, dirs, names in os.walk(corpus):
+		dirs[:] = sorted([d for d in dirs if not d.startswith('.')])
+		for name in sorted(names):
+			if os.path.splitext(name)[1] in EXTENSIONS:
+				files.append(os.path.join(root, name))
+	return files
+
+def run_once (toks, files, jobs):
+	tmpdir = tempfile.mkdtemp(prefix='toks_bench')
+	index = os.path.join(tmpdir, 'TOKS')
+	stats = os.path.join(tmpdir, 'stats.json')
+	try:
+		proc = subprocess.Popen([toks, '-j', str(jobs), '-i', index,
+		                         '--stats', stats, '-0', '-F', '-'],
+		                        stdin=subprocess.PIPE)
+		proc.communicate('\0'.join(files).encode('utf-8'))
+		if proc.returncode != 0:
+			sys.exit('%s failed with %d' % (toks, proc.returncode))
+		fh = open(stats, 'r')
+		total = json.load(fh)['total']
+		fh.close()
+	finally:
+		for name in os.listdir(tmpdir):
+			os.remove(os.path.join(tmpdir, name))
+		os.rmdir(tmpdir)
+
+	wall = total['ms']['wall'] / 1000.0
+	metrics = {
+		'files/s'  : total['files'] / wall,
+		'MB/s'     : total['bytes'] / 1e6 / wall,
+		'tokens/s' : total['chunks'] / wall,
+	}
+	for stage in total['ms']:
+		metrics[stage + ' ms'] = total['ms'][stage]
+	return metrics
+
+def summarize (runs):
+	summary = {}
+	for key in runs[0]:
+		values = [r[key] for r in runs]
+		mean = sum(values) / len(values)
+		var = sum([(v - mean) ** 2 for v in values]) / max(len(values) - 1, 1)
+		summary[key] = { 'mean': mean, 'stddev': math.sqrt(var) }
+	return summary
+
+def higher_is_better (key):
+	return key.endswith('/s')
+
+def report (summary, baseline, threshold):
+	regressions = 0
+	for key in sorted(summary.keys(), key=lambda k: (not higher_is_better(k), k)):
+		s = summary[key]
+		line = '%-24s %12.3f +- %-10.3f' % (key, s['mean'], s['stddev'])
+		if baseline != None and key in baseline and baseline[key]['mean'] > 0:
+			change = (s['mean'] - baseline[key]['mean']) * 100.0 / baseline[key]['mean']
+			worse = -change if higher_is_better(key) else change
+			line += ' %+7.1f%%' % change
+			noise = s['stddev'] + baseline[key]['stddev']
+			if worse > threshold and abs(s['mean'] - baseline[key]['mean']) > noise:
+				line += '  REGRESSION'
+				regressions += 1
+		print(line)
+	return regressions
+
+if __name__ == '__main__':
+	parser = optparse.OptionParser()
+	parser.add_option('--toks', default='toks', help='the toks binary')
+	parser.add_option('--corpus', default='.', help='directory with the sources')
+	parser.add_option('--runs', type='int', default=5, help='number of runs')
+	parser.add_option('--jobs', type='int', default=1, help='toks -j')
+	parser.add_option('--save', help='save the summary to this file')
+	parser.add_option('--baseline', help='compare with a saved summary')
+	parser.add_option('--threshold', type='float', default=5.0,
+	                  help='percent change reported as a regression, '
+	                       'if it is also beyond the deviation of the runs')
+	(opts, args) = parser.parse_args()
+
+	files = find_sources(opts.corpus)
+	if len(files) == 0:
+		sys.exit('No source files in %s' % opts.corpus)
+	print('%d files in %s, %d runs with -j %d' % (len(files), opts.corpus, opts.runs, opts.jobs))
+
+	runs = [run_once(opts.toks, files, opts.jobs) for i in range(0, opts.runs)]
+	summary = summarize(runs)
+
+	baseline = None
+	if opts.baseline and os.path.exists(opts.baseline):
+		fh = open(opts.baseline, 'r')
+		baseline = json.load(fh)
+		fh.close()
+
+	regressions = report(summary, baseline, opts.threshold)
+
+	if opts.save:
+		fh = open(opts.save, 'w')
+		json.dump(summary, fh, indent=2, sort_keys=True)
+		fh.close()
+
+	sys.exit(1 if regressions > 0 else 0)
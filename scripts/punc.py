@@ -30,34 +30,21 @@ def scan_file (filename):
 					token_idx += 1
 	return args
 
-def build_table (db, prev, arr):
-	start_idx = len(arr)
-
-	# do the current level first
-	k = db.keys();
-	if len(k) <= 0:
-		return
-
-	k.sort()
-	num_left = len(k)
-	for i in k:
-		did_one = 1
-		en = db[i]
-		# [ char, full-string, left-in-group, next_index, table-entry ]
-		num_left -= 1
-		arr.append([en[0], prev + en[0], num_left, 0, en[2]])
-
-	# update the one-up level index
-	if len(prev) > 0:
-		for idx in range(0, len(arr)):
-			if arr[idx][1] == prev:
-				arr[idx][3] = start_idx
-				break
-
-	# Now do each sub level
-	for i in k:
-		en = db[i]
-		build_table(en[3], prev + en[0], arr)
+def build_states (db, states):
+	"""
+	number the states of the trie breadth first, state 0 is the start
+	[ full-string, { char: state }, table-entry ]
+	"""
+	states.append(['', {}, None])
+	todo = [[0, db]]
+	while len(todo) > 0:
+		parent, level = todo.pop(0)
+		for ch in sorted(level.keys()):
+			en = level[ch]
+			idx = len(states)
+			states.append([states[parent][0] + ch, {}, en[2]])
+			states[parent][1][ch] = idx
+			todo.append([idx, en[3]])
 
 def add_to_db(entry, db_top):
 	"""
@@ -82,29 +69,53 @@ if __name__ == '__main__':
 	for a in pl:
 		add_to_db(a, db)
 
-	arr = []
-	build_table(db, '', arr)
-	idx = 0
-	print "/**"
-	print " * @file punctuators.h"
-	print " * Automatically generated"
-	print " */"
-	print "static const lookup_entry_t punc_table[] ="
-	print "{"
+	states = []
+	build_states(db, states)
+
+	# class 0 is every character that never appears in a punctuator
+	chars = sorted(set([ch for a in pl for ch in a[0]]))
+	classes = {}
+	for ch in chars:
+		classes[ch] = len(classes) + 1
+
+	print("/**")
+	print(" * @file punctuators.h")
+	print(" * Automatically generated")
+	print(" */")
+	print("")
+	print("#define PUNC_CLASSES    %d" % (len(chars) + 1))
+	print("")
+	print("/* The class of each character, 0 if it is in no punctuator */")
+	print("static const UINT8 punc_class[256] =")
+	print("{")
+	for row in range(0, 256, 16):
+		line = ", ".join(["%2d" % classes.get(chr(ch), 0) for ch in range(row, row + 16)])
+		print("   %s,   // 0x%02x" % (line, row))
+	print("};")
+	print("")
+	print("/* The state after a character class, 0 if no punctuator continues */")
+	print("static const UINT8 punc_next[][PUNC_CLASSES] =")
+	print("{")
+	for idx in range(0, len(states)):
+		st = states[idx]
+		row = [0] * (len(chars) + 1)
+		for ch in st[1]:
+			row[classes[ch]] = st[1][ch]
+		line = ", ".join(["%2d" % n for n in row])
+		print("   { %s },   // %3d: '%s'" % (line, idx, st[0]))
+	print("};")
+	print("")
+	print("/* The punctuator a state ends, NULL if it only leads to longer ones */")
+	print("static const chunk_tag_t *const punc_accept[] =")
+	print("{")
 	max_len = 0
-	for i in arr:
-		rec = i[4]
-		if rec != None and len(rec[1]) > max_len:
-			max_len = len(rec[1])
-		
-	for i in arr:
-		rec = i[4]
-		if len(i[0]) == 0:
-			print "   {   0,  0,  0, NULL %s },   // %3d:" % ((max_len - 4) * ' ', idx)
-		elif rec == None:
-			print "   { '%s', %2d, %2d, NULL %s },   // %3d: '%s'" % (i[0], i[2], i[3], (max_len - 4) * ' ', idx, i[1])
+	for st in states:
+		if st[2] != None and len(st[2][1]) > max_len:
+			max_len = len(st[2][1])
+	for idx in range(0, len(states)):
+		rec = states[idx][2]
+		if rec == None:
+			print("   NULL,%s   // %3d: '%s'" % ((max_len - 3) * ' ', idx, states[idx][0]))
 		else:
-			print "   { '%s', %2d, %2d, &%s%s },   // %3d: '%s'" % (i[0], i[2], i[3], rec[1], (max_len - len(rec[1])) * ' ', idx, i[1])
-		idx += 1
-	print '};'
-
+			print("   &%s,%s   // %3d: '%s'" % (rec[1], (max_len - len(rec[1])) * ' ', idx, states[idx][0]))
+	print("};")
@@ -0,0 +1,108 @@
+/**
+ * @file Arena.h
+ * Template class that allocates items in blocks, which are all released
+ * together when the arena is released.
+ *
+ * @license GPL v2+
+ */
+
+/**
+ * A simple block allocator for items that share a lifetime.
+ * Class T must define 'next', which must be a pointer to type T. It is used
+ * to link freed items, which are handed out again by Alloc() before the
+ * arena grows.
+ * Items stay constructed until the arena is released, so a reused item still
+ * holds the values it had when it was freed.
+ */
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <new>
+#include <vector>
+#include <algorithm>
+
+template<class T, size_t BlockSize = 1024> class Arena
+{
+protected:
+   std::vector<T *> m_blocks;
+   size_t           m_used;   /* items constructed in the last block */
+   T                *m_free;  /* freed items, linked through 'next' */
+
+private:
+   /* Hide copy constructor */
+   Arena(const Arena& ref);
+
+public:
+   Arena() : m_used(BlockSize), m_free(NULL)
+   {
+   }
+
+
+   ~Arena()
+   {
+      Release();
+   }
+
+
+   T *Alloc()
+   {
+      T *obj;
+
+      if (m_free != NULL)
+      {
+         obj       = m_free;
+         m_free    = obj->next;
+         obj->next = NULL;
+         return(obj);
+      }
+
+      if (m_used == BlockSize)
+      {
+         m_blocks.push_back(static_cast<T *>(::operator new(sizeof(T) * BlockSize)));
+         m_used = 0;
+      }
+      obj = new (&m_blocks.back()[m_used]) T();
+      m_used++;
+      return(obj);
+   }
+
+
+   void Free(T *obj)
+   {
+      if (obj != NULL)
+      {
+         obj->next = m_free;
+         m_free    = obj;
+      }
+   }
+
+
+   /* Exchanges the items of two arenas */
+   void Swap(Arena& other)
+   {
+      std::swap(m_blocks, other.m_blocks);
+      std::swap(m_used, other.m_used);
+      std::swap(m_free, other.m_free);
+   }
+
+
+   /* Destroys all items and frees the memory in one go */
+   void Release()
+   {
+      for (size_t i = 0; i < m_blocks.size(); i++)
+      {
+         size_t count = (i + 1 < m_blocks.size()) ? BlockSize : m_used;
+
+         for (size_t j = 0; j < count; j++)
+         {
+            m_blocks[i][j].~T();
+         }
+         ::operator delete(m_blocks[i]);
+      }
+      m_blocks.clear();
+      m_used = BlockSize;
+      m_free = NULL;
+   }
+};
+
+#endif /* ARENA_H_INCLUDED */
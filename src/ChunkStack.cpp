@@ -8,15 +8,45 @@
 #include "ChunkStack.h"
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
+
+
+/* Make room for one more entry at the end, moving to the heap when full */
+void ChunkStack::Grow()
+{
+   if (m_head > 0)
+   {
+      /* Reuse the room left by Pop_Front() */
+      std::copy(m_cse + m_head, m_cse + m_head + m_len, m_cse);
+      m_head = 0;
+   }
+   if (m_len >= m_cap)
+   {
+      Entry *cse = new Entry[m_cap * 2];
+
+      std::copy(m_cse, m_cse + m_len, cse);
+      if (m_cse != m_inline)
+      {
+         delete[] m_cse;
+      }
+      m_cse  = cse;
+      m_cap *= 2;
+   }
+}
 
 
 void ChunkStack::Set(const ChunkStack& cs)
 {
-   m_cse.resize(cs.m_cse.size());
-   for (int idx = 0; idx < (int)m_cse.size(); idx++)
+   if (&cs == this)
    {
-      m_cse[idx].m_pc     = cs.m_cse[idx].m_pc;
-      m_cse[idx].m_seqnum = cs.m_cse[idx].m_seqnum;
+      return;
+   }
+   Reset();
+   for (int idx = 0; idx < cs.m_len; idx++)
+   {
+      const Entry& ent = cs.m_cse[cs.m_head + idx];
+
+      Push_Back(ent.m_pc, ent.m_seqnum);
    }
    m_seqnum = cs.m_seqnum;
 }
@@ -24,9 +54,9 @@ void ChunkStack::Set(const ChunkStack& cs)
 
 const ChunkStack::Entry *ChunkStack::Top() const
 {
-   if (m_cse.size() > 0)
+   if (m_len > 0)
    {
-      return(&m_cse[m_cse.size() - 1]);
+      return(&m_cse[m_head + m_len - 1]);
    }
    return(NULL);
 }
@@ -34,9 +64,9 @@ const ChunkStack::Entry *ChunkStack::Top() const
 
 const ChunkStack::Entry *ChunkStack::Get(int idx) const
 {
-   if ((idx >= 0) && (idx < (int)m_cse.size()))
+   if ((idx >= 0) && (idx < m_len))
    {
-      return(&m_cse[idx]);
+      return(&m_cse[m_head + idx]);
    }
    return(NULL);
 }
@@ -44,9 +74,9 @@ const ChunkStack::Entry *ChunkStack::Get(int idx) const
 
 chunk_t *ChunkStack::GetChunk(int idx) const
 {
-   if ((idx >= 0) && (idx < (int)m_cse.size()))
+   if ((idx >= 0) && (idx < m_len))
    {
-      return(m_cse[idx].m_pc);
+      return(m_cse[m_head + idx].m_pc);
    }
    return(NULL);
 }
@@ -56,10 +86,15 @@ chunk_t *ChunkStack::Pop_Front()
 {
    chunk_t *pc = NULL;
 
-   if (m_cse.size() > 0)
+   if (m_len > 0)
    {
-      pc = m_cse[0].m_pc;
-      m_cse.pop_front();
+      pc = m_cse[m_head].m_pc;
+      m_head++;
+      m_len--;
+      if (m_len == 0)
+      {
+         m_head = 0;
+      }
    }
    return(pc);
 }
@@ -69,25 +104,15 @@ chunk_t *ChunkStack::Pop_Back()
 {
    chunk_t *pc = NULL;
 
-   if (m_cse.size() > 0)
+   if (m_len > 0)
    {
-      pc = m_cse[m_cse.size() - 1].m_pc;
-      m_cse.pop_back();
+      m_len--;
+      pc = m_cse[m_head + m_len].m_pc;
    }
    return(pc);
 }
 
 
-void ChunkStack::Push_Back(chunk_t *pc, int seqnum)
-{
-   m_cse.push_back(Entry(seqnum, pc));
-   if (m_seqnum < seqnum)
-   {
-      m_seqnum = seqnum;
-   }
-}
-
-
 /**
  * Mark an entry to be removed by Collapse()
  *
@@ -95,9 +120,9 @@ void ChunkStack::Push_Back(chunk_t *pc, int seqnum)
  */
 void ChunkStack::Zap(int idx)
 {
-   if ((idx >= 0) && (idx < (int)m_cse.size()))
+   if ((idx >= 0) && (idx < m_len))
    {
-      m_cse[idx].m_pc = NULL;
+      m_cse[m_head + idx].m_pc = NULL;
    }
 }
 
@@ -107,20 +132,21 @@ void ChunkStack::Zap(int idx)
  */
 void ChunkStack::Collapse()
 {
-   int wr_idx = 0;
-   int rd_idx;
+   Entry *cse = m_cse + m_head;
+   int   wr_idx = 0;
+   int   rd_idx;
 
-   for (rd_idx = 0; rd_idx < (int)m_cse.size(); rd_idx++)
+   for (rd_idx = 0; rd_idx < m_len; rd_idx++)
    {
-      if (m_cse[rd_idx].m_pc != NULL)
+      if (cse[rd_idx].m_pc != NULL)
       {
          if (rd_idx != wr_idx)
          {
-            m_cse[wr_idx].m_pc     = m_cse[rd_idx].m_pc;
-            m_cse[wr_idx].m_seqnum = m_cse[rd_idx].m_seqnum;
+            cse[wr_idx].m_pc     = cse[rd_idx].m_pc;
+            cse[wr_idx].m_seqnum = cse[rd_idx].m_seqnum;
          }
          wr_idx++;
       }
    }
-   m_cse.resize(wr_idx);
+   m_len = wr_idx;
 }
@@ -9,7 +9,13 @@
 #define CHUNKSTACK_H_INCLUDED
 
 #include "toks_types.h"
-#include <deque>
+
+/**
+ * The first CHUNKSTACK_INLINE entries are stored in the stack itself, so
+ * the short stacks the combine functions build on every call don't
+ * allocate. Longer ones move to the heap.
+ */
+#define CHUNKSTACK_INLINE    16
 
 class ChunkStack
 {
@@ -24,21 +30,38 @@ public:
    };
 
 protected:
-   deque<Entry> m_cse;
-   int m_seqnum;   // current seq num
+   Entry *m_cse;      // m_inline or a heap array of m_cap entries
+   int   m_head;      // first entry, past those taken by Pop_Front()
+   int   m_len;
+   int   m_cap;
+   int   m_seqnum;    // current seq num
+   Entry m_inline[CHUNKSTACK_INLINE];
+
+   void Grow();
 
 public:
-   ChunkStack() : m_seqnum(0)
+   ChunkStack() : m_cse(m_inline), m_head(0), m_len(0), m_cap(CHUNKSTACK_INLINE), m_seqnum(0)
    {
    }
 
    ChunkStack(const ChunkStack& cs)
+      : m_cse(m_inline), m_head(0), m_len(0), m_cap(CHUNKSTACK_INLINE), m_seqnum(0)
    {
       Set(cs);
    }
 
+   ChunkStack& operator=(const ChunkStack& cs)
+   {
+      Set(cs);
+      return(*this);
+   }
+
    virtual ~ChunkStack()
    {
+      if (m_cse != m_inline)
+      {
+         delete[] m_cse;
+      }
    }
 
    void Set(const ChunkStack& cs);
@@ -50,12 +73,12 @@ public:
 
    bool Empty() const
    {
-      return(m_cse.empty());
+      return(m_len == 0);
    }
 
    int Len() const
    {
-      return(m_cse.size());
+      return(m_len);
    }
 
    const Entry *Top() const;
@@ -63,13 +86,28 @@ public:
    chunk_t *GetChunk(int idx) const;
 
    chunk_t *Pop_Back();
-   void Push_Back(chunk_t *pc, int seqnum);
+
+   void Push_Back(chunk_t *pc, int seqnum)
+   {
+      if (m_head + m_len >= m_cap)
+      {
+         Grow();
+      }
+      m_cse[m_head + m_len].m_seqnum = seqnum;
+      m_cse[m_head + m_len].m_pc     = pc;
+      m_len++;
+      if (m_seqnum < seqnum)
+      {
+         m_seqnum = seqnum;
+      }
+   }
 
    chunk_t *Pop_Front();
 
    void Reset()
    {
-      m_cse.clear();
+      m_head = 0;
+      m_len  = 0;
    }
 
    void Zap(int idx);
@@ -0,0 +1,362 @@
+/**
+ * @file DirWalk.cpp
+ * Recursive directory reading for -r.
+ *
+ * A .gitignore applies to the directory it is in and the ones below, the
+ * common patterns are understood: comments, !negation, a trailing / for
+ * directories only, a / at the start or inside to match from the directory
+ * of the .gitignore, and the * ? [...] and ** wildcards.
+ *
+ * @license GPL v2+
+ */
+#include "DirWalk.h"
+#include "toks_types.h"
+#include "prototypes.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifndef WIN32
+#include <fnmatch.h>
+#endif
+
+/* Files found but not handed out yet, keeps the walk from running far ahead */
+#define WALK_QUEUE_SIZE    4096
+
+
+struct ignore_rule
+{
+   string pattern;
+   bool   negate;
+   bool   dir_only;
+   bool   anchored;   // matched against the path below the .gitignore
+};
+
+struct walk_ignores
+{
+   std::shared_ptr<const walk_ignores> parent;
+   string                              base;   // prefix of the .gitignore directory
+   vector<ignore_rule>                 rules;
+};
+
+
+/* Directories that are never walked */
+static bool walk_skipped_dir(const char *name, const string& path)
+{
+   struct stat st;
+
+   if ((strcmp(name, ".git") == 0) || (strcmp(name, ".hg") == 0) ||
+       (strcmp(name, ".svn") == 0))
+   {
+      return(true);
+   }
+
+   /* A CMake build tree */
+   return(stat((path + "/CMakeCache.txt").c_str(), &st) == 0);
+}
+
+
+/* Read the .gitignore of a directory, NULL if it has none */
+static walk_ignores *walk_read_ignores(const string& prefix)
+{
+   char line[4096];
+   walk_ignores *ignores = NULL;
+   FILE *fp = fopen((prefix + ".gitignore").c_str(), "r");
+
+   if (fp == NULL)
+   {
+      return(NULL);
+   }
+
+   while (fgets(line, sizeof(line), fp) != NULL)
+   {
+      ignore_rule rule;
+      size_t len = strlen(line);
+
+      while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r') ||
+                           (line[len - 1] == ' ')))
+      {
+         len--;
+      }
+      rule.pattern.assign(line, len);
+
+      if (rule.pattern.empty() || (rule.pattern[0] == '#'))
+      {
+         continue;
+      }
+
+      rule.negate = (rule.pattern[0] == '!');
+      if (rule.negate)
+      {
+         rule.pattern.erase(0, 1);
+      }
+
+      rule.dir_only = (!rule.pattern.empty() && (rule.pattern[rule.pattern.size() - 1] == '/'));
+      if (rule.dir_only)
+      {
+         rule.pattern.erase(rule.pattern.size() - 1);
+      }
+
+      /* A leading ** directory matches in any directory, like a plain name */
+      while (rule.pattern.compare(0, 3, "**/") == 0)
+      {
+         rule.pattern.erase(0, 3);
+      }
+
+      rule.anchored = (rule.pattern.find('/') != string::npos);
+      if (rule.anchored && (rule.pattern[0] == '/'))
+      {
+         rule.pattern.erase(0, 1);
+      }
+
+      if (!rule.pattern.empty())
+      {
+         if (ignores == NULL)
+         {
+            ignores       = new walk_ignores;
+            ignores->base = prefix;
+         }
+         ignores->rules.push_back(rule);
+      }
+   }
+   fclose(fp);
+
+   return(ignores);
+}
+
+
+/**
+ * Whether the .gitignore rules exclude a file or directory. The last
+ * matching rule decides, the rules of deeper directories come first.
+ */
+static bool walk_ignored(const walk_ignores *ignores, const string& name, bool is_dir)
+{
+#ifndef WIN32
+   for ( ; ignores != NULL; ignores = ignores->parent.get())
+   {
+      const char *path = name.c_str() + ignores->base.size();
+      const char *base = path_basename(path);
+
+      for (size_t i = ignores->rules.size(); i-- > 0; )
+      {
+         const ignore_rule& rule = ignores->rules[i];
+
+         if (rule.dir_only && !is_dir)
+         {
+            continue;
+         }
+
+         /* Without FNM_PATHNAME a * also matches /, as ** should */
+         int flags = (rule.pattern.find("**") != string::npos) ? 0 : FNM_PATHNAME;
+
+         if (fnmatch(rule.pattern.c_str(), rule.anchored ? path : base, flags) == 0)
+         {
+            return(!rule.negate);
+         }
+      }
+   }
+#endif
+   return(false);
+}
+
+
+DirWalk::DirWalk()
+   : m_pending(0)
+   , m_stop(false)
+   , m_files(WALK_QUEUE_SIZE)
+{
+}
+
+
+DirWalk::~DirWalk()
+{
+   {
+      std::unique_lock<std::mutex> guard(m_lock);
+      m_stop = true;
+      m_more.notify_all();
+   }
+   m_files.Close();
+
+   for (size_t i = 0; i < m_threads.size(); i++)
+   {
+      m_threads[i].join();
+   }
+}
+
+
+/* Walk the directories on the given number of threads */
+void DirWalk::Start(const std::vector<std::string>& dirs, int threads)
+{
+   for (size_t i = dirs.size(); i-- > 0; )
+   {
+      walk_dir dir;
+      struct stat st;
+
+      dir.prefix = dirs[i];
+      while ((dir.prefix.size() > 1) && (dir.prefix[dir.prefix.size() - 1] == '/'))
+      {
+         dir.prefix.erase(dir.prefix.size() - 1);
+      }
+
+      if ((stat(dir.prefix.c_str(), &st) != 0) || !S_ISDIR(st.st_mode))
+      {
+         LOG_FMT(LERR, "Not a directory: %s\n", dirs[i].c_str());
+         continue;
+      }
+
+      if (dir.prefix == ".")
+      {
+         dir.prefix.clear();
+      }
+      else
+      {
+         dir.prefix += "/";
+      }
+      m_dirs.push_back(dir);
+   }
+
+   m_pending = (int)m_dirs.size();
+   if (m_pending == 0)
+   {
+      m_files.Close();
+      return;
+   }
+
+   for (int i = 0; i < max(threads, 1); i++)
+   {
+      m_threads.push_back(std::thread(&DirWalk::Run, this));
+   }
+}
+
+
+void DirWalk::Run()
+{
+   std::unique_lock<std::mutex> guard(m_lock);
+
+   while (true)
+   {
+      while (m_dirs.empty() && (m_pending > 0) && !m_stop)
+      {
+         m_more.wait(guard);
+      }
+      if (m_dirs.empty() || m_stop)
+      {
+         break;
+      }
+
+      walk_dir dir = m_dirs.back();
+      m_dirs.pop_back();
+      guard.unlock();
+
+      Read(dir);
+
+      guard.lock();
+      if (--m_pending == 0)
+      {
+         m_files.Close();
+         m_more.notify_all();
+      }
+   }
+}
+
+
+/* Hand out the source files of a directory and queue its subdirectories */
+void DirWalk::Read(const walk_dir& dir)
+{
+   const char *path = dir.prefix.empty() ? "." : dir.prefix.c_str();
+   vector<string> files, subdirs;
+   struct dirent *entry;
+   walk_ignores *own;
+   walk_dir sub;
+   DIR *dp;
+
+   dp = opendir(path);
+   if (dp == NULL)
+   {
+      LOG_FMT(LWARN, "Unable to read %s: %s (%d)\n", path, strerror(errno), errno);
+      return;
+   }
+
+   own = walk_read_ignores(dir.prefix);
+   if (own != NULL)
+   {
+      own->parent = dir.ignores;
+      sub.ignores.reset(own);
+   }
+   else
+   {
+      sub.ignores = dir.ignores;
+   }
+
+   while ((entry = readdir(dp)) != NULL)
+   {
+      const char *name = entry->d_name;
+      string full(dir.prefix + name);
+      struct stat st;
+      bool is_dir, is_file;
+
+      if ((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0))
+      {
+         continue;
+      }
+
+#ifdef DT_DIR
+      if ((entry->d_type != DT_UNKNOWN) && (entry->d_type != DT_LNK))
+      {
+         is_dir  = (entry->d_type == DT_DIR);
+         is_file = (entry->d_type == DT_REG);
+      }
+      else
+#endif
+      {
+         /* Links to directories are not followed, links to files are */
+         if (lstat(full.c_str(), &st) != 0)
+         {
+            continue;
+         }
+         is_dir  = S_ISDIR(st.st_mode);
+         is_file = S_ISREG(st.st_mode) ||
+                   (S_ISLNK(st.st_mode) && (stat(full.c_str(), &st) == 0) && S_ISREG(st.st_mode));
+      }
+
+      if (is_dir)
+      {
+         if (!walk_skipped_dir(name, full) && !walk_ignored(sub.ignores.get(), full, true))
+         {
+            subdirs.push_back(full + "/");
+         }
+      }
+      else if (is_file && is_source_file(full.c_str()) &&
+               !walk_ignored(sub.ignores.get(), full, false))
+      {
+         files.push_back(full);
+      }
+   }
+   closedir(dp);
+
+   sort(files.begin(), files.end());
+   sort(subdirs.begin(), subdirs.end());
+
+   if (!subdirs.empty())
+   {
+      std::unique_lock<std::mutex> guard(m_lock);
+
+      /* Reversed, so they are taken from the back in order */
+      for (size_t i = subdirs.size(); i-- > 0; )
+      {
+         sub.prefix = subdirs[i];
+         m_dirs.push_back(sub);
+      }
+      m_pending += (int)subdirs.size();
+      m_more.notify_all();
+   }
+
+   for (size_t i = 0; i < files.size(); i++)
+   {
+      m_files.Push(files[i]);
+   }
+}
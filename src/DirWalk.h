@@ -0,0 +1,65 @@
+/**
+ * @file DirWalk.h
+ * Finds the source files below directories, reading the directories on a
+ * pool of threads while the files found are being processed.
+ *
+ * @license GPL v2+
+ */
+#ifndef DIR_WALK_H_INCLUDED
+#define DIR_WALK_H_INCLUDED
+
+#include "WorkQueue.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+struct walk_ignores;
+
+/* A directory still to be read */
+struct walk_dir
+{
+   std::string                         prefix;   // "" or ending in /
+   std::shared_ptr<const walk_ignores> ignores;  // .gitignore rules in effect
+};
+
+/**
+ * Skips the directories of version control systems and CMake build trees
+ * and whatever the .gitignore files on the way exclude. With a single thread
+ * the files come in the order of a sorted depth first walk.
+ */
+class DirWalk
+{
+public:
+   DirWalk();
+   ~DirWalk();
+
+   void Start(const std::vector<std::string>& dirs, int threads);
+
+   /* Blocks until a file is found, false once all directories are read */
+   bool Next(std::string& filename)
+   {
+      return(m_files.Pop(filename));
+   }
+
+protected:
+   std::vector<walk_dir>    m_dirs;     // read by the next free thread
+   int                      m_pending;  // directories queued or being read
+   bool                     m_stop;
+   std::mutex               m_lock;
+   std::condition_variable  m_more;
+   WorkQueue<std::string>   m_files;
+   std::vector<std::thread> m_threads;
+
+   void Run();
+   void Read(const walk_dir& dir);
+
+private:
+   /* Hide copy constructor */
+   DirWalk(const DirWalk& ref);
+};
+
+#endif /* DIR_WALK_H_INCLUDED */
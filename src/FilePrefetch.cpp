@@ -0,0 +1,171 @@
+/**
+ * @file FilePrefetch.cpp
+ * Read-ahead of the source files for sequential runs.
+ *
+ * Where posix_fadvise() is available the system is asked to read a file
+ * in the background, which also starts the reads of a network file system
+ * early. Elsewhere the thread reads the file itself to get it into the
+ * cache.
+ *
+ * @license GPL v2+
+ */
+#include "FilePrefetch.h"
+#include "SourceList.h"
+#include "prototypes.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+/* Names waiting for Next(), keeps the list from being read far ahead */
+#define PREFETCH_QUEUE_SIZE    4096
+
+
+/* Start reading a file into the cache */
+static void prefetch_file(const char *filename)
+{
+#ifdef POSIX_FADV_WILLNEED
+   int fd = open(filename, O_RDONLY);
+
+   if (fd >= 0)
+   {
+      (void) posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+      close(fd);
+   }
+#else
+   char buf[65536];
+   FILE *fp = fopen(filename, "rb");
+
+   if (fp != NULL)
+   {
+      while (fread(buf, 1, sizeof(buf), fp) == sizeof(buf))
+      {
+      }
+      fclose(fp);
+   }
+#endif
+}
+
+
+FilePrefetch::FilePrefetch(size_t files, UINT64 budget)
+   : m_files(files)
+   , m_budget(budget)
+   , m_bytes(0)
+   , m_ahead(0)
+   , m_done(false)
+   , m_stop(false)
+   , m_source_files(NULL)
+   , m_indexed(NULL)
+{
+}
+
+
+FilePrefetch::~FilePrefetch()
+{
+   {
+      std::unique_lock<std::mutex> guard(m_lock);
+      m_stop = true;
+      m_changed.notify_all();
+   }
+
+   if (m_thread.joinable())
+   {
+      m_thread.join();
+   }
+}
+
+
+void FilePrefetch::Start(SourceList& source_files, const indexed_file_map *indexed)
+{
+   m_source_files = &source_files;
+   m_indexed      = indexed;
+   m_thread       = std::thread(&FilePrefetch::Run, this);
+}
+
+
+void FilePrefetch::Run()
+{
+   std::string filename;
+
+   while (m_source_files->Next(filename))
+   {
+      prefetched item;
+      file_stat  st;
+
+      item.filename = filename;
+      item.bytes    = 0;
+      if (get_file_stat(filename.c_str(), st))
+      {
+         indexed_file_map::const_iterator it;
+
+         if ((m_indexed == NULL) ||
+             ((it = m_indexed->find(filename)) == m_indexed->end()) ||
+             !(it->second.stat == st))
+         {
+            item.bytes = st.size;
+         }
+      }
+
+      {
+         std::unique_lock<std::mutex> guard(m_lock);
+
+         /* A file larger than the budget is read ahead on its own */
+         while (!m_stop &&
+                ((m_queue.size() >= PREFETCH_QUEUE_SIZE) ||
+                 ((item.bytes > 0) &&
+                  ((m_ahead >= m_files) ||
+                   ((m_bytes > 0) && (m_bytes + item.bytes > m_budget))))))
+         {
+            m_changed.wait(guard);
+         }
+         if (m_stop)
+         {
+            break;
+         }
+
+         m_queue.push_back(item);
+         if (item.bytes > 0)
+         {
+            m_bytes += item.bytes;
+            m_ahead++;
+         }
+         m_changed.notify_all();
+      }
+
+      if (item.bytes > 0)
+      {
+         prefetch_file(filename.c_str());
+      }
+   }
+
+   std::unique_lock<std::mutex> guard(m_lock);
+   m_done = true;
+   m_changed.notify_all();
+}
+
+
+bool FilePrefetch::Next(std::string& filename)
+{
+   std::unique_lock<std::mutex> guard(m_lock);
+
+   while (m_queue.empty() && !m_done)
+   {
+      m_changed.wait(guard);
+   }
+   if (m_queue.empty())
+   {
+      return(false);
+   }
+
+   filename.swap(m_queue.front().filename);
+   if (m_queue.front().bytes > 0)
+   {
+      m_bytes -= m_queue.front().bytes;
+      m_ahead--;
+   }
+   m_queue.pop_front();
+   m_changed.notify_all();
+   return(true);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file FilePrefetch.h
+ * Reads ahead the source files a sequential run is about to analyze, so
+ * their contents are on the way while the current file is parsed.
+ *
+ * @license GPL v2+
+ */
+#ifndef FILE_PREFETCH_H_INCLUDED
+#define FILE_PREFETCH_H_INCLUDED
+
+#include "toks_types.h"
+
+#include <deque>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+class SourceList;
+
+/**
+ * A thread takes the names from a SourceList and asks the system to read
+ * the files, at most a number of files and bytes ahead of Next(). Files
+ * that are indexed with the same size and time are left alone, they are
+ * not read again anyway.
+ */
+class FilePrefetch
+{
+public:
+   FilePrefetch(size_t files, UINT64 budget);
+   ~FilePrefetch();
+
+   /* indexed may be NULL, then all files are read ahead */
+   void Start(SourceList& source_files, const indexed_file_map *indexed);
+
+   /* Blocks until a name is available, false once all names are returned */
+   bool Next(std::string& filename);
+
+protected:
+   /* A name that was handed out and the bytes read ahead for it */
+   struct prefetched
+   {
+      std::string filename;
+      UINT64      bytes;
+   };
+
+   size_t                   m_files;
+   UINT64                   m_budget;
+   UINT64                   m_bytes;   // read ahead and not returned yet
+   size_t                   m_ahead;   // files of m_bytes
+   std::deque<prefetched>   m_queue;
+   bool                     m_done;    // all names are queued
+   bool                     m_stop;
+   std::mutex               m_lock;
+   std::condition_variable  m_changed;
+   std::thread              m_thread;
+   SourceList               *m_source_files;
+   const indexed_file_map   *m_indexed;
+
+   void Run();
+
+private:
+   /* Hide copy constructor */
+   FilePrefetch(const FilePrefetch& ref);
+};
+
+#endif /* FILE_PREFETCH_H_INCLUDED */
@@ -41,6 +41,14 @@ public:
    }
 
 
+   /* Forget all items, without touching them */
+   void Reset()
+   {
+      first = NULL;
+      last  = NULL;
+   }
+
+
    T *GetHead()
    {
       return(first);
@@ -0,0 +1,125 @@
+/**
+ * @file LookupCache.cpp
+ * Answers of recent lookups, dropped when the index changes under them.
+ *
+ * @license GPL v2+
+ */
+#include "LookupCache.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+LookupCache::LookupCache(size_t answers, size_t bytes)
+   : m_answers(answers)
+   , m_bytes(bytes)
+   , m_used(0)
+{
+}
+
+
+const std::string *LookupCache::Find(const std::string& key)
+{
+   unordered_map<std::string, cached_list::iterator>::iterator it = m_keys.find(key);
+
+   if (it == m_keys.end())
+   {
+      return(NULL);
+   }
+   m_lru.splice(m_lru.begin(), m_lru, it->second);
+   return(&it->second->answer);
+}
+
+
+void LookupCache::Add(const std::string& key, const std::string& pattern,
+                      const std::string& answer, const std::vector<std::string>& files)
+{
+   unordered_map<std::string, cached_list::iterator>::iterator it = m_keys.find(key);
+   size_t bytes = key.size() + pattern.size() + answer.size();
+
+   for (size_t i = 0; i < files.size(); i++)
+   {
+      bytes += files[i].size();
+   }
+
+   if (it != m_keys.end())
+   {
+      Drop(it->second);
+   }
+   if ((m_answers == 0) || (bytes > m_bytes / 8))
+   {
+      return;
+   }
+
+   m_lru.push_front(cached());
+   cached& entry = m_lru.front();
+   entry.key       = key;
+   entry.pattern   = pattern;
+   entry.wildcards = (pattern[strcspn(pattern.c_str(), "*?[")] != 0);
+   entry.answer    = answer;
+   entry.files     = files;
+   entry.bytes     = bytes;
+   sort(entry.files.begin(), entry.files.end());
+   entry.files.erase(unique(entry.files.begin(), entry.files.end()), entry.files.end());
+   m_keys[key] = m_lru.begin();
+   m_used     += bytes;
+
+   while ((m_lru.size() > m_answers) || (m_used > m_bytes))
+   {
+      Drop(--m_lru.end());
+   }
+}
+
+
+/**
+ * Drop the answers a change of files may affect, identifiers has those the
+ * changed files have now
+ */
+void LookupCache::Changed(const std::vector<std::string>& files,
+                          const unordered_set<std::string>& identifiers)
+{
+   cached_list::iterator it = m_lru.begin();
+
+   while (it != m_lru.end())
+   {
+      cached_list::iterator next = it;
+      bool affected = false;
+
+      ++next;
+      for (size_t i = 0; !affected && (i < files.size()); i++)
+      {
+         affected = binary_search(it->files.begin(), it->files.end(), files[i]);
+      }
+      if (!affected && !it->wildcards)
+      {
+         affected = (identifiers.count(it->pattern) != 0);
+      }
+      for (unordered_set<std::string>::const_iterator id = identifiers.begin();
+           !affected && it->wildcards && (id != identifiers.end()); ++id)
+      {
+         affected = (sqlite3_strglob(it->pattern.c_str(), id->c_str()) == 0);
+      }
+
+      if (affected)
+      {
+         Drop(it);
+      }
+      it = next;
+   }
+}
+
+
+void LookupCache::Clear()
+{
+   m_lru.clear();
+   m_keys.clear();
+   m_used = 0;
+}
+
+
+void LookupCache::Drop(cached_list::iterator it)
+{
+   m_used -= it->bytes;
+   m_keys.erase(it->key);
+   m_lru.erase(it);
+}
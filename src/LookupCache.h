@@ -0,0 +1,66 @@
+/**
+ * @file LookupCache.h
+ * Keeps the answers of recent lookups, so a server answers the identifiers
+ * editors ask for again and again without looking them up.
+ *
+ * @license GPL v2+
+ */
+#ifndef LOOKUP_CACHE_H_INCLUDED
+#define LOOKUP_CACHE_H_INCLUDED
+
+#include "toks_types.h"
+
+#include <list>
+#include <string>
+#include <vector>
+
+/**
+ * The least recently used answers are dropped to stay within a number of
+ * answers and bytes. An answer remembers the pattern it was looked up with
+ * and the files of its entries, so a change of the index only drops the
+ * answers it may change: those with an entry in a changed file and those
+ * whose pattern matches an identifier a changed file has now.
+ */
+class LookupCache
+{
+public:
+   LookupCache(size_t answers, size_t bytes);
+
+   /* NULL if there is no answer for the key, else it is the most recent */
+   const std::string *Find(const std::string& key);
+
+   /* An answer bigger than an eighth of the bytes is not kept */
+   void Add(const std::string& key, const std::string& pattern,
+            const std::string& answer, const std::vector<std::string>& files);
+
+   void Changed(const std::vector<std::string>& files,
+                const unordered_set<std::string>& identifiers);
+
+   void Clear();
+
+protected:
+   struct cached
+   {
+      std::string              key;
+      std::string              pattern;
+      bool                     wildcards;
+      std::string              answer;
+      std::vector<std::string> files;    // sorted
+      size_t                   bytes;
+   };
+   typedef std::list<cached> cached_list;
+
+   size_t                                            m_answers;
+   size_t                                            m_bytes;
+   size_t                                            m_used;   // bytes of the answers kept
+   cached_list                                       m_lru;    // most recently used first
+   unordered_map<std::string, cached_list::iterator> m_keys;
+
+   void Drop(cached_list::iterator it);
+
+private:
+   /* Hide copy constructor */
+   LookupCache(const LookupCache& ref);
+};
+
+#endif /* LOOKUP_CACHE_H_INCLUDED */
@@ -0,0 +1,236 @@
+/**
+ * @file SourceBuffer.cpp
+ * Reads source files into memory, or maps them.
+ *
+ * @license GPL v2+
+ */
+#include "SourceBuffer.h"
+#include "logger.h"
+#include "log_levels.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef WIN32
+
+/**
+ * Maps the whole file. Empty files are fine and result in an empty buffer.
+ *
+ * @param filename The file to map
+ * @return         false if the file could not be opened or mapped
+ */
+bool SourceBuffer::Map(const char *filename)
+{
+   LARGE_INTEGER size;
+   HANDLE        file;
+
+   Release();
+
+   file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                      NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+   if (file == INVALID_HANDLE_VALUE)
+   {
+      LOG_FMT(LERR, "%s: unable to open (error %lu)\n", filename, GetLastError());
+      return(false);
+   }
+
+   if (!GetFileSizeEx(file, &size))
+   {
+      LOG_FMT(LERR, "%s: unable to get size (error %lu)\n", filename, GetLastError());
+      CloseHandle(file);
+      return(false);
+   }
+
+   if (size.QuadPart > 0)
+   {
+      HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      void   *view   = NULL;
+
+      if (mapping != NULL)
+      {
+         view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      }
+      if (view == NULL)
+      {
+         LOG_FMT(LERR, "%s: unable to map (error %lu)\n", filename, GetLastError());
+         if (mapping != NULL)
+         {
+            CloseHandle(mapping);
+         }
+         CloseHandle(file);
+         return(false);
+      }
+
+      m_handle   = mapping;
+      m_map      = view;
+      m_map_size = (size_t) size.QuadPart;
+      m_data     = (const UINT8 *) view;
+      m_size     = m_map_size;
+   }
+
+   CloseHandle(file);
+   return(true);
+}
+
+
+void SourceBuffer::Unmap()
+{
+   if (m_map != NULL)
+   {
+      UnmapViewOfFile(m_map);
+      CloseHandle((HANDLE) m_handle);
+      m_map    = NULL;
+      m_handle = NULL;
+   }
+   m_map_size = 0;
+   m_data     = NULL;
+   m_size     = 0;
+}
+
+#else
+
+/**
+ * Maps the whole file. Empty files are fine and result in an empty buffer.
+ * Files that can't be mapped (pipes, some file systems) are read instead.
+ *
+ * @param filename The file to map
+ * @return         false if the file could not be opened or read
+ */
+bool SourceBuffer::Map(const char *filename)
+{
+   struct stat my_stat;
+   int         fd;
+
+   Release();
+
+   if (((fd = open(filename, O_RDONLY)) < 0) ||
+       (fstat(fd, &my_stat) < 0))
+   {
+      LOG_FMT(LERR, "%s: %s\n", filename, strerror(errno));
+      if (fd >= 0)
+      {
+         close(fd);
+      }
+      return(false);
+   }
+
+   if (my_stat.st_size > 0)
+   {
+      void *map = mmap(NULL, my_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (map != MAP_FAILED)
+      {
+         m_map      = map;
+         m_map_size = my_stat.st_size;
+         m_data     = (const UINT8 *) map;
+         m_size     = m_map_size;
+      }
+      else
+      {
+         /* Fall back to reading the file */
+         ssize_t len;
+
+         m_copy.resize(my_stat.st_size);
+         len = read(fd, &m_copy[0], m_copy.size());
+         if (len != (ssize_t) m_copy.size())
+         {
+            LOG_FMT(LERR, "%s: %s\n", filename, strerror(errno));
+            m_copy.clear();
+            close(fd);
+            return(false);
+         }
+         UseCopy();
+      }
+   }
+
+   close(fd);
+   return(true);
+}
+
+
+void SourceBuffer::Unmap()
+{
+   if (m_map != NULL)
+   {
+      (void) munmap(m_map, m_map_size);
+      m_map = NULL;
+   }
+   m_map_size = 0;
+   m_data     = NULL;
+   m_size     = 0;
+}
+
+#endif
+
+
+/**
+ * Reads the whole file into the copy. Empty files are fine and result in an
+ * empty buffer. The file is read up to its end, which may differ from the
+ * size it had when it was looked at.
+ *
+ * @param filename The file to read
+ * @return         false if the file could not be opened or read
+ */
+bool SourceBuffer::Read(const char *filename)
+{
+   FILE   *fp;
+   long   size;
+   size_t used = 0;
+   size_t len;
+
+   Release();
+
+   fp = fopen(filename, "rb");
+   if (fp == NULL)
+   {
+      LOG_FMT(LERR, "%s: %s\n", filename, strerror(errno));
+      return(false);
+   }
+
+   /* One byte more than its size, so the end is found without growing */
+   size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : 0;
+   rewind(fp);
+   m_copy.resize((size > 0) ? (size_t) size + 1 : 4096);
+
+   while ((len = fread(&m_copy[used], 1, m_copy.size() - used, fp)) > 0)
+   {
+      used += len;
+      if (used == m_copy.size())
+      {
+         m_copy.resize(m_copy.size() * 2);
+      }
+   }
+
+   if (ferror(fp))
+   {
+      LOG_FMT(LERR, "%s: %s\n", filename, strerror(errno));
+      fclose(fp);
+      Release();
+      return(false);
+   }
+   fclose(fp);
+
+   m_copy.resize(used);
+   UseCopy();
+   return(true);
+}
+
+
+/* Release the mapping and any copy */
+void SourceBuffer::Release()
+{
+   Unmap();
+   std::vector<UINT8>().swap(m_copy);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file SourceBuffer.h
+ * Holds the contents of a source file, either as a read-only mapping of the
+ * file or as a copy in memory.
+ *
+ * @license GPL v2+
+ */
+#ifndef SOURCE_BUFFER_H_INCLUDED
+#define SOURCE_BUFFER_H_INCLUDED
+
+#include "base_types.h"
+#include <vector>
+#include <cstddef>
+
+/**
+ * Map() makes the whole file available without copying it. Read-only users
+ * such as the tokenizer and the digest read straight from the page cache.
+ * A mapped file that is truncated while it is used kills the process with
+ * SIGBUS, so Read() copies a file that may be edited meanwhile instead.
+ * When the contents have to be converted, the result is stored in the copy
+ * returned by Copy() and UseCopy() drops the mapping.
+ */
+class SourceBuffer
+{
+protected:
+   const UINT8          *m_data;
+   size_t               m_size;
+   void                 *m_map;      /* start of the mapping or NULL */
+   size_t               m_map_size;
+   void                 *m_handle;   /* mapping handle (WIN32 only) */
+   std::vector<UINT8>   m_copy;
+
+private:
+   /* Hide copy constructor */
+   SourceBuffer(const SourceBuffer& ref);
+
+public:
+   SourceBuffer() : m_data(NULL), m_size(0), m_map(NULL), m_map_size(0), m_handle(NULL)
+   {
+   }
+
+
+   ~SourceBuffer()
+   {
+      Release();
+   }
+
+
+   const UINT8 *Data() const
+   {
+      return(m_data);
+   }
+
+
+   size_t Size() const
+   {
+      return(m_size);
+   }
+
+
+   /* Drop the first count bytes, ie. a BOM */
+   void Skip(size_t count)
+   {
+      if (count > m_size)
+      {
+         count = m_size;
+      }
+      m_data += count;
+      m_size -= count;
+   }
+
+
+   std::vector<UINT8>& Copy()
+   {
+      return(m_copy);
+   }
+
+
+   /* Release the file contents and use the contents of Copy() instead */
+   void UseCopy()
+   {
+      Unmap();
+      m_data = m_copy.empty() ? NULL : &m_copy[0];
+      m_size = m_copy.size();
+   }
+
+
+   bool Read(const char *filename);
+   bool Map(const char *filename);
+   void Release();
+
+protected:
+   void Unmap();
+};
+
+#endif /* SOURCE_BUFFER_H_INCLUDED */
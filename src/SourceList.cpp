@@ -0,0 +1,209 @@
+/**
+ * @file SourceList.cpp
+ * Reads the list of source files to process.
+ *
+ * @license GPL v2+
+ */
+#include "SourceList.h"
+#include "DirWalk.h"
+#include "prototypes.h"
+#include "logger.h"
+#include "log_levels.h"
+
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <unistd.h>
+
+
+SourceList::SourceList()
+   : m_remember(false)
+   , m_slice(0)
+   , m_slices(0)
+   , m_file(NULL)
+   , m_from_stdin(false)
+   , m_nul_separated(false)
+   , m_entry(0)
+   , m_len(0)
+   , m_pos(0)
+   , m_walk(NULL)
+{
+}
+
+
+SourceList::~SourceList()
+{
+   Close();
+   delete m_walk;
+}
+
+
+void SourceList::Add(const char *filename)
+{
+   m_names.push_back(filename);
+}
+
+
+bool SourceList::Open(const char *list_file, bool nul_separated)
+{
+   Close();
+
+   m_from_stdin    = (strcmp(list_file, "-") == 0);
+   m_file          = m_from_stdin ? stdin : fopen(list_file, "rb");
+   m_nul_separated = nul_separated;
+   m_entry         = 0;
+   m_len           = 0;
+   m_pos           = 0;
+
+   if (m_file == NULL)
+   {
+      LOG_FMT(LERR, "%s: fopen(%s) failed: %s (%d)\n",
+              __func__, list_file, strerror(errno), errno);
+      return(false);
+   }
+   return(true);
+}
+
+
+void SourceList::Walk(const std::vector<std::string>& dirs, int threads)
+{
+   if (m_walk == NULL)
+   {
+      m_walk = new DirWalk;
+      m_walk->Start(dirs, threads);
+   }
+}
+
+
+void SourceList::Close()
+{
+   if ((m_file != NULL) && !m_from_stdin)
+   {
+      fclose(m_file);
+   }
+   m_file = NULL;
+}
+
+
+/**
+ * Reads up to the next separator, of any length.
+ * Returns false at the end of the list.
+ */
+bool SourceList::ReadEntry(std::string& entry)
+{
+   char sep = m_nul_separated ? '\0' : '\n';
+   bool got_any = false;
+
+   entry.clear();
+
+   while (m_file != NULL)
+   {
+      if (m_pos >= m_len)
+      {
+         /* Unlike fread(), read() returns whatever a pipe has so far */
+         ssize_t got = read(fileno(m_file), m_buf, sizeof(m_buf));
+
+         if ((got < 0) && (errno == EINTR))
+         {
+            continue;
+         }
+         if (got <= 0)
+         {
+            if (got < 0)
+            {
+               LOG_FMT(LERR, "%s: read failed: %s (%d)\n", __func__, strerror(errno), errno);
+            }
+            Close();
+            break;
+         }
+         m_len = (size_t) got;
+         m_pos = 0;
+      }
+
+      const char *start = m_buf + m_pos;
+      const char *end   = (const char *) memchr(start, sep, m_len - m_pos);
+      size_t     count  = (end != NULL) ? (size_t) (end - start) : m_len - m_pos;
+
+      entry.append(start, count);
+      m_pos  += count;
+      got_any = true;
+
+      if (end != NULL)
+      {
+         m_pos++;
+         return(true);
+      }
+   }
+
+   /* The last entry may lack a separator */
+   return(got_any);
+}
+
+
+bool SourceList::ReadName(std::string& filename)
+{
+   std::string entry;
+
+   while (ReadEntry(entry))
+   {
+      m_entry++;
+
+      if (!m_nul_separated)
+      {
+         size_t first = 0;
+         size_t last  = entry.size();
+
+         while ((first < last) && isspace((unsigned char) entry[first]))
+         {
+            first++;
+         }
+         while ((last > first) && isspace((unsigned char) entry[last - 1]))
+         {
+            last--;
+         }
+         entry = entry.substr(first, last - first);
+
+         if (entry.empty() || (entry[0] == '#'))
+         {
+            continue;
+         }
+      }
+      else if (entry.empty())
+      {
+         continue;
+      }
+
+      LOG_FMT(LFILELIST, "%3d] %s\n", m_entry, entry.c_str());
+      filename.swap(entry);
+      return(true);
+   }
+   return(false);
+}
+
+
+/**
+ * Gets the next file to process.
+ * Returns false once all files have been returned.
+ */
+bool SourceList::Next(std::string& filename)
+{
+   do
+   {
+      if (!m_names.empty())
+      {
+         filename = m_names.front();
+         m_names.pop_front();
+      }
+      else if (!ReadName(filename) &&
+               ((m_walk == NULL) || !m_walk->Next(filename)))
+      {
+         return(false);
+      }
+   } while ((m_slices > 0) && (shards_hash(filename) % m_slices != m_slice));
+
+   if (m_remember)
+   {
+      m_seen.push_back(filename);
+   }
+   return(true);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file SourceList.h
+ * The source files to process: the ones on the command line, then the ones
+ * from a list file given with -F, then the ones found below the directories
+ * given with -r. The list file is read as names are needed, so files can be
+ * processed while the list is still arriving, and the directories are read
+ * while the files are processed.
+ *
+ * @license GPL v2+
+ */
+#ifndef SOURCE_LIST_H_INCLUDED
+#define SOURCE_LIST_H_INCLUDED
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+class DirWalk;
+
+class SourceList
+{
+public:
+   SourceList();
+   ~SourceList();
+
+   void Add(const char *filename);
+
+   /**
+    * Reads names from a list file, - is stdin. Names are one per line with
+    * surrounding whitespace removed and # starting a comment line, or with
+    * nul_separated exactly as given between the NUL characters.
+    */
+   bool Open(const char *list_file, bool nul_separated);
+
+   /* Starts finding the source files below dirs, see DirWalk */
+   void Walk(const std::vector<std::string>& dirs, int threads);
+
+   /**
+    * Only return the names in slice of the slices, 0 to slices - 1, by a
+    * hash of the name. See --shard.
+    */
+   void Slice(unsigned int slice, unsigned int slices)
+   {
+      m_slice  = slice;
+      m_slices = slices;
+   }
+
+   bool Next(std::string& filename);
+
+   /* Whether all names are known already and fewer than count are left */
+   bool Fewer(size_t count) const
+   {
+      return((m_file == NULL) && (m_walk == NULL) && (m_names.size() < count));
+   }
+
+   /* Keep all names returned by Next() so they can be listed in Seen() */
+   void Remember(bool remember)
+   {
+      m_remember = remember;
+   }
+
+   const std::deque<std::string>& Seen() const
+   {
+      return(m_seen);
+   }
+
+protected:
+   std::deque<std::string> m_names;  // from the command line
+   std::deque<std::string> m_seen;
+   bool                    m_remember;
+   unsigned int            m_slice;
+   unsigned int            m_slices;  // 0 when all names are returned
+
+   FILE                    *m_file;
+   bool                    m_from_stdin;
+   bool                    m_nul_separated;
+   int                     m_entry;
+   char                    m_buf[65536];
+   size_t                  m_len;
+   size_t                  m_pos;
+   DirWalk                 *m_walk;
+
+   bool ReadEntry(std::string& entry);
+   bool ReadName(std::string& filename);
+   void Close();
+
+private:
+   /* Hide copy constructor */
+   SourceList(const SourceList& ref);
+};
+
+#endif /* SOURCE_LIST_H_INCLUDED */
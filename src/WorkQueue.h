@@ -0,0 +1,84 @@
+/**
+ * @file WorkQueue.h
+ * A simple blocking queue for handing work between threads.
+ *
+ * @license GPL v2+
+ */
+#ifndef WORK_QUEUE_H_INCLUDED
+#define WORK_QUEUE_H_INCLUDED
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Multi producer, multi consumer FIFO.
+ * Pop() blocks until an item is available or the queue has been closed and
+ * drained. A capacity of 0 means unbounded, otherwise Push() blocks while the
+ * queue is full.
+ */
+template<class T> class WorkQueue
+{
+protected:
+   std::deque<T>           m_items;
+   std::mutex              m_lock;
+   std::condition_variable m_not_empty;
+   std::condition_variable m_not_full;
+   size_t                  m_capacity;
+   bool                    m_closed;
+
+private:
+   /* Hide copy constructor */
+   WorkQueue(const WorkQueue& ref);
+
+public:
+   WorkQueue(size_t capacity = 0) : m_capacity(capacity), m_closed(false)
+   {
+   }
+
+
+   void Push(const T& item)
+   {
+      std::unique_lock<std::mutex> guard(m_lock);
+
+      while ((m_capacity != 0) && (m_items.size() >= m_capacity) && !m_closed)
+      {
+         m_not_full.wait(guard);
+      }
+      m_items.push_back(item);
+      m_not_empty.notify_one();
+   }
+
+
+   /* Returns false once the queue is closed and empty */
+   bool Pop(T& item)
+   {
+      std::unique_lock<std::mutex> guard(m_lock);
+
+      while (m_items.empty() && !m_closed)
+      {
+         m_not_empty.wait(guard);
+      }
+      if (m_items.empty())
+      {
+         return(false);
+      }
+      item = m_items.front();
+      m_items.pop_front();
+      m_not_full.notify_one();
+      return(true);
+   }
+
+
+   /* No more items will be pushed, wake up everyone waiting */
+   void Close()
+   {
+      std::unique_lock<std::mutex> guard(m_lock);
+
+      m_closed = true;
+      m_not_empty.notify_all();
+      m_not_full.notify_all();
+   }
+};
+
+#endif /* WORK_QUEUE_H_INCLUDED */
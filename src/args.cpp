@@ -103,8 +103,13 @@ const char *Args::Params(const char *token, int& index)
    {
       arg_len = (int)strlen(m_values[idx]);
 
+      /* A long option only takes its value after a '=', so --id doesn't
+       * match --id-from
+       */
       if ((arg_len >= token_len) &&
-          (memcmp(token, m_values[idx], token_len) == 0))
+          (memcmp(token, m_values[idx], token_len) == 0) &&
+          ((arg_len == token_len) || (token_len < 2) || (token[1] != '-') ||
+           (m_values[idx][token_len] == '=')))
       {
          SetUsed(idx);
          if (arg_len > token_len)
@@ -31,6 +31,7 @@ typedef char       CHAR;
 typedef int8_t     INT8;
 typedef int16_t    INT16;
 typedef int32_t    INT32;
+typedef int64_t    INT64;
 
 typedef uint8_t    UINT8;
 typedef uint16_t   UINT16;
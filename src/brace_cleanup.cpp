@@ -102,7 +102,8 @@ static void print_stack(log_sev_t logsev, const char *str,
  *
  * TODO: This can be cleaned up and simplified - we can look both forward and backward!
  */
-void brace_cleanup(fp_data& fpd)
+template <int LANGS>
+static void brace_cleanup_langs(fp_data& fpd)
 {
    chunk_t            *pc;
    struct parse_frame frm;
@@ -113,7 +114,7 @@ void brace_cleanup(fp_data& fpd)
    memset(&frm, 0, sizeof(frm));
 
    pc = chunk_get_head(fpd);
-   while (pc != NULL)
+   while ((pc != NULL) && !analysis_overdue(fpd))
    {
       /* Check for leaving a #define body */
       if ((in_preproc != CT_NONE) && ((pc->flags & PCF_IN_PREPROC) == 0))
@@ -135,7 +136,7 @@ void brace_cleanup(fp_data& fpd)
       }
 
       /* Do before assigning stuff from the frame */
-      if ((fpd.lang_flags & LANG_PAWN) != 0)
+      if (lang_is<LANGS>(fpd, LANG_PAWN))
       {
          if ((frm.pse[frm.pse_tos].type == CT_VBRACE_OPEN) &&
              (pc->type == CT_NEWLINE))
@@ -145,9 +146,9 @@ void brace_cleanup(fp_data& fpd)
       }
 
       /* Assume the level won't change */
-      pc->level       = frm.level;
-      pc->brace_level = frm.brace_level;
-      pc->pp_level    = pp_level;
+      pc->level       = chunk_level(frm.level);
+      pc->brace_level = chunk_level(frm.brace_level);
+      pc->pp_level    = chunk_level(pp_level);
 
 
       /**
@@ -160,13 +161,30 @@ void brace_cleanup(fp_data& fpd)
       {
          consumed = false;
          parse_cleanup(fpd, consumed, &frm, pc);
-         print_stack(LBCSAFTER, (pc->type == CT_VBRACE_CLOSE) ? "Virt-}" : pc->str.c_str(), &frm, pc);
+         if (log_sev_on(LBCSAFTER))
+         {
+            string text(pc->text(), pc->len());
+            print_stack(LBCSAFTER, (pc->type == CT_VBRACE_CLOSE) ? "Virt-}" : text.c_str(), &frm, pc);
+         }
       }
       pc = chunk_get_next(pc);
    }
 }
 
 
+void brace_cleanup(fp_data& fpd)
+{
+   if ((fpd.lang_flags & ~LANG_CCPP) == 0)
+   {
+      brace_cleanup_langs<LANG_CCPP>(fpd);
+   }
+   else
+   {
+      brace_cleanup_langs<LANG_ALL>(fpd);
+   }
+}
+
+
 /**
  * pc is a CT_WHILE.
  * Scan backwards to see if we find a brace/vbrace with the parent set to CT_DO
@@ -292,8 +310,8 @@ static void parse_cleanup(fp_data& fpd, bool& consumed, struct parse_frame *frm,
    {
       pc->flags |= PCF_EXPR_START;
       pc->flags |= (frm->stmt_count == 0) ? PCF_STMT_START : 0;
-      LOG_FMT(LSTMT, "%d] 1.marked %s as %s start st:%d ex:%d\n",
-              pc->orig_line, pc->str.c_str(), (pc->flags &PCF_STMT_START) ? "stmt" : "expr",
+      LOG_FMT(LSTMT, "%d] 1.marked %.*s as %s start st:%d ex:%d\n",
+              pc->orig_line, pc->len(), pc->text(), (pc->flags &PCF_STMT_START) ? "stmt" : "expr",
               frm->stmt_count, frm->expr_count);
    }
    frm->stmt_count++;
@@ -383,8 +401,8 @@ static void parse_cleanup(fp_data& fpd, bool& consumed, struct parse_frame *frm,
          if ((frm->pse[frm->pse_tos].type != CT_NONE) &&
              (frm->pse[frm->pse_tos].type != CT_PP_DEFINE))
          {
-            LOG_FMT(LWARN, "%s:%d Unexpected '%s' for '%s', which was on line %d\n",
-                    fpd.filename, pc->orig_line, pc->str.c_str(),
+            LOG_FMT(LWARN, "%s:%d Unexpected '%.*s' for '%s', which was on line %d\n",
+                    fpd.filename, pc->orig_line, pc->len(), pc->text(),
                     get_token_name(frm->pse[frm->pse_tos].pc->type),
                     frm->pse[frm->pse_tos].pc->orig_line);
             print_stack(LBCSPOP, "=Error  ", frm, pc);
@@ -403,8 +421,14 @@ static void parse_cleanup(fp_data& fpd, bool& consumed, struct parse_frame *frm,
          {
             frm->brace_level--;
          }
-         pc->level       = frm->level;
-         pc->brace_level = frm->brace_level;
+         pc->level       = chunk_level(frm->level);
+         pc->brace_level = chunk_level(frm->brace_level);
+
+         /* The first close seen wins, like a search from the open would */
+         if (frm->pse[frm->pse_tos].pc->match == NULL)
+         {
+            chunk_link_match(frm->pse[frm->pse_tos].pc, pc);
+         }
 
          /* Pop the entry */
          frm->pse_tos--;
@@ -614,8 +638,8 @@ static void parse_cleanup(fp_data& fpd, bool& consumed, struct parse_frame *frm,
         (frm->pse[frm->pse_tos].type != CT_FPAREN_OPEN) &&
         (frm->pse[frm->pse_tos].type != CT_SPAREN_OPEN)))
    {
-      LOG_FMT(LSTMT, "%s: %d> reset1 stmt on %s\n",
-              __func__, pc->orig_line, pc->str.c_str());
+      LOG_FMT(LSTMT, "%s: %d> reset1 stmt on %.*s\n",
+              __func__, pc->orig_line, pc->len(), pc->text());
       frm->stmt_count = 0;
       frm->expr_count = 0;
    }
@@ -649,8 +673,8 @@ static void parse_cleanup(fp_data& fpd, bool& consumed, struct parse_frame *frm,
        (pc->type == CT_QUESTION))
    {
       frm->expr_count = 0;
-      LOG_FMT(LSTMT, "%s: %d> reset expr on %s\n",
-              __func__, pc->orig_line, pc->str.c_str());
+      LOG_FMT(LSTMT, "%s: %d> reset expr on %.*s\n",
+              __func__, pc->orig_line, pc->len(), pc->text());
    }
 }
 
@@ -751,8 +775,8 @@ static bool check_complex_statements(fp_data& fpd, bool& consumed, struct parse_
          return(true);
       }
 
-      LOG_FMT(LWARN, "%s:%d Expected 'while', got '%s'\n",
-              fpd.filename, pc->orig_line, pc->str.c_str());
+      LOG_FMT(LWARN, "%s:%d Expected 'while', got '%.*s'\n",
+              fpd.filename, pc->orig_line, pc->len(), pc->text());
       frm->pse_tos--;
       print_stack(LBCSPOP, "-Error  ", frm, pc);
    }
@@ -774,8 +798,8 @@ static bool check_complex_statements(fp_data& fpd, bool& consumed, struct parse_
       frm->pse[frm->pse_tos].parent = parent;
 
       /* update the level of pc */
-      pc->level       = frm->level;
-      pc->brace_level = frm->brace_level;
+      pc->level       = chunk_level(frm->level);
+      pc->brace_level = chunk_level(frm->brace_level);
 
       /* Mark as a start of a statement */
       frm->stmt_count = 0;
@@ -783,7 +807,7 @@ static bool check_complex_statements(fp_data& fpd, bool& consumed, struct parse_
       pc->flags      |= PCF_STMT_START | PCF_EXPR_START;
       frm->stmt_count = 1;
       frm->expr_count = 1;
-      LOG_FMT(LSTMT, "%d] 2.marked %s as stmt start\n", pc->orig_line, pc->str.c_str());
+      LOG_FMT(LSTMT, "%d] 2.marked %.*s as stmt start\n", pc->orig_line, pc->len(), pc->text());
    }
 
    /* Verify open paren in complex statement */
@@ -791,8 +815,8 @@ static bool check_complex_statements(fp_data& fpd, bool& consumed, struct parse_
        ((frm->pse[frm->pse_tos].stage == BS_PAREN1) ||
         (frm->pse[frm->pse_tos].stage == BS_WOD_PAREN)))
    {
-      LOG_FMT(LWARN, "%s:%d Expected '(', got '%s' for '%s'\n",
-              fpd.filename, pc->orig_line, pc->str.c_str(),
+      LOG_FMT(LWARN, "%s:%d Expected '(', got '%.*s' for '%s'\n",
+              fpd.filename, pc->orig_line, pc->len(), pc->text(),
               get_token_name(frm->pse[frm->pse_tos].type));
 
       /* Throw out the complex statement */
@@ -916,14 +940,20 @@ static chunk_t *insert_vbrace(fp_data& fpd, chunk_t *pc, bool after,
 
    chunk.orig_line   = pc->orig_line;
    chunk.parent_type = frm->pse[frm->pse_tos].type;
-   chunk.level       = frm->level;
-   chunk.brace_level = frm->brace_level;
+   chunk.level       = chunk_level(frm->level);
+   chunk.brace_level = chunk_level(frm->brace_level);
    chunk.flags       = pc->flags & PCF_COPY_FLAGS;
-   chunk.str         = "";
+   chunk.str.clear();
    if (after)
    {
       chunk.type = CT_VBRACE_CLOSE;
       rv         = chunk_add_after(fpd, &chunk, pc);
+
+      ref = frm->pse[frm->pse_tos].pc;
+      if ((ref != NULL) && (ref->type == CT_VBRACE_OPEN) && (ref->match == NULL))
+      {
+         chunk_link_match(ref, rv);
+      }
    }
    else
    {
@@ -935,8 +965,8 @@ static chunk_t *insert_vbrace(fp_data& fpd, chunk_t *pc, bool after,
 
       while (chunk_is_newline(ref))
       {
-         ref->level++;
-         ref->brace_level++;
+         ref->level       = chunk_level(ref->level + 1);
+         ref->brace_level = chunk_level(ref->brace_level + 1);
          ref = chunk_get_prev(ref);
       }
 
@@ -978,9 +1008,9 @@ static bool close_statement(fp_data& fpd, bool& consumed, struct parse_frame *fr
 {
    chunk_t *vbc = pc;
 
-   LOG_FMT(LTOK, "%s:%d] %s '%s' type %s stage %d\n", __func__,
+   LOG_FMT(LTOK, "%s:%d] %s '%.*s' type %s stage %d\n", __func__,
            pc->orig_line,
-           get_token_name(pc->type), pc->str.c_str(),
+           get_token_name(pc->type), pc->len(), pc->text(),
            get_token_name(frm->pse[frm->pse_tos].type),
            frm->pse[frm->pse_tos].stage);
 
@@ -988,8 +1018,8 @@ static bool close_statement(fp_data& fpd, bool& consumed, struct parse_frame *fr
    {
       frm->stmt_count = 0;
       frm->expr_count = 0;
-      LOG_FMT(LSTMT, "%s: %d> reset2 stmt on %s\n",
-              __func__, pc->orig_line, pc->str.c_str());
+      LOG_FMT(LSTMT, "%s: %d> reset2 stmt on %.*s\n",
+              __func__, pc->orig_line, pc->len(), pc->text());
    }
 
    /**
@@ -1014,8 +1044,8 @@ static bool close_statement(fp_data& fpd, bool& consumed, struct parse_frame *fr
          frm->pse_tos--;
 
          /* Update the token level */
-         pc->level       = frm->level;
-         pc->brace_level = frm->brace_level;
+         pc->level       = chunk_level(frm->level);
+         pc->brace_level = chunk_level(frm->brace_level);
 
          print_stack(LBCSPOP, "-CS VB  ", frm, pc);
 
@@ -12,6 +12,9 @@
 #include "ListManager.h"
 #include "prototypes.h"
 
+/* Chunks are moved once more than one in this many is out of order */
+#define CHUNK_COMPACT_RATIO    64
+
 
 chunk_t *chunk_get_head(fp_data& fpd)
 {
@@ -83,21 +86,18 @@ chunk_t *chunk_get_prev(chunk_t *cur, chunk_nav_t nav)
 }
 
 
-chunk_t *chunk_dup(const chunk_t *pc_in)
+chunk_t *chunk_dup(fp_data& fpd, const chunk_t *pc_in)
 {
    chunk_t *pc;
 
    /* Allocate the entry */
-   pc = new chunk_t;
-   if (pc == NULL)
-   {
-      exit(1);
-   }
+   pc = fpd.chunk_arena.Alloc();
 
    /* Copy all fields and then init the entry */
    *pc = *pc_in;
-   pc->next = NULL;
-   pc->prev = NULL;
+   pc->next  = NULL;
+   pc->prev  = NULL;
+   pc->match = NULL;
 
    return(pc);
 }
@@ -110,7 +110,7 @@ chunk_t *chunk_add(fp_data& fpd, const chunk_t *pc_in)
 {
    chunk_t *pc;
 
-   if ((pc = chunk_dup(pc_in)) != NULL)
+   if ((pc = chunk_dup(fpd, pc_in)) != NULL)
    {
       fpd.chunk_list.AddTail(pc);
    }
@@ -126,7 +126,7 @@ chunk_t *chunk_add_after(fp_data& fpd, const chunk_t *pc_in, chunk_t *ref)
 {
    chunk_t *pc;
 
-   if ((pc = chunk_dup(pc_in)) != NULL)
+   if ((pc = chunk_dup(fpd, pc_in)) != NULL)
    {
       if (ref != NULL)
       {
@@ -149,7 +149,7 @@ chunk_t *chunk_add_before(fp_data& fpd, const chunk_t *pc_in, chunk_t *ref)
 {
    chunk_t *pc;
 
-   if ((pc = chunk_dup(pc_in)) != NULL)
+   if ((pc = chunk_dup(fpd, pc_in)) != NULL)
    {
       if (ref != NULL)
       {
@@ -166,8 +166,94 @@ chunk_t *chunk_add_before(fp_data& fpd, const chunk_t *pc_in, chunk_t *ref)
 
 void chunk_del(fp_data& fpd, chunk_t *pc)
 {
+   if ((pc->match != NULL) && (pc->match->match == pc))
+   {
+      pc->match->match = NULL;
+   }
    fpd.chunk_list.Pop(pc);
-   delete pc;
+   fpd.chunk_arena.Free(pc);
+}
+
+
+/**
+ * Moves the chunks to new storage in list order, so later passes walk the
+ * memory front to back. Chunks inserted after the tokenizer ran sit at the
+ * end of the arena or in freed slots, away from their neighbours.
+ * Nothing that holds a chunk pointer may live across this call.
+ *
+ * @return  Whether the chunks were moved, not when they are mostly in order
+ */
+bool chunk_compact(fp_data& fpd)
+{
+   chunk_t *pc;
+   int     count     = 0;
+   int     scattered = 0;
+
+   for (pc = chunk_get_head(fpd); pc != NULL; pc = pc->next)
+   {
+      count++;
+      if ((pc->next != NULL) && (pc->next != pc + 1))
+      {
+         scattered++;
+      }
+   }
+   if (scattered <= count / CHUNK_COMPACT_RATIO)
+   {
+      return(false);
+   }
+
+   Arena<chunk_t> compacted;
+   chunk_t        *head = chunk_get_head(fpd);
+
+   /* The old chunks stay valid until the arenas are swapped, each keeps
+    * its copy in prev so the match links can be moved along
+    */
+   fpd.chunk_list.Reset();
+   for (pc = head; pc != NULL; pc = pc->next)
+   {
+      chunk_t *nc = compacted.Alloc();
+
+      *nc = *pc;
+      pc->prev = nc;
+      fpd.chunk_list.AddTail(nc);
+   }
+   for (pc = chunk_get_head(fpd); pc != NULL; pc = pc->next)
+   {
+      if (pc->match != NULL)
+      {
+         pc->match = pc->match->prev;
+      }
+   }
+   fpd.chunk_arena.Swap(compacted);
+
+   LOG_FMT(LCHUNK, "%s: moved %d chunks, %d were out of order\n", __func__, count, scattered);
+   return(true);
+}
+
+
+/**
+ * Appends text to the text of a chunk.
+ * If the text follows the chunk text in the file data, the chunk text simply
+ * grows. Otherwise the combined text is stored in fpd.text_pool.
+ */
+void chunk_append_text(fp_data& fpd, chunk_t *pc, const char *str, int len)
+{
+   const char *text  = pc->text();
+   const char *end   = text + pc->len();
+   const char *start = (const char *)fpd.data.Data();
+
+   if ((end == str) ||
+       ((text >= start) && (end + len <= start + fpd.data.Size()) &&
+        (memcmp(end, str, len) == 0)))
+   {
+      pc->str.assign(text, pc->len() + len);
+   }
+   else
+   {
+      fpd.text_pool.push_back(string(text, pc->len()));
+      fpd.text_pool.back().append(str, len);
+      pc->str.assign(fpd.text_pool.back().data(), fpd.text_pool.back().size());
+   }
 }
 
 
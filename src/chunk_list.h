@@ -28,7 +28,7 @@ enum chunk_nav_t
 };
 
 
-chunk_t *chunk_dup(const chunk_t *pc_in);
+chunk_t *chunk_dup(fp_data& fpd, const chunk_t *pc_in);
 
 chunk_t *chunk_add(fp_data& fpd, const chunk_t *pc_in);
 chunk_t *chunk_add_after(fp_data& fpd, const chunk_t *pc_in, chunk_t *ref);
@@ -36,6 +36,10 @@ chunk_t *chunk_add_before(fp_data& fpd, const chunk_t *pc_in, chunk_t *ref);
 
 void chunk_del(fp_data& fpd, chunk_t *pc);
 
+bool chunk_compact(fp_data& fpd);
+
+void chunk_append_text(fp_data& fpd, chunk_t *pc, const char *str, int len);
+
 chunk_t *chunk_get_head(fp_data& fpd);
 chunk_t *chunk_get_tail(fp_data& fpd);
 chunk_t *chunk_get_next(chunk_t *cur, chunk_nav_t nav = CNAV_ALL);
@@ -58,6 +62,49 @@ chunk_t *chunk_get_next_str(chunk_t *cur, const char *str, int len, int level, c
 chunk_t *chunk_get_prev_str(chunk_t *cur, const char *str, int len, int level, chunk_nav_t nav = CNAV_ALL);
 
 
+/* A level as a chunk holds it, see CHUNK_LEVEL_MAX */
+static_inline
+INT16 chunk_level(int level)
+{
+   return((INT16) ((level > CHUNK_LEVEL_MAX) ? CHUNK_LEVEL_MAX :
+                   (level < CHUNK_LEVEL_MIN) ? CHUNK_LEVEL_MIN : level));
+}
+
+
+/**
+ * Links an open paren/brace/square/angle with its close, so that
+ * chunk_skip_to_match() doesn't need to search.
+ */
+static_inline
+void chunk_link_match(chunk_t *open, chunk_t *close)
+{
+   open->match  = close;
+   close->match = open;
+}
+
+
+/**
+ * The linked other end of cur, if the link still holds: the two chunks
+ * point at each other, their types still pair up and they are at the same
+ * level. Otherwise the caller has to search.
+ *
+ * @param delta  +1 to go from an open to its close, -1 for the reverse
+ */
+static_inline
+chunk_t *chunk_linked_match(chunk_t *cur, int delta, chunk_nav_t nav)
+{
+   chunk_t *other = cur->match;
+
+   if ((other != NULL) && (other->match == cur) &&
+       (other->type == cur->type + delta) && (other->level == cur->level) &&
+       ((nav == CNAV_ALL) || (((other->flags ^ cur->flags) & PCF_IN_PREPROC) == 0)))
+   {
+      return(other);
+   }
+   return(NULL);
+}
+
+
 /**
  * Skips to the closing match for the current paren/brace/square.
  *
@@ -77,7 +124,10 @@ chunk_t *chunk_skip_to_match(chunk_t *cur, chunk_nav_t nav = CNAV_ALL)
         (cur->type == CT_ANGLE_OPEN) ||
         (cur->type == CT_SQUARE_OPEN)))
    {
-      return chunk_get_next_type(cur, (c_token_t)(cur->type + 1), cur->level, nav);
+      chunk_t *close = chunk_linked_match(cur, 1, nav);
+
+      return (close != NULL) ? close :
+             chunk_get_next_type(cur, (c_token_t)(cur->type + 1), cur->level, nav);
    }
    return cur;
 }
@@ -96,7 +146,10 @@ chunk_t *chunk_skip_to_match_rev(chunk_t *cur, chunk_nav_t nav = CNAV_ALL)
         (cur->type == CT_ANGLE_CLOSE) ||
         (cur->type == CT_SQUARE_CLOSE)))
    {
-      return chunk_get_prev_type(cur, (c_token_t)(cur->type - 1), cur->level, nav);
+      chunk_t *open = chunk_linked_match(cur, -1, nav);
+
+      return (open != NULL) ? open :
+             chunk_get_prev_type(cur, (c_token_t)(cur->type - 1), cur->level, nav);
    }
    return cur;
 }
@@ -17,6 +17,14 @@
 #include <cctype>
 #include <cassert>
 
+/* Where mark_define_expression() is in the walk over the chunks */
+struct define_expr_state
+{
+   chunk_t *prev;
+   bool    in_define;
+   bool    first;
+};
+
 static void fix_fcn_def_params(fp_data& fpd, chunk_t *pc);
 static void fix_typedef(fp_data& fpd, chunk_t *pc);
 static void fix_enum_struct_union(fp_data& fpd, chunk_t *pc);
@@ -29,7 +37,7 @@ static bool mark_function_type(fp_data& fpd, chunk_t *pc);
 static void mark_struct_union_body(chunk_t *start);
 static chunk_t *mark_variable_definition(chunk_t *start, UINT64 flags);
 
-static void mark_define_expressions(fp_data& fpd);
+static void mark_define_expression(define_expr_state& st, chunk_t *pc);
 static void mark_class_ctor(fp_data& fpd, chunk_t *pclass);
 static void mark_namespace(chunk_t *pns);
 static void mark_cpp_constructor(fp_data& fpd, chunk_t *pc);
@@ -108,14 +116,14 @@ static chunk_t *flag_parens2(const char *func, int line,
    paren_close = chunk_skip_to_match(po, CNAV_PREPROC);
    if (paren_close == NULL)
    {
-      LOG_FMT(LWARN, "flag_parens[%s:%d]: no match for [%s] at  [%d:%d]\n",
-              func, line, po->str.c_str(), po->orig_line, po->orig_col);
+      LOG_FMT(LWARN, "flag_parens[%s:%d]: no match for [%.*s] at  [%d:%d]\n",
+              func, line, po->len(), po->text(), po->orig_line, po->orig_col);
       return(NULL);
    }
 
-   LOG_FMT(LFLPAREN, "flag_parens[%s:%d] @ %d:%d [%s] and %d:%d [%s] type=%s ptype=%s\n",
-           func, line, po->orig_line, po->orig_col, po->text(),
-           paren_close->orig_line, paren_close->orig_col, paren_close->text(),
+   LOG_FMT(LFLPAREN, "flag_parens[%s:%d] @ %d:%d [%.*s] and %d:%d [%.*s] type=%s ptype=%s\n",
+           func, line, po->orig_line, po->orig_col, po->len(), po->text(),
+           paren_close->orig_line, paren_close->orig_col, paren_close->len(), paren_close->text(),
            get_token_name(opentype), get_token_name(parenttype));
 
    if (po != paren_close)
@@ -183,8 +191,8 @@ static bool chunk_ends_type(chunk_t *pc)
 
    for (/* nada */; pc != NULL; pc = chunk_get_prev_nnl(pc))
    {
-      LOG_FMT(LFTYPE, "%s: [%s] %s flags %" PRIx64 " on line %d, col %d\n",
-              __func__, get_token_name(pc->type), pc->str.c_str(),
+      LOG_FMT(LFTYPE, "%s: [%s] %.*s flags %" PRIx64 " on line %d, col %d\n",
+              __func__, get_token_name(pc->type), pc->len(), pc->text(),
               pc->flags, pc->orig_line, pc->orig_col);
 
       if ((pc->type == CT_WORD) ||
@@ -248,6 +256,7 @@ static chunk_t *skip_dc_member(chunk_t *start)
  * First on all non-preprocessor chunks and then on each preprocessor chunk.
  * It does all the detection and classifying.
  */
+template <int LANGS>
 static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *next)
 {
    chunk_t *tmp;
@@ -273,7 +282,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
    }
 
    /* D stuff */
-   if ((fpd.lang_flags & LANG_D) &&
+   if (lang_is<LANGS>(fpd, LANG_D) &&
        (pc->type == CT_QUALIFIER) &&
        chunk_is_str(pc, "const", 5) &&
        (next->type == CT_PAREN_OPEN))
@@ -380,7 +389,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
    }
 
    /* Objective C stuff */
-   if (fpd.lang_flags & LANG_OC)
+   if (lang_is<LANGS>(fpd, LANG_OC))
    {
       /* Check for message declarations */
       if (pc->flags & PCF_STMT_START)
@@ -405,7 +414,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
    }
 
    /* C# stuff */
-   if (fpd.lang_flags & LANG_CS)
+   if (lang_is<LANGS>(fpd, LANG_CS))
    {
       /* '[assembly: xxx]' stuff */
       if ((pc->flags & PCF_EXPR_START) &&
@@ -424,7 +433,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
    }
 
    /* C++11 Lambda stuff */
-   if (prev && (fpd.lang_flags & LANG_CPP) &&
+   if (prev && lang_is<LANGS>(fpd, LANG_CPP) &&
        ((pc->type == CT_SQUARE_OPEN) || (pc->type == CT_TSQUARE)) &&
        !CharTable::IsKw1(prev->str[0]))
    {
@@ -468,7 +477,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
 
    /* A [] in C# and D only follows a type */
    if ((pc->type == CT_TSQUARE) &&
-       ((fpd.lang_flags & (LANG_D | LANG_CS | LANG_VALA)) != 0))
+       lang_is<LANGS>(fpd, LANG_D | LANG_CS | LANG_VALA))
    {
       if ((prev != NULL) && (prev->type == CT_WORD))
       {
@@ -528,7 +537,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
 
    if (pc->type == CT_TEMPLATE)
    {
-      if (fpd.lang_flags & LANG_D)
+      if (lang_is<LANGS>(fpd, LANG_D))
       {
          handle_d_template(pc);
       }
@@ -576,7 +585,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
    if (next->type == CT_PAREN_OPEN)
    {
       tmp = chunk_get_next_nnl(next);
-      if ((fpd.lang_flags & LANG_OC) && chunk_is_token(tmp, CT_CARET))
+      if (lang_is<LANGS>(fpd, LANG_OC) && chunk_is_token(tmp, CT_CARET))
       {
          handle_oc_block_type(fpd, tmp);
       }
@@ -629,7 +638,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
          flag_parens(next, 0, CT_FPAREN_OPEN, CT_ATTRIBUTE, false);
       }
    }
-   if ((fpd.lang_flags & LANG_PAWN) != 0)
+   if (lang_is<LANGS>(fpd, LANG_PAWN))
    {
       if ((pc->type == CT_FUNCTION) && (pc->brace_level > 0))
       {
@@ -737,7 +746,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
        chunk_is_str(pc, ")", 1) &&
        chunk_is_str(next, "(", 1))
    {
-      if ((fpd.lang_flags & LANG_D) != 0)
+      if (lang_is<LANGS>(fpd, LANG_D))
       {
          flag_parens(next, 0, CT_FPAREN_OPEN, CT_FUNC_CALL, false);
       }
@@ -751,7 +760,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
         (pc->type == CT_STRUCT)) &&
        (pc->level == pc->brace_level))
    {
-      if ((pc->type != CT_STRUCT) || ((fpd.lang_flags & LANG_C) == 0))
+      if ((pc->type != CT_STRUCT) || !lang_is<LANGS>(fpd, LANG_C))
       {
          mark_class_ctor(fpd, pc);
       }
@@ -769,7 +778,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
 
    /*TODO: Check for stuff that can only occur at the start of an statement */
 
-   if ((fpd.lang_flags & LANG_D) == 0)
+   if (!lang_is<LANGS>(fpd, LANG_D))
    {
       /**
        * Check a paren pair to see if it is a cast.
@@ -823,7 +832,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
       }
       if (pc->type == CT_CARET)
       {
-         if (fpd.lang_flags & LANG_OC)
+         if (lang_is<LANGS>(fpd, LANG_OC))
          {
             /* This is likely the start of a block literal */
             handle_oc_block_literal(fpd, pc);
@@ -900,7 +909,7 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
       {
          pc->type = CT_PTR_TYPE;
       }
-      else if ((fpd.lang_flags & LANG_OC) && (next->type == CT_STAR))
+      else if (lang_is<LANGS>(fpd, LANG_OC) && (next->type == CT_STAR))
       {
          /* Change pointer-to-pointer types in OC_MSG_DECLs
           * from ARITH <===> DEREF to PTR_TYPE <===> PTR_TYPE */
@@ -998,35 +1007,21 @@ static void do_symbol_check(fp_data& fpd, chunk_t *prev, chunk_t *pc, chunk_t *n
  *   STRUCT/ENUM/UNION + WORD :: WORD => TYPE
  *   WORD + '('               :: WORD => FUNCTION
  */
-void fix_symbols(fp_data& fpd)
+/* Runs do_symbol_check() on every chunk */
+template <int LANGS>
+static void do_symbol_checks(fp_data& fpd)
 {
    chunk_t *pc;
    chunk_t *next;
    chunk_t *prev;
    chunk_t dummy;
 
-   mark_define_expressions(fpd);
-
-   for (pc = chunk_get_head(fpd); pc != NULL; pc = chunk_get_next_nnl(pc))
-   {
-      if ((pc->type == CT_FUNC_WRAP) ||
-          (pc->type == CT_TYPE_WRAP))
-      {
-         handle_wrap(fpd, pc);
-      }
-
-      if (pc->type == CT_ASSIGN)
-      {
-         mark_lvalue(pc);
-      }
-   }
-
    pc = chunk_get_head(fpd);
    if (chunk_is_newline(pc))
    {
       pc = chunk_get_next_nnl(pc);
    }
-   while (pc != NULL)
+   while ((pc != NULL) && !analysis_overdue(fpd))
    {
       prev = chunk_get_prev_nnl(pc, CNAV_PREPROC);
       if (prev == NULL)
@@ -1038,9 +1033,45 @@ void fix_symbols(fp_data& fpd)
       {
          next = &dummy;
       }
-      do_symbol_check(fpd, prev, pc, next);
+      do_symbol_check<LANGS>(fpd, prev, pc, next);
       pc = chunk_get_next_nnl(pc);
    }
+}
+
+
+void fix_symbols(fp_data& fpd)
+{
+   chunk_t           *pc;
+   define_expr_state define_st = { NULL, false, true };
+
+   /* One walk for the passes that only change the current chunk or the
+    * ones before it. A wrap is folded after its own statement start is
+    * marked, the chunks it removes are never the previous chunk of another.
+    */
+   for (pc = chunk_get_head(fpd); (pc != NULL) && !analysis_overdue(fpd); pc = chunk_get_next(pc))
+   {
+      mark_define_expression(define_st, pc);
+
+      if ((pc->type == CT_FUNC_WRAP) ||
+          (pc->type == CT_TYPE_WRAP))
+      {
+         handle_wrap(fpd, pc);
+      }
+
+      if (pc->type == CT_ASSIGN)
+      {
+         mark_lvalue(pc);
+      }
+   }
+
+   if ((fpd.lang_flags & ~LANG_CCPP) == 0)
+   {
+      do_symbol_checks<LANG_CCPP>(fpd);
+   }
+   else
+   {
+      do_symbol_checks<LANG_ALL>(fpd);
+   }
 
    pawn_add_virtual_semicolons(fpd);
 
@@ -1050,7 +1081,7 @@ void fix_symbols(fp_data& fpd)
     */
    pc = chunk_get_head(fpd);
    int square_level = -1;
-   while (pc != NULL)
+   while ((pc != NULL) && !analysis_overdue(fpd))
    {
       /* Can't have a variable definition inside [ ] */
       if (square_level < 0)
@@ -1090,6 +1121,156 @@ void fix_symbols(fp_data& fpd)
 }
 
 
+/* The braces at an #if and after its first branch, see fix_symbols_degraded() */
+struct degraded_branch
+{
+   vector<chunk_t *> start;
+   chunk_t           *start_outer;
+   vector<chunk_t *> first;
+   chunk_t           *first_outer;
+   bool              in_else;
+};
+
+/**
+ * The symbols of a file in degraded mode, see analysis_overdue(), in a
+ * single pass: a word followed by parens outside of any braces is a
+ * function definition if a brace follows them, a word followed by parens
+ * in the body of a definition is a call. The braces of a namespace or an
+ * extern "C" don't count. The braces outside of the preprocessor get
+ * their levels and are linked. Like brace_cleanup() the braces are as at
+ * the #if for every #else branch and as after the first branch at the
+ * #endif.
+ */
+void fix_symbols_degraded(fp_data& fpd)
+{
+   vector<degraded_branch> branches;
+   vector<chunk_t *> braces;
+   vector<chunk_t *> parens;   // the word before each paren open outside of braces, or NULL
+   chunk_t           *outer  = NULL;  // the outermost brace that counts
+   chunk_t           *prev   = NULL;
+   chunk_t           *prev2  = NULL;
+   chunk_t           *closed = NULL;
+
+   for (chunk_t *pc = chunk_get_head(fpd); pc != NULL; pc = chunk_get_next(pc))
+   {
+      if ((pc->flags & PCF_IN_PREPROC) != 0)
+      {
+         if (pc->type == CT_PP_IF)
+         {
+            branches.push_back(degraded_branch());
+            branches.back().start       = braces;
+            branches.back().start_outer = outer;
+            branches.back().in_else     = false;
+         }
+         else if ((pc->type == CT_PP_ELSE) && !branches.empty())
+         {
+            degraded_branch& branch = branches.back();
+
+            if (!branch.in_else)
+            {
+               branch.first       = braces;
+               branch.first_outer = outer;
+               branch.in_else     = true;
+            }
+            braces = branch.start;
+            outer  = branch.start_outer;
+         }
+         else if ((pc->type == CT_PP_ENDIF) && !branches.empty())
+         {
+            if (branches.back().in_else)
+            {
+               braces.swap(branches.back().first);
+               outer = branches.back().first_outer;
+            }
+            branches.pop_back();
+         }
+         continue;
+      }
+
+      pc->level       = chunk_level((int) braces.size());
+      pc->brace_level = pc->level;
+
+      if (chunk_is_newline(pc))
+      {
+         continue;
+      }
+
+      /* The word whose parens closed just before */
+      chunk_t *word = closed;
+      closed = NULL;
+
+      switch (pc->type)
+      {
+         case CT_BRACE_OPEN:
+            if (((prev != NULL) && (prev->type == CT_NAMESPACE)) ||
+                ((prev2 != NULL) && (prev2->type == CT_NAMESPACE)))
+            {
+               pc->parent_type = CT_NAMESPACE;
+            }
+            else if ((prev != NULL) && (prev->type == CT_STRING) &&
+                     (prev2 != NULL) && (prev2->type == CT_EXTERN))
+            {
+               pc->parent_type = CT_EXTERN;
+            }
+            else if (outer == NULL)
+            {
+               if (word != NULL)
+               {
+                  word->type      = CT_FUNC_DEF;
+                  pc->parent_type = CT_FUNC_DEF;
+               }
+               outer = pc;
+               parens.clear();
+            }
+            braces.push_back(pc);
+            break;
+
+         case CT_BRACE_CLOSE:
+            if (!braces.empty())
+            {
+               chunk_t *open = braces.back();
+
+               braces.pop_back();
+               pc->level       = chunk_level((int) braces.size());
+               pc->brace_level = pc->level;
+               pc->parent_type = open->parent_type;
+               chunk_link_match(open, pc);
+               if (open == outer)
+               {
+                  outer = NULL;
+               }
+            }
+            break;
+
+         case CT_PAREN_OPEN:
+            word = ((prev != NULL) && (prev->type == CT_WORD)) ? prev : NULL;
+            if (outer == NULL)
+            {
+               parens.push_back(word);
+            }
+            else if ((word != NULL) && (outer->parent_type == CT_FUNC_DEF))
+            {
+               word->type = CT_FUNC_CALL;
+            }
+            break;
+
+         case CT_PAREN_CLOSE:
+            if ((outer == NULL) && !parens.empty())
+            {
+               closed = parens.back();
+               parens.pop_back();
+            }
+            break;
+
+         default:
+            break;
+      }
+      prev2 = prev;
+      prev  = pc;
+   }
+}
+
+
 /* Just hit an assign. Go backwards until we hit an open brace/paren/square or
  * semicolon (TODO: other limiter?) and mark as a LValue.
  */
@@ -1138,8 +1319,8 @@ static void mark_function_return_type(chunk_t *the_type, chunk_t *pc, c_token_t
    if (pc)
    {
       /* Step backwards from pc and mark the parent of the return type */
-      LOG_FMT(LFCNR, "%s: (backwards) return type for '%s' @ %d:%d", __func__,
-              the_type->text(), the_type->orig_line, the_type->orig_col);
+      LOG_FMT(LFCNR, "%s: (backwards) return type for '%.*s' @ %d:%d", __func__,
+              the_type->len(), the_type->text(), the_type->orig_line, the_type->orig_col);
 
       while (pc)
       {
@@ -1151,7 +1332,7 @@ static void mark_function_return_type(chunk_t *the_type, chunk_t *pc, c_token_t
          {
             break;
          }
-         LOG_FMT(LFCNR, " [%s|%s]", pc->text(), get_token_name(pc->type));
+         LOG_FMT(LFCNR, " [%.*s|%s]", pc->len(), pc->text(), get_token_name(pc->type));
 
          if (pc->type == CT_QUALIFIER)
          {
@@ -1194,8 +1375,8 @@ static void mark_function_return_type(chunk_t *the_type, chunk_t *pc, c_token_t
  */
 static bool mark_function_type(fp_data& fpd, chunk_t *pc)
 {
-   LOG_FMT(LFTYPE, "%s: [%s] %s @ %d:%d\n",
-           __func__, get_token_name(pc->type), pc->str.c_str(),
+   LOG_FMT(LFTYPE, "%s: [%s] %.*s @ %d:%d\n",
+           __func__, get_token_name(pc->type), pc->len(), pc->text(),
            pc->orig_line, pc->orig_col);
 
    int     star_count = 0;
@@ -1221,8 +1402,8 @@ static bool mark_function_type(fp_data& fpd, chunk_t *pc)
       }
       else
       {
-         LOG_FMT(LFTYPE, "%s: not a word '%s' [%s] @ %d:%d\n",
-                 __func__, varcnk->text(), get_token_name(varcnk->type),
+         LOG_FMT(LFTYPE, "%s: not a word '%.*s' [%s] @ %d:%d\n",
+                 __func__, varcnk->len(), varcnk->text(), get_token_name(varcnk->type),
                  varcnk->orig_line, varcnk->orig_col);
          goto nogo_exit;
       }
@@ -1255,8 +1436,8 @@ static bool mark_function_type(fp_data& fpd, chunk_t *pc)
    tmp = pc;
    while ((tmp = chunk_get_prev_nnl(tmp)) != NULL)
    {
-      LOG_FMT(LFTYPE, " -- [%s] %s on line %d, col %d",
-              get_token_name(tmp->type), tmp->str.c_str(),
+      LOG_FMT(LFTYPE, " -- [%s] %.*s on line %d, col %d",
+              get_token_name(tmp->type), tmp->len(), tmp->text(),
               tmp->orig_line, tmp->orig_col);
 
       if (chunk_is_star(tmp) || chunk_is_token(tmp, CT_PTR_TYPE) ||
@@ -1271,7 +1452,7 @@ static bool mark_function_type(fp_data& fpd, chunk_t *pc)
                (tmp->type == CT_TYPE))
       {
          word_count++;
-         LOG_FMT(LFTYPE, " -- TYPE(%s)\n", tmp->text());
+         LOG_FMT(LFTYPE, " -- TYPE(%.*s)\n", tmp->len(), tmp->text());
       }
       else if (tmp->type == CT_DC_MEMBER)
       {
@@ -1285,8 +1466,8 @@ static bool mark_function_type(fp_data& fpd, chunk_t *pc)
       }
       else
       {
-         LOG_FMT(LFTYPE, " --  unexpected token [%s] %s on line %d, col %d\n",
-                 get_token_name(tmp->type), tmp->str.c_str(),
+         LOG_FMT(LFTYPE, " --  unexpected token [%s] %.*s on line %d, col %d\n",
+                 get_token_name(tmp->type), tmp->len(), tmp->text(),
                  tmp->orig_line, tmp->orig_col);
          goto nogo_exit;
       }
@@ -1346,8 +1527,8 @@ static bool mark_function_type(fp_data& fpd, chunk_t *pc)
    tmp = pc;
    while ((tmp = chunk_get_prev_nnl(tmp)) != NULL)
    {
-      LOG_FMT(LFTYPE, " ++ [%s] %s on line %d, col %d\n",
-              get_token_name(tmp->type), tmp->str.c_str(),
+      LOG_FMT(LFTYPE, " ++ [%s] %.*s on line %d, col %d\n",
+              get_token_name(tmp->type), tmp->len(), tmp->text(),
               tmp->orig_line, tmp->orig_col);
 
       if (*tmp->str.data() == '(')
@@ -1598,15 +1779,15 @@ static void fix_casts(chunk_t *start)
                (pc->type != CT_FUNCTION) &&
                (pc->type != CT_BRACE_OPEN))
       {
-         LOG_FMT(LCASTS, " -- not a cast - followed by '%s' %s\n",
-                 pc->str.c_str(), get_token_name(pc->type));
+         LOG_FMT(LCASTS, " -- not a cast - followed by '%.*s' %s\n",
+                 pc->len(), pc->text(), get_token_name(pc->type));
          return;
       }
 
       if (nope)
       {
-         LOG_FMT(LCASTS, " -- not a cast - '%s' followed by %s\n",
-                 pc->str.c_str(), get_token_name(after->type));
+         LOG_FMT(LCASTS, " -- not a cast - '%.*s' followed by %s\n",
+                 pc->len(), pc->text(), get_token_name(after->type));
          return;
       }
    }
@@ -1628,7 +1809,7 @@ static void fix_casts(chunk_t *start)
    {
       pc->parent_type = CT_C_CAST;
       make_type(pc);
-      LOG_FMT(LCASTS, " %s", pc->str.c_str());
+      LOG_FMT(LCASTS, " %.*s", pc->len(), pc->text());
    }
    LOG_FMT(LCASTS, " )%s\n", detail);
 
@@ -1907,8 +2088,8 @@ static void fix_typedef(fp_data& fpd, chunk_t *start)
       }
       the_type->parent_type = CT_TYPEDEF;
 
-      LOG_FMT(LTYPEDEF, "%s: fcn typedef [%s] on line %d\n", __func__,
-              the_type->text(), the_type->orig_line);
+      LOG_FMT(LTYPEDEF, "%s: fcn typedef [%.*s] on line %d\n", __func__,
+              the_type->len(), the_type->text(), the_type->orig_line);
 
       /* already did everything we need to do */
       return;
@@ -1926,8 +2107,8 @@ static void fix_typedef(fp_data& fpd, chunk_t *start)
       if (the_type != NULL)
       {
          /* We have just a regular typedef */
-         LOG_FMT(LTYPEDEF, "%s: regular typedef [%s] on line %d\n", __func__,
-                 the_type->str.c_str(), the_type->orig_line);
+         LOG_FMT(LTYPEDEF, "%s: regular typedef [%.*s] on line %d\n", __func__,
+                 the_type->len(), the_type->text(), the_type->orig_line);
          the_type->parent_type = CT_TYPEDEF;
       }
       return;
@@ -1946,7 +2127,7 @@ static void fix_typedef(fp_data& fpd, chunk_t *start)
    {
       next->parent_type = tag;
       /* Skip to the closing brace */
-      next = chunk_get_next_type(next, CT_BRACE_CLOSE, next->level, CNAV_PREPROC);
+      next = chunk_skip_to_match(next, CNAV_PREPROC);
       if (next != NULL)
       {
          next->parent_type = tag;
@@ -1955,8 +2136,8 @@ static void fix_typedef(fp_data& fpd, chunk_t *start)
 
    if (the_type != NULL)
    {
-      LOG_FMT(LTYPEDEF, "%s: %s typedef [%s] on line %d\n",
-              __func__, get_token_name(tag), the_type->str.c_str(), the_type->orig_line);
+      LOG_FMT(LTYPEDEF, "%s: %s typedef [%.*s] on line %d\n",
+              __func__, get_token_name(tag), the_type->len(), the_type->text(), the_type->orig_line);
       the_type->parent_type = CT_TYPEDEF;
       if (tag == CT_STRUCT)
          the_type->flags |= PCF_TYPEDEF_STRUCT;
@@ -1988,7 +2169,7 @@ void combine_labels(fp_data& fpd)
    next = chunk_get_next(cur);
 
    /* unlikely that the file will start with a label... */
-   while (next != NULL)
+   while ((next != NULL) && !analysis_overdue(fpd))
    {
       if (!(next->flags & PCF_IN_OC_MSG) && /* filter OC case of [self class] msg send */
           ((next->type == CT_CLASS) ||
@@ -2037,7 +2218,7 @@ void combine_labels(fp_data& fpd)
             if ((tmp != NULL) && (tmp->type == CT_BRACE_OPEN))
             {
                tmp->parent_type = CT_CASE;
-               tmp = chunk_get_next_type(tmp, CT_BRACE_CLOSE, tmp->level);
+               tmp = chunk_skip_to_match(tmp);
                if (tmp != NULL)
                {
                   tmp->parent_type = CT_CASE;
@@ -2194,7 +2375,7 @@ static void mark_variable_stack(ChunkStack& cs, log_sev_t sev)
       {
          if ((word_type->type == CT_WORD) || (word_type->type == CT_TYPE))
          {
-            LOG_FMT(LFCNP, " <%s>", word_type->str.c_str());
+            LOG_FMT(LFCNP, " <%.*s>", word_type->len(), word_type->text());
 
             word_type->type   = CT_TYPE;
             word_type->flags |= PCF_VAR_TYPE;
@@ -2206,12 +2387,12 @@ static void mark_variable_stack(ChunkStack& cs, log_sev_t sev)
       {
          if (word_cnt)
          {
-            LOG_FMT(LFCNP, " [%s]\n", var_name->str.c_str());
+            LOG_FMT(LFCNP, " [%.*s]\n", var_name->len(), var_name->text());
             var_name->flags |= PCF_VAR_DEF;
          }
          else
          {
-            LOG_FMT(LFCNP, " <%s>\n", var_name->str.c_str());
+            LOG_FMT(LFCNP, " <%.*s>\n", var_name->len(), var_name->text());
             var_name->type   = CT_TYPE;
             var_name->flags |= PCF_VAR_TYPE;
          }
@@ -2227,8 +2408,8 @@ static void mark_variable_stack(ChunkStack& cs, log_sev_t sev)
  */
 static void fix_fcn_def_params(fp_data& fpd, chunk_t *start)
 {
-   LOG_FMT(LFCNP, "%s: %s [%s] on line %d, level %d\n",
-           __func__, start->str.c_str(), get_token_name(start->type), start->orig_line, start->level);
+   LOG_FMT(LFCNP, "%s: %.*s [%s] on line %d, level %d\n",
+           __func__, start->len(), start->text(), get_token_name(start->type), start->orig_line, start->level);
 
    while ((start != NULL) && !chunk_is_paren_open(start))
    {
@@ -2247,13 +2428,13 @@ static void fix_fcn_def_params(fp_data& fpd, chunk_t *start)
       if (((start->len() == 1) && (start->str[0] == ')')) ||
           (pc->level < level))
       {
-         LOG_FMT(LFCNP, "%s: bailed on %s on line %d\n", __func__, pc->str.c_str(), pc->orig_line);
+         LOG_FMT(LFCNP, "%s: bailed on %.*s on line %d\n", __func__, pc->len(), pc->text(), pc->orig_line);
          break;
       }
 
-      LOG_FMT(LFCNP, "%s: %s %s on line %d, level %d\n", __func__,
+      LOG_FMT(LFCNP, "%s: %s %.*s on line %d, level %d\n", __func__,
               (pc->level > level) ? "skipping" : "looking at",
-              pc->str.c_str(), pc->orig_line, pc->level);
+              pc->len(), pc->text(), pc->orig_line, pc->level);
 
       if (pc->level > level)
       {
@@ -2335,7 +2516,7 @@ static chunk_t *fix_var_def(chunk_t *start)
            chunk_is_addr(pc) ||
            chunk_is_star(pc)))
    {
-      LOG_FMT(LFVD, " %s[%s]", pc->str.c_str(), get_token_name(pc->type));
+      LOG_FMT(LFVD, " %.*s[%s]", pc->len(), pc->text(), get_token_name(pc->type));
       cs.Push_Back(pc);
 
       if (pc->type == CT_QUALIFIER)
@@ -2402,7 +2583,7 @@ static chunk_t *fix_var_def(chunk_t *start)
          }
          if (tmp_pc1->type == CT_DC_MEMBER)
          {
-            LOG_FMT(LFVD, " make_type %s[%s]\n", tmp_pc2->str.c_str(), get_token_name(tmp_pc2->type));
+            LOG_FMT(LFVD, " make_type %.*s[%s]\n", tmp_pc2->len(), tmp_pc2->text(), get_token_name(tmp_pc2->type));
             make_type(tmp_pc2);
          }
          idx--;
@@ -2410,7 +2591,7 @@ static chunk_t *fix_var_def(chunk_t *start)
       ref_idx = idx + 1;
    }
    tmp_pc = cs.Get(ref_idx)->m_pc;
-   LOG_FMT(LFVD, " ref_idx(%d) => %s\n", ref_idx, tmp_pc->str.c_str());
+   LOG_FMT(LFVD, " ref_idx(%d) => %.*s\n", ref_idx, tmp_pc->len(), tmp_pc->text());
 
    /* No type part found! */
    if (ref_idx <= 0)
@@ -2424,7 +2605,7 @@ static chunk_t *fix_var_def(chunk_t *start)
       tmp_pc = cs.Get(idx)->m_pc;
       make_type(tmp_pc);
       tmp_pc->flags |= PCF_VAR_TYPE;
-      LOG_FMT(LFVD2, " %s[%s]", tmp_pc->str.c_str(), get_token_name(tmp_pc->type));
+      LOG_FMT(LFVD2, " %.*s[%s]", tmp_pc->len(), tmp_pc->text(), get_token_name(tmp_pc->type));
    }
    LOG_FMT(LFVD2, "\n");
 
@@ -2482,9 +2663,9 @@ static chunk_t *mark_variable_definition(chunk_t *start, UINT64 flags)
       return(NULL);
    }
 
-   LOG_FMT(LVARDEF, "%s: line %d, col %d '%s' type %s\n",
+   LOG_FMT(LVARDEF, "%s: line %d, col %d '%.*s' type %s\n",
            __func__,
-           pc->orig_line, pc->orig_col, pc->str.c_str(),
+           pc->orig_line, pc->orig_col, pc->len(), pc->text(),
            get_token_name(pc->type));
 
    pc = start;
@@ -2499,8 +2680,8 @@ static chunk_t *mark_variable_definition(chunk_t *start, UINT64 flags)
             pc->flags |= flags;
          }
 
-         LOG_FMT(LVARDEF, "%s:%d marked '%s'[%s] in col %d flags: %#" PRIx64 " -> %#" PRIx64 "\n",
-                 __func__, pc->orig_line, pc->str.c_str(),
+         LOG_FMT(LVARDEF, "%s:%d marked '%.*s'[%s] in col %d flags: %#" PRIx64 " -> %#" PRIx64 "\n",
+                 __func__, pc->orig_line, pc->len(), pc->text(),
                  get_token_name(pc->type), pc->orig_col, flg, pc->flags);
       }
       else if (chunk_is_star(pc))
@@ -2555,7 +2736,7 @@ static bool can_be_full_param(fp_data& fpd, chunk_t *start, chunk_t *end)
 
    for (pc = start; pc != end; pc = chunk_get_next_nnl(pc, CNAV_PREPROC))
    {
-      LOG_FMT(LFPARAM, " [%s]", pc->str.c_str());
+      LOG_FMT(LFPARAM, " [%.*s]", pc->len(), pc->text());
 
       if ((pc->type == CT_QUALIFIER) ||
           (pc->type == CT_STRUCT) ||
@@ -2615,7 +2796,7 @@ static bool can_be_full_param(fp_data& fpd, chunk_t *start, chunk_t *end)
 
             do {
                pc = chunk_get_next_nnl(pc, CNAV_PREPROC);
-               LOG_FMT(LFPARAM, " [%s]", pc->text());
+               LOG_FMT(LFPARAM, " [%.*s]", pc->len(), pc->text());
             } while (pc != tmp1);
 
             /* reset some vars to allow [] after parens */
@@ -2785,18 +2966,18 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
       next = chunk_get_next_nnlnp(next);
    }
 
-   LOG_FMT(LFCN, "%s: %d] %s[%s] - parent=%s level=%d/%d, next=%s[%s] - level=%d\n",
+   LOG_FMT(LFCN, "%s: %d] %.*s[%s] - parent=%s level=%d/%d, next=%.*s[%s] - level=%d\n",
            __func__,
-           pc->orig_line, pc->str.c_str(),
+           pc->orig_line, pc->len(), pc->text(),
            get_token_name(pc->type), get_token_name(pc->parent_type),
            pc->level, pc->brace_level,
-           next->str.c_str(), get_token_name(next->type), next->level);
+           next->len(), next->text(), get_token_name(next->type), next->level);
 
    if (pc->flags & PCF_IN_CONST_ARGS)
    {
       pc->type = CT_FUNC_CTOR_VAR;
-      LOG_FMT(LFCN, "  1) Marked [%s] as FUNC_CTOR_VAR on line %d col %d\n",
-              pc->str.c_str(), pc->orig_line, pc->orig_col);
+      LOG_FMT(LFCN, "  1) Marked [%.*s] as FUNC_CTOR_VAR on line %d col %d\n",
+              pc->len(), pc->text(), pc->orig_line, pc->orig_col);
       next = skip_template_next(next);
       flag_parens(next, 0, CT_FPAREN_OPEN, pc->type, true);
       return;
@@ -2812,8 +2993,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
 
    if ((paren_open == NULL) || (paren_close == NULL))
    {
-      LOG_FMT(LFCN, "No parens found for [%s] on line %d col %d\n",
-              pc->str.c_str(), pc->orig_line, pc->orig_col);
+      LOG_FMT(LFCN, "No parens found for [%.*s] on line %d col %d\n",
+              pc->len(), pc->text(), pc->orig_line, pc->orig_col);
       return;
    }
 
@@ -2863,8 +3044,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
       {
          if (tmp2)
          {
-            LOG_FMT(LFCN, "%s: [%d/%d] function variable [%s], changing [%s] into a type\n",
-                    __func__, pc->orig_line, pc->orig_col, tmp2->text(), pc->text());
+            LOG_FMT(LFCN, "%s: [%d/%d] function variable [%.*s], changing [%.*s] into a type\n",
+                    __func__, pc->orig_line, pc->orig_col, tmp2->len(), tmp2->text(), pc->len(), pc->text());
             tmp2->type = CT_FUNC_VAR;
             flag_parens(paren_open, 0, CT_PAREN_OPEN, CT_FUNC_VAR, false);
 
@@ -2873,8 +3054,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
          }
          else
          {
-            LOG_FMT(LFCN, "%s: [%d/%d] function type, changing [%s] into a type\n",
-                    __func__, pc->orig_line, pc->orig_col, pc->str.c_str());
+            LOG_FMT(LFCN, "%s: [%d/%d] function type, changing [%.*s] into a type\n",
+                    __func__, pc->orig_line, pc->orig_col, pc->len(), pc->text());
             if (tmp2)
             {
                tmp2->type = CT_FUNC_TYPE;
@@ -2894,8 +3075,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
          return;
       }
 
-      LOG_FMT(LFCN, "%s: chained function calls? [%d.%d] [%s]\n",
-              __func__, pc->orig_line, pc->orig_col, pc->str.c_str());
+      LOG_FMT(LFCN, "%s: chained function calls? [%d.%d] [%.*s]\n",
+              __func__, pc->orig_line, pc->orig_col, pc->len(), pc->text());
    }
 
    /* Assume it is a function call if not already labeled */
@@ -2937,9 +3118,9 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
             if (pc->str == prev->str)
             {
                pc->type = CT_FUNC_CLASS;
-               LOG_FMT(LFCN, "FOUND %sSTRUCTOR for %s[%s]\n",
+               LOG_FMT(LFCN, "FOUND %sSTRUCTOR for %.*s[%s]\n",
                        (destr != NULL) ? "DE" : "CON",
-                       prev->str.c_str(), get_token_name(prev->type));
+                       prev->len(), prev->text(), get_token_name(prev->type));
 
                mark_cpp_constructor(fpd, pc);
                return;
@@ -3029,7 +3210,7 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
                isa_def  = false;
                break;
             }
-            LOG_FMT(LFCN, " <skip %s>", prev->str.c_str());
+            LOG_FMT(LFCN, " <skip %.*s>", prev->len(), prev->text());
             prev = chunk_get_prev_nnlnp(prev);
             continue;
          }
@@ -3063,8 +3244,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
              !chunk_is_addr(prev) &&
              !chunk_is_star(prev))
          {
-            LOG_FMT(LFCN, " --> Stopping on %s [%s]\n",
-                    prev->str.c_str(), get_token_name(prev->type));
+            LOG_FMT(LFCN, " --> Stopping on %.*s [%s]\n",
+                    prev->len(), prev->text(), get_token_name(prev->type));
             /* certain tokens are unlikely to preceed a proto or def */
             if ((prev->type == CT_ARITH) ||
                 (prev->type == CT_ASSIGN) ||
@@ -3098,22 +3279,22 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
            (prev->type == CT_ASSIGN) ||
            (prev->type == CT_RETURN)))
       {
-         LOG_FMT(LFCN, " -- overriding DEF due to %s [%s]\n",
-                 prev->str.c_str(), get_token_name(prev->type));
+         LOG_FMT(LFCN, " -- overriding DEF due to %.*s [%s]\n",
+                 prev->len(), prev->text(), get_token_name(prev->type));
          isa_def = false;
       }
       if (isa_def)
       {
          pc->type = CT_FUNC_DEF;
-         LOG_FMT(LFCN, "%s: '%s' is FCN_DEF:", __func__, pc->str.c_str());
+         LOG_FMT(LFCN, "%s: '%.*s' is FCN_DEF:", __func__, pc->len(), pc->text());
          if (prev == NULL)
          {
             prev = chunk_get_head(fpd);
          }
          for (tmp = prev; tmp != pc; tmp = chunk_get_next_nnl(tmp))
          {
-            LOG_FMT(LFCN, " %s[%s]",
-                    tmp->str.c_str(), get_token_name(tmp->type));
+            LOG_FMT(LFCN, " %.*s[%s]",
+                    tmp->len(), tmp->text(), get_token_name(tmp->type));
             make_type(tmp);
          }
          LOG_FMT(LFCN, "\n");
@@ -3122,9 +3303,9 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
 
    if (pc->type != CT_FUNC_DEF)
    {
-      LOG_FMT(LFCN, "  Detected %s '%s' on line %d col %d\n",
+      LOG_FMT(LFCN, "  Detected %s '%.*s' on line %d col %d\n",
               get_token_name(pc->type),
-              pc->str.c_str(), pc->orig_line, pc->orig_col);
+              pc->len(), pc->text(), pc->orig_line, pc->orig_col);
 
       tmp = flag_parens(next, PCF_IN_FCN_CALL, CT_FPAREN_OPEN, CT_FUNC_CALL, false);
       if ((tmp != NULL) && (tmp->type == CT_BRACE_OPEN))
@@ -3171,8 +3352,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
          else if (pc->type == CT_COMMA)
          {
             pc->type = CT_FUNC_CTOR_VAR;
-            LOG_FMT(LFCN, "  2) Marked [%s] as FUNC_CTOR_VAR on line %d col %d\n",
-                    pc->str.c_str(), pc->orig_line, pc->orig_col);
+            LOG_FMT(LFCN, "  2) Marked [%.*s] as FUNC_CTOR_VAR on line %d col %d\n",
+                    pc->len(), pc->text(), pc->orig_line, pc->orig_col);
             break;
          }
       }
@@ -3191,8 +3372,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
        (pc->type == CT_FUNC_PROTO) &&
        (pc->parent_type != CT_OPERATOR))
    {
-      LOG_FMT(LFPARAM, "%s :: checking '%s' for constructor variable %s %s\n",
-              __func__, pc->str.c_str(),
+      LOG_FMT(LFPARAM, "%s :: checking '%.*s' for constructor variable %s %s\n",
+              __func__, pc->len(), pc->text(),
               get_token_name(paren_open->type),
               get_token_name(paren_close->type));
 
@@ -3230,8 +3411,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
       if (!is_param)
       {
          pc->type = CT_FUNC_CTOR_VAR;
-         LOG_FMT(LFCN, "  3) Marked [%s] as FUNC_CTOR_VAR on line %d col %d\n",
-                 pc->str.c_str(), pc->orig_line, pc->orig_col);
+         LOG_FMT(LFCN, "  3) Marked [%.*s] as FUNC_CTOR_VAR on line %d col %d\n",
+                 pc->len(), pc->text(), pc->orig_line, pc->orig_col);
       }
       else if (pc->brace_level > 0)
       {
@@ -3252,8 +3433,8 @@ static void mark_function(fp_data& fpd, chunk_t *pc)
                    (p_op->parent_type != CT_NAMESPACE))
                {
                   pc->type = CT_FUNC_CTOR_VAR;
-                  LOG_FMT(LFCN, "  4) Marked [%s] as FUNC_CTOR_VAR on line %d col %d\n",
-                          pc->str.c_str(), pc->orig_line, pc->orig_col);
+                  LOG_FMT(LFCN, "  4) Marked [%.*s] as FUNC_CTOR_VAR on line %d col %d\n",
+                          pc->len(), pc->text(), pc->orig_line, pc->orig_col);
                }
             }
          }
@@ -3313,17 +3494,17 @@ static void mark_cpp_constructor(fp_data& fpd, chunk_t *pc)
       pc->parent_type = CT_DESTRUCTOR;
    }
 
-   LOG_FMT(LFTOR, "%d:%d FOUND %sSTRUCTOR for %s[%s]",
+   LOG_FMT(LFTOR, "%d:%d FOUND %sSTRUCTOR for %.*s[%s]",
            pc->orig_line, pc->orig_col,
            tmp->type == CT_DESTRUCTOR ? "DE" : "CON",
-           pc->str.c_str(), get_token_name(pc->type));
+           pc->len(), pc->text(), get_token_name(pc->type));
 
    paren_open = skip_template_next(chunk_get_next_nnl(pc));
    if (!chunk_is_str(paren_open, "(", 1))
    {
-      LOG_FMT(LWARN, "%s:%d Expected '(', got: [%s]\n",
+      LOG_FMT(LWARN, "%s:%d Expected '(', got: [%.*s]\n",
               fpd.filename, paren_open->orig_line,
-              paren_open->str.c_str());
+              paren_open->len(), paren_open->text());
       return;
    }
 
@@ -3331,7 +3512,7 @@ static void mark_cpp_constructor(fp_data& fpd, chunk_t *pc)
    fix_fcn_def_params(fpd, paren_open);
    after = flag_parens(paren_open, PCF_IN_FCN_CALL, CT_FPAREN_OPEN, CT_FUNC_CLASS, false);
 
-   LOG_FMT(LFTOR, "[%s]\n", after->str.c_str());
+   LOG_FMT(LFTOR, "[%.*s]\n", after->len(), after->text());
 
    /* Scan until the brace open, mark everything */
    tmp = paren_open;
@@ -3404,16 +3585,16 @@ static void mark_class_ctor(fp_data& fpd, chunk_t *start)
 
    if (pc == NULL)
    {
-      LOG_FMT(LFTOR, "%s: Called on %s on line %d. Bailed on NULL\n",
-              __func__, pclass->str.c_str(), pclass->orig_line);
+      LOG_FMT(LFTOR, "%s: Called on %.*s on line %d. Bailed on NULL\n",
+              __func__, pclass->len(), pclass->text(), pclass->orig_line);
       return;
    }
 
    /* Add the class name */
    cs.Push_Back(pclass);
 
-   LOG_FMT(LFTOR, "%s: Called on %s on line %d (next='%s')\n",
-           __func__, pclass->str.c_str(), pclass->orig_line, pc->str.c_str());
+   LOG_FMT(LFTOR, "%s: Called on %.*s on line %d (next='%.*s')\n",
+           __func__, pclass->len(), pclass->text(), pclass->orig_line, pc->len(), pc->text());
 
    /* detect D template class: "class foo(x) { ... }" */
    if ((fpd.lang_flags & LANG_D) && (next->type == CT_PAREN_OPEN))
@@ -3431,7 +3612,7 @@ static void mark_class_ctor(fp_data& fpd, chunk_t *start)
    int flags = 0;
    while ((pc != NULL) && (pc->type != CT_BRACE_OPEN))
    {
-      LOG_FMT(LFTOR, " [%s]", pc->str.c_str());
+      LOG_FMT(LFTOR, " [%.*s]", pc->len(), pc->text());
 
       if (chunk_is_str(pc, ":", 1))
       {
@@ -3490,7 +3671,7 @@ static void mark_class_ctor(fp_data& fpd, chunk_t *start)
          if ((next != NULL) && (next->len() == 1) && (next->str[0] == '('))
          {
             pc->type = CT_FUNC_CLASS;
-            LOG_FMT(LFTOR, "%d] Marked CTor/DTor %s\n", pc->orig_line, pc->str.c_str());
+            LOG_FMT(LFTOR, "%d] Marked CTor/DTor %.*s\n", pc->orig_line, pc->len(), pc->text());
             mark_cpp_constructor(fpd, pc);
          }
          else
@@ -3564,7 +3745,7 @@ static chunk_t *skip_align(chunk_t *start)
       pc = chunk_get_next_nnl(pc);
       if (pc->type == CT_PAREN_OPEN)
       {
-         pc = chunk_get_next_type(pc, CT_PAREN_CLOSE, pc->level);
+         pc = chunk_skip_to_match(pc);
          pc = chunk_get_next_nnl(pc);
          if (pc->type == CT_COLON)
          {
@@ -3610,66 +3791,58 @@ static void mark_struct_union_body(chunk_t *start)
 
 
 /**
- * Marks statement starts in a macro body.
+ * Marks statement starts in a macro body, called on every chunk in order.
+ * Only looks back at the previous chunk, so it shares the first walk of
+ * fix_symbols().
  * REVISIT: this may already be done
  */
-static void mark_define_expressions(fp_data& fpd)
+static void mark_define_expression(define_expr_state& st, chunk_t *pc)
 {
-   chunk_t *pc;
-   chunk_t *prev;
-   bool    in_define = false;
-   bool    first     = true;
+   chunk_t *prev = st.prev;
 
-   pc   = chunk_get_head(fpd);
-   prev = pc;
+   st.prev = pc;
 
-   while (pc != NULL)
+   if (!st.in_define)
    {
-      if (!in_define)
+      if ((pc->type == CT_PP_DEFINE) ||
+          (pc->type == CT_PP_IF) ||
+          (pc->type == CT_PP_ELSE))
       {
-         if ((pc->type == CT_PP_DEFINE) ||
-             (pc->type == CT_PP_IF) ||
-             (pc->type == CT_PP_ELSE))
-         {
-            in_define = true;
-            first     = true;
-         }
+         st.in_define = true;
+         st.first     = true;
+      }
+   }
+   else
+   {
+      if (((pc->flags & PCF_IN_PREPROC) == 0) || (pc->type == CT_PREPROC))
+      {
+         st.in_define = false;
       }
       else
       {
-         if (((pc->flags & PCF_IN_PREPROC) == 0) || (pc->type == CT_PREPROC))
+         if ((pc->type != CT_MACRO) &&
+             (st.first ||
+              (prev->type == CT_PAREN_OPEN) ||
+              (prev->type == CT_ARITH) ||
+              (prev->type == CT_CARET) ||
+              (prev->type == CT_ASSIGN) ||
+              (prev->type == CT_COMPARE) ||
+              (prev->type == CT_RETURN) ||
+              (prev->type == CT_GOTO) ||
+              (prev->type == CT_CONTINUE) ||
+              (prev->type == CT_PAREN_OPEN) ||
+              (prev->type == CT_FPAREN_OPEN) ||
+              (prev->type == CT_SPAREN_OPEN) ||
+              (prev->type == CT_BRACE_OPEN) ||
+              chunk_is_semicolon(prev) ||
+              (prev->type == CT_COMMA) ||
+              (prev->type == CT_COLON) ||
+              (prev->type == CT_QUESTION)))
          {
-            in_define = false;
-         }
-         else
-         {
-            if ((pc->type != CT_MACRO) &&
-                (first ||
-                 (prev->type == CT_PAREN_OPEN) ||
-                 (prev->type == CT_ARITH) ||
-                 (prev->type == CT_CARET) ||
-                 (prev->type == CT_ASSIGN) ||
-                 (prev->type == CT_COMPARE) ||
-                 (prev->type == CT_RETURN) ||
-                 (prev->type == CT_GOTO) ||
-                 (prev->type == CT_CONTINUE) ||
-                 (prev->type == CT_PAREN_OPEN) ||
-                 (prev->type == CT_FPAREN_OPEN) ||
-                 (prev->type == CT_SPAREN_OPEN) ||
-                 (prev->type == CT_BRACE_OPEN) ||
-                 chunk_is_semicolon(prev) ||
-                 (prev->type == CT_COMMA) ||
-                 (prev->type == CT_COLON) ||
-                 (prev->type == CT_QUESTION)))
-            {
-               pc->flags |= PCF_EXPR_START;
-               first      = false;
-            }
+            pc->flags |= PCF_EXPR_START;
+            st.first   = false;
          }
       }
-
-      prev = pc;
-      pc   = chunk_get_next(pc);
    }
 }
 
@@ -3809,7 +3982,7 @@ static void handle_cpp_lambda(fp_data& fpd, chunk_t *sq_o)
       sq_o->orig_col_end = sq_o->orig_col + 1;
 
       nc.type = CT_SQUARE_CLOSE;
-      nc.str = "]";
+      nc.str.assign("]", 1);
       nc.orig_col++;
       sq_c = chunk_add_after(fpd, &nc, sq_o);
    }
@@ -3977,8 +4150,8 @@ static void mark_template_func(fp_data& fpd, chunk_t *pc, chunk_t *pc_next)
       {
          if (angle_close->flags & PCF_IN_FCN_CALL)
          {
-            LOG_FMT(LTEMPFUNC, "%s: marking '%s' in line %d as a FUNC_CALL\n",
-                    __func__, pc->str.c_str(), pc->orig_line);
+            LOG_FMT(LTEMPFUNC, "%s: marking '%.*s' in line %d as a FUNC_CALL\n",
+                    __func__, pc->len(), pc->text(), pc->orig_line);
             pc->type = CT_FUNC_CALL;
             flag_parens(after, PCF_IN_FCN_CALL, CT_FPAREN_OPEN, CT_FUNC_CALL, false);
          }
@@ -3991,8 +4164,8 @@ static void mark_template_func(fp_data& fpd, chunk_t *pc, chunk_t *pc_next)
              *   std::pair<int, double>(*it, double(*it) + 1.0));
              */
 
-            LOG_FMT(LTEMPFUNC, "%s: marking '%s' in line %d as a FUNC_CALL 2\n",
-                    __func__, pc->str.c_str(), pc->orig_line);
+            LOG_FMT(LTEMPFUNC, "%s: marking '%.*s' in line %d as a FUNC_CALL 2\n",
+                    __func__, pc->len(), pc->text(), pc->orig_line);
             // its a function!!!
             pc->type = CT_FUNC_CALL;
             mark_function(fpd, pc);
@@ -4041,7 +4214,7 @@ static void mark_exec_sql(chunk_t *pc)
         (tmp != NULL) && (tmp->type != CT_SQL_END);
         tmp = chunk_get_next(tmp))
    {
-      tmp->level++;
+      tmp->level = chunk_level(tmp->level + 1);
    }
 }
 
@@ -4056,7 +4229,7 @@ chunk_t *skip_template_next(chunk_t *ang_open)
    if ((ang_open != NULL) && (ang_open->type == CT_ANGLE_OPEN))
    {
       chunk_t *pc;
-      pc = chunk_get_next_type(ang_open, CT_ANGLE_CLOSE, ang_open->level);
+      pc = chunk_skip_to_match(ang_open);
       return(chunk_get_next_nnl(pc));
    }
    return(ang_open);
@@ -4073,7 +4246,7 @@ chunk_t *skip_template_prev(chunk_t *ang_close)
    if ((ang_close != NULL) && (ang_close->type == CT_ANGLE_CLOSE))
    {
       chunk_t *pc;
-      pc = chunk_get_prev_type(ang_close, CT_ANGLE_OPEN, ang_close->level);
+      pc = chunk_skip_to_match_rev(ang_close);
       return(chunk_get_prev_nnl(pc));
    }
    return(ang_close);
@@ -4132,8 +4305,8 @@ static void handle_oc_class(chunk_t *pc)
    bool    hit_scope = false;
    int     do_pl     = 1;
 
-   LOG_FMT(LOCCLASS, "%s: start [%s] [%s] line %d\n", __func__,
-           pc->str.c_str(), get_token_name(pc->parent_type), pc->orig_line);
+   LOG_FMT(LOCCLASS, "%s: start [%.*s] [%s] line %d\n", __func__,
+           pc->len(), pc->text(), get_token_name(pc->parent_type), pc->orig_line);
 
    if (pc->parent_type == CT_OC_PROTOCOL)
    {
@@ -4149,8 +4322,8 @@ static void handle_oc_class(chunk_t *pc)
    tmp = pc;
    while ((tmp = chunk_get_next_nnl(tmp)) != NULL)
    {
-      LOG_FMT(LOCCLASS, "%s:       %d [%s]\n", __func__,
-              tmp->orig_line, tmp->str.c_str());
+      LOG_FMT(LOCCLASS, "%s:       %d [%.*s]\n", __func__,
+              tmp->orig_line, tmp->len(), tmp->text());
 
       if (tmp->type == CT_OC_END)
       {
@@ -4172,7 +4345,7 @@ static void handle_oc_class(chunk_t *pc)
       {
          do_pl            = 0;
          tmp->parent_type = CT_OC_CLASS;
-         tmp = chunk_get_next_type(tmp, CT_BRACE_CLOSE, tmp->level);
+         tmp = chunk_skip_to_match(tmp);
          if (tmp != NULL)
          {
             tmp->parent_type = CT_OC_CLASS;
@@ -4204,7 +4377,7 @@ static void handle_oc_class(chunk_t *pc)
 
    if ((tmp != NULL) && (tmp->type == CT_BRACE_OPEN))
    {
-      tmp = chunk_get_next_type(tmp, CT_BRACE_CLOSE, tmp->level);
+      tmp = chunk_skip_to_match(tmp);
       if (tmp != NULL)
       {
          tmp->parent_type = CT_OC_CLASS;
@@ -4250,7 +4423,7 @@ static void handle_oc_block_literal(fp_data& fpd, chunk_t *pc)
    LOG_FMT(LOCBLK, "%s:  + scan", __func__);
    for (tmp = next; tmp; tmp = chunk_get_next_nnl(tmp))
    {
-      LOG_FMT(LOCBLK, " %s", tmp->text());
+      LOG_FMT(LOCBLK, " %.*s", tmp->len(), tmp->text());
       if ((tmp->level < pc->level) || (tmp->type == CT_SEMICOLON))
       {
          LOG_FMT(LOCBLK, "[DONE]");
@@ -4307,7 +4480,7 @@ static void handle_oc_block_literal(fp_data& fpd, chunk_t *pc)
    /* mark the return type, if any */
    while (lbp != pc)
    {
-      LOG_FMT(LOCBLK, " -- lbp %s[%s]\n", lbp->text(), get_token_name(lbp->type));
+      LOG_FMT(LOCBLK, " -- lbp %.*s[%s]\n", lbp->len(), lbp->text(), get_token_name(lbp->type));
       make_type(lbp);
       lbp->flags      |= PCF_OC_RTYPE;
       lbp->parent_type = CT_OC_BLOCK_EXPR;
@@ -4383,8 +4556,8 @@ static void handle_oc_block_type(fp_data& fpd, chunk_t *pc)
             nam->type = CT_FUNC_TYPE;
             pt        = CT_FUNC_TYPE;
          }
-         LOG_FMT(LOCBLK, "%s: block type @ %d:%d (%s)[%s]\n", __func__,
-                 pc->orig_line, pc->orig_col, nam->text(), get_token_name(nam->type));
+         LOG_FMT(LOCBLK, "%s: block type @ %d:%d (%.*s)[%s]\n", __func__,
+                 pc->orig_line, pc->orig_col, nam->len(), nam->text(), get_token_name(nam->type));
          pc->type         = CT_PTR_TYPE;
          pc->parent_type  = pt; //CT_OC_BLOCK_TYPE;
          tpo->type        = CT_TPAREN_OPEN;
@@ -4431,7 +4604,7 @@ static chunk_t *handle_oc_md_type(chunk_t *paren_open, c_token_t ptype, UINT64 f
         cur != paren_close;
         cur = chunk_get_next_nnl(cur))
    {
-      LOG_FMT(LOCMSGD, " <%s|%s>", cur->text(), get_token_name(cur->type));
+      LOG_FMT(LOCMSGD, " <%.*s|%s>", cur->len(), cur->text(), get_token_name(cur->type));
       cur->flags |= flags;
       make_type(cur);
    }
@@ -4515,7 +4688,7 @@ static void handle_oc_message_decl(chunk_t *pc)
    tmp->parent_type = pt;
    pc = chunk_get_next_nnl(tmp);
 
-   LOG_FMT(LOCMSGD, " [%s]%s", pc->text(), get_token_name(pc->type));
+   LOG_FMT(LOCMSGD, " [%.*s]%s", pc->len(), pc->text(), get_token_name(pc->type));
 
    /* if we have a colon next, we have args */
    if ((pc->type == CT_COLON) || (pc->type == CT_OC_COLON))
@@ -4540,7 +4713,7 @@ static void handle_oc_message_decl(chunk_t *pc)
          pc = chunk_get_next_nnl(pc);
 
          /* next is the type in parens */
-         LOG_FMT(LOCMSGD, "  (%s)", pc->text());
+         LOG_FMT(LOCMSGD, "  (%.*s)", pc->len(), pc->text());
          tmp = handle_oc_md_type(pc, pt, PCF_OC_ATYPE, did_it);
          if (!did_it)
          {
@@ -4550,12 +4723,12 @@ static void handle_oc_message_decl(chunk_t *pc)
          pc = tmp;
          /* we should now be on the arg name */
          pc->flags |= PCF_VAR_DEF;
-         LOG_FMT(LOCMSGD, " arg[%s]", pc->text());
+         LOG_FMT(LOCMSGD, " arg[%.*s]", pc->len(), pc->text());
          pc = chunk_get_next_nnl(pc);
       }
    }
 
-   LOG_FMT(LOCMSGD, " end[%s]", pc->text());
+   LOG_FMT(LOCMSGD, " end[%.*s]", pc->len(), pc->text());
 
    if (chunk_is_token(pc, CT_BRACE_OPEN))
    {
@@ -4578,7 +4751,7 @@ static void handle_oc_message_decl(chunk_t *pc)
    tmp = pc;
    while ((tmp = chunk_get_next(tmp)) != NULL)
    {
-      LOG_FMT(LOCMSGD, " [%s]", tmp->text());
+      LOG_FMT(LOCMSGD, " [%.*s]", tmp->len(), tmp->text());
 
       if ((tmp->type == CT_SEMICOLON) ||
           (tmp->type == CT_BRACE_OPEN))
@@ -4693,9 +4866,9 @@ static void handle_oc_message_send(chunk_t *os)
    }
    else if ((tmp->type != CT_WORD) && (tmp->type != CT_TYPE))
    {
-      LOG_FMT(LOCMSG, "%s: %d:%d expected identifier, not '%s' [%s]\n", __func__,
+      LOG_FMT(LOCMSG, "%s: %d:%d expected identifier, not '%.*s' [%s]\n", __func__,
               tmp->orig_line, tmp->orig_col,
-              tmp->text(), get_token_name(tmp->type));
+              tmp->len(), tmp->text(), get_token_name(tmp->type));
       return;
    }
    else
@@ -4725,9 +4898,10 @@ static void handle_oc_message_send(chunk_t *os)
          ao->parent_type = CT_OC_PROTO_LIST;
          ac->type = CT_ANGLE_CLOSE;
          ac->parent_type = CT_OC_PROTO_LIST;
+         chunk_link_match(ao, ac);
          for (tmp = chunk_get_next(ao); tmp != ac; tmp = chunk_get_next(tmp))
          {
-            tmp->level += 1;
+            tmp->level       = chunk_level(tmp->level + 1);
             tmp->parent_type = CT_OC_PROTO_LIST;
          }
       }
@@ -4868,9 +5042,9 @@ static void handle_wrap(fp_data& fpd, chunk_t *pc)
        ((name->type == CT_WORD) || (name->type == CT_TYPE)) &&
        (clp->type == CT_PAREN_CLOSE))
    {
-      pc->str.append("(");
-      pc->str.append(name->str);
-      pc->str.append(")");
+      chunk_append_text(fpd, pc, "(", 1);
+      chunk_append_text(fpd, pc, name->text(), name->len());
+      chunk_append_text(fpd, pc, ")", 1);
 
       pc->type = (pc->type == CT_FUNC_WRAP) ? CT_FUNCTION : CT_TYPE;
 
@@ -0,0 +1,858 @@
+/**
+ * @file compact.cpp
+ * A compact index is a read-only export of an index for lookups, written by
+ * --compact. It is mapped into memory and searched as it is, so opening it
+ * costs nothing and a lookup only decodes the entries of the identifiers it
+ * finds.
+ *
+ * The file starts with a compact_header, followed by the file table, the
+ * scope table, the identifiers sorted by name, the entries and the names.
+ * The entries of an identifier are stored per sub type in the order of the
+ * index, each as varints: the distance to the previous entry in the order
+ * of the index, the file and line as zigzag deltas from the previous entry, the
+ * column, the scope and the type. An entry of a content several files have
+ * is stored once for every file.
+ *
+ * Numbers are in the byte order of the machine that wrote the file, a file
+ * from a machine with another byte order is not taken.
+ *
+ * Lookups give the same entries in the same order as the index they were
+ * exported from.
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cinttypes>
+#include <algorithm>
+
+
+#define COMPACT_MAGIC         "TOKSCMP"
+#define COMPACT_VERSION       1
+#define COMPACT_BYTE_ORDER    0x01020304
+
+#define xstr(a) str(a)
+#define str(a) #a
+
+
+struct compact_header
+{
+   char   magic[8];
+   UINT32 version;
+   UINT32 byte_order;
+   UINT32 files;
+   UINT32 scopes;
+   UINT32 identifiers;
+   UINT32 unused;
+   UINT64 file_table;     // compact_file per file, in the order of the index
+   UINT64 scope_table;    // name offset per scope
+   UINT64 ident_table;    // compact_ident per identifier, by name
+   UINT64 names;          // NUL terminated names
+   UINT64 size;           // of the whole file
+};
+
+struct compact_file
+{
+   UINT32 name;
+   UINT32 unused;
+   INT64  mtime;
+};
+
+/* The entry lists are indexed by id_sub_type */
+struct compact_ident
+{
+   UINT32 name;
+   UINT32 count[3];
+   UINT64 entries[3];
+};
+
+/* An entry, as exported and as found by a lookup */
+struct compact_entry
+{
+   UINT64 seq;         // rowid in the index table, or number of the reference
+   UINT32 file;
+   UINT32 line;
+   UINT32 column;
+   UINT32 scope;
+   UINT32 type;
+   UINT32 ident;
+   bool   near;
+   INT64  mtime;
+};
+
+
+static SourceBuffer         compact_map;
+static const compact_header *compact_hdr;
+
+
+static void compact_put_varint(vector<UINT8>& out, UINT64 value)
+{
+   while (value >= 0x80)
+   {
+      out.push_back((UINT8) (value | 0x80));
+      value >>= 7;
+   }
+   out.push_back((UINT8) value);
+}
+
+
+static UINT64 compact_get_varint(const UINT8 *& pos)
+{
+   UINT64 value = 0;
+   int    shift = 0;
+
+   while ((*pos & 0x80) != 0)
+   {
+      value |= (UINT64) (*pos++ & 0x7f) << shift;
+      shift += 7;
+   }
+   value |= (UINT64) *pos++ << shift;
+
+   return(value);
+}
+
+
+/* Deltas may be negative, zigzag keeps small ones short */
+static UINT64 compact_zigzag(INT64 value)
+{
+   return(((UINT64) value << 1) ^ (UINT64) (value >> 63));
+}
+
+
+static INT64 compact_unzigzag(UINT64 value)
+{
+   return((INT64) (value >> 1) ^ -(INT64) (value & 1));
+}
+
+
+static UINT32 compact_add_name(vector<char>& names, const char *name)
+{
+   UINT32 offset = (UINT32) names.size();
+
+   names.insert(names.end(), name, name + strlen(name) + 1);
+   return(offset);
+}
+
+
+/* Identifiers in the order of the compact index, by name */
+struct compact_name_order
+{
+   const vector<string> *names;
+
+   bool operator()(UINT32 a, UINT32 b) const
+   {
+      return((*names)[a] < (*names)[b]);
+   }
+};
+
+
+/**
+ * Read the rowid and name of every row of a table of names, the rowid is
+ * mapped to the position of the name in names
+ */
+static int compact_read_names(const char *sql, vector<string>& names,
+                              unordered_map<sqlite3_int64, UINT32>& rows)
+{
+   sqlite3_stmt *stmt = NULL;
+   int result;
+
+   result = sqlite3_prepare_v2(cpd.index, sql, -1, &stmt, NULL);
+
+   if (result == SQLITE_OK)
+   {
+      while ((result = sqlite3_step(stmt)) == SQLITE_ROW)
+      {
+         const char *name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+
+         rows[sqlite3_column_int64(stmt, 0)] = (UINT32) names.size();
+         names.push_back((name != NULL) ? name : "");
+      }
+      if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+   }
+
+   (void) sqlite3_finalize(stmt);
+
+   return(result);
+}
+
+
+/**
+ * Add the entries of one index table to the lists of their identifiers,
+ * once for every file with the content of the entry
+ */
+static int compact_read_entries(
+   const char *table,
+   id_sub_type sub_type,
+   const unordered_map<sqlite3_int64, vector<UINT32> >& content_files,
+   const unordered_map<sqlite3_int64, UINT32>& scope_rows,
+   const unordered_map<sqlite3_int64, UINT32>& ident_rows,
+   vector<vector<compact_entry> >& lists)
+{
+   sqlite3_stmt *stmt = NULL;
+   string sql;
+   int result;
+
+   sql  = "SELECT rowid,Content,Line,ColumnStart,Scope,Type,Identifier FROM ";
+   sql += table;
+   sql += " ORDER BY rowid";
+   result = sqlite3_prepare_v2(cpd.index, sql.c_str(), -1, &stmt, NULL);
+
+   if (result == SQLITE_OK)
+   {
+      while ((result = sqlite3_step(stmt)) == SQLITE_ROW)
+      {
+         unordered_map<sqlite3_int64, vector<UINT32> >::const_iterator files =
+            content_files.find(sqlite3_column_int64(stmt, 1));
+         unordered_map<sqlite3_int64, UINT32>::const_iterator scope =
+            scope_rows.find(sqlite3_column_int64(stmt, 4));
+         unordered_map<sqlite3_int64, UINT32>::const_iterator ident =
+            ident_rows.find(sqlite3_column_int64(stmt, 6));
+         compact_entry entry;
+
+         /* Entries of a content no file has any more are never looked up */
+         if ((files == content_files.end()) || (scope == scope_rows.end()) ||
+             (ident == ident_rows.end()))
+         {
+            continue;
+         }
+
+         memset(&entry, 0, sizeof(entry));
+         entry.seq    = (UINT64) sqlite3_column_int64(stmt, 0);
+         entry.line   = (UINT32) sqlite3_column_int64(stmt, 2);
+         entry.column = (UINT32) sqlite3_column_int64(stmt, 3);
+         entry.scope  = scope->second;
+         entry.type   = (UINT32) sqlite3_column_int64(stmt, 5);
+
+         vector<compact_entry>& list = lists[ident->second * 3 + sub_type];
+         for (size_t idx = 0; idx < files->second.size(); idx++)
+         {
+            entry.file = files->second[idx];
+            list.push_back(entry);
+         }
+      }
+      if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+   }
+
+   (void) sqlite3_finalize(stmt);
+
+   return(result);
+}
+
+
+/* A reference of a content, with the row of its identifier */
+struct compact_ref
+{
+   block_ref     ref;
+   sqlite3_int64 ident;
+
+   bool operator<(const compact_ref& other) const
+   {
+      return((ref.line < other.ref.line) ||
+             ((ref.line == other.ref.line) && (ref.column_start < other.ref.column_start)));
+   }
+};
+
+
+/**
+ * Add the references of one content to the lists of their identifiers,
+ * numbered in the order of the index
+ */
+static void compact_add_refs(
+   vector<compact_ref>& refs,
+   const vector<UINT32>& files,
+   const unordered_map<sqlite3_int64, UINT32>& scope_rows,
+   const unordered_map<sqlite3_int64, UINT32>& ident_rows,
+   UINT64& seq,
+   vector<vector<compact_entry> >& lists)
+{
+   sort(refs.begin(), refs.end());
+   for (size_t i = 0; i < refs.size(); i++)
+   {
+      unordered_map<sqlite3_int64, UINT32>::const_iterator scope =
+         scope_rows.find(refs[i].ref.scope);
+      unordered_map<sqlite3_int64, UINT32>::const_iterator ident =
+         ident_rows.find(refs[i].ident);
+      compact_entry entry;
+
+      seq++;
+      if ((scope == scope_rows.end()) || (ident == ident_rows.end()))
+      {
+         continue;
+      }
+
+      memset(&entry, 0, sizeof(entry));
+      entry.seq    = seq;
+      entry.line   = refs[i].ref.line;
+      entry.column = refs[i].ref.column_start;
+      entry.scope  = scope->second;
+      entry.type   = (UINT32) refs[i].ref.type;
+
+      vector<compact_entry>& list = lists[ident->second * 3 + IST_REFERENCE];
+      for (size_t idx = 0; idx < files.size(); idx++)
+      {
+         entry.file = files[idx];
+         list.push_back(entry);
+      }
+   }
+   refs.clear();
+}
+
+
+/**
+ * Add the references in the blocks of the index to the lists of their
+ * identifiers, like compact_read_entries()
+ */
+static int compact_read_refs(
+   const unordered_map<sqlite3_int64, vector<UINT32> >& content_files,
+   const unordered_map<sqlite3_int64, UINT32>& scope_rows,
+   const unordered_map<sqlite3_int64, UINT32>& ident_rows,
+   vector<vector<compact_entry> >& lists)
+{
+   unordered_map<sqlite3_int64, vector<UINT32> >::const_iterator files = content_files.end();
+   sqlite3_stmt *stmt = NULL;
+   vector<block_ref> decoded;
+   vector<compact_ref> refs;
+   sqlite3_int64 content = 0;
+   UINT64 seq = 0;
+   int result;
+
+   result = sqlite3_prepare_v2(cpd.index,
+                               "SELECT Content,Identifier,Refs FROM RefBlocks ORDER BY Content",
+                               -1,
+                               &stmt,
+                               NULL);
+
+   if (result == SQLITE_OK)
+   {
+      while ((result = sqlite3_step(stmt)) == SQLITE_ROW)
+      {
+         compact_ref ref;
+
+         if ((files == content_files.end()) || (sqlite3_column_int64(stmt, 0) != content))
+         {
+            if (files != content_files.end())
+            {
+               compact_add_refs(refs, files->second, scope_rows, ident_rows, seq, lists);
+            }
+            content = sqlite3_column_int64(stmt, 0);
+            files   = content_files.find(content);
+         }
+
+         /* Entries of a content no file has any more are never looked up */
+         if (files == content_files.end())
+         {
+            continue;
+         }
+
+         decoded.clear();
+         if (!index_decode_refs(sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2),
+                                decoded))
+         {
+            result = SQLITE_CORRUPT;
+            break;
+         }
+         ref.ident = sqlite3_column_int64(stmt, 1);
+         for (size_t idx = 0; idx < decoded.size(); idx++)
+         {
+            ref.ref = decoded[idx];
+            refs.push_back(ref);
+         }
+      }
+      if (result == SQLITE_DONE)
+      {
+         if (files != content_files.end())
+         {
+            compact_add_refs(refs, files->second, scope_rows, ident_rows, seq, lists);
+         }
+         result = SQLITE_OK;
+      }
+   }
+
+   (void) sqlite3_finalize(stmt);
+
+   return(result);
+}
+
+
+/* Write the entries of one list, see the file comment */
+static void compact_put_entries(vector<UINT8>& out, const vector<compact_entry>& list)
+{
+   UINT64 seq  = 0;
+   INT64  file = 0;
+   INT64  line = 0;
+
+   for (size_t idx = 0; idx < list.size(); idx++)
+   {
+      const compact_entry& entry = list[idx];
+
+      compact_put_varint(out, entry.seq - seq);
+      compact_put_varint(out, compact_zigzag((INT64) entry.file - file));
+      compact_put_varint(out, compact_zigzag((INT64) entry.line - line));
+      compact_put_varint(out, entry.column);
+      compact_put_varint(out, entry.scope);
+      compact_put_varint(out, entry.type);
+      seq  = entry.seq;
+      file = entry.file;
+      line = entry.line;
+   }
+}
+
+
+/**
+ * Export the open index to a compact index, see the file comment.
+ *
+ * @param filename  The compact index to write, replaced if it exists
+ */
+bool compact_export(const char *filename)
+{
+   unordered_map<sqlite3_int64, vector<UINT32> > content_files;
+   unordered_map<sqlite3_int64, UINT32> file_rows, scope_rows, ident_rows;
+   vector<string> file_names, scope_names, ident_names;
+   vector<INT64> mtimes;
+   vector<vector<compact_entry> > lists;
+   vector<compact_file> files;
+   vector<UINT32> scopes, order;
+   vector<compact_ident> idents;
+   vector<UINT8> entries;
+   vector<char> names;
+   compact_header hdr;
+   sqlite3_stmt *stmt = NULL;
+   string temp;
+   FILE *fp;
+   bool retval = true;
+   int result;
+
+   result = sqlite3_prepare_v2(cpd.index,
+                               "SELECT rowid,Filename,Mtime,Content FROM Files ORDER BY rowid",
+                               -1,
+                               &stmt,
+                               NULL);
+
+   if (result == SQLITE_OK)
+   {
+      while ((result = sqlite3_step(stmt)) == SQLITE_ROW)
+      {
+         const char *name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+
+         content_files[sqlite3_column_int64(stmt, 3)].push_back((UINT32) file_names.size());
+         file_names.push_back((name != NULL) ? name : "");
+         mtimes.push_back(sqlite3_column_int64(stmt, 2));
+      }
+      if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+   }
+   (void) sqlite3_finalize(stmt);
+
+   if (result == SQLITE_OK)
+   {
+      result = compact_read_names("SELECT rowid,Scope FROM Scopes", scope_names, scope_rows);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = compact_read_names("SELECT rowid,Identifier FROM Identifiers", ident_names, ident_rows);
+   }
+
+   /* Number the identifiers by name */
+   if (result == SQLITE_OK)
+   {
+      compact_name_order by_name;
+      vector<UINT32> position(ident_names.size());
+
+      for (UINT32 idx = 0; idx < ident_names.size(); idx++)
+      {
+         order.push_back(idx);
+      }
+      by_name.names = &ident_names;
+      sort(order.begin(), order.end(), by_name);
+      for (UINT32 idx = 0; idx < order.size(); idx++)
+      {
+         position[order[idx]] = idx;
+      }
+      for (unordered_map<sqlite3_int64, UINT32>::iterator it = ident_rows.begin();
+           it != ident_rows.end(); ++it)
+      {
+         it->second = position[it->second];
+      }
+      lists.resize(ident_names.size() * 3);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = compact_read_refs(content_files, scope_rows, ident_rows, lists);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = compact_read_entries("Defs", IST_DEFINITION, content_files, scope_rows,
+                                    ident_rows, lists);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = compact_read_entries("Decls", IST_DECLARATION, content_files, scope_rows,
+                                    ident_rows, lists);
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "compact_export: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      return(false);
+   }
+
+   /* Lay out the file */
+   for (size_t idx = 0; idx < file_names.size(); idx++)
+   {
+      compact_file file;
+
+      file.name   = compact_add_name(names, file_names[idx].c_str());
+      file.unused = 0;
+      file.mtime  = mtimes[idx];
+      files.push_back(file);
+   }
+   for (size_t idx = 0; idx < scope_names.size(); idx++)
+   {
+      scopes.push_back(compact_add_name(names, scope_names[idx].c_str()));
+   }
+   if (scopes.size() % 2 != 0)
+   {
+      scopes.push_back(0);
+   }
+
+   memset(&hdr, 0, sizeof(hdr));
+   memcpy(hdr.magic, COMPACT_MAGIC, sizeof(hdr.magic));
+   hdr.version     = COMPACT_VERSION;
+   hdr.byte_order  = COMPACT_BYTE_ORDER;
+   hdr.files       = (UINT32) files.size();
+   hdr.scopes      = (UINT32) scope_names.size();
+   hdr.identifiers = (UINT32) order.size();
+   hdr.file_table  = sizeof(hdr);
+   hdr.scope_table = hdr.file_table + files.size() * sizeof(compact_file);
+   hdr.ident_table = hdr.scope_table + scopes.size() * sizeof(UINT32);
+   UINT64 entries_start = hdr.ident_table + order.size() * sizeof(compact_ident);
+
+   for (size_t idx = 0; idx < order.size(); idx++)
+   {
+      compact_ident ident;
+
+      ident.name = compact_add_name(names, ident_names[order[idx]].c_str());
+      for (int sub_type = 0; sub_type < 3; sub_type++)
+      {
+         const vector<compact_entry>& list = lists[idx * 3 + sub_type];
+
+         ident.count[sub_type]   = (UINT32) list.size();
+         ident.entries[sub_type] = entries_start + entries.size();
+         compact_put_entries(entries, list);
+      }
+      idents.push_back(ident);
+   }
+   hdr.names = entries_start + entries.size();
+   hdr.size  = hdr.names + names.size();
+
+   /* Written next to it and renamed, lookups never see half a file */
+   temp = string(filename) + ".new";
+   fp   = fopen(temp.c_str(), "wb");
+   if (fp == NULL)
+   {
+      LOG_FMT(LERR, "Unable to create %s: %s (%d)\n", temp.c_str(), strerror(errno), errno);
+      return(false);
+   }
+
+   retval = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1) &&
+            (files.empty() || (fwrite(&files[0], sizeof(compact_file), files.size(), fp) == files.size())) &&
+            (scopes.empty() || (fwrite(&scopes[0], sizeof(UINT32), scopes.size(), fp) == scopes.size())) &&
+            (idents.empty() || (fwrite(&idents[0], sizeof(compact_ident), idents.size(), fp) == idents.size())) &&
+            (entries.empty() || (fwrite(&entries[0], 1, entries.size(), fp) == entries.size())) &&
+            (names.empty() || (fwrite(&names[0], 1, names.size(), fp) == names.size()));
+   retval = (fclose(fp) == 0) && retval;
+
+   if (retval && (rename(temp.c_str(), filename) != 0))
+   {
+      retval = false;
+   }
+   if (!retval)
+   {
+      LOG_FMT(LERR, "Unable to write %s: %s (%d)\n", filename, strerror(errno), errno);
+      (void) remove(temp.c_str());
+      return(false);
+   }
+
+   LOG_FMT(LNOTE, "Exported %d files and %d identifiers to %s (%" PRIu64 " bytes)\n",
+           (int) files.size(), (int) idents.size(), filename, (uint64_t) hdr.size);
+   return(true);
+}
+
+
+/* Whether a file is a compact index, going by its magic */
+bool compact_is_compact(const char *filename)
+{
+   char  magic[sizeof(((compact_header *) NULL)->magic)];
+   FILE  *fp;
+   bool  retval = false;
+
+   if (filename == NULL)
+   {
+      filename = "TOKS";
+   }
+
+   fp = fopen(filename, "rb");
+   if (fp != NULL)
+   {
+      retval = (fread(magic, sizeof(magic), 1, fp) == 1) &&
+               (memcmp(magic, COMPACT_MAGIC, sizeof(magic)) == 0);
+      fclose(fp);
+   }
+
+   return(retval);
+}
+
+
+/* Map a compact index for lookups */
+bool compact_open(const char *filename)
+{
+   const compact_header *hdr;
+
+   if (filename == NULL)
+   {
+      filename = "TOKS";
+   }
+
+   if (!compact_map.Map(filename))
+   {
+      return(false);
+   }
+
+   hdr = reinterpret_cast<const compact_header *>(compact_map.Data());
+   if ((compact_map.Size() < sizeof(compact_header)) ||
+       (memcmp(hdr->magic, COMPACT_MAGIC, sizeof(hdr->magic)) != 0) ||
+       (hdr->byte_order != COMPACT_BYTE_ORDER) || (hdr->version != COMPACT_VERSION) ||
+       (hdr->size != compact_map.Size()))
+   {
+      LOG_FMT(LERR, "%s is not a compact index of version " xstr(COMPACT_VERSION) " for this machine\n",
+              filename);
+      compact_map.Release();
+      return(false);
+   }
+
+   compact_hdr = hdr;
+   return(true);
+}
+
+
+bool compact_opened()
+{
+   return(compact_hdr != NULL);
+}
+
+
+void compact_close()
+{
+   compact_hdr = NULL;
+   compact_map.Release();
+}
+
+
+static const char *compact_name(UINT32 offset)
+{
+   return(reinterpret_cast<const char *>(compact_map.Data() + compact_hdr->names + offset));
+}
+
+
+static const compact_ident *compact_idents()
+{
+   return(reinterpret_cast<const compact_ident *>(compact_map.Data() + compact_hdr->ident_table));
+}
+
+
+/* Identifiers by name, for the binary search */
+struct compact_ident_order
+{
+   bool operator()(const compact_ident& ident, const char *name) const
+   {
+      return(strcmp(compact_name(ident.name), name) < 0);
+   }
+};
+
+
+/**
+ * Find the identifiers matching a GLOB pattern, in name order. The literal
+ * start of the pattern limits the names to look at.
+ */
+static void compact_match(const char *pattern, vector<UINT32>& found)
+{
+   const compact_ident *begin = compact_idents();
+   const compact_ident *end   = begin + compact_hdr->identifiers;
+   const compact_ident *it    = begin;
+   string prefix(pattern, strcspn(pattern, "*?["));
+
+   if (!prefix.empty())
+   {
+      it = std::lower_bound(begin, end, prefix.c_str(), compact_ident_order());
+   }
+
+   for ( ; it != end; ++it)
+   {
+      const char *name = compact_name(it->name);
+
+      if (strncmp(name, prefix.c_str(), prefix.size()) != 0)
+      {
+         break;
+      }
+      if (sqlite3_strglob(pattern, name) == 0)
+      {
+         found.push_back((UINT32) (it - begin));
+      }
+   }
+}
+
+
+/* Decode the entries of one sub type of an identifier */
+static void compact_get_entries(UINT32 ident, id_sub_type sub_type, vector<compact_entry>& entries)
+{
+   const compact_ident& id = compact_idents()[ident];
+   const UINT8          *pos = compact_map.Data() + id.entries[sub_type];
+   compact_entry        entry;
+
+   memset(&entry, 0, sizeof(entry));
+   entry.ident = ident;
+   for (UINT32 idx = 0; idx < id.count[sub_type]; idx++)
+   {
+      entry.seq   += compact_get_varint(pos);
+      entry.file   = (UINT32) ((INT64) entry.file + compact_unzigzag(compact_get_varint(pos)));
+      entry.line   = (UINT32) ((INT64) entry.line + compact_unzigzag(compact_get_varint(pos)));
+      entry.column = (UINT32) compact_get_varint(pos);
+      entry.scope  = (UINT32) compact_get_varint(pos);
+      entry.type   = (UINT32) compact_get_varint(pos);
+      entries.push_back(entry);
+   }
+}
+
+
+/* The order of the index tables */
+struct compact_seq_order
+{
+   bool operator()(const compact_entry& a, const compact_entry& b) const
+   {
+      return(a.seq < b.seq);
+   }
+};
+
+
+/* The order of ranked entries of one sub type, see index_lookup_statement() */
+struct compact_rank_order
+{
+   bool operator()(const compact_entry& a, const compact_entry& b) const
+   {
+      if (a.near != b.near)
+      {
+         return(a.near);
+      }
+      return(a.mtime > b.mtime);
+   }
+};
+
+
+/**
+ * Print the entries of an identifier, which may contain GLOB wildcards,
+ * from the compact index, like index_lookup_in() does from an index
+ */
+bool compact_lookup_identifier(output_sink& sink, const char *identifier, int sub_types,
+                               bool ranked, const char *near)
+{
+   static const id_sub_type plain_order[] =
+   {
+      IST_DECLARATION,
+      IST_DEFINITION,
+      IST_REFERENCE,
+   };
+   static const id_sub_type rank_order[] =
+   {
+      IST_DEFINITION,
+      IST_DECLARATION,
+      IST_REFERENCE,
+   };
+   const compact_file *files =
+      reinterpret_cast<const compact_file *>(compact_map.Data() + compact_hdr->file_table);
+   const UINT32 *scopes =
+      reinterpret_cast<const UINT32 *>(compact_map.Data() + compact_hdr->scope_table);
+   const id_sub_type *order = ranked ? rank_order : plain_order;
+   vector<compact_entry> entries;
+   vector<UINT32> found;
+   string dir;
+   bool more = true;
+
+   if (identifier == NULL)
+   {
+      identifier = "*";
+   }
+   compact_match(identifier, found);
+
+   if (ranked && (near != NULL))
+   {
+      index_near_directory(near, dir);
+   }
+
+   for (size_t i = 0; more && (i < ARRAY_SIZE(plain_order)); i++)
+   {
+      if (((sub_types & IST_MASK(order[i])) == 0) ||
+          ((sink.limit > 0) && (sink.count >= sink.limit)))
+      {
+         continue;
+      }
+
+      entries.clear();
+      for (size_t idx = 0; idx < found.size(); idx++)
+      {
+         compact_get_entries(found[idx], order[i], entries);
+      }
+      if (found.size() > 1)
+      {
+         stable_sort(entries.begin(), entries.end(), compact_seq_order());
+      }
+
+      if (ranked)
+      {
+         for (size_t idx = 0; idx < entries.size(); idx++)
+         {
+            const char *filename = compact_name(files[entries[idx].file].name);
+
+            entries[idx].mtime = files[entries[idx].file].mtime;
+            entries[idx].near  = (near != NULL) &&
+                                 (strncmp(filename, dir.c_str(), dir.size()) == 0) &&
+                                 (strchr(filename + dir.size(), '/') == NULL);
+         }
+         stable_sort(entries.begin(), entries.end(), compact_rank_order());
+      }
+
+      for (size_t idx = 0; more && (idx < entries.size()); idx++)
+      {
+         const compact_entry& entry = entries[idx];
+
+         more = output_identifier(sink,
+                                  compact_name(files[entry.file].name),
+                                  entry.line,
+                                  entry.column,
+                                  compact_name(scopes[entry.scope]),
+                                  (id_type) entry.type,
+                                  order[i],
+                                  compact_name(compact_idents()[entry.ident].name));
+      }
+   }
+
+   (void) output_flush(sink);
+
+   return(true);
+}
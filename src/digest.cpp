@@ -0,0 +1,172 @@
+/**
+ * @file digest.cpp
+ * XXH64, following the reference description of the algorithm by
+ * Yann Collet. Input is read as little endian on every host so digests
+ * stored in an index stay comparable.
+ *
+ * @license GPL v2+
+ */
+
+#include "digest.h"
+#include <string.h>
+
+#define PRIME64_1    11400714785074694791ULL
+#define PRIME64_2    14029467366897019727ULL
+#define PRIME64_3    1609587929392839161ULL
+#define PRIME64_4    9650029242287828579ULL
+#define PRIME64_5    2870177450012600261ULL
+
+
+static inline UINT64 rotl64(UINT64 x, int r)
+{
+   return((x << r) | (x >> (64 - r)));
+}
+
+static inline UINT64 read64(const UINT8 *p)
+{
+   return(((UINT64)p[0])       | ((UINT64)p[1] << 8)  |
+          ((UINT64)p[2] << 16) | ((UINT64)p[3] << 24) |
+          ((UINT64)p[4] << 32) | ((UINT64)p[5] << 40) |
+          ((UINT64)p[6] << 48) | ((UINT64)p[7] << 56));
+}
+
+static inline UINT64 read32(const UINT8 *p)
+{
+   return(((UINT64)p[0])       | ((UINT64)p[1] << 8) |
+          ((UINT64)p[2] << 16) | ((UINT64)p[3] << 24));
+}
+
+static inline UINT64 xxh_round(UINT64 acc, UINT64 input)
+{
+   acc += input * PRIME64_2;
+   acc  = rotl64(acc, 31);
+   return(acc * PRIME64_1);
+}
+
+static inline UINT64 xxh_merge(UINT64 acc, UINT64 val)
+{
+   acc ^= xxh_round(0, val);
+   return(acc * PRIME64_1 + PRIME64_4);
+}
+
+/* Consumes as many whole 32 byte stripes as there are, returns the count */
+static size_t xxh_stripes(UINT64 acc[4], const UINT8 *p, size_t len)
+{
+   size_t done = 0;
+
+   while (len - done >= 32)
+   {
+      acc[0] = xxh_round(acc[0], read64(p + done));
+      acc[1] = xxh_round(acc[1], read64(p + done + 8));
+      acc[2] = xxh_round(acc[2], read64(p + done + 16));
+      acc[3] = xxh_round(acc[3], read64(p + done + 24));
+      done  += 32;
+   }
+   return(done);
+}
+
+
+void Digest::Init(UINT64 seed)
+{
+   m_seed   = seed;
+   m_acc[0] = seed + PRIME64_1 + PRIME64_2;
+   m_acc[1] = seed + PRIME64_2;
+   m_acc[2] = seed;
+   m_acc[3] = seed - PRIME64_1;
+   m_total  = 0;
+   m_in_len = 0;
+}
+
+
+void Digest::Update(const void *data, size_t len)
+{
+   const UINT8 *p = (const UINT8 *)data;
+
+   m_total += len;
+
+   /* Top up a partial stripe left by an earlier call first */
+   if (m_in_len > 0)
+   {
+      size_t fill = 32 - m_in_len;
+
+      if (len < fill)
+      {
+         memcpy(m_in + m_in_len, p, len);
+         m_in_len += len;
+         return;
+      }
+      memcpy(m_in + m_in_len, p, fill);
+      (void)xxh_stripes(m_acc, m_in, 32);
+      m_in_len = 0;
+      p       += fill;
+      len     -= fill;
+   }
+
+   size_t done = xxh_stripes(m_acc, p, len);
+
+   m_in_len = len - done;
+   memcpy(m_in, p + done, m_in_len);
+}
+
+
+digest_t Digest::Final() const
+{
+   UINT64      h64;
+   const UINT8 *p  = m_in;
+   size_t      len = m_in_len;
+
+   if (m_total >= 32)
+   {
+      h64 = rotl64(m_acc[0], 1) + rotl64(m_acc[1], 7) +
+            rotl64(m_acc[2], 12) + rotl64(m_acc[3], 18);
+      h64 = xxh_merge(h64, m_acc[0]);
+      h64 = xxh_merge(h64, m_acc[1]);
+      h64 = xxh_merge(h64, m_acc[2]);
+      h64 = xxh_merge(h64, m_acc[3]);
+   }
+   else
+   {
+      h64 = m_seed + PRIME64_5;
+   }
+
+   h64 += m_total;
+
+   while (len >= 8)
+   {
+      h64 ^= xxh_round(0, read64(p));
+      h64  = rotl64(h64, 27) * PRIME64_1 + PRIME64_4;
+      p   += 8;
+      len -= 8;
+   }
+   if (len >= 4)
+   {
+      h64 ^= read32(p) * PRIME64_1;
+      h64  = rotl64(h64, 23) * PRIME64_2 + PRIME64_3;
+      p   += 4;
+      len -= 4;
+   }
+   while (len > 0)
+   {
+      h64 ^= (*p) * PRIME64_5;
+      h64  = rotl64(h64, 11) * PRIME64_1;
+      p++;
+      len--;
+   }
+
+   h64 ^= h64 >> 33;
+   h64 *= PRIME64_2;
+   h64 ^= h64 >> 29;
+   h64 *= PRIME64_3;
+   h64 ^= h64 >> 32;
+
+   return(h64);
+}
+
+
+digest_t Digest::Calc(const void *data, size_t length)
+{
+   Digest digest;
+
+   digest.Update(data, length);
+   return(digest.Final());
+}
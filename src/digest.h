@@ -0,0 +1,38 @@
+/**
+ * @file digest.h
+ * The content digest used to tell whether a file changed since it was
+ * indexed. This is XXH64, a fast non-cryptographic 64-bit hash; nothing
+ * relies on it being collision resistant against crafted input.
+ *
+ * @license GPL v2+
+ */
+#ifndef DIGEST_H_INCLUDED
+#define DIGEST_H_INCLUDED
+
+#include "base_types.h"
+#include <cstddef>
+
+typedef UINT64 digest_t;
+
+class Digest
+{
+public:
+   Digest() { Init(); }
+   ~Digest() { }
+
+   void Init(UINT64 seed = 0);
+   void Update(const void *data, size_t len);
+
+   digest_t Final() const;
+
+   static digest_t Calc(const void *data, size_t length);
+
+private:
+   UINT64 m_acc[4];
+   UINT64 m_seed;
+   UINT64 m_total;
+   UINT8  m_in[32];
+   size_t m_in_len;
+};
+
+#endif /* DIGEST_H_INCLUDED */
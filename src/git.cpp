@@ -0,0 +1,230 @@
+/**
+ * @file git.cpp
+ * Indexing of a git commit. The index remembers the commit it was last
+ * brought to, and the next --git run only analyzes the files git reports as
+ * changed since then and removes the deleted ones, instead of checking every
+ * file of the tree. Without a remembered commit, or when git cannot compare
+ * it, all files of the commit are indexed and the others are removed.
+ *
+ * Files are read from the working tree, which is expected to be at the
+ * commit. Names are relative to the current directory, as git gives them,
+ * and only those with a source extension are indexed.
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+#include "SourceList.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+
+#ifdef WIN32
+#define popen     _popen
+#define pclose    _pclose
+#endif
+
+
+/**
+ * Revisions are passed to the shell, only allow the characters of commit
+ * names, branches and the usual suffixes like ~1, ^2 or @{1}
+ */
+static bool git_revision_valid(const char *rev)
+{
+   if ((rev == NULL) || (*rev == 0) || (*rev == '-'))
+   {
+      return(false);
+   }
+   for ( ; *rev != 0; rev++)
+   {
+      if (!isalnum((unsigned char) *rev) && (strchr("_./~^@{}-", *rev) == NULL))
+      {
+         return(false);
+      }
+   }
+   return(true);
+}
+
+
+/**
+ * Run a git command and collect its output, false if it could not run or
+ * did not succeed
+ */
+static bool git_run(const string& command, string& output)
+{
+   char buf[4096];
+   size_t len;
+   FILE *pipe;
+
+   output.clear();
+   LOG_FMT(LNOTE, "Running %s\n", command.c_str());
+
+   pipe = popen(command.c_str(), "r");
+   if (pipe == NULL)
+   {
+      LOG_FMT(LERR, "Unable to run git: %s (%d)\n", strerror(errno), errno);
+      return(false);
+   }
+
+   while ((len = fread(buf, 1, sizeof(buf), pipe)) > 0)
+   {
+      output.append(buf, len);
+   }
+
+   return(pclose(pipe) == 0);
+}
+
+
+/* Split the output of a git command given -z at the NUL characters */
+static void git_split(const string& output, vector<string>& fields)
+{
+   size_t start = 0, end;
+
+   while ((end = output.find('\0', start)) != string::npos)
+   {
+      fields.push_back(output.substr(start, end - start));
+      start = end + 1;
+   }
+}
+
+
+/* The full name of the commit rev refers to */
+static bool git_resolve(const char *rev, string& commit)
+{
+   if (!git_revision_valid(rev))
+   {
+      LOG_FMT(LERR, "Invalid git revision: %s\n", rev);
+      return(false);
+   }
+
+   if (!git_run(string("git rev-parse -q --verify ") + rev + "^{commit}", commit))
+   {
+      LOG_FMT(LERR, "Unknown git revision: %s\n", rev);
+      return(false);
+   }
+
+   while (!commit.empty() && isspace((unsigned char) commit[commit.size() - 1]))
+   {
+      commit.erase(commit.size() - 1);
+   }
+   return(!commit.empty());
+}
+
+
+/**
+ * Analyze the files that changed between the commits old and commit and
+ * remove the deleted ones, false if git could not compare the commits
+ *
+ * @param stored  Set if all files were removed or stored
+ */
+static bool git_index_changes(const string& old, const string& commit, int jobs, bool dump,
+                              bool& stored)
+{
+   SourceList source_files;
+   vector<string> fields, deleted;
+   string output;
+   int changed = 0;
+
+   if (!git_run("git diff --name-status -z --no-renames --relative " + old + " " + commit,
+                output))
+   {
+      LOG_FMT(LWARN, "Unable to compare with the indexed commit %s, indexing all files\n",
+              old.c_str());
+      return(false);
+   }
+
+   git_split(output, fields);
+   for (size_t i = 0; i + 1 < fields.size(); i += 2)
+   {
+      const string& status   = fields[i];
+      const string& filename = fields[i + 1];
+
+      if (!is_source_file(filename.c_str()))
+      {
+         continue;
+      }
+      if (status[0] == 'D')
+      {
+         deleted.push_back(filename);
+      }
+      else
+      {
+         source_files.Add(filename.c_str());
+         changed++;
+      }
+   }
+
+   LOG_FMT(LNOTE, "%d files changed and %d deleted since %s\n",
+           changed, (int)deleted.size(), old.c_str());
+
+   stored = index_remove_files(deleted) &&
+            index_source_files(source_files, jobs, dump);
+   return(true);
+}
+
+
+/* Analyze all files of the commit and remove the others, false if one is not stored */
+static bool git_index_all(const string& commit, int jobs, bool dump)
+{
+   SourceList source_files;
+   vector<string> fields;
+   string output;
+
+   if (!git_run("git ls-tree -r -z --name-only " + commit, output))
+   {
+      LOG_FMT(LERR, "Unable to list the files of %s\n", commit.c_str());
+      return(false);
+   }
+
+   git_split(output, fields);
+   for (size_t i = 0; i < fields.size(); i++)
+   {
+      if (is_source_file(fields[i].c_str()))
+      {
+         source_files.Add(fields[i].c_str());
+      }
+   }
+
+   source_files.Remember(true);
+   return(index_source_list(source_files, jobs, dump, true));
+}
+
+
+/**
+ * Bring the open index to the commit rev refers to and remember it for the
+ * next run. The commit is only remembered if every file was stored, else
+ * the next run compares with the commit before and tries the files again.
+ */
+bool git_index_revision(const char *rev, int jobs, bool dump)
+{
+   string commit, old;
+   bool indexed = false;
+
+   if (!git_resolve(rev, commit) || !index_prepare_for_analysis())
+   {
+      return(false);
+   }
+
+   index_git_commit(old);
+   if (old == commit)
+   {
+      LOG_FMT(LNOTE, "The index is at %s\n", commit.c_str());
+      indexed = true;
+   }
+   else if (old.empty() || !git_index_changes(old, commit, jobs, dump, indexed))
+   {
+      indexed = git_index_all(commit, jobs, dump);
+   }
+
+   indexed = index_end_analysis() && indexed;
+   if (!indexed)
+   {
+      LOG_FMT(LERR, "Not all files of %s were stored, the index stays at %s\n",
+              commit.c_str(), old.empty() ? "no commit" : old.c_str());
+      return(false);
+   }
+
+   return(index_set_git_commit(commit));
+}
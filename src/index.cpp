@@ -1,7 +1,13 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <cinttypes>
+#include <climits>
+#include <algorithm>
+#include <map>
+#include <unordered_set>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -10,7 +16,36 @@
 #include "toks_types.h"
 #include "sqlite3080200.h"
 
-#define INDEX_VERSION 1
+#define INDEX_VERSION 13
+
+/* Milliseconds to wait for a lock another connection holds */
+#define INDEX_BUSY_TIMEOUT_MS 5000
+
+/* Rows per multi-row insert, 7 columns each stays below the variable limit */
+#define INDEX_BATCH_ROWS 64
+
+/* Bloom filter of the identifiers: bits per identifier, bit positions per
+ * identifier and the smallest filter
+ */
+#define INDEX_BLOOM_BITS_PER_ID  10
+#define INDEX_BLOOM_HASHES       7
+#define INDEX_BLOOM_MIN_BYTES    1024
+
+/* Rows of the Changes table kept for the readers following it, see
+ * index_read_changes()
+ */
+#define INDEX_CHANGES_KEPT    4096
+
+#define INDEX_TRIM_CHANGES \
+   "DELETE FROM Changes WHERE rowid<=(SELECT max(rowid) FROM Changes)-" xstr(INDEX_CHANGES_KEPT)
+
+/* Trigrams of a pattern used to find candidate identifiers */
+#define INDEX_LOOKUP_TRIGRAMS 4
+
+/* Parameters of the lookup after those of the pattern */
+#define INDEX_LOOKUP_LIMIT    10
+#define INDEX_LOOKUP_DIR      11
+#define INDEX_LOOKUP_DIRLEN   12
 
 #define xstr(a) str(a)
 #define str(a) #a
@@ -26,6 +61,53 @@ static int index_version_check_callback(
    return 0;
 }
 
+static int index_journal_mode_callback(
+   void *mode,
+   int argc,
+   char **argv,
+   char **azColName)
+{
+   if ((argc == 1) && (argv[0] != NULL))
+      *((string *) mode) = argv[0];
+   return 0;
+}
+
+/**
+ * Without a journal, a lookup while the index is written may see a half
+ * stored file, and a crash leaves a broken index. In WAL mode lookups read
+ * the last commit without waiting and a crash loses no more than the files
+ * after it. An index stays in WAL mode once --wal put it there.
+ */
+static void index_set_journal(void)
+{
+   string mode;
+
+   (void) sqlite3_exec(cpd.index,
+                       "PRAGMA journal_mode",
+                       index_journal_mode_callback,
+                       &mode,
+                       NULL);
+
+   if (cpd.wal || (mode == "wal"))
+   {
+      (void) sqlite3_exec(cpd.index,
+                          "PRAGMA journal_mode=WAL;"
+                          "PRAGMA synchronous=NORMAL;",
+                          NULL,
+                          NULL,
+                          NULL);
+   }
+   else
+   {
+      (void) sqlite3_exec(cpd.index,
+                          "PRAGMA journal_mode=MEMORY;"
+                          "PRAGMA synchronous=OFF;",
+                          NULL,
+                          NULL,
+                          NULL);
+   }
+}
+
 static bool index_check(void)
 {
    int result;
@@ -43,7 +125,7 @@ static bool index_check(void)
    {
       if (version != INDEX_VERSION)
       {
-         LOG_FMT(LERR, "Wrong index format version, delete it to continue\n");
+         LOG_FMT(LERR, "Wrong index format version %d (expected " xstr(INDEX_VERSION) "), delete it to continue\n", version);
          retval = false;
       }
    }
@@ -55,10 +137,20 @@ static bool index_check(void)
          cpd.index,
          "CREATE TABLE Version(Version INTEGER);"
          "INSERT INTO Version VALUES(" xstr(INDEX_VERSION) ");"
-         "CREATE TABLE Files(Digest TEXT, Filename TEXT UNIQUE);"
-         "CREATE TABLE Refs(Filerow INTEGER, Line INTEGER, ColumnStart INTEGER, Scope TEXT, Type INTEGER, Identifier TEXT);"
-         "CREATE TABLE Defs(Filerow INTEGER, Line INTEGER, ColumnStart INTEGER, Scope TEXT, Type INTEGER, Identifier TEXT);"
-         "CREATE TABLE Decls(Filerow INTEGER, Line INTEGER, ColumnStart INTEGER, Scope TEXT, Type INTEGER, Identifier TEXT);",
+         "CREATE TABLE Files(Digest INTEGER, Filename TEXT UNIQUE, Size INTEGER, Mtime INTEGER, Inode INTEGER, Content INTEGER);"
+         "CREATE INDEX FilesContent ON Files(Content);"
+         "CREATE TABLE Contents(Digest INTEGER, Lang INTEGER, UNIQUE(Digest, Lang));"
+         "CREATE TABLE Regions(Content INTEGER, Line INTEGER, Lines INTEGER, Digest INTEGER);"
+         "CREATE INDEX RegionsContent ON Regions(Content);"
+         "CREATE TABLE Scopes(Scope TEXT UNIQUE);"
+         "CREATE TABLE Identifiers(Identifier TEXT UNIQUE);"
+         "CREATE TABLE Trigrams(Trigram INTEGER, Idrow INTEGER, PRIMARY KEY(Trigram, Idrow)) WITHOUT ROWID;"
+         "CREATE TABLE Bloom(Bits BLOB);"
+         "CREATE TABLE RefBlocks(Content INTEGER, Identifier INTEGER, Refs BLOB);"
+         "CREATE TABLE Defs(Content INTEGER, Line INTEGER, ColumnStart INTEGER, Scope INTEGER, Type INTEGER, Identifier INTEGER, ColumnEnd INTEGER);"
+         "CREATE TABLE Decls(Content INTEGER, Line INTEGER, ColumnStart INTEGER, Scope INTEGER, Type INTEGER, Identifier INTEGER, ColumnEnd INTEGER);"
+         "CREATE TABLE Calls(Content INTEGER, Line INTEGER, ColumnStart INTEGER, Scope INTEGER, Type INTEGER, Identifier INTEGER, ColumnEnd INTEGER, Caller INTEGER);"
+         "CREATE TABLE Changes(Filename TEXT, Content INTEGER);",
          NULL,
          NULL,
          &errmsg);
@@ -72,10 +164,10 @@ static bool index_check(void)
       sqlite3_free(errmsg);
    }
 
+   index_set_journal();
+
    (void) sqlite3_exec(
       cpd.index,
-      "PRAGMA journal_mode=OFF;"
-      "PRAGMA synchronous=OFF;"
       "PRAGMA case_sensitive_like=ON;",
       NULL,
       NULL,
@@ -84,6 +176,59 @@ static bool index_check(void)
    return retval;
 }
 
+/**
+ * Open a copy of the index for --snapshot, lookups keep reading the index
+ * until index_close() puts the copy in its place
+ */
+static int index_open_snapshot(const char *index_file, int open_flags)
+{
+   string snapshot = string(index_file) + ".new";
+   sqlite3 *current = NULL;
+   sqlite3_backup *backup;
+   struct stat st;
+   int result;
+
+   /* Left behind by an interrupted run */
+   (void) remove(snapshot.c_str());
+   (void) remove((snapshot + "-journal").c_str());
+   (void) remove((snapshot + "-wal").c_str());
+   (void) remove((snapshot + "-shm").c_str());
+
+   result = sqlite3_open_v2(snapshot.c_str(),
+                            &cpd.index,
+                            open_flags | SQLITE_OPEN_CREATE,
+                            NULL);
+
+   if ((result == SQLITE_OK) && (stat(index_file, &st) == 0))
+   {
+      result = sqlite3_open_v2(index_file,
+                               &current,
+                               SQLITE_OPEN_READONLY,
+                               NULL);
+
+      if (result == SQLITE_OK)
+      {
+         (void) sqlite3_busy_timeout(current, INDEX_BUSY_TIMEOUT_MS);
+         backup = sqlite3_backup_init(cpd.index, "main", current, "main");
+         if (backup != NULL)
+         {
+            (void) sqlite3_backup_step(backup, -1);
+            (void) sqlite3_backup_finish(backup);
+         }
+         result = sqlite3_errcode(cpd.index);
+      }
+      (void) sqlite3_close(current);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      LOG_FMT(LNOTE, "Indexing into %s\n", snapshot.c_str());
+      cpd.snapshot_file = snapshot;
+   }
+
+   return result;
+}
+
 bool index_open(const char *index_file, bool create)
 {
    int result, open_flags = SQLITE_OPEN_READWRITE;
@@ -99,13 +244,25 @@ bool index_open(const char *index_file, bool create)
       open_flags |= SQLITE_OPEN_CREATE;
    }
 
-   result = sqlite3_open_v2(index_file,
-                            &cpd.index,
-                            open_flags,
-                            NULL);
+   if (create && cpd.snapshot)
+   {
+      result = index_open_snapshot(index_file, open_flags);
+   }
+   else
+   {
+      result = sqlite3_open_v2(index_file,
+                               &cpd.index,
+                               open_flags,
+                               NULL);
+   }
 
    if (result == SQLITE_OK)
    {
+      struct stat st;
+
+      cpd.index_file  = index_file;
+      cpd.index_inode = (stat(index_file, &st) == 0) ? (UINT64) st.st_ino : 0;
+      (void) sqlite3_busy_timeout(cpd.index, INDEX_BUSY_TIMEOUT_MS);
       retval = index_check();
    }
    else
@@ -118,6 +275,8 @@ bool index_open(const char *index_file, bool create)
    if (!retval)
    {
       (void) sqlite3_close(cpd.index);
+      cpd.index_file.clear();
+      cpd.snapshot_file.clear();
    }
 
    return retval;
@@ -128,6 +287,13 @@ bool index_close(void)
    int result;
    bool retval = true;
 
+   for (size_t i = 0; i < ARRAY_SIZE(cpd.stmt_lookup_identifier); i++)
+   {
+      (void) sqlite3_finalize(cpd.stmt_lookup_identifier[i]);
+      cpd.stmt_lookup_identifier[i] = NULL;
+   }
+
+   cpd.bloom = index_bloom();
    result = sqlite3_close(cpd.index);
 
    if (result != SQLITE_OK)
@@ -136,583 +302,4064 @@ bool index_close(void)
       LOG_FMT(LERR, "index_close: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
       retval = false;
    }
+   else if (!cpd.snapshot_file.empty())
+   {
+      /* Lookups that have the index open keep reading it */
+      if (rename(cpd.snapshot_file.c_str(), cpd.index_file.c_str()) != 0)
+      {
+         LOG_FMT(LERR, "Unable to replace %s with %s: %s (%d)\n", cpd.index_file.c_str(),
+                 cpd.snapshot_file.c_str(), strerror(errno), errno);
+         retval = false;
+      }
+   }
+
+   cpd.index_file.clear();
+   cpd.snapshot_file.clear();
 
    return retval;
 }
 
-bool index_prepare_for_analysis(void)
+/* Whether --snapshot put a new index in place of the open one */
+bool index_replaced(void)
 {
-   int result;
-   bool retval = true;
+   struct stat st;
 
-   result = sqlite3_prepare_v2(cpd.index,
-                               "INSERT INTO Refs VALUES(?,?,?,?,?,?)",
-                               -1,
-                               &cpd.stmt_insert_reference,
-                               NULL);
+   return(!cpd.index_file.empty() && cpd.snapshot_file.empty() &&
+          (stat(cpd.index_file.c_str(), &st) == 0) &&
+          ((UINT64) st.st_ino != cpd.index_inode));
+}
 
-   if (result == SQLITE_OK)
-   {
-      result |= sqlite3_prepare_v2(cpd.index,
-                                  "INSERT INTO Defs VALUES(?,?,?,?,?,?)",
-                                  -1,
-                                  &cpd.stmt_insert_definition,
-                                  NULL);
-   }
+/**
+ * Open an index for lookups only, on its own connection. Used for the
+ * shards of a sharded index, which are looked up at the same time.
+ */
+bool index_open_shard(const char *index_file, sqlite3 **db)
+{
+   int result, version = 0;
 
-   if (result == SQLITE_OK)
-   {
-      result |= sqlite3_prepare_v2(cpd.index,
-                                  "INSERT INTO Decls VALUES(?,?,?,?,?,?)",
-                                  -1,
-                                  &cpd.stmt_insert_declaration,
-                                  NULL);
-   }
+   result = sqlite3_open_v2(index_file,
+                            db,
+                            SQLITE_OPEN_READONLY,
+                            NULL);
 
    if (result == SQLITE_OK)
    {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "BEGIN",
-                                  -1,
-                                  &cpd.stmt_begin,
-                                  NULL);
+      result = sqlite3_exec(*db,
+                            "SELECT Version FROM Version",
+                            index_version_check_callback,
+                            &version,
+                            NULL);
    }
 
-   if (result == SQLITE_OK)
+   if (result != SQLITE_OK)
    {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "COMMIT",
-                                  -1,
-                                  &cpd.stmt_commit,
-                                  NULL);
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_open_shard: %s: access error (%d: %s)\n", index_file, result, errstr != NULL ? errstr : "");
    }
-
-   if (result == SQLITE_OK)
+   else if (version != INDEX_VERSION)
    {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "INSERT INTO Files VALUES(?,?)",
-                                  -1,
-                                  &cpd.stmt_insert_file,
-                                  NULL);
+      LOG_FMT(LERR, "Wrong index format version %d in %s (expected " xstr(INDEX_VERSION) ")\n", version, index_file);
+      result = SQLITE_ERROR;
    }
 
-   if (result == SQLITE_OK)
+   if (result != SQLITE_OK)
    {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "DELETE FROM Files WHERE rowid=?",
-                                  -1,
-                                  &cpd.stmt_remove_file,
-                                  NULL);
+      (void) sqlite3_close(*db);
+      *db = NULL;
+      return(false);
    }
 
-   if (result == SQLITE_OK)
-   {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "DELETE FROM Refs WHERE Filerow=?",
-                                  -1,
-                                  &cpd.stmt_prune_refs,
-                                  NULL);
-   }
+   return(true);
+}
 
-   if (result == SQLITE_OK)
+/* Close an index opened by index_open_shard() and its lookup statements */
+void index_close_shard(sqlite3 *db, sqlite3_stmt **stmts)
+{
+   for (size_t i = 0; i < INDEX_LOOKUP_STATEMENTS; i++)
    {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "DELETE FROM Defs WHERE Filerow=?",
-                                  -1,
-                                  &cpd.stmt_prune_defs,
-                                  NULL);
+      (void) sqlite3_finalize(stmts[i]);
+      stmts[i] = NULL;
    }
+   (void) sqlite3_close(db);
+}
 
-   if (result == SQLITE_OK)
-   {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "DELETE FROM Decls WHERE Filerow=?",
-                                  -1,
-                                  &cpd.stmt_prune_decls,
-                                  NULL);
-   }
+/**
+ * Replace the open index with a copy of it in memory, for a server that
+ * only looks up identifiers. Changes made to the index file afterwards are
+ * not seen.
+ */
+bool index_load_into_memory(void)
+{
+   int result;
+   bool retval = true;
+   sqlite3 *memory = NULL;
+   sqlite3_backup *backup;
+
+   result = sqlite3_open_v2(":memory:",
+                            &memory,
+                            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                            NULL);
 
    if (result == SQLITE_OK)
    {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "UPDATE Files SET Digest=? WHERE Filename=?",
-                                  -1,
-                                  &cpd.stmt_change_digest,
-                                  NULL);
+      backup = sqlite3_backup_init(memory, "main", cpd.index, "main");
+      if (backup != NULL)
+      {
+         (void) sqlite3_backup_step(backup, -1);
+         (void) sqlite3_backup_finish(backup);
+      }
+      result = sqlite3_errcode(memory);
    }
 
    if (result == SQLITE_OK)
    {
-      result = sqlite3_prepare_v2(cpd.index,
-                                  "SELECT rowid,Digest FROM Files WHERE Filename=?",
-                                  -1,
-                                  &cpd.stmt_lookup_file,
-                                  NULL);
+      (void) index_close();
+      cpd.index = memory;
    }
-
-   if (result != SQLITE_OK)
+   else
    {
       const char *errstr = sqlite3_errstr(result);
-      LOG_FMT(LERR, "index_prepare_for_analysis: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      LOG_FMT(LERR, "index_load_into_memory: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      (void) sqlite3_close(memory);
       retval = false;
    }
 
    return retval;
 }
 
-void index_end_analysis(void)
+/* Step a statement that returns no rows and make it ready for reuse */
+static int index_run(sqlite3_stmt *stmt)
 {
-   (void) sqlite3_finalize(cpd.stmt_insert_reference);
-   (void) sqlite3_finalize(cpd.stmt_insert_definition);
-   (void) sqlite3_finalize(cpd.stmt_insert_declaration);
-   (void) sqlite3_finalize(cpd.stmt_begin);
-   (void) sqlite3_finalize(cpd.stmt_commit);
-   (void) sqlite3_finalize(cpd.stmt_insert_file);
-   (void) sqlite3_finalize(cpd.stmt_remove_file);
-   (void) sqlite3_finalize(cpd.stmt_prune_refs);
-   (void) sqlite3_finalize(cpd.stmt_prune_defs);
-   (void) sqlite3_finalize(cpd.stmt_prune_decls);
-   (void) sqlite3_finalize(cpd.stmt_change_digest);
-   (void) sqlite3_finalize(cpd.stmt_lookup_file);
+   int result = sqlite3_step(stmt);
+
+   if (result == SQLITE_DONE)
+   {
+      result = sqlite3_reset(stmt);
+   }
+   else
+   {
+      (void) sqlite3_reset(stmt);
+   }
+
+   return result;
 }
 
-static int index_insert_file(
-   const char *digest,
-   const char *filename,
-   sqlite3_int64 *filerow)
+/* Prepare an insert of INDEX_BATCH_ROWS entries into a table */
+static int index_prepare_batch_insert(const char *table, sqlite3_stmt **stmt)
 {
-   int result;
-
-   result = sqlite3_bind_text(cpd.stmt_insert_file,
-                              1,
-                              digest,
-                              -1,
-                              SQLITE_STATIC);
+   string sql = string("INSERT INTO ") + table + " VALUES";
 
-   if (result == SQLITE_OK)
+   for (int i = 0; i < INDEX_BATCH_ROWS; i++)
    {
-      result = sqlite3_bind_text(cpd.stmt_insert_file,
-                                 2,
-                                 filename,
-                                 -1,
-                                 SQLITE_STATIC);
+      sql += (i == 0) ? "(?,?,?,?,?,?,?)" : ",(?,?,?,?,?,?,?)";
    }
 
-   if (result == SQLITE_OK)
+   return(sqlite3_prepare_v2(cpd.index, sql.c_str(), -1, stmt, NULL));
+}
+
+/* Set or test the bits of an identifier in a Bloom filter */
+static bool index_bloom_bits(vector<UINT8>& bits, const char *identifier, size_t len, bool set)
+{
+   digest_t digest = Digest::Calc(identifier, len);
+   UINT32   h1     = (UINT32) digest;
+   UINT32   h2     = (UINT32) (digest >> 32) | 1;
+   UINT32   mask   = (UINT32) (bits.size() * 8 - 1);
+
+   for (int i = 0; i < INDEX_BLOOM_HASHES; i++)
    {
-      result = sqlite3_step(cpd.stmt_insert_file);
-      if (result == SQLITE_DONE)
+      UINT32 bit = (h1 + (UINT32) i * h2) & mask;
+
+      if (set)
       {
-         result = sqlite3_reset(cpd.stmt_insert_file);
+         bits[bit >> 3] |= (UINT8) (1 << (bit & 7));
+      }
+      else if ((bits[bit >> 3] & (1 << (bit & 7))) == 0)
+      {
+         return(false);
       }
    }
+   return(true);
+}
 
-   *filerow = sqlite3_last_insert_rowid(cpd.index);
+/* The last identifier row, it grows with every identifier an index gets */
+static sqlite3_int64 index_bloom_generation(sqlite3 *db)
+{
+   sqlite3_stmt *stmt = NULL;
+   sqlite3_int64 generation = -1;
 
-   return result;
+   if ((sqlite3_prepare_v2(db, "SELECT max(rowid) FROM Identifiers", -1, &stmt, NULL) == SQLITE_OK) &&
+       (sqlite3_step(stmt) == SQLITE_ROW))
+   {
+      generation = sqlite3_column_int64(stmt, 0);
+   }
+   (void) sqlite3_finalize(stmt);
+
+   return(generation);
 }
 
-static int index_prune_entries(sqlite3_int64 filerow)
+/**
+ * Load the filter of an index. The generation is read first, a filter
+ * stored after it only makes the next negative check again.
+ */
+static void index_bloom_load(sqlite3 *db, index_bloom& bloom)
 {
-   int result;
+   sqlite3_stmt *stmt = NULL;
 
-   result = sqlite3_bind_int64(cpd.stmt_prune_refs,
-                               1,
-                               filerow);
-
-   if (result == SQLITE_OK)
+   bloom.loaded     = true;
+   bloom.generation = index_bloom_generation(db);
+   bloom.bits.clear();
+   if (sqlite3_prepare_v2(db, "SELECT Bits FROM Bloom", -1, &stmt, NULL) == SQLITE_OK)
    {
-      result = sqlite3_step(cpd.stmt_prune_refs);
-      if (result == SQLITE_DONE)
+      if (sqlite3_step(stmt) == SQLITE_ROW)
       {
-         result = sqlite3_reset(cpd.stmt_prune_refs);
+         const UINT8 *bits = (const UINT8 *) sqlite3_column_blob(stmt, 0);
+         int         len   = sqlite3_column_bytes(stmt, 0);
+
+         /* A power of two, see index_bloom_rebuild() */
+         if ((bits != NULL) && (len > 0) && ((len & (len - 1)) == 0))
+         {
+            bloom.bits.assign(bits, bits + len);
+         }
       }
    }
+   (void) sqlite3_finalize(stmt);
+}
 
-   if (result == SQLITE_OK)
+/**
+ * Whether an index may have an identifier, false only if it has not. Loads
+ * the filter of the index on first use, an index without one may have any.
+ * Before a negative is trusted the filter is loaded again if another
+ * connection added identifiers since, unless this one has unstored bits.
+ */
+static bool index_bloom_may_contain(sqlite3 *db, index_bloom& bloom, const char *identifier)
+{
+   size_t len = strlen(identifier);
+
+   if (!bloom.loaded)
    {
-      result = sqlite3_bind_int64(cpd.stmt_prune_defs,
-                                  1,
-                                  filerow);
+      index_bloom_load(db, bloom);
    }
 
-   if (result == SQLITE_OK)
+   if (bloom.bits.empty() || index_bloom_bits(bloom.bits, identifier, len, false))
    {
-      result = sqlite3_step(cpd.stmt_prune_defs);
-      if (result == SQLITE_DONE)
-      {
-         result = sqlite3_reset(cpd.stmt_prune_defs);
-      }
+      return(true);
    }
 
-   if (result == SQLITE_OK)
+   if (!bloom.changed && (index_bloom_generation(db) != bloom.generation))
    {
-      result = sqlite3_bind_int64(cpd.stmt_prune_decls,
-                                  1,
-                                  filerow);
+      index_bloom_load(db, bloom);
+      return(bloom.bits.empty() || index_bloom_bits(bloom.bits, identifier, len, false));
+   }
+   return(false);
+}
+
+/**
+ * Size the filter of the open index for twice the identifiers it has and
+ * add them all, once the identifiers outgrow it
+ */
+static int index_bloom_rebuild(void)
+{
+   sqlite3_stmt *stmt = NULL;
+   size_t bytes = INDEX_BLOOM_MIN_BYTES;
+   int result;
+
+   while ((sqlite3_int64) bytes * 8 < cpd.bloom.identifiers * 2 * INDEX_BLOOM_BITS_PER_ID)
+   {
+      bytes *= 2;
    }
+   cpd.bloom.bits.assign(bytes, 0);
+
+   result = sqlite3_prepare_v2(cpd.index, "SELECT Identifier FROM Identifiers", -1, &stmt, NULL);
 
    if (result == SQLITE_OK)
    {
-      result = sqlite3_step(cpd.stmt_prune_decls);
+      while ((result = sqlite3_step(stmt)) == SQLITE_ROW)
+      {
+         (void) index_bloom_bits(cpd.bloom.bits,
+                                 (const char *) sqlite3_column_text(stmt, 0),
+                                 (size_t) sqlite3_column_bytes(stmt, 0),
+                                 true);
+      }
       if (result == SQLITE_DONE)
       {
-         result = sqlite3_reset(cpd.stmt_prune_decls);
+         result = SQLITE_OK;
       }
    }
 
+   (void) sqlite3_finalize(stmt);
+
    return result;
 }
 
-static int index_remove_file(sqlite3_int64 filerow)
+/**
+ * Get the filter of the open index ready for the identifiers added while
+ * indexing
+ */
+static int index_bloom_prepare(void)
 {
+   sqlite3_stmt *stmt = NULL;
    int result;
 
-   result = sqlite3_bind_int64(cpd.stmt_remove_file,
-                               1,
-                               filerow);
+   index_bloom_load(cpd.index, cpd.bloom);
+   cpd.bloom.changed = false;
 
+   /* Identifiers are never removed, the last rowid is their number */
+   result = sqlite3_prepare_v2(cpd.index, "SELECT max(rowid) FROM Identifiers", -1, &stmt, NULL);
    if (result == SQLITE_OK)
    {
-      result = sqlite3_step(cpd.stmt_remove_file);
-      if (result == SQLITE_DONE)
+      result = sqlite3_step(stmt);
+      if (result == SQLITE_ROW)
       {
-         result = sqlite3_reset(cpd.stmt_remove_file);
+         cpd.bloom.identifiers = sqlite3_column_int64(stmt, 0);
+         result = SQLITE_OK;
       }
    }
+   (void) sqlite3_finalize(stmt);
 
    return result;
 }
 
-static bool file_exists(const char *filename)
+/**
+ * Store the filter of the open index with the transaction that added
+ * identifiers to it, so it never misses an identifier
+ */
+static int index_bloom_store(void)
 {
-   struct stat buffer;
-   return stat(filename, &buffer) == 0;
-}
+   sqlite3_stmt *stmt = NULL;
+   int result = SQLITE_OK;
 
-bool index_prune_files(void)
-{
-   int result;
-   bool retval = true;
-   sqlite3_stmt *stmt_iterate_files;
+   if (!cpd.bloom.changed)
+   {
+      return result;
+   }
+
+   if ((sqlite3_int64) cpd.bloom.bits.size() * 8 < cpd.bloom.identifiers * INDEX_BLOOM_BITS_PER_ID)
+   {
+      result = index_bloom_rebuild();
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_exec(cpd.index, "DELETE FROM Bloom", NULL, NULL, NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index, "INSERT INTO Bloom VALUES(?)", -1, &stmt, NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_blob(stmt, 1, &cpd.bloom.bits[0], (int) cpd.bloom.bits.size(),
+                                 SQLITE_STATIC);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(stmt);
+      if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+   }
+
+   (void) sqlite3_finalize(stmt);
+   cpd.bloom.changed = (result != SQLITE_OK);
+
+   return result;
+}
+
+/**
+ * Prepare the statements that update the entries of a table in place for
+ * a file window: one deletes the lines from ?2 up to ?3, the other adds ?2
+ * to the lines from ?3 on
+ */
+static int index_prepare_window(const char *table, sqlite3_stmt **stmt_cut,
+                                sqlite3_stmt **stmt_shift)
+{
+   string sql;
+   int result;
+
+   sql  = "DELETE FROM ";
+   sql += table;
+   sql += " WHERE Content=?1 AND Line>=?2 AND Line<?3";
+   result = sqlite3_prepare_v2(cpd.index, sql.c_str(), -1, stmt_cut, NULL);
+
+   if (result == SQLITE_OK)
+   {
+      sql  = "UPDATE ";
+      sql += table;
+      sql += " SET Line=Line+?2 WHERE Content=?1 AND Line>=?3";
+      result = sqlite3_prepare_v2(cpd.index, sql.c_str(), -1, stmt_shift, NULL);
+   }
+
+   return(result);
+}
+
+bool index_prepare_for_analysis(void)
+{
+   int result;
+   bool retval = true;
 
    result = sqlite3_prepare_v2(cpd.index,
-                               "SELECT rowid,Filename FROM Files",
+                               "INSERT INTO RefBlocks VALUES(?,?,?)",
                                -1,
-                               &stmt_iterate_files,
+                               &cpd.stmt_insert_ref_block,
                                NULL);
 
-   if (result == SQLITE_OK)
+   if (result == SQLITE_OK)
+   {
+      result |= sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Defs VALUES(?,?,?,?,?,?,?)",
+                                  -1,
+                                  &cpd.stmt_insert_definition,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result |= sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Decls VALUES(?,?,?,?,?,?,?)",
+                                  -1,
+                                  &cpd.stmt_insert_declaration,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_prepare_batch_insert("Defs", &cpd.stmt_insert_definitions);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_prepare_batch_insert("Decls", &cpd.stmt_insert_declarations);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "BEGIN",
+                                  -1,
+                                  &cpd.stmt_begin,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "COMMIT",
+                                  -1,
+                                  &cpd.stmt_commit,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SAVEPOINT file",
+                                  -1,
+                                  &cpd.stmt_savepoint,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "RELEASE file",
+                                  -1,
+                                  &cpd.stmt_release,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "ROLLBACK TO file",
+                                  -1,
+                                  &cpd.stmt_rollback,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Files VALUES(?,?,?,?,?,?)",
+                                  -1,
+                                  &cpd.stmt_insert_file,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "DELETE FROM RefBlocks WHERE Content=?",
+                                  -1,
+                                  &cpd.stmt_prune_refs,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "DELETE FROM Defs WHERE Content=?",
+                                  -1,
+                                  &cpd.stmt_prune_defs,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "DELETE FROM Decls WHERE Content=?",
+                                  -1,
+                                  &cpd.stmt_prune_decls,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "UPDATE Files SET Digest=?,Size=?,Mtime=?,Inode=?,Content=? WHERE Filename=?",
+                                  -1,
+                                  &cpd.stmt_change_digest,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT rowid,Digest,Size,Mtime,Inode,Content FROM Files WHERE Filename=?",
+                                  -1,
+                                  &cpd.stmt_lookup_file,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT rowid FROM Contents WHERE Digest=? AND Lang=?",
+                                  -1,
+                                  &cpd.stmt_lookup_content,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Contents VALUES(?,?)",
+                                  -1,
+                                  &cpd.stmt_insert_content,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT 1 FROM Files WHERE Content=?1 AND rowid<>?2 LIMIT 1",
+                                  -1,
+                                  &cpd.stmt_content_used,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "DELETE FROM Contents WHERE rowid=?",
+                                  -1,
+                                  &cpd.stmt_delete_content,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT Line,Lines,Digest FROM Regions WHERE Content=?1 AND "
+                                  "(SELECT Lang FROM Contents WHERE rowid=?1)=?2 ORDER BY Line",
+                                  -1,
+                                  &cpd.stmt_lookup_regions,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Regions VALUES(?,?,?,?)",
+                                  -1,
+                                  &cpd.stmt_insert_region,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "DELETE FROM Regions WHERE Content=?",
+                                  -1,
+                                  &cpd.stmt_prune_regions,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "UPDATE Contents SET Digest=? WHERE rowid=?",
+                                  -1,
+                                  &cpd.stmt_change_content,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT Identifier,Refs FROM RefBlocks WHERE Content=?",
+                                  -1,
+                                  &cpd.stmt_lookup_ref_blocks,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_prepare_window("Defs", &cpd.stmt_cut_defs, &cpd.stmt_shift_defs);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_prepare_window("Decls", &cpd.stmt_cut_decls, &cpd.stmt_shift_decls);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_prepare_window("Calls", &cpd.stmt_cut_calls, &cpd.stmt_shift_calls);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Calls VALUES(?,?,?,?,?,?,?,?)",
+                                  -1,
+                                  &cpd.stmt_insert_call,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Changes VALUES(?,?)",
+                                  -1,
+                                  &cpd.stmt_insert_change,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  INDEX_TRIM_CHANGES,
+                                  -1,
+                                  &cpd.stmt_trim_changes,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "DELETE FROM Calls WHERE Content=?",
+                                  -1,
+                                  &cpd.stmt_prune_calls,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT rowid FROM Scopes WHERE Scope=?",
+                                  -1,
+                                  &cpd.stmt_lookup_scope,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Scopes VALUES(?)",
+                                  -1,
+                                  &cpd.stmt_insert_scope,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT rowid FROM Identifiers WHERE Identifier=?",
+                                  -1,
+                                  &cpd.stmt_find_identifier,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Identifiers VALUES(?)",
+                                  -1,
+                                  &cpd.stmt_insert_identifier,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT OR IGNORE INTO Trigrams VALUES(?,?)",
+                                  -1,
+                                  &cpd.stmt_insert_trigram,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_bloom_prepare();
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_prepare_for_analysis: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      retval = false;
+   }
+
+   return retval;
+}
+
+static int index_commit(void);
+
+/**
+ * Create the lookup and pruning indexes. A new index is built without them
+ * and they are created once all entries are in, after that they are
+ * maintained by every update. The definitions and declarations, which
+ * ranked lookups read first, are covered by their Identifier index. The
+ * reference blocks of an identifier come by content from theirs, as limited
+ * lookups want them. The Content indexes also find the entry at a position
+ * for --at.
+ */
+static int index_create_indexes(void)
+{
+   char *errmsg = NULL;
+   UINT64 start = stage_clock();
+   int result;
+
+   result = sqlite3_exec(
+      cpd.index,
+      "CREATE INDEX IF NOT EXISTS RefBlocksIdentifier ON RefBlocks(Identifier, Content);"
+      "CREATE INDEX IF NOT EXISTS DefsIdentifier ON Defs(Identifier, Content, Line, ColumnStart, Scope, Type);"
+      "CREATE INDEX IF NOT EXISTS DeclsIdentifier ON Decls(Identifier, Content, Line, ColumnStart, Scope, Type);"
+      "CREATE INDEX IF NOT EXISTS RefBlocksContent ON RefBlocks(Content);"
+      "CREATE INDEX IF NOT EXISTS DefsContent ON Defs(Content, Line, ColumnStart, ColumnEnd);"
+      "CREATE INDEX IF NOT EXISTS DeclsContent ON Decls(Content, Line, ColumnStart, ColumnEnd);"
+      "CREATE INDEX IF NOT EXISTS CallsIdentifier ON Calls(Identifier);"
+      "CREATE INDEX IF NOT EXISTS CallsCaller ON Calls(Caller);"
+      "CREATE INDEX IF NOT EXISTS CallsContent ON Calls(Content);",
+      NULL,
+      NULL,
+      &errmsg);
+
+   if (errmsg != NULL)
+   {
+      LOG_FMT(LERR, "index_create_indexes: %s\n", errmsg);
+   }
+   sqlite3_free(errmsg);
+   stats_create_indexes(stage_clock() - start);
+
+   return result;
+}
+
+/* Commit the last files and create the lookup indexes, false on an error */
+bool index_end_analysis(void)
+{
+   int result = index_commit();
+
+   if ((result == SQLITE_OK) && !cpd.partial)
+   {
+      result = index_create_indexes();
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_end_analysis: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+   }
+
+   (void) sqlite3_finalize(cpd.stmt_insert_ref_block);
+   (void) sqlite3_finalize(cpd.stmt_insert_definition);
+   (void) sqlite3_finalize(cpd.stmt_insert_declaration);
+   (void) sqlite3_finalize(cpd.stmt_insert_definitions);
+   (void) sqlite3_finalize(cpd.stmt_insert_declarations);
+   (void) sqlite3_finalize(cpd.stmt_begin);
+   (void) sqlite3_finalize(cpd.stmt_commit);
+   (void) sqlite3_finalize(cpd.stmt_savepoint);
+   (void) sqlite3_finalize(cpd.stmt_release);
+   (void) sqlite3_finalize(cpd.stmt_rollback);
+   (void) sqlite3_finalize(cpd.stmt_insert_file);
+   (void) sqlite3_finalize(cpd.stmt_prune_refs);
+   (void) sqlite3_finalize(cpd.stmt_prune_defs);
+   (void) sqlite3_finalize(cpd.stmt_prune_decls);
+   (void) sqlite3_finalize(cpd.stmt_change_digest);
+   (void) sqlite3_finalize(cpd.stmt_lookup_file);
+   (void) sqlite3_finalize(cpd.stmt_lookup_content);
+   (void) sqlite3_finalize(cpd.stmt_insert_content);
+   (void) sqlite3_finalize(cpd.stmt_content_used);
+   (void) sqlite3_finalize(cpd.stmt_delete_content);
+   (void) sqlite3_finalize(cpd.stmt_lookup_regions);
+   (void) sqlite3_finalize(cpd.stmt_insert_region);
+   (void) sqlite3_finalize(cpd.stmt_prune_regions);
+   (void) sqlite3_finalize(cpd.stmt_change_content);
+   (void) sqlite3_finalize(cpd.stmt_lookup_ref_blocks);
+   (void) sqlite3_finalize(cpd.stmt_cut_defs);
+   (void) sqlite3_finalize(cpd.stmt_cut_decls);
+   (void) sqlite3_finalize(cpd.stmt_shift_defs);
+   (void) sqlite3_finalize(cpd.stmt_shift_decls);
+   (void) sqlite3_finalize(cpd.stmt_insert_call);
+   (void) sqlite3_finalize(cpd.stmt_prune_calls);
+   (void) sqlite3_finalize(cpd.stmt_insert_change);
+   (void) sqlite3_finalize(cpd.stmt_trim_changes);
+   (void) sqlite3_finalize(cpd.stmt_cut_calls);
+   (void) sqlite3_finalize(cpd.stmt_shift_calls);
+   (void) sqlite3_finalize(cpd.stmt_lookup_scope);
+   (void) sqlite3_finalize(cpd.stmt_insert_scope);
+   (void) sqlite3_finalize(cpd.stmt_find_identifier);
+   (void) sqlite3_finalize(cpd.stmt_insert_identifier);
+   (void) sqlite3_finalize(cpd.stmt_insert_trigram);
+   cpd.scope_rows.clear();
+   cpd.identifier_rows.clear();
+
+   return(result == SQLITE_OK);
+}
+
+/**
+ * Finish an index that merge_index() added partial indexes to: trim the
+ * Changes table, size the Bloom filter for all the identifiers and create
+ * the lookup indexes, unless the merged index is --partial too
+ */
+bool index_end_merge(void)
+{
+   int result = sqlite3_exec(cpd.index, INDEX_TRIM_CHANGES, NULL, NULL, NULL);
+
+   if (result == SQLITE_OK)
+   {
+      result = index_bloom_prepare();
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_bloom_rebuild();
+   }
+
+   if (result == SQLITE_OK)
+   {
+      cpd.bloom.changed = true;
+      result = index_bloom_store();
+   }
+
+   if ((result == SQLITE_OK) && !cpd.partial)
+   {
+      result = index_create_indexes();
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_end_merge: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      return(false);
+   }
+
+   return(true);
+}
+
+/**
+ * Bind the stat information of a file, starting at parameter idx. A racy
+ * stat is stored with a size no file has, so the next run reads the file
+ * again instead of skipping it.
+ */
+static int index_bind_stat(sqlite3_stmt *stmt, int idx, const file_stat& stat)
+{
+   int result;
+
+   result = sqlite3_bind_int64(stmt, idx, stat.racy ? -1 : (sqlite3_int64) stat.size);
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(stmt, idx + 1, stat.mtime);
+   }
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(stmt, idx + 2, (sqlite3_int64) stat.inode);
+   }
+
+   return result;
+}
+
+/* Read the stat information of a file, starting at column idx */
+static void index_column_stat(sqlite3_stmt *stmt, int idx, file_stat& stat)
+{
+   stat.size  = (UINT64) sqlite3_column_int64(stmt, idx);
+   stat.mtime = sqlite3_column_int64(stmt, idx + 1);
+   stat.inode = (UINT64) sqlite3_column_int64(stmt, idx + 2);
+   stat.racy  = false;
+}
+
+static int index_insert_file(
+   fp_data& fpd,
+   sqlite3_int64 *filerow)
+{
+   int result;
+
+   result = sqlite3_bind_int64(cpd.stmt_insert_file,
+                               1,
+                               (sqlite3_int64) fpd.digest);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_text(cpd.stmt_insert_file,
+                                 2,
+                                 fpd.filename,
+                                 -1,
+                                 SQLITE_STATIC);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_bind_stat(cpd.stmt_insert_file, 3, fpd.stat);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_insert_file,
+                                  6,
+                                  fpd.contentrow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_insert_file);
+      if (result == SQLITE_DONE)
+      {
+         result = sqlite3_reset(cpd.stmt_insert_file);
+      }
+   }
+
+   *filerow = sqlite3_last_insert_rowid(cpd.index);
+
+   return result;
+}
+
+static int index_prune_entries(sqlite3_int64 contentrow)
+{
+   int result;
+
+   result = sqlite3_bind_int64(cpd.stmt_prune_refs,
+                               1,
+                               contentrow);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_prune_refs);
+      if (result == SQLITE_DONE)
+      {
+         result = sqlite3_reset(cpd.stmt_prune_refs);
+      }
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_prune_defs,
+                                  1,
+                                  contentrow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_prune_defs);
+      if (result == SQLITE_DONE)
+      {
+         result = sqlite3_reset(cpd.stmt_prune_defs);
+      }
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_prune_decls,
+                                  1,
+                                  contentrow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_prune_decls);
+      if (result == SQLITE_DONE)
+      {
+         result = sqlite3_reset(cpd.stmt_prune_decls);
+      }
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_prune_calls,
+                                  1,
+                                  contentrow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(cpd.stmt_prune_calls);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_prune_regions,
+                                  1,
+                                  contentrow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(cpd.stmt_prune_regions);
+   }
+
+   return result;
+}
+
+/**
+ * Delete a content with its entries once no file has it any more. Files
+ * with the same content share its entries.
+ */
+static int index_release_content(sqlite3_int64 contentrow)
+{
+   int result;
+   bool used = false;
+
+   result = sqlite3_bind_int64(cpd.stmt_content_used,
+                               1,
+                               contentrow);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_content_used,
+                                  2,
+                                  0);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_content_used);
+      used = (result == SQLITE_ROW);
+      if ((result == SQLITE_ROW) || (result == SQLITE_DONE))
+      {
+         result = sqlite3_reset(cpd.stmt_content_used);
+      }
+   }
+
+   if ((result == SQLITE_OK) && !used)
+   {
+      result = index_prune_entries(contentrow);
+
+      if (result == SQLITE_OK)
+      {
+         result = sqlite3_bind_int64(cpd.stmt_delete_content,
+                                     1,
+                                     contentrow);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_delete_content);
+      }
+   }
+
+   return result;
+}
+
+/**
+ * Delete the files in the temporary Pruned table, and the entries of the
+ * contents no other file has
+ */
+static int index_remove_pruned(const vector<sqlite3_int64>& filerows)
+{
+   int result;
+   sqlite3_stmt *stmt_insert_pruned = NULL;
+
+   result = index_commit();
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_exec(cpd.index,
+                            "BEGIN;"
+                            "CREATE TEMP TABLE Pruned(Filerow INTEGER PRIMARY KEY);",
+                            NULL,
+                            NULL,
+                            NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Pruned VALUES(?)",
+                                  -1,
+                                  &stmt_insert_pruned,
+                                  NULL);
+   }
+
+   for (size_t i = 0; (i < filerows.size()) && (result == SQLITE_OK); i++)
+   {
+      result = sqlite3_bind_int64(stmt_insert_pruned,
+                                  1,
+                                  filerows[i]);
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(stmt_insert_pruned);
+      }
+   }
+
+   (void) sqlite3_finalize(stmt_insert_pruned);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_exec(cpd.index,
+                            "CREATE TEMP TABLE Released(Content INTEGER PRIMARY KEY);"
+                            "INSERT OR IGNORE INTO Released SELECT Content FROM Files WHERE rowid IN (SELECT Filerow FROM Pruned);"
+                            "INSERT INTO Changes SELECT Filename,NULL FROM Files WHERE rowid IN (SELECT Filerow FROM Pruned);"
+                            INDEX_TRIM_CHANGES ";"
+                            "DELETE FROM Files WHERE rowid IN (SELECT Filerow FROM Pruned);"
+                            "DELETE FROM Released WHERE EXISTS (SELECT 1 FROM Files WHERE Files.Content=Released.Content);"
+                            "DELETE FROM RefBlocks WHERE Content IN (SELECT Content FROM Released);"
+                            "DELETE FROM Defs WHERE Content IN (SELECT Content FROM Released);"
+                            "DELETE FROM Decls WHERE Content IN (SELECT Content FROM Released);"
+                            "DELETE FROM Calls WHERE Content IN (SELECT Content FROM Released);"
+                            "DELETE FROM Regions WHERE Content IN (SELECT Content FROM Released);"
+                            "DELETE FROM Contents WHERE rowid IN (SELECT Content FROM Released);"
+                            "DROP TABLE Pruned;"
+                            "DROP TABLE Released;"
+                            "COMMIT;",
+                            NULL,
+                            NULL,
+                            NULL);
+   }
+
+   if (result != SQLITE_OK)
+   {
+      (void) sqlite3_exec(cpd.index, "ROLLBACK", NULL, NULL, NULL);
+   }
+
+   return result;
+}
+
+/**
+ * Remove the files that no longer exist from the index. The files are
+ * checked using a number of threads, slow file systems take their time.
+ *
+ * @param jobs    Number of threads checking the files
+ * @param listed  If not NULL, the complete list of source files. All
+ *                others are removed without checking the file system.
+ */
+bool index_prune_files(int jobs, const deque<string> *listed)
+{
+   int result;
+   bool retval = true;
+   sqlite3_stmt *stmt_iterate_files;
+   vector<sqlite3_int64> filerows;
+   vector<string> filenames;
+   vector<char> keep;
+   vector<sqlite3_int64> pruned;
+
+   result = sqlite3_prepare_v2(cpd.index,
+                               "SELECT rowid,Filename FROM Files",
+                               -1,
+                               &stmt_iterate_files,
+                               NULL);
+
+   if (result == SQLITE_OK)
+   {
+      while ((result = sqlite3_step(stmt_iterate_files)) == SQLITE_ROW)
+      {
+         filerows.push_back(sqlite3_column_int64(stmt_iterate_files, 0));
+         filenames.push_back((const char *) sqlite3_column_text(stmt_iterate_files, 1));
+      }
+      if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+   }
+
+   (void) sqlite3_finalize(stmt_iterate_files);
+
+   if (result == SQLITE_OK)
+   {
+      if (listed != NULL)
+      {
+         unordered_set<string> names(listed->begin(), listed->end());
+
+         keep.resize(filenames.size());
+         for (size_t i = 0; i < filenames.size(); i++)
+         {
+            keep[i] = (names.count(filenames[i]) != 0);
+         }
+      }
+      else
+      {
+         files_exist(filenames, keep, jobs);
+      }
+
+      for (size_t i = 0; i < filenames.size(); i++)
+      {
+         if (!keep[i])
+         {
+            LOG_FMT(LNOTE, "File %s at filerow %" PRId64 " %s, removed from index\n",
+                    filenames[i].c_str(), (int64_t) filerows[i],
+                    (listed != NULL) ? "is not listed" : "does not exist");
+            pruned.push_back(filerows[i]);
+         }
+      }
+
+      if (!pruned.empty())
+      {
+         result = index_remove_pruned(pruned);
+      }
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_prune_files: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      retval = false;
+   }
+
+   return retval;
+}
+
+/**
+ * Remove the named files and their entries from the index, names that are
+ * not in it are ignored.
+ */
+bool index_remove_files(const vector<string>& filenames)
+{
+   int result;
+   bool retval = true;
+   vector<sqlite3_int64> pruned;
+   sqlite3_stmt *stmt_find_file = NULL;
+
+   result = sqlite3_prepare_v2(cpd.index,
+                               "SELECT rowid FROM Files WHERE Filename=?",
+                               -1,
+                               &stmt_find_file,
+                               NULL);
+
+   for (size_t i = 0; (i < filenames.size()) && (result == SQLITE_OK); i++)
+   {
+      result = sqlite3_bind_text(stmt_find_file,
+                                 1,
+                                 filenames[i].c_str(),
+                                 -1,
+                                 SQLITE_STATIC);
+
+      if (result == SQLITE_OK)
+      {
+         result = sqlite3_step(stmt_find_file);
+         if (result == SQLITE_ROW)
+         {
+            LOG_FMT(LNOTE, "File %s was deleted, removed from index\n", filenames[i].c_str());
+            pruned.push_back(sqlite3_column_int64(stmt_find_file, 0));
+            result = SQLITE_DONE;
+         }
+         if (result == SQLITE_DONE)
+         {
+            result = sqlite3_reset(stmt_find_file);
+         }
+      }
+   }
+
+   (void) sqlite3_finalize(stmt_find_file);
+
+   if ((result == SQLITE_OK) && !pruned.empty())
+   {
+      result = index_remove_pruned(pruned);
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_remove_files: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      retval = false;
+   }
+
+   return retval;
+}
+
+/**
+ * Collect the names the open index has no file of, in the order given
+ */
+bool index_unknown_files(const vector<string>& filenames, vector<string>& unknown)
+{
+   int result;
+   sqlite3_stmt *stmt_find_file = NULL;
+
+   result = sqlite3_prepare_v2(cpd.index,
+                               "SELECT 1 FROM Files WHERE Filename=?",
+                               -1,
+                               &stmt_find_file,
+                               NULL);
+
+   for (size_t i = 0; (i < filenames.size()) && (result == SQLITE_OK); i++)
+   {
+      result = sqlite3_bind_text(stmt_find_file,
+                                 1,
+                                 filenames[i].c_str(),
+                                 -1,
+                                 SQLITE_STATIC);
+
+      if (result == SQLITE_OK)
+      {
+         result = sqlite3_step(stmt_find_file);
+         if (result == SQLITE_DONE)
+         {
+            unknown.push_back(filenames[i]);
+         }
+         if ((result == SQLITE_ROW) || (result == SQLITE_DONE))
+         {
+            result = sqlite3_reset(stmt_find_file);
+         }
+      }
+   }
+
+   (void) sqlite3_finalize(stmt_find_file);
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_unknown_files: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      return(false);
+   }
+
+   return(true);
+}
+
+/**
+ * Get the git commit recorded by index_set_git_commit(), empty if there is
+ * none. The Git table is only created by the first --git run.
+ */
+void index_git_commit(string& commit)
+{
+   sqlite3_stmt *stmt_git = NULL;
+
+   commit.clear();
+   if ((sqlite3_prepare_v2(cpd.index,
+                           "SELECT Revision FROM Git",
+                           -1,
+                           &stmt_git,
+                           NULL) == SQLITE_OK) &&
+       (sqlite3_step(stmt_git) == SQLITE_ROW) &&
+       (sqlite3_column_text(stmt_git, 0) != NULL))
+   {
+      commit = (const char *) sqlite3_column_text(stmt_git, 0);
+   }
+   (void) sqlite3_finalize(stmt_git);
+}
+
+/* Record the git commit the index is at */
+bool index_set_git_commit(const string& commit)
+{
+   int result;
+   sqlite3_stmt *stmt_git = NULL;
+
+   result = index_commit();
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_exec(cpd.index,
+                            "CREATE TABLE IF NOT EXISTS Git(Revision TEXT);"
+                            "DELETE FROM Git;",
+                            NULL,
+                            NULL,
+                            NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO Git VALUES(?)",
+                                  -1,
+                                  &stmt_git,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_text(stmt_git,
+                                 1,
+                                 commit.c_str(),
+                                 -1,
+                                 SQLITE_STATIC);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(stmt_git);
+   }
+
+   (void) sqlite3_finalize(stmt_git);
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_set_git_commit: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      return(false);
+   }
+
+   return(true);
+}
+
+/* Update the digest, stat information and content of an indexed file */
+static int index_replace_file(fp_data& fpd)
+{
+   int result;
+
+   result = sqlite3_bind_int64(cpd.stmt_change_digest,
+                               1,
+                               (sqlite3_int64) fpd.digest);
+
+   if (result == SQLITE_OK)
+   {
+      result = index_bind_stat(cpd.stmt_change_digest, 2, fpd.stat);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_change_digest,
+                                  5,
+                                  fpd.contentrow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_text(cpd.stmt_change_digest,
+                                 6,
+                                 fpd.filename,
+                                 -1,
+                                 SQLITE_STATIC);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_change_digest);
+      if (result == SQLITE_DONE)
+      {
+         result = sqlite3_reset(cpd.stmt_change_digest);
+      }
+   }
+
+   return result;
+}
+
+/**
+ * Returns true if the stat information of the file matches the index, so
+ * the file doesn't even need to be read.
+ */
+bool index_file_unchanged(fp_data& fpd)
+{
+   int result;
+   bool retval = false;
+
+   result = sqlite3_bind_text(cpd.stmt_lookup_file,
+                              1,
+                              fpd.filename,
+                              -1,
+                              SQLITE_STATIC);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_lookup_file);
+   }
+
+   if (result == SQLITE_ROW)
+   {
+      file_stat stat;
+
+      index_column_stat(cpd.stmt_lookup_file, 2, stat);
+      if (stat == fpd.stat)
+      {
+         LOG_FMT(LNOTE, "File %s is unchanged since it was indexed\n", fpd.filename);
+         retval = true;
+      }
+   }
+
+   (void) sqlite3_reset(cpd.stmt_lookup_file);
+
+   return retval;
+}
+
+/* Commit the files stored since the last commit */
+static int index_commit(void)
+{
+   int result = SQLITE_OK;
+
+   if (cpd.in_transaction)
+   {
+      UINT64 start = stage_clock();
+
+      LOG_FMT(LNOTE, "Committing %d files with %d entries\n", cpd.pending_files, cpd.pending_entries);
+      result = index_bloom_store();
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_trim_changes);
+      }
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_commit);
+      }
+      stats_commit(stage_clock() - start);
+      cpd.in_transaction = (sqlite3_get_autocommit(cpd.index) == 0);
+   }
+   if (result != SQLITE_OK)
+   {
+      cpd.failed_files += cpd.pending_files;
+   }
+   cpd.pending_files = 0;
+   cpd.pending_entries = 0;
+
+   return result;
+}
+
+/* Open a savepoint for the file, starting a transaction if none is open */
+static int index_begin_file(fp_data& fpd)
+{
+   int result = SQLITE_OK;
+
+   if (!cpd.in_transaction)
+   {
+      result = index_run(cpd.stmt_begin);
+      cpd.in_transaction = (result == SQLITE_OK);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(cpd.stmt_savepoint);
+   }
+
+   return result;
+}
+
+/**
+ * Close the savepoint of a file. If the file could not be stored all its
+ * changes are undone, so the index keeps what it had for the file before.
+ * Commits once enough files or entries are pending.
+ *
+ * @param fpd     The file data
+ * @param stored  Whether all changes for the file were made
+ * @return        true if the file is stored
+ */
+static bool index_end_file(fp_data& fpd, bool stored)
+{
+   int result = SQLITE_OK;
+
+   if (!stored)
+   {
+      LOG_FMT(LWARN, "File %s could not be stored, its previous index entries are kept\n", fpd.filename);
+      result = index_run(cpd.stmt_rollback);
+
+      /* Any scope and identifier rows added for the file are gone as well */
+      cpd.scope_rows.clear();
+      cpd.identifier_rows.clear();
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(cpd.stmt_release);
+   }
+
+   /* Some errors roll back the whole transaction, with the files pending in it */
+   if (cpd.in_transaction && (sqlite3_get_autocommit(cpd.index) != 0))
+   {
+      cpd.failed_files   += cpd.pending_files;
+      cpd.pending_files   = 0;
+      cpd.pending_entries = 0;
+   }
+   cpd.in_transaction = (sqlite3_get_autocommit(cpd.index) == 0);
+
+   if (result == SQLITE_OK)
+   {
+      cpd.pending_files++;
+      cpd.pending_entries += (int) fpd.entries.size();
+
+      if (((cpd.commit_files > 0) && (cpd.pending_files >= cpd.commit_files)) ||
+          ((cpd.commit_entries > 0) && (cpd.pending_entries >= cpd.commit_entries)))
+      {
+         result = index_commit();
+      }
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_end_file: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      stored = false;
+   }
+
+   if (!stored)
+   {
+      cpd.failed_files++;
+   }
+
+   return stored;
+}
+
+/**
+ * Get the row of the content with the digest and language of the file.
+ *
+ * @param found  Set if a file had that content before
+ */
+static int index_find_content(fp_data& fpd, bool *found)
+{
+   int result;
+
+   *found = false;
+
+   result = sqlite3_bind_int64(cpd.stmt_lookup_content,
+                               1,
+                               (sqlite3_int64) fpd.digest);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int(cpd.stmt_lookup_content,
+                                2,
+                                fpd.lang_flags);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_lookup_content);
+      if (result == SQLITE_ROW)
+      {
+         fpd.contentrow = sqlite3_column_int64(cpd.stmt_lookup_content, 0);
+         *found = true;
+         result = SQLITE_DONE;
+      }
+      if (result == SQLITE_DONE)
+      {
+         result = sqlite3_reset(cpd.stmt_lookup_content);
+      }
+   }
+
+   return result;
+}
+
+/* Add a content with the digest and language of the file */
+static int index_add_content(fp_data& fpd)
+{
+   int result;
+
+   result = sqlite3_bind_int64(cpd.stmt_insert_content,
+                               1,
+                               (sqlite3_int64) fpd.digest);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int(cpd.stmt_insert_content,
+                                2,
+                                fpd.lang_flags);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(cpd.stmt_insert_content);
+   }
+
+   fpd.contentrow = sqlite3_last_insert_rowid(cpd.index);
+
+   return result;
+}
+
+/**
+ * Get the row of the content of the file, adding it if no file had that
+ * content before.
+ *
+ * @param added  Set if the content is new, so it needs analysis
+ */
+static int index_content_row(fp_data& fpd, bool *added)
+{
+   int result;
+   bool found;
+
+   result = index_find_content(fpd, &found);
+   *added = !found;
+
+   if ((result == SQLITE_OK) && *added)
+   {
+      result = index_add_content(fpd);
+   }
+
+   return result;
+}
+
+/**
+ * Only analyze the changed regions of a file whose old content has them and
+ * belongs to no other file. The content then gets the new digest and keeps
+ * the entries of the unchanged regions, see region_window().
+ */
+static int index_plan_window(fp_data& fpd, sqlite3_int64 filerow, sqlite3_int64 old_content)
+{
+   int result;
+   bool shared = false;
+   vector<file_region> old;
+
+   result = sqlite3_bind_int64(cpd.stmt_content_used,
+                               1,
+                               old_content);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_content_used,
+                                  2,
+                                  filerow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_content_used);
+      shared = (result == SQLITE_ROW);
+      if ((result == SQLITE_ROW) || (result == SQLITE_DONE))
+      {
+         result = sqlite3_reset(cpd.stmt_content_used);
+      }
+   }
+
+   if ((result == SQLITE_OK) && !shared)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_lookup_regions,
+                                  1,
+                                  old_content);
+
+      if (result == SQLITE_OK)
+      {
+         result = sqlite3_bind_int(cpd.stmt_lookup_regions,
+                                   2,
+                                   fpd.lang_flags);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         while ((result = sqlite3_step(cpd.stmt_lookup_regions)) == SQLITE_ROW)
+         {
+            file_region region;
+
+            region.line   = sqlite3_column_int(cpd.stmt_lookup_regions, 0);
+            region.lines  = sqlite3_column_int(cpd.stmt_lookup_regions, 1);
+            region.digest = (digest_t) sqlite3_column_int64(cpd.stmt_lookup_regions, 2);
+            old.push_back(region);
+         }
+         if (result == SQLITE_DONE)
+         {
+            result = sqlite3_reset(cpd.stmt_lookup_regions);
+         }
+      }
+   }
+
+   if ((result == SQLITE_OK) && !shared && region_window(fpd, old))
+   {
+      result = sqlite3_bind_int64(cpd.stmt_change_content,
+                                  1,
+                                  (sqlite3_int64) fpd.digest);
+
+      if (result == SQLITE_OK)
+      {
+         result = sqlite3_bind_int64(cpd.stmt_change_content,
+                                     2,
+                                     old_content);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_change_content);
+      }
+
+      fpd.contentrow = old_content;
+   }
+
+   return result;
+}
+
+/**
+ * Record that a file was stored with the content it has now, for the
+ * readers that follow the changes, see index_read_changes()
+ */
+static int index_log_change(fp_data& fpd)
+{
+   int result;
+
+   result = sqlite3_bind_text(cpd.stmt_insert_change,
+                              1,
+                              fpd.filename,
+                              -1,
+                              SQLITE_STATIC);
+   result |= sqlite3_bind_int64(cpd.stmt_insert_change,
+                                2,
+                                fpd.contentrow);
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(cpd.stmt_insert_change);
+   }
+
+   return result;
+}
+
+/**
+ * Returns true if the file needs to be analyzed. A file whose content was
+ * already analyzed in the same language, under any name, is linked to the
+ * entries stored for it instead.
+ */
+bool index_prepare_for_file(fp_data& fpd)
+{
+   int result;
+   bool retval = true;
+   bool in_file;
+   bool added = false;
+   bool linked = false;
+   sqlite3_int64 filerow = 0;
+
+   result = index_begin_file(fpd);
+   in_file = (result == SQLITE_OK);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_text(cpd.stmt_lookup_file,
+                                 1,
+                                 fpd.filename,
+                                 -1,
+                                 SQLITE_STATIC);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(cpd.stmt_lookup_file);
+   }
+
+   if (result == SQLITE_ROW)
+   {
+      filerow = sqlite3_column_int64(cpd.stmt_lookup_file, 0);
+      digest_t ingest =
+         (digest_t) sqlite3_column_int64(cpd.stmt_lookup_file, 1);
+      sqlite3_int64 old_content = sqlite3_column_int64(cpd.stmt_lookup_file, 5);
+      file_stat stat;
+
+      index_column_stat(cpd.stmt_lookup_file, 2, stat);
+      (void) sqlite3_reset(cpd.stmt_lookup_file);
+
+      if (fpd.digest == ingest)
+      {
+         LOG_FMT(LNOTE, "File %s(%016" PRIx64 ") exists in index at filerow %" PRId64 " with same digest\n", fpd.filename, (uint64_t) fpd.digest, (int64_t) filerow);
+         result = SQLITE_OK;
+         retval = false;
+         fpd.contentrow = old_content;
+
+         /* Remember the new stat information to skip the file next time */
+         if (!(stat == fpd.stat))
+         {
+            result = index_replace_file(fpd);
+            if (result == SQLITE_OK)
+            {
+               result = index_log_change(fpd);
+            }
+         }
+      }
+      else
+      {
+         LOG_FMT(LNOTE, "File %s(%016" PRIx64 ") exists in index at filerow %" PRId64 " with different digest (%016" PRIx64 ")\n", fpd.filename, (uint64_t) fpd.digest, (int64_t) filerow, (uint64_t) ingest);
+         result = index_find_content(fpd, &linked);
+         added = !linked;
+         if ((result == SQLITE_OK) && added && region_candidate(fpd))
+         {
+            result = index_plan_window(fpd, filerow, old_content);
+         }
+         if ((result == SQLITE_OK) && added && !fpd.window.partial)
+         {
+            result = index_add_content(fpd);
+         }
+         if (result == SQLITE_OK)
+         {
+            result = index_replace_file(fpd);
+         }
+         if (result == SQLITE_OK)
+         {
+            result = index_log_change(fpd);
+         }
+
+         /* A content updated in place still is the file's */
+         if ((result == SQLITE_OK) && !fpd.window.partial)
+         {
+            result = index_release_content(old_content);
+         }
+         retval = added;
+         linked = !added;
+      }
+   }
+   else if (result == SQLITE_DONE)
+   {
+      (void) sqlite3_reset(cpd.stmt_lookup_file);
+      result = index_content_row(fpd, &added);
+      if (result == SQLITE_OK)
+      {
+         result = index_insert_file(fpd, &filerow);
+      }
+      if (result == SQLITE_OK)
+      {
+         result = index_log_change(fpd);
+      }
+      LOG_FMT(LNOTE, "File %s(%016" PRIx64 ") does not exist in index, inserted at filerow %" PRId64 "\n", fpd.filename, (uint64_t) fpd.digest, (int64_t) filerow);
+      retval = added;
+      linked = !added;
+   }
+
+   if ((result == SQLITE_OK) && linked)
+   {
+      LOG_FMT(LNOTE, "File %s has the content of an indexed file, linked to content row %" PRId64 "\n", fpd.filename, (int64_t) fpd.contentrow);
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_prepare_for_file: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      retval = false;
+
+      /* index_end_file() counts it otherwise */
+      if (!in_file)
+      {
+         cpd.failed_files++;
+      }
+   }
+
+   (void) sqlite3_reset(cpd.stmt_lookup_file);
+
+   /* Without analysis there is nothing more to store for the file */
+   if (!retval && in_file)
+   {
+      (void) index_end_file(fpd, result == SQLITE_OK);
+   }
+
+   return retval;
+}
+
+/**
+ * Get the rowid of a name in a table of unique names, adding it if needed.
+ *
+ * @param stmt_find    Selects the rowid of the bound name
+ * @param stmt_insert  Inserts the bound name
+ * @param cache        Rows already looked up
+ * @param name         The name
+ * @param row          Gets the rowid
+ * @param added        Set if the name was not in the table, may be NULL
+ */
+static int index_name_row(
+   sqlite3_stmt *stmt_find,
+   sqlite3_stmt *stmt_insert,
+   unordered_map<string, sqlite3_int64>& cache,
+   const string& name,
+   sqlite3_int64 *row,
+   bool *added)
+{
+   int result = SQLITE_OK;
+   unordered_map<string, sqlite3_int64>::iterator it = cache.find(name);
+
+   if (added != NULL)
+   {
+      *added = false;
+   }
+
+   if (it != cache.end())
+   {
+      *row = it->second;
+      return result;
+   }
+
+   result = sqlite3_bind_text(stmt_find,
+                              1,
+                              name.data(),
+                              (int) name.size(),
+                              SQLITE_STATIC);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(stmt_find);
+   }
+
+   if (result == SQLITE_ROW)
+   {
+      *row = sqlite3_column_int64(stmt_find, 0);
+      result = SQLITE_OK;
+   }
+   else if (result == SQLITE_DONE)
+   {
+      result = sqlite3_bind_text(stmt_insert,
+                                 1,
+                                 name.data(),
+                                 (int) name.size(),
+                                 SQLITE_STATIC);
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(stmt_insert);
+      }
+
+      *row = sqlite3_last_insert_rowid(cpd.index);
+      if ((result == SQLITE_OK) && (added != NULL))
+      {
+         *added = true;
+      }
+   }
+
+   (void) sqlite3_reset(stmt_find);
+
+   if (result == SQLITE_OK)
+   {
+      cache[name] = *row;
+   }
+
+   return result;
+}
+
+/* Get the rowid of a scope in the Scopes table, adding it if needed */
+static int index_scope_row(const string& scope, sqlite3_int64 *scoperow)
+{
+   return(index_name_row(cpd.stmt_lookup_scope,
+                         cpd.stmt_insert_scope,
+                         cpd.scope_rows,
+                         scope,
+                         scoperow,
+                         NULL));
+}
+
+/* A trigram as an integer, the three bytes in order */
+static inline sqlite3_int64 index_trigram(const char *text)
+{
+   return(((sqlite3_int64) (UINT8) text[0] << 16) |
+          ((sqlite3_int64) (UINT8) text[1] << 8) |
+          (sqlite3_int64) (UINT8) text[2]);
+}
+
+/**
+ * Make sure an identifier is in the Identifiers table. A new identifier
+ * also gets its trigrams, so wildcard lookups can find it by any part, and
+ * is added to the Bloom filter.
+ */
+static int index_identifier_row(const string& identifier, sqlite3_int64 *idrow)
+{
+   bool added;
+   int result = index_name_row(cpd.stmt_find_identifier,
+                               cpd.stmt_insert_identifier,
+                               cpd.identifier_rows,
+                               identifier,
+                               idrow,
+                               &added);
+
+   if (added && (result == SQLITE_OK))
+   {
+      cpd.bloom.identifiers++;
+      cpd.bloom.changed = true;
+      if ((sqlite3_int64) cpd.bloom.bits.size() * 8 >= cpd.bloom.identifiers * INDEX_BLOOM_BITS_PER_ID)
+      {
+         (void) index_bloom_bits(cpd.bloom.bits, identifier.data(), identifier.size(), true);
+      }
+   }
+
+   for (size_t i = 0; added && (result == SQLITE_OK) && (i + 3 <= identifier.size()); i++)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_insert_trigram,
+                                  1,
+                                  index_trigram(identifier.data() + i));
+      result |= sqlite3_bind_int64(cpd.stmt_insert_trigram,
+                                   2,
+                                   *idrow);
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_insert_trigram);
+      }
+   }
+
+   return result;
+}
+
+/**
+ * The references of an identifier in a content are stored together, as a
+ * block in the RefBlocks table. The references are sorted by position and
+ * each is written as varints: the line as the distance to the line of the
+ * one before, the column as the distance to its column on the same line,
+ * the length and the type in INDEX_REF_TYPE_BITS below it, and the scope
+ * row as a zigzag delta.
+ */
+#define INDEX_REF_TYPE_BITS   4
+
+/* IT_NAMESPACE is the last id_type, a type more needs another bit */
+static_assert(IT_NAMESPACE < (1 << INDEX_REF_TYPE_BITS),
+              "id_type doesn't fit into INDEX_REF_TYPE_BITS, widen it and raise INDEX_VERSION");
+
+static void index_put_varint(vector<UINT8>& out, UINT64 value)
+{
+   while (value >= 0x80)
+   {
+      out.push_back((UINT8) (value | 0x80));
+      value >>= 7;
+   }
+   out.push_back((UINT8) value);
+}
+
+/* false at the end of the data */
+static bool index_get_varint(const UINT8 *& pos, const UINT8 *end, UINT64& value)
+{
+   int shift = 0;
+
+   value = 0;
+   while ((pos < end) && (shift < 64))
+   {
+      value |= (UINT64) (*pos & 0x7f) << shift;
+      if ((*pos++ & 0x80) == 0)
+      {
+         return(true);
+      }
+      shift += 7;
+   }
+   return(false);
+}
+
+static UINT64 index_zigzag(INT64 value)
+{
+   return(((UINT64) value << 1) ^ (UINT64) (value >> 63));
+}
+
+static INT64 index_unzigzag(UINT64 value)
+{
+   return((INT64) (value >> 1) ^ -(INT64) (value & 1));
+}
+
+/* Order of the references in a block */
+struct block_ref_order
+{
+   bool operator()(const block_ref& a, const block_ref& b) const
+   {
+      return((a.line < b.line) ||
+             ((a.line == b.line) && (a.column_start < b.column_start)));
+   }
+};
+
+/* Write a block of references, sorting them first */
+void index_encode_refs(vector<block_ref>& refs, vector<UINT8>& block)
+{
+   UINT32 line = 0, column = 0;
+   sqlite3_int64 scope = 0;
+
+   sort(refs.begin(), refs.end(), block_ref_order());
+
+   block.clear();
+   for (size_t i = 0; i < refs.size(); i++)
+   {
+      const block_ref& ref = refs[i];
+
+      index_put_varint(block, ref.line - line);
+      index_put_varint(block, ref.column_start - ((ref.line == line) ? column : 0));
+      index_put_varint(block,
+                       (index_zigzag((INT64) ref.column_end - ref.column_start) << INDEX_REF_TYPE_BITS) |
+                       (UINT64) ref.type);
+      index_put_varint(block, index_zigzag(ref.scope - scope));
+      line   = ref.line;
+      column = ref.column_start;
+      scope  = ref.scope;
+   }
+}
+
+/* Add the references of a block to refs, false if it is damaged */
+bool index_decode_refs(const void *data, int size, vector<block_ref>& refs)
+{
+   const UINT8 *pos = (const UINT8 *) data;
+   const UINT8 *end = pos + ((data != NULL) ? size : 0);
+   block_ref ref;
+   UINT64 line, column, length, scope;
+
+   ref.line         = 0;
+   ref.column_start = 0;
+   ref.scope        = 0;
+   while (pos < end)
+   {
+      if (!index_get_varint(pos, end, line) || !index_get_varint(pos, end, column) ||
+          !index_get_varint(pos, end, length) || !index_get_varint(pos, end, scope))
+      {
+         return(false);
+      }
+      if (line != 0)
+      {
+         ref.column_start = 0;
+      }
+      ref.line         += (UINT32) line;
+      ref.column_start += (UINT32) column;
+      ref.column_end    = (UINT32) (ref.column_start +
+                                     index_unzigzag(length >> INDEX_REF_TYPE_BITS));
+      ref.type          = (id_type) (length & ((1 << INDEX_REF_TYPE_BITS) - 1));
+      ref.scope        += index_unzigzag(scope);
+      refs.push_back(ref);
+   }
+   return(true);
+}
+
+/* An entry with the rows of its scope and identifier */
+struct entry_row
+{
+   const index_entry *entry;
+   sqlite3_int64     scoperow;
+   sqlite3_int64     idrow;
+};
+
+/* Bind the 7 columns of an entry row, starting at parameter idx */
+static int index_bind_entry(
+   sqlite3_stmt *stmt,
+   int idx,
+   sqlite3_int64 contentrow,
+   const entry_row& row)
+{
+   int result;
+
+   result = sqlite3_bind_int64(stmt,
+                               idx,
+                               contentrow);
+   result |= sqlite3_bind_int64(stmt,
+                                idx + 1,
+                                row.entry->line);
+   result |= sqlite3_bind_int64(stmt,
+                                idx + 2,
+                                row.entry->column_start);
+   result |= sqlite3_bind_int64(stmt,
+                                idx + 3,
+                                row.scoperow);
+   result |= sqlite3_bind_int(stmt,
+                              idx + 4,
+                              (int) row.entry->type);
+   result |= sqlite3_bind_int64(stmt,
+                                idx + 5,
+                                row.idrow);
+   result |= sqlite3_bind_int64(stmt,
+                                idx + 6,
+                                row.entry->column_end);
+
+   return result;
+}
+
+/**
+ * Insert entries into one table, INDEX_BATCH_ROWS rows per step of
+ * stmt_batch and whatever is left one row at a time.
+ *
+ * @param rowids  If not NULL, gets the rowid of every row. The rows of a
+ *                step are given consecutive rowids, as there is no
+ *                AUTOINCREMENT and the largest rowid is far from the limit.
+ */
+static int index_insert_rows(
+   fp_data& fpd,
+   const vector<entry_row>& rows,
+   sqlite3_stmt *stmt_batch,
+   sqlite3_stmt *stmt_single,
+   vector<sqlite3_int64> *rowids)
+{
+   int result = SQLITE_OK;
+   size_t i = 0;
+
+   while ((result == SQLITE_OK) && (i < rows.size()))
+   {
+      sqlite3_stmt *stmt = stmt_single;
+      size_t count = 1;
+
+      if (rows.size() - i >= INDEX_BATCH_ROWS)
+      {
+         stmt = stmt_batch;
+         count = INDEX_BATCH_ROWS;
+      }
+
+      for (size_t j = 0; (j < count) && (result == SQLITE_OK); j++)
+      {
+         result = index_bind_entry(stmt,
+                                   (int) (j * 7) + 1,
+                                   fpd.contentrow,
+                                   rows[i + j]);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(stmt);
+      }
+
+      if ((result == SQLITE_OK) && (rowids != NULL))
+      {
+         sqlite3_int64 last = sqlite3_last_insert_rowid(cpd.index);
+
+         for (size_t j = count; j > 0; j--)
+         {
+            rowids->push_back(last - (sqlite3_int64) j + 1);
+         }
+      }
+
+      i += count;
+   }
+
+   return result;
+}
+
+/**
+ * Drop the entries of one table on the lines a window analyzed again, and
+ * move those after it by the lines added or removed
+ */
+static int index_update_window(
+   fp_data& fpd,
+   sqlite3_stmt *stmt_cut,
+   sqlite3_stmt *stmt_shift)
+{
+   int result;
+
+   result = sqlite3_bind_int64(stmt_cut, 1, fpd.contentrow);
+   result |= sqlite3_bind_int(stmt_cut, 2, fpd.window.keep_before);
+   result |= sqlite3_bind_int(stmt_cut, 3,
+                              (fpd.window.keep_from != 0) ? fpd.window.keep_from : INT_MAX);
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(stmt_cut);
+   }
+
+   if ((result == SQLITE_OK) && (fpd.window.keep_from != 0) && (fpd.window.shift != 0))
+   {
+      result = sqlite3_bind_int64(stmt_shift, 1, fpd.contentrow);
+      result |= sqlite3_bind_int(stmt_shift, 2, fpd.window.shift);
+      result |= sqlite3_bind_int(stmt_shift, 3, fpd.window.keep_from);
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(stmt_shift);
+      }
+   }
+
+   return result;
+}
+
+/**
+ * Store which function definition every call in a function body is made
+ * by, as the columns of the reference and the rowid of the definition
+ */
+static int index_insert_calls(
+   fp_data& fpd,
+   const vector<entry_row>& refs,
+   const vector<entry_row>& defs,
+   const vector<sqlite3_int64>& def_rows)
+{
+   int result = SQLITE_OK;
+   vector<sqlite3_int64> entry_rows(fpd.entries.size(), 0);
+
+   for (size_t i = 0; i < defs.size(); i++)
+   {
+      entry_rows[defs[i].entry - &fpd.entries[0]] = def_rows[i];
+   }
+
+   for (size_t i = 0; (i < refs.size()) && (result == SQLITE_OK); i++)
+   {
+      const index_entry *entry = refs[i].entry;
+
+      if ((entry->caller < 0) || (entry_rows[entry->caller] == 0))
+      {
+         continue;
+      }
+
+      result = index_bind_entry(cpd.stmt_insert_call, 1, fpd.contentrow, refs[i]);
+      result |= sqlite3_bind_int64(cpd.stmt_insert_call, 8, entry_rows[entry->caller]);
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_insert_call);
+      }
+   }
+
+   return result;
+}
+
+/**
+ * Take the references a content keeps outside of a window out of its
+ * blocks, moving those after it by the lines added or removed, and delete
+ * the blocks. index_insert_ref_blocks() stores them again.
+ */
+static int index_window_refs(
+   fp_data& fpd,
+   map<sqlite3_int64, vector<block_ref> >& blocks)
+{
+   vector<block_ref> refs;
+   int result;
+
+   result = sqlite3_bind_int64(cpd.stmt_lookup_ref_blocks, 1, fpd.contentrow);
+
+   while ((result == SQLITE_OK) &&
+          ((result = sqlite3_step(cpd.stmt_lookup_ref_blocks)) == SQLITE_ROW))
+   {
+      vector<block_ref>& kept = blocks[sqlite3_column_int64(cpd.stmt_lookup_ref_blocks, 0)];
+
+      refs.clear();
+      if (!index_decode_refs(sqlite3_column_blob(cpd.stmt_lookup_ref_blocks, 1),
+                             sqlite3_column_bytes(cpd.stmt_lookup_ref_blocks, 1),
+                             refs))
+      {
+         result = SQLITE_CORRUPT;
+         break;
+      }
+      for (size_t i = 0; i < refs.size(); i++)
+      {
+         if ((int) refs[i].line < fpd.window.keep_before)
+         {
+            kept.push_back(refs[i]);
+         }
+         else if ((fpd.window.keep_from != 0) && ((int) refs[i].line >= fpd.window.keep_from))
+         {
+            refs[i].line += fpd.window.shift;
+            kept.push_back(refs[i]);
+         }
+      }
+      result = SQLITE_OK;
+   }
+   if (result == SQLITE_DONE)
+   {
+      result = SQLITE_OK;
+   }
+   (void) sqlite3_reset(cpd.stmt_lookup_ref_blocks);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_prune_refs, 1, fpd.contentrow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_run(cpd.stmt_prune_refs);
+   }
+
+   return result;
+}
+
+/* Store the references of a content, a block per identifier */
+static int index_insert_ref_blocks(
+   fp_data& fpd,
+   const vector<entry_row>& refs,
+   map<sqlite3_int64, vector<block_ref> >& blocks)
+{
+   int result = SQLITE_OK;
+   vector<UINT8> block;
+
+   for (size_t i = 0; i < refs.size(); i++)
+   {
+      block_ref ref;
+
+      ref.line         = refs[i].entry->line;
+      ref.column_start = refs[i].entry->column_start;
+      ref.column_end   = refs[i].entry->column_end;
+      ref.type         = refs[i].entry->type;
+      ref.scope        = refs[i].scoperow;
+      blocks[refs[i].idrow].push_back(ref);
+   }
+
+   for (map<sqlite3_int64, vector<block_ref> >::iterator it = blocks.begin();
+        (it != blocks.end()) && (result == SQLITE_OK); ++it)
+   {
+      if (it->second.empty())
+      {
+         continue;
+      }
+      index_encode_refs(it->second, block);
+
+      result = sqlite3_bind_int64(cpd.stmt_insert_ref_block, 1, fpd.contentrow);
+      result |= sqlite3_bind_int64(cpd.stmt_insert_ref_block, 2, it->first);
+      result |= sqlite3_bind_blob(cpd.stmt_insert_ref_block, 3, &block[0], (int) block.size(),
+                                  SQLITE_STATIC);
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_insert_ref_block);
+      }
+   }
+
+   return result;
+}
+
+/* Store the regions found by find_regions() */
+static int index_insert_regions(fp_data& fpd)
+{
+   int result = SQLITE_OK;
+
+   for (size_t i = 0; (i < fpd.regions.size()) && (result == SQLITE_OK); i++)
+   {
+      result = sqlite3_bind_int64(cpd.stmt_insert_region, 1, fpd.contentrow);
+      result |= sqlite3_bind_int(cpd.stmt_insert_region, 2, fpd.regions[i].line);
+      result |= sqlite3_bind_int(cpd.stmt_insert_region, 3, fpd.regions[i].lines);
+      result |= sqlite3_bind_int64(cpd.stmt_insert_region, 4,
+                                   (sqlite3_int64) fpd.regions[i].digest);
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_insert_region);
+      }
+   }
+
+   return result;
+}
+
+/**
+ * Store the entries collected by output() for a file prepared with
+ * index_prepare_for_file(). Either all entries are stored or none.
+ */
+bool index_insert_entries(fp_data& fpd)
+{
+   int result = SQLITE_OK;
+   vector<sqlite3_int64> scope_rows(fpd.scopes.size(), 0);
+   vector<entry_row> refs, defs, decls;
+   vector<sqlite3_int64> def_rows;
+   map<sqlite3_int64, vector<block_ref> > blocks;
+
+   for (size_t i = 0; (i < fpd.entries.size()) && (result == SQLITE_OK); i++)
+   {
+      entry_row row;
+
+      row.entry = &fpd.entries[i];
+      row.idrow = 0;
+
+      sqlite3_int64& scoperow = scope_rows[row.entry->scope];
+      if (scoperow == 0)
+      {
+         result = index_scope_row(fpd.scopes[row.entry->scope], &scoperow);
+      }
+      row.scoperow = scoperow;
+
+      if (result == SQLITE_OK)
+      {
+         result = index_identifier_row(row.entry->identifier, &row.idrow);
+      }
+
+      if (row.entry->sub_type == IST_DEFINITION)
+         defs.push_back(row);
+      else if (row.entry->sub_type == IST_DECLARATION)
+         decls.push_back(row);
+      else
+         refs.push_back(row);
+   }
+
+   /* The content keeps the entries outside of a window */
+   if ((result == SQLITE_OK) && fpd.window.partial)
+   {
+      result = index_window_refs(fpd, blocks);
+
+      if (result == SQLITE_OK)
+      {
+         result = index_update_window(fpd, cpd.stmt_cut_defs, cpd.stmt_shift_defs);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         result = index_update_window(fpd, cpd.stmt_cut_decls, cpd.stmt_shift_decls);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         result = index_update_window(fpd, cpd.stmt_cut_calls, cpd.stmt_shift_calls);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         result = sqlite3_bind_int64(cpd.stmt_prune_regions, 1, fpd.contentrow);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         result = index_run(cpd.stmt_prune_regions);
+      }
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_insert_ref_blocks(fpd, refs, blocks);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_insert_rows(fpd, defs,
+                                 cpd.stmt_insert_definitions,
+                                 cpd.stmt_insert_definition,
+                                 &def_rows);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_insert_rows(fpd, decls,
+                                 cpd.stmt_insert_declarations,
+                                 cpd.stmt_insert_declaration,
+                                 NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_insert_calls(fpd, refs, defs, def_rows);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = index_insert_regions(fpd);
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_insert_entries: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+   }
+
+   return(index_end_file(fpd, result == SQLITE_OK));
+}
+
+/**
+ * Read the digest and stat information of every indexed file and which
+ * contents are analyzed, so worker threads can tell whether a file needs
+ * analysis without access to the index.
+ */
+bool index_load_files(indexed_file_map& files, indexed_content_set& contents)
+{
+   int result;
+   bool retval = true;
+   sqlite3_stmt *stmt_iterate_files;
+
+   result = sqlite3_prepare_v2(cpd.index,
+                               "SELECT Filename,Digest,Size,Mtime,Inode FROM Files",
+                               -1,
+                               &stmt_iterate_files,
+                               NULL);
+
+   if (result == SQLITE_OK)
+   {
+      while ((result = sqlite3_step(stmt_iterate_files)) == SQLITE_ROW)
+      {
+         const char *filename =
+            (const char *) sqlite3_column_text(stmt_iterate_files, 0);
+         indexed_file& file = files[filename];
+         file.digest = (digest_t) sqlite3_column_int64(stmt_iterate_files, 1);
+         index_column_stat(stmt_iterate_files, 2, file.stat);
+      }
+      if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+   }
+
+   (void) sqlite3_finalize(stmt_iterate_files);
+   stmt_iterate_files = NULL;
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT Digest,Lang FROM Contents",
+                                  -1,
+                                  &stmt_iterate_files,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      while ((result = sqlite3_step(stmt_iterate_files)) == SQLITE_ROW)
+      {
+         contents.insert(make_pair((digest_t) sqlite3_column_int64(stmt_iterate_files, 0),
+                                   sqlite3_column_int(stmt_iterate_files, 1)));
+      }
+      if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+   }
+
+   if (result != SQLITE_OK)
+   {
+      const char *errstr = sqlite3_errstr(result);
+      LOG_FMT(LERR, "index_load_files: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      retval = false;
+   }
+
+   (void) sqlite3_finalize(stmt_iterate_files);
+
+   return retval;
+}
+
+/* How a lookup finds the identifiers that match the pattern */
+enum lookup_kind
+{
+   LOOKUP_ALL,       // every entry, for a pattern of only *
+   LOOKUP_SCAN,      // test every identifier
+   LOOKUP_RANGE,     // a range of the identifiers, for a literal prefix
+   LOOKUP_TRIGRAMS,  // the identifiers having trigrams of the pattern
+};
+
+/**
+ * Get the literal text a GLOB pattern starts with and the first string
+ * after all strings with that prefix, so the lookup can use a range of the
+ * Identifiers table. Returns false if there is no usable prefix.
+ */
+static bool index_glob_range(const char *pattern, string& lower, string& upper)
+{
+   size_t len = strcspn(pattern, "*?[");
+
+   lower.assign(pattern, len);
+   upper = lower;
+
+   /* Drop trailing 0xff bytes, they can't be incremented */
+   while (!upper.empty() && ((UINT8) upper[upper.size() - 1] == 0xff))
+   {
+      upper.resize(upper.size() - 1);
+   }
+   if (upper.empty())
+   {
+      return(false);
+   }
+   upper[upper.size() - 1] = (char) ((UINT8) upper[upper.size() - 1] + 1);
+
+   return(true);
+}
+
+/**
+ * Get up to INDEX_LOOKUP_TRIGRAMS trigrams that every identifier matching
+ * a GLOB pattern contains, from the literal runs between wildcards.
+ * Returns false if the pattern has no literal run of 3 characters.
+ */
+static bool index_glob_trigrams(const char *pattern, vector<sqlite3_int64>& trigrams)
+{
+   vector<sqlite3_int64> all;
+   size_t run = 0;
+
+   for (size_t i = 0; ; i++)
+   {
+      char ch = pattern[i];
+
+      if ((ch == 0) || (ch == '*') || (ch == '?') || (ch == '['))
+      {
+         for (size_t j = i - run; j + 3 <= i; j++)
+         {
+            sqlite3_int64 trigram = index_trigram(pattern + j);
+
+            if (std::find(all.begin(), all.end(), trigram) == all.end())
+            {
+               all.push_back(trigram);
+            }
+         }
+         run = 0;
+
+         if (ch == 0)
+         {
+            break;
+         }
+         if (ch == '[')
+         {
+            /* Skip the character class, a ] right after [ or [^ is literal */
+            i++;
+            if (pattern[i] == '^')
+               i++;
+            if (pattern[i] == ']')
+               i++;
+            while ((pattern[i] != 0) && (pattern[i] != ']'))
+               i++;
+            if (pattern[i] == 0)
+               break;
+         }
+      }
+      else
+      {
+         run++;
+      }
+   }
+
+   /* Spread the ones used over the pattern */
+   trigrams.clear();
+   for (size_t i = 0; (i < INDEX_LOOKUP_TRIGRAMS) && (i < all.size()); i++)
+   {
+      size_t pick = (all.size() <= INDEX_LOOKUP_TRIGRAMS) ? i :
+                    i * (all.size() - 1) / (INDEX_LOOKUP_TRIGRAMS - 1);
+      trigrams.push_back(all[pick]);
+   }
+
+   return(!trigrams.empty());
+}
+
+/* Add the condition on the identifiers an entry of X has to match */
+static void index_lookup_where(string& sql, lookup_kind kind)
+{
+   char select[128];
+
+   /* Find the matching identifiers first, then their entries */
+   if (kind != LOOKUP_ALL)
+   {
+      sql += " WHERE X.Identifier IN (SELECT rowid FROM Identifiers WHERE Identifier GLOB ?1";
+   }
+   if (kind == LOOKUP_RANGE)
+   {
+      sql += " AND Identifier>=?2 AND Identifier<?3";
+   }
+   else if (kind == LOOKUP_TRIGRAMS)
+   {
+      sql += " AND rowid IN (";
+      for (int t = 0; t < INDEX_LOOKUP_TRIGRAMS; t++)
+      {
+         snprintf(select, sizeof(select), "%sSELECT Idrow FROM Trigrams WHERE Trigram=?%d",
+                  (t > 0) ? " INTERSECT " : "", t + 2);
+         sql += select;
+      }
+      sql += ")";
+   }
+   if (kind != LOOKUP_ALL)
+   {
+      sql += ")";
+   }
+}
+
+/**
+ * Get the lookup statement for a set of sub types, preparing it on first
+ * use. Declarations come first, then definitions, each in the order they
+ * were stored. The references are looked up on their own: for them the
+ * statement gives the blocks of the matching identifiers, with the file,
+ * the content and the identifier, see index_lookup_refs(). Unranked and
+ * limited they come by content.
+ *
+ * Ranked, the entries of the directory ?11 (?12 bytes long, NULL for
+ * none) come first, then those of the most recently modified files. The
+ * caller asks for one sub type at a time, see index_lookup_identifier().
+ * With a limit in ?10 only the best entries are kept while sorting.
+ *
+ * The pattern is ?1, LOOKUP_RANGE has the bounds in ?2 and ?3 and
+ * LOOKUP_TRIGRAMS has INDEX_LOOKUP_TRIGRAMS trigrams from ?2 on.
+ */
+static int index_lookup_statement(sqlite3 *db, sqlite3_stmt **stmts,
+                                  int sub_types, lookup_kind kind, bool ranked, bool limited,
+                                  sqlite3_stmt **stmt)
+{
+   static const struct
+   {
+      id_sub_type sub_type;
+      const char  *table;
+   } tables[] =
+   {
+      { IST_DECLARATION, "Decls" },
+      { IST_DEFINITION,  "Defs"  },
+   };
+   static const char near_columns[] =
+      ",substr(Files.Filename,1,?12)=?11 AND "
+      "instr(substr(Files.Filename,?12+1),'/')=0,Files.Mtime";
+   bool by_content = (sub_types == IST_MASK(IST_REFERENCE)) && !ranked && limited;
+   sqlite3_stmt **cached = by_content ? &stmts[INDEX_LOOKUP_BY_CONTENT + kind] :
+      &stmts[(sub_types & IST_ALL) + (kind + (ranked ? 4 : 0)) * (IST_ALL + 1)];
+   string sql;
+   int result = SQLITE_OK;
+
+   if ((*cached == NULL) && (sub_types == IST_MASK(IST_REFERENCE)))
+   {
+      sql = "SELECT Files.Filename,X.Content,X.Refs,Identifiers.Identifier,Files.rowid";
+      if (ranked)
+      {
+         sql += near_columns;
+      }
+      sql += " FROM Files JOIN RefBlocks AS X ON Files.Content=X.Content "
+             "JOIN Identifiers ON Identifiers.rowid=X.Identifier";
+      index_lookup_where(sql, kind);
+
+      /* A limited lookup stops after the contents it needs */
+      if (by_content)
+      {
+         sql += " ORDER BY X.Content";
+      }
+
+      result = sqlite3_prepare_v2(db,
+                                  sql.c_str(),
+                                  -1,
+                                  cached,
+                                  NULL);
+   }
+   else if (*cached == NULL)
+   {
+      for (size_t i = 0; i < ARRAY_SIZE(tables); i++)
+      {
+         if ((sub_types & IST_MASK(tables[i].sub_type)) == 0)
+         {
+            continue;
+         }
+         if (!sql.empty())
+         {
+            sql += " UNION ALL ";
+         }
+         char select[128];
+         snprintf(select, sizeof(select),
+                  "SELECT Files.Filename,X.Line,X.ColumnStart,Scopes.Scope,X.Type,Identifiers.Identifier,%d,X.rowid",
+                  (int) tables[i].sub_type);
+         sql += select;
+         if (ranked)
+         {
+            sql += near_columns;
+         }
+         sql += " FROM Files JOIN ";
+         sql += tables[i].table;
+         sql += " AS X ON Files.Content=X.Content "
+                "JOIN Scopes ON Scopes.rowid=X.Scope "
+                "JOIN Identifiers ON Identifiers.rowid=X.Identifier";
+         index_lookup_where(sql, kind);
+      }
+
+      /* The Identifier index gives entries in identifier order, keep the
+       * order of a table scan instead
+       */
+      if (ranked)
+      {
+         sql += " ORDER BY 9 DESC,10 DESC,8";
+      }
+      else if (kind != LOOKUP_ALL)
+      {
+         sql += " ORDER BY 7 DESC,8";
+      }
+      sql += " LIMIT ?10";
+
+      result = sqlite3_prepare_v2(db,
+                                  sql.c_str(),
+                                  -1,
+                                  cached,
+                                  NULL);
+   }
+
+   *stmt = *cached;
+
+   return result;
+}
+
+/**
+ * The directory whose entries a ranked lookup puts first: near itself if
+ * it is a directory, else the directory part of it. It ends in a /, or is
+ * empty for a name without a directory.
+ */
+void index_near_directory(const char *near, string& dir)
+{
+   struct stat st;
+   const char  *slash = strrchr(near, '/');
+
+   if ((stat(near, &st) == 0) && S_ISDIR(st.st_mode))
+   {
+      dir = near;
+      if (!dir.empty() && (dir[dir.size() - 1] != '/'))
+      {
+         dir += '/';
+      }
+   }
+   else if (slash != NULL)
+   {
+      dir.assign(near, slash - near + 1);
+   }
+   else
+   {
+      dir.clear();
+   }
+}
+
+/**
+ * Bind the pattern of a lookup statement and the directory of a ranked
+ * one, see index_lookup_statement()
+ */
+static int index_lookup_bind(
+   sqlite3_stmt *stmt,
+   const char *identifier,
+   lookup_kind kind,
+   bool ranked,
+   const string& lower,
+   const string& upper,
+   const vector<sqlite3_int64>& trigrams,
+   const string *dir)
+{
+   int result = SQLITE_OK;
+
+   /* Without a directory all entries are equally near */
+   if (ranked && (dir != NULL))
+   {
+      result = sqlite3_bind_text(stmt,
+                                 INDEX_LOOKUP_DIR,
+                                 dir->data(),
+                                 (int) dir->size(),
+                                 SQLITE_STATIC);
+      result |= sqlite3_bind_int(stmt,
+                                 INDEX_LOOKUP_DIRLEN,
+                                 (int) dir->size());
+   }
+
+   if ((result == SQLITE_OK) && (kind != LOOKUP_ALL))
+   {
+      result = sqlite3_bind_text(stmt,
+                                 1,
+                                 identifier,
+                                 -1,
+                                 SQLITE_STATIC);
+   }
+
+   if ((result == SQLITE_OK) && (kind == LOOKUP_RANGE))
+   {
+      result = sqlite3_bind_text(stmt,
+                                 2,
+                                 lower.data(),
+                                 (int) lower.size(),
+                                 SQLITE_STATIC);
+      result |= sqlite3_bind_text(stmt,
+                                  3,
+                                  upper.data(),
+                                  (int) upper.size(),
+                                  SQLITE_STATIC);
+   }
+
+   /* Repeating a trigram doesn't change the intersection */
+   for (int t = 0; (result == SQLITE_OK) && (kind == LOOKUP_TRIGRAMS) && (t < INDEX_LOOKUP_TRIGRAMS); t++)
+   {
+      result = sqlite3_bind_int64(stmt,
+                                  t + 2,
+                                  trigrams[t % trigrams.size()]);
+   }
+
+   return result;
+}
+
+/* Print or keep one entry found, false once the sink has enough */
+static bool index_lookup_found(
+   output_sink& sink,
+   const char *filename,
+   UINT32 line,
+   UINT32 column_start,
+   const char *scope,
+   id_type type,
+   id_sub_type sub_type,
+   const char *identifier,
+   bool near,
+   INT64 mtime)
+{
+   if (sink.rows != NULL)
+   {
+      sink.rows->push_back(lookup_row());
+      lookup_row& row = sink.rows->back();
+      row.filename.assign(filename);
+      row.line = line;
+      row.column_start = column_start;
+      row.scope.assign(scope);
+      row.type = type;
+      row.sub_type = sub_type;
+      row.identifier.assign(identifier);
+      row.near = near;
+      row.mtime = mtime;
+      sink.count++;
+      return((sink.limit == 0) || (sink.count < sink.limit));
+   }
+
+   return(output_identifier(sink, filename, line, column_start,
+                            scope, type, sub_type, identifier));
+}
+
+/* A block of references found, for one of the files with its content */
+struct ref_block_hit
+{
+   string        filename;
+   string        identifier;
+   sqlite3_int64 content;
+   sqlite3_int64 filerow;
+   bool          near;
+   INT64         mtime;
+};
+
+/* A reference decoded from the block it is in */
+struct ref_hit
+{
+   size_t    block;
+   block_ref ref;
+};
+
+/**
+ * The order of the references found: by content and position, which is
+ * the order they were stored in, ranked the near and recent files first
+ */
+struct ref_hit_order
+{
+   const vector<ref_block_hit> *blocks;
+   bool                        ranked;
+
+   bool operator()(const ref_hit& a, const ref_hit& b) const
+   {
+      const ref_block_hit& x = (*blocks)[a.block];
+      const ref_block_hit& y = (*blocks)[b.block];
+
+      if (ranked && (x.near != y.near))
+      {
+         return(x.near);
+      }
+      if (ranked && (x.mtime != y.mtime))
+      {
+         return(x.mtime > y.mtime);
+      }
+      if (x.content != y.content)
+      {
+         return(x.content < y.content);
+      }
+      if (a.ref.line != b.ref.line)
+      {
+         return(a.ref.line < b.ref.line);
+      }
+      if (a.ref.column_start != b.ref.column_start)
+      {
+         return(a.ref.column_start < b.ref.column_start);
+      }
+      return(x.filerow < y.filerow);
+   }
+};
+
+/* Get the name of a scope, through the cache of one lookup */
+static int index_scope_name(sqlite3 *db, sqlite3_stmt **stmts,
+                            unordered_map<sqlite3_int64, string>& names,
+                            sqlite3_int64 scoperow, const string **name)
+{
+   unordered_map<sqlite3_int64, string>::iterator it = names.find(scoperow);
+   sqlite3_stmt **stmt = &stmts[INDEX_LOOKUP_SCOPE];
+   int result = SQLITE_OK;
+
+   if (it != names.end())
+   {
+      *name = &it->second;
+      return(result);
+   }
+
+   if (*stmt == NULL)
+   {
+      result = sqlite3_prepare_v2(db,
+                                  "SELECT Scope FROM Scopes WHERE rowid=?",
+                                  -1,
+                                  stmt,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(*stmt, 1, scoperow);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      string& scope = names[scoperow];
+
+      result = sqlite3_step(*stmt);
+      if (result == SQLITE_ROW)
+      {
+         const char *text = reinterpret_cast<const char*>(sqlite3_column_text(*stmt, 0));
+
+         scope.assign((text != NULL) ? text : "");
+         result = SQLITE_OK;
+      }
+      else if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+      *name = &scope;
+      (void) sqlite3_reset(*stmt);
+   }
+
+   return(result);
+}
+
+/**
+ * Print the references of a lookup: the matching blocks are read and
+ * decoded, and the references sorted like the rows of the other entries.
+ * Stops at the limit of the sink. Limited and without ranking the blocks
+ * come by content, which comes first in the order, so once the contents
+ * read have enough references for the limit the blocks of the others are
+ * skipped. A ranked lookup orders by the files first and reads all blocks.
+ */
+static int index_lookup_refs(
+   sqlite3 *db,
+   sqlite3_stmt **stmts,
+   output_sink& sink,
+   const char *identifier,
+   lookup_kind kind,
+   bool ranked,
+   const string& lower,
+   const string& upper,
+   const vector<sqlite3_int64>& trigrams,
+   const string *dir)
+{
+   sqlite3_stmt *stmt_lookup_blocks = NULL;
+   vector<ref_block_hit> blocks;
+   vector<block_ref> refs;
+   vector<ref_hit> hits;
+   unordered_map<sqlite3_int64, string> scopes;
+   int result;
+
+   result = index_lookup_statement(db, stmts, IST_MASK(IST_REFERENCE), kind, ranked,
+                                   sink.limit > 0, &stmt_lookup_blocks);
+
+   if (result == SQLITE_OK)
+   {
+      result = index_lookup_bind(stmt_lookup_blocks, identifier, kind, ranked,
+                                 lower, upper, trigrams, dir);
+   }
+
+   while ((result == SQLITE_OK) && ((result = sqlite3_step(stmt_lookup_blocks)) == SQLITE_ROW))
+   {
+      ref_block_hit block;
+      ref_hit hit;
+
+      block.content = sqlite3_column_int64(stmt_lookup_blocks, 1);
+      if (!ranked && (sink.limit > 0) && !blocks.empty() &&
+          (block.content != blocks.back().content) &&
+          (hits.size() >= (size_t) (sink.limit - sink.count)))
+      {
+         result = SQLITE_DONE;
+         break;
+      }
+
+      block.filename.assign(reinterpret_cast<const char*>(sqlite3_column_text(stmt_lookup_blocks, 0)));
+      block.identifier.assign(reinterpret_cast<const char*>(sqlite3_column_text(stmt_lookup_blocks, 3)));
+      block.filerow = sqlite3_column_int64(stmt_lookup_blocks, 4);
+      block.near    = ranked && (sqlite3_column_int(stmt_lookup_blocks, 5) != 0);
+      block.mtime   = ranked ? sqlite3_column_int64(stmt_lookup_blocks, 6) : 0;
+
+      refs.clear();
+      if (!index_decode_refs(sqlite3_column_blob(stmt_lookup_blocks, 2),
+                             sqlite3_column_bytes(stmt_lookup_blocks, 2),
+                             refs))
+      {
+         result = SQLITE_CORRUPT;
+         break;
+      }
+
+      hit.block = blocks.size();
+      for (size_t i = 0; i < refs.size(); i++)
+      {
+         hit.ref = refs[i];
+         hits.push_back(hit);
+      }
+      blocks.push_back(block);
+      result = SQLITE_OK;
+   }
+   if (result == SQLITE_DONE)
+   {
+      result = SQLITE_OK;
+   }
+
+   /* Keep the statement for the next lookup, without the bound strings */
+   if (stmt_lookup_blocks != NULL)
+   {
+      (void) sqlite3_reset(stmt_lookup_blocks);
+      (void) sqlite3_clear_bindings(stmt_lookup_blocks);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      ref_hit_order order;
+      size_t count = hits.size();
+
+      order.blocks = &blocks;
+      order.ranked = ranked;
+      if ((sink.limit > 0) && ((size_t) (sink.limit - sink.count) < count))
+      {
+         count = (size_t) (sink.limit - sink.count);
+         partial_sort(hits.begin(), hits.begin() + count, hits.end(), order);
+      }
+      else
+      {
+         sort(hits.begin(), hits.end(), order);
+      }
+
+      for (size_t i = 0; (i < count) && (result == SQLITE_OK); i++)
+      {
+         const ref_block_hit& block = blocks[hits[i].block];
+         const block_ref& ref = hits[i].ref;
+         const string *scope = NULL;
+
+         result = index_scope_name(db, stmts, scopes, ref.scope, &scope);
+         if ((result == SQLITE_OK) &&
+             !index_lookup_found(sink, block.filename.c_str(), ref.line, ref.column_start,
+                                 scope->c_str(), ref.type, IST_REFERENCE,
+                                 block.identifier.c_str(), block.near, block.mtime))
+         {
+            break;
+         }
+      }
+   }
+
+   return result;
+}
+
+/**
+ * Print the entries of one lookup, see index_lookup_statement() for the
+ * parameters. The references come last, from their blocks. Stops at the
+ * limit of the sink.
+ */
+static int index_lookup_entries(
+   sqlite3 *db,
+   sqlite3_stmt **stmts,
+   output_sink& sink,
+   const char *identifier,
+   int sub_types,
+   lookup_kind kind,
+   bool ranked,
+   const string& lower,
+   const string& upper,
+   const vector<sqlite3_int64>& trigrams,
+   const string *dir)
+{
+   sqlite3_stmt *stmt_lookup_identifier = NULL;
+   int result = SQLITE_OK;
+
+   if ((sub_types & IST_ALL & ~IST_MASK(IST_REFERENCE)) != 0)
+   {
+      result = index_lookup_statement(db, stmts, sub_types & ~IST_MASK(IST_REFERENCE), kind, ranked,
+                                      false, &stmt_lookup_identifier);
+
+      if (result == SQLITE_OK)
+      {
+         result = sqlite3_bind_int(stmt_lookup_identifier,
+                                   INDEX_LOOKUP_LIMIT,
+                                   (sink.limit > 0) ? sink.limit - sink.count : -1);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         result = index_lookup_bind(stmt_lookup_identifier, identifier, kind, ranked,
+                                    lower, upper, trigrams, dir);
+      }
+
+      if (result == SQLITE_OK)
+      {
+         do
+         {
+            result = sqlite3_step(stmt_lookup_identifier);
+            if (result == SQLITE_ROW)
+            {
+               const char *filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt_lookup_identifier, 0));
+               UINT32 line = (UINT32) sqlite3_column_int64(stmt_lookup_identifier, 1);
+               UINT32 column_start = (UINT32) sqlite3_column_int64(stmt_lookup_identifier, 2);
+               const char *scope = reinterpret_cast<const char*>(sqlite3_column_text(stmt_lookup_identifier, 3));
+               id_type type = (id_type) sqlite3_column_int64(stmt_lookup_identifier, 4);
+               const char *identifier = reinterpret_cast<const char*>(sqlite3_column_text(stmt_lookup_identifier, 5));
+               id_sub_type sub_type = (id_sub_type) sqlite3_column_int(stmt_lookup_identifier, 6);
+               bool near = ranked && (sqlite3_column_int(stmt_lookup_identifier, 8) != 0);
+               INT64 mtime = ranked ? sqlite3_column_int64(stmt_lookup_identifier, 9) : 0;
+
+               if (!index_lookup_found(sink, filename, line, column_start, scope, type,
+                                       sub_type, identifier, near, mtime))
+               {
+                  /* Enough results, the rest are never read */
+                  result = SQLITE_DONE;
+               }
+            }
+         } while (result == SQLITE_ROW);
+
+         if (result == SQLITE_DONE)
+         {
+            result = SQLITE_OK;
+         }
+      }
+
+      /* Keep the statement for the next lookup, without the bound strings */
+      if (stmt_lookup_identifier != NULL)
+      {
+         (void) sqlite3_reset(stmt_lookup_identifier);
+         (void) sqlite3_clear_bindings(stmt_lookup_identifier);
+      }
+   }
+
+   if ((result == SQLITE_OK) && ((sub_types & IST_MASK(IST_REFERENCE)) != 0) &&
+       ((sink.limit == 0) || (sink.count < sink.limit)))
+   {
+      result = index_lookup_refs(db, stmts, sink, identifier, kind, ranked,
+                                 lower, upper, trigrams, dir);
+   }
+
+   return result;
+}
+
+/**
+ * Print the entries of an identifier, which may contain GLOB wildcards,
+ * from an index opened on db. stmts caches its INDEX_LOOKUP_STATEMENTS
+ * lookup statements and bloom its Bloom filter.
+ *
+ * Ranked, definitions come first, then declarations, then references, each
+ * looked up only if the limit of the sink isn't reached yet.
+ *
+ * @param sink        Where to print the entries, stops at its limit
+ * @param identifier  The identifier to look for
+ * @param sub_types   IST_MASK() of the sub types to show
+ * @param ranked      Print the best entries first, see index_lookup_statement()
+ * @param near        NULL or a file or directory whose directory is preferred
+ */
+bool index_lookup_in(sqlite3 *db, sqlite3_stmt **stmts, index_bloom& bloom, output_sink& sink,
+                     const char *identifier, int sub_types, bool ranked, const char *near)
+{
+   static const id_sub_type rank_order[] =
+   {
+      IST_DEFINITION,
+      IST_DECLARATION,
+      IST_REFERENCE,
+   };
+   bool retval = true;
+   int result = SQLITE_OK;
+   string lower, upper, dir;
+   vector<sqlite3_int64> trigrams;
+   lookup_kind kind = LOOKUP_SCAN;
+
+   if ((sub_types & IST_ALL) == 0)
    {
-      while ((result = sqlite3_step(stmt_iterate_files)) == SQLITE_ROW)
-      {
-         sqlite3_int64 filerow = sqlite3_column_int64(stmt_iterate_files, 0);
-         const char *filename =
-            (const char *) sqlite3_column_text(stmt_iterate_files, 1);
-         if (!file_exists(filename))
-         {
-            LOG_FMT(LNOTE, "File %s at filerow %" PRId64 " does not exist, removed from index\n", filename, (int64_t) filerow);
-            result = index_remove_file(filerow);
+      return(true);
+   }
 
-            if (result == SQLITE_OK)
-            {
-               result = index_prune_entries(filerow);
-            }
+   if (identifier == NULL)
+   {
+      identifier = "*";
+   }
 
-            if (result != SQLITE_OK)
-            {
-               break;
-            }
-         }
+   /* A name without wildcards that the index doesn't have */
+   if ((identifier[strcspn(identifier, "*?[")] == 0) &&
+       !index_bloom_may_contain(db, bloom, identifier))
+   {
+      (void) output_flush(sink);
+      return(true);
+   }
+
+   /* A short prefix matches more than the trigrams of the rest would */
+   if ((identifier[0] != 0) && (identifier[strspn(identifier, "*")] == 0))
+   {
+      kind = LOOKUP_ALL;
+   }
+   else if (index_glob_range(identifier, lower, upper))
+   {
+      kind = LOOKUP_RANGE;
+   }
+   if (((kind == LOOKUP_SCAN) || ((kind == LOOKUP_RANGE) && (lower.size() < 3))) &&
+       index_glob_trigrams(identifier, trigrams))
+   {
+      kind = LOOKUP_TRIGRAMS;
+   }
+
+   if (!ranked)
+   {
+      result = index_lookup_entries(db, stmts, sink, identifier, sub_types, kind, false,
+                                    lower, upper, trigrams, NULL);
+   }
+   else
+   {
+      if (near != NULL)
+      {
+         index_near_directory(near, dir);
       }
-      if (result == SQLITE_DONE)
+      for (size_t i = 0; (result == SQLITE_OK) && (i < ARRAY_SIZE(rank_order)); i++)
       {
-         result = SQLITE_OK;
+         if (((sub_types & IST_MASK(rank_order[i])) != 0) &&
+             ((sink.limit == 0) || (sink.count < sink.limit)))
+         {
+            result = index_lookup_entries(db, stmts, sink, identifier, IST_MASK(rank_order[i]), kind, true,
+                                          lower, upper, trigrams, (near != NULL) ? &dir : NULL);
+         }
       }
    }
 
    if (result != SQLITE_OK)
    {
       const char *errstr = sqlite3_errstr(result);
-      LOG_FMT(LERR, "index_prune_files: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      LOG_FMT(LERR, "index_lookup_identifier: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
       retval = false;
    }
 
-   (void) sqlite3_finalize(stmt_iterate_files);
+   (void) output_flush(sink);
 
    return retval;
 }
 
-static int index_replace_file(const char *digest, const char *filename)
+/* Print the entries of an identifier from the open index, shards or compact index */
+bool index_lookup_identifier(output_sink& sink, const char *identifier, int sub_types,
+                             bool ranked, const char *near)
 {
-   int result;
+   if (compact_opened())
+   {
+      return(compact_lookup_identifier(sink, identifier, sub_types, ranked, near));
+   }
+   if (shards_opened())
+   {
+      return(shards_lookup_identifier(sink, identifier, sub_types, ranked, near));
+   }
+   return(index_lookup_in(cpd.index, cpd.stmt_lookup_identifier, cpd.bloom, sink,
+                          identifier, sub_types, ranked, near));
+}
 
-   result = sqlite3_bind_text(cpd.stmt_change_digest,
-                              1,
-                              digest,
-                              -1,
-                              SQLITE_STATIC);
+/* A lookup read by index_lookup_batch() */
+struct lookup_query
+{
+   string identifier;
+   int    sub_types;
+   string tag;          // the words of its line
 
-   if (result == SQLITE_OK)
+   bool operator<(const lookup_query& ref) const
    {
-      result = sqlite3_bind_text(cpd.stmt_change_digest,
-                                 2,
-                                 filename,
-                                 -1,
-                                 SQLITE_STATIC);
+      return((identifier < ref.identifier) ||
+             ((identifier == ref.identifier) && (sub_types < ref.sub_types)));
    }
 
-   if (result == SQLITE_OK)
+   bool operator==(const lookup_query& ref) const
    {
-      result = sqlite3_step(cpd.stmt_change_digest);
-      if (result == SQLITE_DONE)
+      return((identifier == ref.identifier) && (sub_types == ref.sub_types));
+   }
+};
+
+/**
+ * Look up the identifiers listed in a file, - is stdin, for --id-from. A
+ * line is an identifier optionally followed by the sub types to look for,
+ * any of refs, defs and decls, else sub_types is used. Empty lines and
+ * those starting with # are skipped.
+ *
+ * The lookups are done in the order of the identifiers, so the indexes of
+ * the index are walked in order, and a lookup listed twice is done once.
+ * Each result is tagged with the line of its lookup, the limit of the sink
+ * applies to every lookup.
+ */
+bool index_lookup_batch(output_sink& sink, const char *list_file, int sub_types,
+                        bool ranked, const char *near)
+{
+   static const struct
+   {
+      const char  *name;
+      id_sub_type sub_type;
+   } filters[] =
+   {
+      { "refs",  IST_REFERENCE   },
+      { "defs",  IST_DEFINITION  },
+      { "decls", IST_DECLARATION },
+   };
+   vector<lookup_query> queries;
+   bool from_stdin = (strcmp(list_file, "-") == 0);
+   FILE *fp        = from_stdin ? stdin : fopen(list_file, "r");
+   bool retval     = true;
+   char line[4096];
+
+   if (fp == NULL)
+   {
+      LOG_FMT(LERR, "%s: fopen(%s) failed: %s (%d)\n",
+              __func__, list_file, strerror(errno), errno);
+      return(false);
+   }
+
+   while (fgets(line, sizeof(line), fp) != NULL)
+   {
+      const char   *seps = " \t\r\n";
+      lookup_query query;
+      char         *word = line + strspn(line, seps);
+
+      if ((*word == 0) || (*word == '#'))
       {
-         result = sqlite3_reset(cpd.stmt_change_digest);
+         continue;
+      }
+
+      query.sub_types = 0;
+      while (*word != 0)
+      {
+         size_t len = strcspn(word, seps);
+         string name(word, len);
+         size_t idx;
+
+         word += len;
+         word += strspn(word, seps);
+
+         if (query.tag.empty())
+         {
+            query.identifier = name;
+            query.tag        = name;
+            continue;
+         }
+
+         for (idx = 0; (idx < ARRAY_SIZE(filters)) && (name != filters[idx].name); idx++)
+         {
+         }
+         if (idx < ARRAY_SIZE(filters))
+         {
+            query.sub_types |= IST_MASK(filters[idx].sub_type);
+            query.tag       += " " + name;
+         }
+         else
+         {
+            LOG_FMT(LWARN, "Ignoring unknown sub type %s of %s\n",
+                    name.c_str(), query.identifier.c_str());
+         }
+      }
+      if (query.sub_types == 0)
+      {
+         query.sub_types = sub_types;
       }
+      queries.push_back(query);
    }
 
-   return result;
+   if (ferror(fp))
+   {
+      LOG_FMT(LERR, "%s: reading %s failed\n", __func__, list_file);
+      retval = false;
+   }
+   if (!from_stdin)
+   {
+      fclose(fp);
+   }
+
+   sort(queries.begin(), queries.end());
+   queries.erase(unique(queries.begin(), queries.end()), queries.end());
+
+   for (size_t idx = 0; idx < queries.size(); idx++)
+   {
+      sink.count = 0;
+      sink.query = queries[idx].tag.c_str();
+      if (!index_lookup_identifier(sink, queries[idx].identifier.c_str(),
+                                   queries[idx].sub_types, ranked, near))
+      {
+         retval = false;
+      }
+   }
+   sink.query = NULL;
+
+   return(retval);
 }
 
-/* Returns true if the file needs to be analyzed */
-bool index_prepare_for_file(fp_data& fpd)
+/* Split file:line:column, the file name may contain colons itself */
+static bool index_parse_position(const char *position, string& filename,
+                                 unsigned long& line, unsigned long& column)
+{
+   const char *colon = strrchr(position, ':');
+   char *end;
+
+   if (colon == NULL)
+   {
+      return(false);
+   }
+   column = strtoul(colon + 1, &end, 10);
+   if ((*end != 0) || (column == 0))
+   {
+      return(false);
+   }
+
+   filename.assign(position, colon - position);
+   colon = strrchr(filename.c_str(), ':');
+   if (colon == NULL)
+   {
+      return(false);
+   }
+   line = strtoul(colon + 1, &end, 10);
+   if ((*end != 0) || (line == 0))
+   {
+      return(false);
+   }
+   filename.resize(colon - filename.c_str());
+
+   return(!filename.empty());
+}
+
+/**
+ * Print the reference at a position, from the blocks of the content of the
+ * file, and set identifier to its identifier. Prints nothing if there is
+ * none.
+ */
+static int index_lookup_ref_at(output_sink& sink, const string& filename, unsigned long line,
+                               unsigned long column, string& identifier)
 {
+   sqlite3_stmt *stmt = NULL;
+   vector<block_ref> refs;
+   unordered_map<sqlite3_int64, string> scopes;
+   const string *scope = NULL;
    int result;
-   bool retval = true;
-   sqlite3_int64 filerow = 0;
 
-   result = sqlite3_bind_text(cpd.stmt_lookup_file,
-                              1,
-                              fpd.filename,
-                              -1,
-                              SQLITE_STATIC);
+   result = sqlite3_prepare_v2(cpd.index,
+                               "SELECT Identifiers.Identifier,X.Refs FROM RefBlocks AS X "
+                               "JOIN Identifiers ON Identifiers.rowid=X.Identifier "
+                               "WHERE X.Content=(SELECT Content FROM Files WHERE Filename=?1)",
+                               -1,
+                               &stmt,
+                               NULL);
 
    if (result == SQLITE_OK)
    {
-      result = sqlite3_step(cpd.stmt_lookup_file);
+      result = sqlite3_bind_text(stmt,
+                                 1,
+                                 filename.data(),
+                                 (int) filename.size(),
+                                 SQLITE_STATIC);
    }
 
-   if (result == SQLITE_ROW)
+   while ((result == SQLITE_OK) && identifier.empty() &&
+          ((result = sqlite3_step(stmt)) == SQLITE_ROW))
    {
-      filerow = sqlite3_column_int64(cpd.stmt_lookup_file, 0);
-      const char *ingest =
-         (const char *) sqlite3_column_text(cpd.stmt_lookup_file, 1);
-
-      if (strcmp(fpd.digest, ingest) == 0)
+      refs.clear();
+      if (!index_decode_refs(sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1), refs))
       {
-         LOG_FMT(LNOTE, "File %s(%s) exists in index at filerow %" PRId64 " with same digest\n", fpd.filename, fpd.digest, (int64_t) filerow);
-         result = SQLITE_OK;
-         retval = false;
+         result = SQLITE_CORRUPT;
+         break;
       }
-      else
+      result = SQLITE_OK;
+
+      for (size_t i = 0; i < refs.size(); i++)
       {
-         LOG_FMT(LNOTE, "File %s(%s) exists in index at filerow %" PRId64 " with different digest (%s)\n", fpd.filename, fpd.digest, (int64_t) filerow, ingest);
-         result = index_replace_file(fpd.digest, fpd.filename);
-         if (result == SQLITE_OK)
+         if ((refs[i].line == line) && (refs[i].column_start <= column) &&
+             (refs[i].column_end > column))
          {
-            result = index_prune_entries(filerow);
+            identifier = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            result = index_scope_name(cpd.index, cpd.stmt_lookup_identifier, scopes,
+                                      refs[i].scope, &scope);
+            if (result == SQLITE_OK)
+            {
+               (void) output_identifier(sink, filename.c_str(), refs[i].line,
+                                        refs[i].column_start, scope->c_str(), refs[i].type,
+                                        IST_REFERENCE, identifier.c_str());
+            }
+            break;
          }
       }
    }
-   else if (result == SQLITE_DONE)
+   if (result == SQLITE_DONE)
    {
-      result = index_insert_file(fpd.digest, fpd.filename, &filerow);
-      LOG_FMT(LNOTE, "File %s(%s) does not exist in index, inserted at filerow %" PRId64 "\n", fpd.filename, fpd.digest, (int64_t) filerow);
+      result = SQLITE_OK;
    }
 
-   if (result == SQLITE_OK)
+   (void) sqlite3_finalize(stmt);
+
+   return(result);
+}
+
+/**
+ * Print the entry at a position given as file:line:column, the column
+ * anywhere in the identifier, and then the definitions of its identifier,
+ * those near the file first. The file name must be written the way it was
+ * given when indexing.
+ */
+bool index_lookup_at(output_sink& sink, const char *position)
+{
+   static const struct
    {
-      result = sqlite3_bind_int64(cpd.stmt_insert_reference,
-                                  1,
-                                  filerow);
+      id_sub_type sub_type;
+      const char  *table;
+   } tables[] =
+   {
+      { IST_DEFINITION,  "Defs"  },
+      { IST_DECLARATION, "Decls" },
+   };
+   sqlite3_stmt *stmt = NULL;
+   string filename, identifier;
+   unsigned long line, column;
+   string sql;
+   bool retval = true;
+   int result;
+
+   if (!index_parse_position(position, filename, line, column))
+   {
+      LOG_FMT(LERR, "--at needs a position like file:line:column, not %s\n", position);
+      return(false);
+   }
+
+   for (size_t i = 0; i < ARRAY_SIZE(tables); i++)
+   {
+      char select[128];
+
+      snprintf(select, sizeof(select),
+               "%sSELECT X.Line,X.ColumnStart,Scopes.Scope,X.Type,Identifiers.Identifier,%d FROM ",
+               (i > 0) ? " UNION ALL " : "", (int) tables[i].sub_type);
+      sql += select;
+      sql += tables[i].table;
+      sql += " AS X JOIN Scopes ON Scopes.rowid=X.Scope "
+             "JOIN Identifiers ON Identifiers.rowid=X.Identifier "
+             "WHERE X.Content=(SELECT Content FROM Files WHERE Filename=?1) AND "
+             "X.Line=?2 AND X.ColumnStart<=?3 AND X.ColumnEnd>?3";
    }
+   sql += " LIMIT 1";
+
+   result = sqlite3_prepare_v2(cpd.index,
+                               sql.c_str(),
+                               -1,
+                               &stmt,
+                               NULL);
 
    if (result == SQLITE_OK)
    {
-      result = sqlite3_bind_int64(cpd.stmt_insert_definition,
-                                  1,
-                                  filerow);
+      result = sqlite3_bind_text(stmt,
+                                 1,
+                                 filename.data(),
+                                 (int) filename.size(),
+                                 SQLITE_STATIC);
+      result |= sqlite3_bind_int64(stmt, 2, (sqlite3_int64) line);
+      result |= sqlite3_bind_int64(stmt, 3, (sqlite3_int64) column);
    }
 
    if (result == SQLITE_OK)
    {
-      result = sqlite3_bind_int64(cpd.stmt_insert_declaration,
-                                  1,
-                                  filerow);
+      result = sqlite3_step(stmt);
+      if (result == SQLITE_ROW)
+      {
+         const char *scope = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+
+         identifier = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+         (void) output_identifier(sink,
+                                  filename.c_str(),
+                                  (UINT32) sqlite3_column_int64(stmt, 0),
+                                  (UINT32) sqlite3_column_int64(stmt, 1),
+                                  scope,
+                                  (id_type) sqlite3_column_int64(stmt, 3),
+                                  (id_sub_type) sqlite3_column_int(stmt, 5),
+                                  identifier.c_str());
+         result = SQLITE_OK;
+      }
+      else if (result == SQLITE_DONE)
+      {
+         result = index_lookup_ref_at(sink, filename, line, column, identifier);
+      }
    }
 
+   (void) sqlite3_finalize(stmt);
+
    if (result != SQLITE_OK)
    {
       const char *errstr = sqlite3_errstr(result);
-      LOG_FMT(LERR, "index_prepare_for_file: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      LOG_FMT(LERR, "index_lookup_at: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
       retval = false;
    }
+   else if (!identifier.empty() && ((sink.limit == 0) || (sink.count < sink.limit)))
+   {
+      retval = index_lookup_in(cpd.index, cpd.stmt_lookup_identifier, cpd.bloom, sink,
+                               identifier.c_str(), IST_MASK(IST_DEFINITION), true,
+                               filename.c_str());
+   }
 
-   (void) sqlite3_reset(cpd.stmt_lookup_file);
+   (void) output_flush(sink);
 
    return retval;
 }
 
-void index_begin_file(fp_data& fpd)
-{
-   (void) sqlite3_reset(cpd.stmt_begin);
-   (void) sqlite3_step(cpd.stmt_begin);
-}
-
-void index_end_file(fp_data& fpd)
+/**
+ * Print the callers or the callees of a function from the open index,
+ * following them up to depth functions away, 0 for no limit. The callers
+ * are printed as their definitions, each once, the callees as the calls.
+ * Each level is a query per function found on the previous one, every
+ * function is looked at once.
+ */
+bool index_lookup_calls(output_sink& sink, const char *function, bool callers, int depth)
 {
-   (void) sqlite3_reset(cpd.stmt_commit);
-   (void) sqlite3_step(cpd.stmt_commit);
-}
+   static const char *sql[] =
+   {
+      /* The calls made in the definitions of ?1 */
+      "SELECT Files.Filename,Calls.Line,Calls.ColumnStart,Scopes.Scope,Calls.Type,Identifiers.Identifier"
+      " FROM Defs JOIN Calls ON Calls.Caller=Defs.rowid"
+      " JOIN Files ON Files.Content=Calls.Content JOIN Scopes ON Scopes.rowid=Calls.Scope"
+      " JOIN Identifiers ON Identifiers.rowid=Calls.Identifier"
+      " WHERE Defs.Identifier=(SELECT rowid FROM Identifiers WHERE Identifier=?1)"
+      " ORDER BY Calls.rowid,Files.rowid",
 
-bool index_insert_entry(
-   fp_data& fpd,
-   UINT32 line,
-   UINT32 column_start,
-   const char *scope,
-   id_type type,
-   id_sub_type sub_type,
-   const char *identifier)
-{
+      /* The definitions that call ?1 */
+      "SELECT Files.Filename,Defs.Line,Defs.ColumnStart,Scopes.Scope,Defs.Type,Identifiers.Identifier"
+      " FROM Calls JOIN Defs ON Defs.rowid=Calls.Caller"
+      " JOIN Files ON Files.Content=Defs.Content JOIN Scopes ON Scopes.rowid=Defs.Scope"
+      " JOIN Identifiers ON Identifiers.rowid=Defs.Identifier"
+      " WHERE Calls.Identifier=(SELECT rowid FROM Identifiers WHERE Identifier=?1)"
+      " GROUP BY Defs.rowid,Files.rowid ORDER BY Defs.rowid,Files.rowid",
+   };
+   sqlite3_stmt *stmt = NULL;
+   vector<string> level(1, function), next;
+   set<string> seen, printed;
+   char position[32];
+   bool more = true;
    bool retval = true;
    int result;
-   sqlite3_stmt *stmt_insert_entry = cpd.stmt_insert_reference;
-
-   if (sub_type == IST_DEFINITION)
-      stmt_insert_entry = cpd.stmt_insert_definition;
-   else if (sub_type == IST_DECLARATION)
-      stmt_insert_entry = cpd.stmt_insert_declaration;
-
-   result = sqlite3_bind_int64(stmt_insert_entry,
-                               2,
-                               line);
-   result |= sqlite3_bind_int64(stmt_insert_entry,
-                                3,
-                                column_start);
-   result |= sqlite3_bind_text(stmt_insert_entry,
-                               4,
-                               scope,
-                               -1,
-                               SQLITE_STATIC);
-   result |= sqlite3_bind_int(stmt_insert_entry,
-                              5,
-                              (int) type);
-   result |= sqlite3_bind_text(stmt_insert_entry,
-                               6,
-                               identifier,
+
+   seen.insert(function);
+
+   result = sqlite3_prepare_v2(cpd.index,
+                               sql[callers ? 1 : 0],
                                -1,
-                               SQLITE_STATIC);
+                               &stmt,
+                               NULL);
 
-   if (result == SQLITE_OK)
+   for (int d = 0; (result == SQLITE_OK) && more && !level.empty() && ((depth == 0) || (d < depth)); d++)
    {
-      result = sqlite3_step(stmt_insert_entry);
-      if (result == SQLITE_DONE)
+      next.clear();
+      for (size_t i = 0; (result == SQLITE_OK) && more && (i < level.size()); i++)
       {
-         result = sqlite3_reset(stmt_insert_entry);
+         result = sqlite3_bind_text(stmt,
+                                    1,
+                                    level[i].data(),
+                                    (int) level[i].size(),
+                                    SQLITE_STATIC);
+
+         while ((result == SQLITE_OK) && more)
+         {
+            result = sqlite3_step(stmt);
+            if (result == SQLITE_ROW)
+            {
+               const char *filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+               UINT32 line = (UINT32) sqlite3_column_int64(stmt, 1);
+               UINT32 column_start = (UINT32) sqlite3_column_int64(stmt, 2);
+               const char *scope = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+               id_type type = (id_type) sqlite3_column_int64(stmt, 4);
+               const char *identifier = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
+
+               snprintf(position, sizeof(position), ":%u:%u", line, column_start);
+               if (!callers || printed.insert(filename + string(position)).second)
+               {
+                  more = output_identifier(sink, filename, line, column_start, scope, type,
+                                           callers ? IST_DEFINITION : IST_REFERENCE, identifier);
+               }
+               if (seen.insert(identifier).second)
+               {
+                  next.push_back(identifier);
+               }
+               result = SQLITE_OK;
+            }
+            else if (result == SQLITE_DONE)
+            {
+               break;
+            }
+         }
+
+         if ((result == SQLITE_OK) || (result == SQLITE_DONE))
+         {
+            result = sqlite3_reset(stmt);
+         }
       }
+      level.swap(next);
    }
 
+   (void) sqlite3_finalize(stmt);
+
    if (result != SQLITE_OK)
    {
       const char *errstr = sqlite3_errstr(result);
-      LOG_FMT(LERR, "index_insert_entry: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      LOG_FMT(LERR, "index_lookup_calls: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
       retval = false;
    }
 
+   (void) output_flush(sink);
+
    return retval;
 }
 
-bool index_lookup_identifier(const char *identifier, id_sub_type sub_type)
+/* Prepare one of the statements of index_read_changes() on first use */
+static int index_changes_statement(int idx, const char *sql, sqlite3_stmt **stmt)
 {
-   bool retval = true;
-   sqlite3_stmt *stmt_lookup_identifier;
+   sqlite3_stmt **cached = &cpd.stmt_lookup_identifier[INDEX_LOOKUP_CHANGES + idx];
+   int result = SQLITE_OK;
+
+   if (*cached == NULL)
+   {
+      result = sqlite3_prepare_v2(cpd.index, sql, -1, cached, NULL);
+   }
+   *stmt = *cached;
+
+   return result;
+}
+
+/**
+ * Collect the changes made to the open index since the change last, by
+ * this or any other connection: the names of the files stored or removed
+ * and the identifiers of the contents the stored ones have now. last is
+ * set to the latest change, a negative last only gets it.
+ *
+ * @param max_changes  More changes than this set all instead
+ * @param all          Set if the changes are not known, because there
+ *                     are too many or some were trimmed already
+ */
+bool index_read_changes(sqlite3_int64& last, size_t max_changes, vector<string>& files,
+                        unordered_set<string>& identifiers, bool& all)
+{
+   sqlite3_stmt *stmt_last = NULL, *stmt_changes = NULL, *stmt_identifiers = NULL;
+   set<sqlite3_int64> contents;
+   sqlite3_int64 latest = 0;
    int result;
 
-   switch (sub_type)
+   all = false;
+
+   result = index_changes_statement(0, "SELECT max(rowid) FROM Changes", &stmt_last);
+
+   if (result == SQLITE_OK)
    {
-      default:
-      case IST_REFERENCE:
+      result = sqlite3_step(stmt_last);
+      if (result == SQLITE_ROW)
       {
-         result = sqlite3_prepare_v2(cpd.index,
-                                     "SELECT Files.Filename,Refs.Line,Refs.ColumnStart,Refs.Scope,Refs.Type,Refs.Identifier "
-                                     "FROM Files JOIN Refs ON Files.rowid=Refs.Filerow "
-                                     "WHERE Refs.Identifier GLOB ?",
-                                     -1,
-                                     &stmt_lookup_identifier,
-                                     NULL);
-         break;
+         latest = sqlite3_column_int64(stmt_last, 0);
+         result = SQLITE_OK;
       }
-      case IST_DEFINITION:
+      (void) sqlite3_reset(stmt_last);
+   }
+
+   if ((result != SQLITE_OK) || (last < 0) || (latest == last))
+   {
+      last = latest;
+      return(result == SQLITE_OK);
+   }
+
+   if ((latest < last) || ((size_t) (latest - last) > max_changes))
+   {
+      last = latest;
+      all  = true;
+      return(true);
+   }
+
+   result = index_changes_statement(1, "SELECT rowid,Filename,Content FROM Changes WHERE rowid>? "
+                                    "ORDER BY rowid", &stmt_changes);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_int64(stmt_changes, 1, last);
+   }
+
+   while ((result == SQLITE_OK) && ((result = sqlite3_step(stmt_changes)) == SQLITE_ROW))
+   {
+      const char *filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt_changes, 1));
+
+      /* The changes right after last are gone */
+      if (files.empty() && (sqlite3_column_int64(stmt_changes, 0) != last + 1))
       {
-         result = sqlite3_prepare_v2(cpd.index,
-                                     "SELECT Files.Filename,Defs.Line,Defs.ColumnStart,Defs.Scope,Defs.Type,Defs.Identifier "
-                                     "FROM Files JOIN Defs ON Files.rowid=Defs.Filerow "
-                                     "WHERE Defs.Identifier GLOB ?",
-                                     -1,
-                                     &stmt_lookup_identifier,
-                                     NULL);
-         break;
+         all = true;
       }
-      case IST_DECLARATION:
+      latest = max(latest, sqlite3_column_int64(stmt_changes, 0));
+      files.push_back((filename != NULL) ? filename : "");
+      if (sqlite3_column_type(stmt_changes, 2) != SQLITE_NULL)
       {
-         result = sqlite3_prepare_v2(cpd.index,
-                                     "SELECT Files.Filename,Decls.Line,Decls.ColumnStart,Decls.Scope,Decls.Type,Decls.Identifier "
-                                     "FROM Files JOIN Decls ON Files.rowid=Decls.Filerow "
-                                     "WHERE Decls.Identifier GLOB ?",
-                                     -1,
-                                     &stmt_lookup_identifier,
-                                     NULL);
-         break;
+         contents.insert(sqlite3_column_int64(stmt_changes, 2));
       }
+      result = SQLITE_OK;
    }
+   if (result == SQLITE_DONE)
+   {
+      result = SQLITE_OK;
+   }
+   (void) sqlite3_reset(stmt_changes);
 
-   if (result == SQLITE_OK)
+   if ((result == SQLITE_OK) && !all)
    {
-      result = sqlite3_bind_text(stmt_lookup_identifier,
-                                 1,
-                                 identifier != NULL ? identifier : "%",
-                                 -1,
-                                 SQLITE_STATIC);
+      result = index_changes_statement(2,
+                                       "SELECT Identifier FROM Identifiers WHERE rowid IN "
+                                       "(SELECT Identifier FROM RefBlocks WHERE Content=?1 UNION ALL "
+                                       "SELECT Identifier FROM Defs WHERE Content=?1 UNION ALL "
+                                       "SELECT Identifier FROM Decls WHERE Content=?1)",
+                                       &stmt_identifiers);
    }
 
-   if (result == SQLITE_OK)
+   for (set<sqlite3_int64>::iterator it = contents.begin();
+        (it != contents.end()) && (result == SQLITE_OK) && !all; ++it)
    {
-      do
-      {
-         result = sqlite3_step(stmt_lookup_identifier);
-         if (result == SQLITE_ROW)
-         {
-            const char *filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt_lookup_identifier, 0));
-            UINT32 line = (UINT32) sqlite3_column_int64(stmt_lookup_identifier, 1);
-            UINT32 column_start = (UINT32) sqlite3_column_int64(stmt_lookup_identifier, 2);
-            const char *scope = reinterpret_cast<const char*>(sqlite3_column_text(stmt_lookup_identifier, 3));
-            id_type type = (id_type) sqlite3_column_int64(stmt_lookup_identifier, 4);
-            const char *identifier = reinterpret_cast<const char*>(sqlite3_column_text(stmt_lookup_identifier, 5));
-            output_identifier(
-               filename,
-               line,
-               column_start,
-               scope,
-               type,
-               sub_type,
-               identifier);
-         }
-      } while (result == SQLITE_ROW);
+      result = sqlite3_bind_int64(stmt_identifiers, 1, *it);
 
+      while ((result == SQLITE_OK) && ((result = sqlite3_step(stmt_identifiers)) == SQLITE_ROW))
+      {
+         identifiers.insert(reinterpret_cast<const char*>(sqlite3_column_text(stmt_identifiers, 0)));
+         result = SQLITE_OK;
+      }
       if (result == SQLITE_DONE)
       {
          result = SQLITE_OK;
       }
+      (void) sqlite3_reset(stmt_identifiers);
    }
 
    if (result != SQLITE_OK)
    {
       const char *errstr = sqlite3_errstr(result);
-      LOG_FMT(LERR, "index_lookup_identifier: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
-      retval = false;
+      LOG_FMT(LERR, "index_read_changes: access error (%d: %s)\n", result, errstr != NULL ? errstr : "");
+      all = true;
    }
 
-   (void) sqlite3_finalize(stmt_lookup_identifier);
+   last = latest;
 
-   return retval;
+   return(result == SQLITE_OK);
 }
@@ -12,14 +12,19 @@
 #include <cstring>
 #include <cerrno>
 #include <cstdlib>
-#include <map>
+#include <algorithm>
 #include <cctype>
 
 using namespace std;
 
-/* Dynamic keyword map */
-typedef map<string, c_token_t> dkwmap;
-static dkwmap dkwm;
+/* Dynamic keywords, dkw_table holds the index + 1 of an entry, 0 if free */
+struct dkw_entry
+{
+   string    tag;
+   c_token_t type;
+};
+static vector<dkw_entry> dkw_list;
+static vector<int>       dkw_table;
 
 
 /**
@@ -264,8 +269,174 @@ static const chunk_tag_t keywords[] =
 };
 
 
+/**
+ * A distinct tag of keywords[]: the run of entries with that tag and the
+ * languages any of them applies to.
+ */
+struct kw_slot
+{
+   const chunk_tag_t *first;
+   int               count;
+   int               len;
+   int               lang_flags;
+};
+
+/* Average number of tags per bucket of the perfect hash */
+#define KW_BUCKET_TAGS    4
+
+/**
+ * Perfect hash over the tags of keywords[]. A tag hashes to a bucket, the
+ * displacement of the bucket picks its slot, and no two tags share a slot.
+ */
+static vector<kw_slot> kw_slots;
+static vector<UINT32>  kw_displacement;
+
+
+/* FNV-1a, also used for the dynamic keywords */
+static inline UINT64 kw_hash(const char *word, int len)
+{
+   UINT64 h = 0xcbf29ce484222325ULL;
+
+   for (int idx = 0; idx < len; idx++)
+   {
+      h ^= (UINT8)word[idx];
+      h *= 0x100000001b3ULL;
+   }
+   return(h);
+}
+
+
+static inline UINT64 kw_mix(UINT64 h)
+{
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+   return(h);
+}
+
+
+static inline UINT32 kw_bucket(UINT64 h)
+{
+   return((UINT32)(kw_mix(h) & (kw_displacement.size() - 1)));
+}
+
+
+static inline UINT32 kw_slot_of(UINT64 h, UINT32 displacement)
+{
+   return((UINT32)(kw_mix(h + displacement * 0x9e3779b97f4a7c15ULL) & (kw_slots.size() - 1)));
+}
+
+
+/**
+ * Places the tags of keywords[] in a table of the given size, fails if a
+ * bucket finds no free slots.
+ */
+static bool kw_build(const vector<kw_slot>& tags, UINT32 size)
+{
+   vector<UINT64>      hashes(tags.size());
+   vector<vector<int> > buckets;
+   UINT32              bucket_count = 1;
+
+   while (bucket_count * KW_BUCKET_TAGS < tags.size())
+   {
+      bucket_count <<= 1;
+   }
+
+   kw_slots.assign(size, kw_slot());
+   kw_displacement.assign(bucket_count, 0);
+   buckets.resize(bucket_count);
+
+   for (size_t idx = 0; idx < tags.size(); idx++)
+   {
+      hashes[idx] = kw_hash(tags[idx].first->tag, tags[idx].len);
+      buckets[kw_bucket(hashes[idx])].push_back(idx);
+   }
+
+   /* The fullest buckets go first, while most slots are free */
+   vector<pair<int, int> > order(bucket_count);
+   for (UINT32 idx = 0; idx < bucket_count; idx++)
+   {
+      order[idx] = make_pair(-(int)buckets[idx].size(), (int)idx);
+   }
+   sort(order.begin(), order.end());
+
+   for (UINT32 oidx = 0; oidx < bucket_count; oidx++)
+   {
+      const vector<int>& bucket = buckets[order[oidx].second];
+      UINT32             displacement;
+      bool               placed = bucket.empty();
+
+      for (displacement = 0; !placed && (displacement < size * 64); displacement++)
+      {
+         size_t idx;
+
+         placed = true;
+         for (idx = 0; placed && (idx < bucket.size()); idx++)
+         {
+            UINT32 slot = kw_slot_of(hashes[bucket[idx]], displacement);
+
+            if (kw_slots[slot].first != NULL)
+            {
+               placed = false;
+            }
+            for (size_t prev = 0; placed && (prev < idx); prev++)
+            {
+               placed = (kw_slot_of(hashes[bucket[prev]], displacement) != slot);
+            }
+         }
+         if (placed)
+         {
+            for (idx = 0; idx < bucket.size(); idx++)
+            {
+               kw_slots[kw_slot_of(hashes[bucket[idx]], displacement)] = tags[bucket[idx]];
+            }
+            kw_displacement[order[oidx].second] = displacement;
+         }
+      }
+      if (!placed)
+      {
+         return(false);
+      }
+   }
+   return(true);
+}
+
+
+/**
+ * Builds the perfect hash over keywords[], before any call to
+ * find_keyword_type().
+ */
 void init_keywords()
 {
+   vector<kw_slot> tags;
+   UINT32          size = 1;
+
+   for (size_t idx = 0; idx < ARRAY_SIZE(keywords); idx++)
+   {
+      if ((idx > 0) && (strcmp(keywords[idx].tag, keywords[idx - 1].tag) == 0))
+      {
+         tags.back().count++;
+         tags.back().lang_flags |= keywords[idx].lang_flags;
+      }
+      else
+      {
+         kw_slot tag = { &keywords[idx], 1, (int)strlen(keywords[idx].tag), keywords[idx].lang_flags };
+
+         tags.push_back(tag);
+      }
+   }
+
+   while (size < tags.size() + tags.size() / 4)
+   {
+      size <<= 1;
+   }
+   while (!kw_build(tags, size))
+   {
+      size <<= 1;
+   }
+   LOG_FMT(LDYNKW, "%s: %d tags in %u slots\n", __func__, (int)tags.size(), size);
 }
 
 /**
@@ -302,64 +473,109 @@ bool keywords_are_sorted(void)
 
 
 /**
- * Adds a keyword to the list of dynamic keywords
+ * Finds a dynamic keyword
  *
- * @param tag        The tag (string) must be zero terminated
- * @param type       The type, usually CT_TYPE
+ * @return  The index of its entry in dkw_list, -1 if there is none
  */
-void add_keyword(const char *tag, c_token_t type)
+static int dkw_find(const char *word, int len)
 {
-   string ss = tag;
+   if (dkw_table.empty())
+   {
+      return(-1);
+   }
 
-   /* See if the keyword has already been added */
-   dkwmap::iterator it = dkwm.find(ss);
-   if (it != dkwm.end())
+   size_t mask = dkw_table.size() - 1;
+   size_t slot = kw_hash(word, len) & mask;
+
+   while (dkw_table[slot] != 0)
    {
-      LOG_FMT(LDYNKW, "%s: changed '%s' to %d\n", __func__, tag, type);
-      (*it).second = type;
-      return;
+      const dkw_entry& entry = dkw_list[dkw_table[slot] - 1];
+
+      if ((entry.tag.size() == (size_t)len) && (memcmp(entry.tag.data(), word, len) == 0))
+      {
+         return(dkw_table[slot] - 1);
+      }
+      slot = (slot + 1) & mask;
    }
+   return(-1);
+}
 
-   /* Insert the keyword */
-   dkwm.insert(dkwmap::value_type(ss, type));
-   LOG_FMT(LDYNKW, "%s: added '%s' as %d\n", __func__, tag, type);
+
+/* Rebuilds dkw_table with room for twice the entries */
+static void dkw_grow()
+{
+   size_t size = 16;
+
+   while (size < dkw_list.size() * 4)
+   {
+      size <<= 1;
+   }
+   dkw_table.assign(size, 0);
+
+   for (size_t idx = 0; idx < dkw_list.size(); idx++)
+   {
+      size_t slot = kw_hash(dkw_list[idx].tag.data(), dkw_list[idx].tag.size()) & (size - 1);
+
+      while (dkw_table[slot] != 0)
+      {
+         slot = (slot + 1) & (size - 1);
+      }
+      dkw_table[slot] = idx + 1;
+   }
 }
 
 
 /**
- * Backs up to the first string match in keywords.
+ * Adds a keyword to the list of dynamic keywords
+ *
+ * @param tag        The tag (string) must be zero terminated
+ * @param type       The type, usually CT_TYPE
  */
-static const chunk_tag_t *kw_static_first(const chunk_tag_t *tag)
+void add_keyword(const char *tag, c_token_t type)
 {
-   const chunk_tag_t *prev = tag - 1;
+   /* See if the keyword has already been added */
+   int idx = dkw_find(tag, strlen(tag));
+   if (idx >= 0)
+   {
+      LOG_FMT(LDYNKW, "%s: changed '%s' to %d\n", __func__, tag, type);
+      dkw_list[idx].type = type;
+      return;
+   }
 
-   while ((prev >= &keywords[0]) && (strcmp(prev->tag, tag->tag) == 0))
+   /* Insert the keyword, keeping the table at most half full */
+   dkw_entry entry = { tag, type };
+   dkw_list.push_back(entry);
+   if (dkw_list.size() * 2 > dkw_table.size())
+   {
+      dkw_grow();
+   }
+   else
    {
-      tag = prev;
-      prev--;
+      size_t mask = dkw_table.size() - 1;
+      size_t slot = kw_hash(tag, entry.tag.size()) & mask;
+
+      while (dkw_table[slot] != 0)
+      {
+         slot = (slot + 1) & mask;
+      }
+      dkw_table[slot] = dkw_list.size();
    }
-   //fprintf(stderr, "first:%s -", tag->tag);
-   return(tag);
+   LOG_FMT(LDYNKW, "%s: added '%s' as %d\n", __func__, tag, type);
 }
 
 
-static const chunk_tag_t *kw_static_match(const chunk_tag_t *tag, c_token_t in_preproc, int lang_flags)
+static const chunk_tag_t *kw_static_match(const kw_slot& slot, c_token_t in_preproc, int lang_flags)
 {
    bool              in_pp = ((in_preproc != CT_NONE) && (in_preproc != CT_PP_DEFINE));
    bool              pp_iter;
    const chunk_tag_t *iter;
 
-   for (iter = kw_static_first(tag);
-        iter < &keywords[ARRAY_SIZE(keywords)];
-        iter++)
+   for (iter = slot.first; iter < slot.first + slot.count; iter++)
    {
-      //fprintf(stderr, " check:%s", iter->tag);
       pp_iter = (iter->lang_flags & FLAG_PP) != 0;
-      if ((strcmp(iter->tag, tag->tag) == 0) &&
-          ((lang_flags & iter->lang_flags) != 0) &&
+      if (((lang_flags & iter->lang_flags) != 0) &&
           (in_pp == pp_iter))
       {
-         //fprintf(stderr, " match:%s", iter->tag);
          return(iter);
       }
    }
@@ -376,9 +592,8 @@ static const chunk_tag_t *kw_static_match(const chunk_tag_t *tag, c_token_t in_p
  */
 c_token_t find_keyword_type(const char *word, int len, c_token_t in_preproc, int lang_flags)
 {
-   string            ss(word, len);
-   chunk_tag_t       key;
-   const chunk_tag_t *p_ret;
+   const chunk_tag_t *p_ret = NULL;
+   int               idx;
 
    if (len <= 0)
    {
@@ -386,20 +601,21 @@ c_token_t find_keyword_type(const char *word, int len, c_token_t in_preproc, int
    }
 
    /* check the dynamic word list first */
-   dkwmap::iterator it = dkwm.find(ss);
-   if (it != dkwm.end())
+   if ((idx = dkw_find(word, len)) >= 0)
    {
-      return((*it).second);
+      return(dkw_list[idx].type);
    }
 
-   key.tag = ss.c_str();
+   /* check the static word list, a single slot may hold the word */
+   UINT64         h     = kw_hash(word, len);
+   const kw_slot& slot  = kw_slots[kw_slot_of(h, kw_displacement[kw_bucket(h)])];
 
-   /* check the static word list */
-   p_ret = (const chunk_tag_t *)bsearch(&key, keywords, ARRAY_SIZE(keywords),
-                                        sizeof(keywords[0]), kw_compare);
-   if (p_ret != NULL)
+   if ((slot.first != NULL) &&
+       ((slot.lang_flags & lang_flags) != 0) &&
+       (slot.len == len) &&
+       (memcmp(slot.first->tag, word, len) == 0))
    {
-      p_ret = kw_static_match(p_ret, in_preproc, lang_flags);
+      p_ret = kw_static_match(slot, in_preproc, lang_flags);
    }
    return((p_ret != NULL) ? p_ret->type : CT_WORD);
 }
@@ -460,37 +676,52 @@ bool load_keyword_file(const char *filename)
 }
 
 
+static bool dkw_less(int idx1, int idx2)
+{
+   return(dkw_list[idx1].tag < dkw_list[idx2].tag);
+}
+
+
 void print_keywords(FILE *pfile)
 {
-   for (dkwmap::iterator it = dkwm.begin(); it != dkwm.end(); ++it)
+   vector<int> order(dkw_list.size());
+
+   for (size_t idx = 0; idx < order.size(); idx++)
+   {
+      order[idx] = idx;
+   }
+   sort(order.begin(), order.end(), dkw_less);
+
+   for (size_t idx = 0; idx < order.size(); idx++)
    {
-      c_token_t tt = (*it).second;
+      const dkw_entry& entry = dkw_list[order[idx]];
+      c_token_t        tt    = entry.type;
       if (tt == CT_TYPE)
       {
          fprintf(pfile, "type %*.s%s\n",
-                 30 - 4, " ", (*it).first.c_str());
+                 30 - 4, " ", entry.tag.c_str());
       }
       else if (tt == CT_MACRO_OPEN)
       {
          fprintf(pfile, "macro-open %*.s%s\n",
-                 30 - 11, " ", (*it).first.c_str());
+                 30 - 11, " ", entry.tag.c_str());
       }
       else if (tt == CT_MACRO_CLOSE)
       {
          fprintf(pfile, "macro-close %*.s%s\n",
-                 30 - 12, " ", (*it).first.c_str());
+                 30 - 12, " ", entry.tag.c_str());
       }
       else if (tt == CT_MACRO_ELSE)
       {
          fprintf(pfile, "macro-else %*.s%s\n",
-                 30 - 11, " ", (*it).first.c_str());
+                 30 - 11, " ", entry.tag.c_str());
       }
       else
       {
          const char *tn = get_token_name(tt);
 
          fprintf(pfile, "set %s %*.s%s\n", tn,
-                 int(30 - (4 + strlen(tn))), " ", (*it).first.c_str());
+                 int(30 - (4 + strlen(tn))), " ", entry.tag.c_str());
       }
    }
 }
@@ -498,7 +729,8 @@ void print_keywords(FILE *pfile)
 
 void clear_keyword_file(void)
 {
-   dkwm.clear();
+   dkw_list.clear();
+   dkw_table.clear();
 }
 
 
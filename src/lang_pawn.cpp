@@ -34,11 +34,11 @@ chunk_t *pawn_add_vsemi_after(fp_data& fpd, chunk_t *pc)
 
    chunk             = *pc;
    chunk.type        = CT_VSEMICOLON;
-   chunk.str         = "";
+   chunk.str.clear();
    chunk.parent_type = CT_NONE;
 
-   LOG_FMT(LPVSEMI, "%s: Added VSEMI on line %d, prev='%s' [%s]\n",
-           __func__, pc->orig_line, pc->str.c_str(),
+   LOG_FMT(LPVSEMI, "%s: Added VSEMI on line %d, prev='%.*s' [%s]\n",
+           __func__, pc->orig_line, pc->len(), pc->text(),
            get_token_name(pc->type));
 
    return(chunk_add_after(fpd, &chunk, pc));
@@ -286,8 +286,8 @@ static chunk_t *pawn_mark_function0(fp_data& fpd, chunk_t *start, chunk_t *fcn)
       last = chunk_get_next(last);
       if ((last != NULL) && (last->type == CT_SEMICOLON))
       {
-         LOG_FMT(LPFUNC, "%s: %d] '%s' proto due to semicolon\n", __func__,
-                 fcn->orig_line, fcn->str.c_str());
+         LOG_FMT(LPFUNC, "%s: %d] '%.*s' proto due to semicolon\n", __func__,
+                 fcn->orig_line, fcn->len(), fcn->text());
          fcn->type = CT_FUNC_PROTO;
          return(last);
       }
@@ -297,8 +297,8 @@ static chunk_t *pawn_mark_function0(fp_data& fpd, chunk_t *start, chunk_t *fcn)
       if ((start->type == CT_FORWARD) ||
           (start->type == CT_NATIVE))
       {
-         LOG_FMT(LPFUNC, "%s: %d] '%s' [%s] proto due to %s\n", __func__,
-                 fcn->orig_line, fcn->str.c_str(),
+         LOG_FMT(LPFUNC, "%s: %d] '%.*s' [%s] proto due to %s\n", __func__,
+                 fcn->orig_line, fcn->len(), fcn->text(),
                  get_token_name(fcn->type),
                  get_token_name(start->type));
          fcn->type = CT_FUNC_PROTO;
@@ -328,15 +328,17 @@ static chunk_t *pawn_process_func_def(fp_data& fpd, chunk_t *pc)
 
    if (last != NULL)
    {
-      LOG_FMT(LPFUNC, "%s: %d] last is '%s' [%s]\n", __func__,
-              last->orig_line, last->str.c_str(), get_token_name(last->type));
+      LOG_FMT(LPFUNC, "%s: %d] last is '%.*s' [%s]\n", __func__,
+              last->orig_line, last->len(), last->text(), get_token_name(last->type));
    }
 
    /* See if there is a state clause after the function */
    if ((last != NULL) && chunk_is_str(last, "<", 1))
    {
-      LOG_FMT(LPFUNC, "%s: %d] '%s' has state angle open %s\n", __func__,
-              pc->orig_line, pc->str.c_str(), get_token_name(last->type));
+      LOG_FMT(LPFUNC, "%s: %d] '%.*s' has state angle open %s\n", __func__,
+              pc->orig_line, pc->len(), pc->text(), get_token_name(last->type));
+
+      chunk_t *open = last;
 
       last->type        = CT_ANGLE_OPEN;
       last->parent_type = CT_FUNC_DEF;
@@ -347,10 +349,11 @@ static chunk_t *pawn_process_func_def(fp_data& fpd, chunk_t *pc)
 
       if (last != NULL)
       {
-         LOG_FMT(LPFUNC, "%s: %d] '%s' has state angle close %s\n", __func__,
-                 pc->orig_line, pc->str.c_str(), get_token_name(last->type));
+         LOG_FMT(LPFUNC, "%s: %d] '%.*s' has state angle close %s\n", __func__,
+                 pc->orig_line, pc->len(), pc->text(), get_token_name(last->type));
          last->type        = CT_ANGLE_CLOSE;
          last->parent_type = CT_FUNC_DEF;
+         chunk_link_match(open, last);
       }
       last = chunk_get_next_nnl(last);
    }
@@ -362,7 +365,7 @@ static chunk_t *pawn_process_func_def(fp_data& fpd, chunk_t *pc)
    if (last->type == CT_BRACE_OPEN)
    {
       last->parent_type = CT_FUNC_DEF;
-      last = chunk_get_next_type(last, CT_BRACE_CLOSE, last->level);
+      last = chunk_skip_to_match(last);
       if (last != NULL)
       {
          last->parent_type = CT_FUNC_DEF;
@@ -370,8 +373,8 @@ static chunk_t *pawn_process_func_def(fp_data& fpd, chunk_t *pc)
    }
    else
    {
-      LOG_FMT(LPFUNC, "%s: %d] '%s' fdef: expected brace open: %s\n", __func__,
-              pc->orig_line, pc->str.c_str(), get_token_name(last->type));
+      LOG_FMT(LPFUNC, "%s: %d] '%.*s' fdef: expected brace open: %s\n", __func__,
+              pc->orig_line, pc->len(), pc->text(), get_token_name(last->type));
 
       chunk_t chunk;
       chunk             = *last;
@@ -399,8 +402,8 @@ static chunk_t *pawn_process_func_def(fp_data& fpd, chunk_t *pc)
                break;
             }
          }
-         prev->level++;
-         prev->brace_level++;
+         prev->level       = chunk_level(prev->level + 1);
+         prev->brace_level = chunk_level(prev->brace_level + 1);
          last = prev;
       } while ((prev = chunk_get_next(prev)) != NULL);
 
@@ -454,8 +457,8 @@ chunk_t *pawn_check_vsemicolon(fp_data& fpd, chunk_t *pc)
    {
       if (prev != NULL)
       {
-         LOG_FMT(LPVSEMI, "%s:  no  VSEMI on line %d, prev='%s' [%s]\n",
-                 __func__, prev->orig_line, prev->str.c_str(), get_token_name(prev->type));
+         LOG_FMT(LPVSEMI, "%s:  no  VSEMI on line %d, prev='%.*s' [%s]\n",
+                 __func__, prev->orig_line, prev->len(), prev->text(), get_token_name(prev->type));
       }
       return(pc);
    }
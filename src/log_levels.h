@@ -98,6 +98,8 @@ enum log_sev_t
    LOCMSGD   = 87,    /* OC Message declaration */
    LINDENTAG = 88,    /* indent again */
    LNFD      = 89,    /* newline-function-def */
+   LCHUNK    = 90,    /* chunk storage */
+   LSTAGE    = 91,    /* time spent in each stage of a file */
 };
 
 #endif   /* LOG_LEVELS_H_INCLUDED */
@@ -17,22 +17,45 @@
 #include "log_levels.h"
 
 
-/** Private log structure */
+/** Private log configuration, shared by all threads */
+struct log_cfg
+{
+   log_cfg() : log_file(0), show_hdr(false)
+   {
+   }
+
+   FILE *log_file;
+   bool show_hdr;
+};
+static struct log_cfg g_log;
+
+log_mask_t log_active_mask;
+
+static void log_flush(bool force_nl);
+
+
+/**
+ * Private log buffer, one per thread so that log lines from threads
+ * analyzing different files don't get mixed up.
+ * Anything left in the buffer is flushed when the thread exits.
+ */
 struct log_buf
 {
-   log_buf() : log_file(0), sev(LERR), in_log(0), buf_len(0), show_hdr(false)
+   log_buf() : sev(LERR), in_log(0), buf_len(0)
+   {
+   }
+
+   ~log_buf()
    {
+      log_flush(false);
    }
 
-   FILE       *log_file;
    log_sev_t  sev;
    int        in_log;
    char       buf[256];
    int        buf_len;
-   log_mask_t mask;
-   bool       show_hdr;
 };
-static struct log_buf g_log;
+static thread_local struct log_buf t_log;
 
 
 /**
@@ -44,7 +67,7 @@ static struct log_buf g_log;
 void log_init(FILE *log_file)
 {
    /* set the top severity */
-   logmask_set_all(g_log.mask, false);
+   logmask_set_all(log_active_mask, false);
    log_set_sev(LERR, true);
 
    g_log.log_file = (log_file != NULL) ? log_file : stderr;
@@ -62,18 +85,6 @@ void log_show_sev(bool show)
 }
 
 
-/**
- * Returns whether a log severity is active.
- *
- * @param sev  The severity
- * @return     true/false
- */
-bool log_sev_on(log_sev_t sev)
-{
-   return(logmask_test(g_log.mask, sev));
-}
-
-
 /**
  * Sets a log sev on or off
  *
@@ -82,7 +93,7 @@ bool log_sev_on(log_sev_t sev)
  */
 void log_set_sev(log_sev_t sev, bool value)
 {
-   logmask_set_sev(g_log.mask, sev, value);
+   logmask_set_sev(log_active_mask, sev, value);
 }
 
 
@@ -93,7 +104,7 @@ void log_set_sev(log_sev_t sev, bool value)
  */
 void log_set_mask(const log_mask_t& mask)
 {
-   g_log.mask = mask;
+   log_active_mask = mask;
 }
 
 
@@ -104,7 +115,7 @@ void log_set_mask(const log_mask_t& mask)
  */
 void log_get_mask(log_mask_t& mask)
 {
-   mask = g_log.mask;
+   mask = log_active_mask;
 }
 
 
@@ -115,19 +126,19 @@ void log_get_mask(log_mask_t& mask)
  */
 static void log_flush(bool force_nl)
 {
-   if (g_log.buf_len > 0)
+   if (t_log.buf_len > 0)
    {
-      if (force_nl && (g_log.buf[g_log.buf_len - 1] != '\n'))
+      if (force_nl && (t_log.buf[t_log.buf_len - 1] != '\n'))
       {
-         g_log.buf[g_log.buf_len++] = '\n';
-         g_log.buf[g_log.buf_len]   = 0;
+         t_log.buf[t_log.buf_len++] = '\n';
+         t_log.buf[t_log.buf_len]   = 0;
       }
-      if (fwrite(g_log.buf, g_log.buf_len, 1,g_log .log_file) != 1)
+      if (fwrite(t_log.buf, t_log.buf_len, 1, g_log.log_file) != 1)
       {
          /* maybe we should log something to complain... =) */
       }
 
-      g_log.buf_len = 0;
+      t_log.buf_len = 0;
    }
 }
 
@@ -140,23 +151,23 @@ static void log_flush(bool force_nl)
  */
 static size_t log_start(log_sev_t sev)
 {
-   if (sev != g_log.sev)
+   if (sev != t_log.sev)
    {
-      if (g_log.buf_len > 0)
+      if (t_log.buf_len > 0)
       {
          log_flush(true);
       }
-      g_log.sev    = sev;
-      g_log.in_log = false;
+      t_log.sev    = sev;
+      t_log.in_log = false;
    }
 
    /* If not in a log, the buffer is empty. Add the header, if enabled. */
-   if (!g_log.in_log && g_log.show_hdr)
+   if (!t_log.in_log && g_log.show_hdr)
    {
-      g_log.buf_len = snprintf(g_log.buf, sizeof(g_log.buf), "<%d>", sev);
+      t_log.buf_len = snprintf(t_log.buf, sizeof(t_log.buf), "<%d>", sev);
    }
 
-   int cap = ((int)sizeof(g_log.buf) - 2) - g_log.buf_len;
+   int cap = ((int)sizeof(t_log.buf) - 2) - t_log.buf_len;
 
    return((cap > 0) ? (size_t)cap : 0);
 }
@@ -168,8 +179,8 @@ static size_t log_start(log_sev_t sev)
  */
 static void log_end(void)
 {
-   g_log.in_log = (g_log.buf[g_log.buf_len - 1] != '\n');
-   if (!g_log.in_log || (g_log.buf_len > (int)(sizeof(g_log.buf) / 2)))
+   t_log.in_log = (t_log.buf[t_log.buf_len - 1] != '\n');
+   if (!t_log.in_log || (t_log.buf_len > (int)(sizeof(t_log.buf) / 2)))
    {
       log_flush(false);
    }
@@ -197,9 +208,9 @@ void log_str(log_sev_t sev, const char *str, int len)
       {
          len = cap;
       }
-      memcpy(&g_log.buf[g_log.buf_len], str, len);
-      g_log.buf_len           += len;
-      g_log.buf[g_log.buf_len] = 0;
+      memcpy(&t_log.buf[t_log.buf_len], str, len);
+      t_log.buf_len           += len;
+      t_log.buf[t_log.buf_len] = 0;
    }
    log_end();
 }
@@ -231,7 +242,7 @@ void log_fmt(log_sev_t sev, const char *fmt, ...)
 
    /* Add on the variable log parameters to the log string */
    va_start(args, fmt);
-   len = vsnprintf(&g_log.buf[g_log.buf_len], cap, fmt, args);
+   len = vsnprintf(&t_log.buf[t_log.buf_len], cap, fmt, args);
    va_end(args);
 
    if (len > 0)
@@ -240,8 +251,8 @@ void log_fmt(log_sev_t sev, const char *fmt, ...)
       {
          len = cap;
       }
-      g_log.buf_len           += len;
-      g_log.buf[g_log.buf_len] = 0;
+      t_log.buf_len           += len;
+      t_log.buf[t_log.buf_len] = 0;
    }
 
    log_end();
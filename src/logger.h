@@ -8,6 +8,9 @@
  * If a log statement ends in a newline, the current log is ended.
  * When the log severity changes, an implicit newline is inserted.
  *
+ * Severities above LOG_MAX_SEV (set with TOKS_LOG_MAX_SEV at configure
+ * time) are never on, so the macros for them compile to nothing.
+ *
  * @author  Ben Gardner
  * @license GPL v2+
  */
@@ -18,6 +21,13 @@
 #include <cstring>     /* strlen() */
 #include <cstdio>      /* FILE */
 
+#ifndef LOG_MAX_SEV
+#define LOG_MAX_SEV    255
+#endif
+
+/** The active severities, use log_sev_on() to test them */
+extern log_mask_t log_active_mask;
+
 
 /**
  * Initializes the log subsystem - call this first.
@@ -42,7 +52,10 @@ void log_show_sev(bool show);
  * @param sev  The severity
  * @return     true/false
  */
-bool log_sev_on(log_sev_t sev);
+static_inline bool log_sev_on(log_sev_t sev)
+{
+   return((sev <= LOG_MAX_SEV) && log_active_mask[sev]);
+}
 
 
 /**
@@ -93,7 +106,11 @@ void log_str(log_sev_t sev, const char *str, int len);
  * @param fmt     The format string
  * @param ...     Additional arguments
  */
-void log_fmt(log_sev_t sev, const char *fmt, ...);
+void log_fmt(log_sev_t sev, const char *fmt, ...)
+#ifdef __GNUC__
+__attribute__((format(printf, 2, 3)))
+#endif
+;
 
 #ifdef NO_MACRO_VARARG
 #define LOG_FMT    log_fmt
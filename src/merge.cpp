@@ -0,0 +1,351 @@
+/**
+ * @file merge.cpp
+ * Merging partial indexes into the open index, for builds that index the
+ * slices of a tree on different machines with --partial --shard k/n and
+ * put the results together with --merge.
+ *
+ * A partial index is an ordinary index, usually without the lookup indexes.
+ * It is attached to the open index and its tables are copied with one
+ * statement each: the identifiers, scopes and contents it adds get rows
+ * after those of the open index, temporary tables map its rows to those,
+ * and the definitions keep their order with their rowids moved past the
+ * last one, so the callers of the calls move with them. The reference
+ * blocks are only decoded when they name scopes that got other rows.
+ *
+ * A file the open index has with the same digest and stat is kept as it
+ * is. One with another digest or stat is replaced, so of the indexes that
+ * have a file the one merged last wins. A content the open index already
+ * has keeps its entries. The Bloom filter and the lookup indexes
+ * are made once all partial indexes are in, see index_end_merge().
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+
+#include <cstdio>
+
+
+/**
+ * The tables of the attached partial index that are copied, one statement
+ * each. MergeBase has the last rows the open index had before.
+ */
+static const char *merge_tables_sql =
+   /* The files analyzed otherwise than in the open index go first, and
+    * with them the entries of the contents no other file has
+    */
+   "CREATE TEMP TABLE MergeReplaced(Filerow INTEGER PRIMARY KEY);"
+   "INSERT INTO MergeReplaced SELECT m.rowid FROM main.Files m JOIN Partial.Files p ON p.Filename=m.Filename"
+   " WHERE p.Digest IS NOT m.Digest OR p.Size IS NOT m.Size OR p.Mtime IS NOT m.Mtime OR p.Inode IS NOT m.Inode;"
+   "CREATE TEMP TABLE MergeReleased(Content INTEGER PRIMARY KEY);"
+   "INSERT OR IGNORE INTO MergeReleased SELECT Content FROM main.Files WHERE rowid IN MergeReplaced;"
+   "DELETE FROM main.Files WHERE rowid IN MergeReplaced;"
+   "DELETE FROM MergeReleased WHERE EXISTS (SELECT 1 FROM main.Files f WHERE f.Content=MergeReleased.Content);"
+   "DELETE FROM main.RefBlocks WHERE Content IN MergeReleased;"
+   "DELETE FROM main.Defs WHERE Content IN MergeReleased;"
+   "DELETE FROM main.Decls WHERE Content IN MergeReleased;"
+   "DELETE FROM main.Calls WHERE Content IN MergeReleased;"
+   "DELETE FROM main.Regions WHERE Content IN MergeReleased;"
+   "DELETE FROM main.Contents WHERE rowid IN MergeReleased;"
+
+   /* Taken after that, a content added may get the rowid of one released */
+   "CREATE TEMP TABLE MergeBase AS SELECT"
+   " (SELECT ifnull(max(rowid),0) FROM main.Identifiers) AS Identifiers,"
+   " (SELECT ifnull(max(rowid),0) FROM main.Contents) AS Contents,"
+   " (SELECT ifnull(max(rowid),0) FROM main.Files) AS Files,"
+   " (SELECT ifnull(max(rowid),0) FROM main.Defs) AS Defs;"
+
+   /* The files new to the index and the contents they add */
+   "CREATE TEMP TABLE MergeFiles(Filerow INTEGER PRIMARY KEY);"
+   "INSERT INTO MergeFiles SELECT p.rowid FROM Partial.Files p"
+   " WHERE NOT EXISTS (SELECT 1 FROM main.Files m WHERE m.Filename=p.Filename);"
+   "INSERT OR IGNORE INTO main.Contents(Digest,Lang) SELECT Digest,Lang FROM Partial.Contents"
+   " WHERE rowid IN (SELECT Content FROM Partial.Files WHERE rowid IN MergeFiles) ORDER BY rowid;"
+   "CREATE TEMP TABLE MergeContents(Old INTEGER PRIMARY KEY, New INTEGER);"
+   "INSERT INTO MergeContents SELECT p.rowid,m.rowid"
+   " FROM Partial.Contents p JOIN main.Contents m ON m.Digest=p.Digest AND m.Lang=p.Lang"
+   " WHERE p.rowid IN (SELECT Content FROM Partial.Files WHERE rowid IN MergeFiles)"
+   " AND m.rowid>(SELECT Contents FROM MergeBase);"
+
+   /* The names, a new identifier brings its trigrams along */
+   "INSERT OR IGNORE INTO main.Identifiers(Identifier) SELECT Identifier FROM Partial.Identifiers ORDER BY rowid;"
+   "CREATE TEMP TABLE MergeIdentifiers(Old INTEGER PRIMARY KEY, New INTEGER);"
+   "INSERT INTO MergeIdentifiers SELECT p.rowid,m.rowid"
+   " FROM Partial.Identifiers p JOIN main.Identifiers m ON m.Identifier=p.Identifier;"
+   "INSERT OR IGNORE INTO main.Trigrams SELECT t.Trigram,i.New"
+   " FROM Partial.Trigrams t JOIN MergeIdentifiers i ON i.Old=t.Idrow"
+   " WHERE i.New>(SELECT Identifiers FROM MergeBase);"
+   "INSERT OR IGNORE INTO main.Scopes(Scope) SELECT Scope FROM Partial.Scopes ORDER BY rowid;"
+   "CREATE TEMP TABLE MergeScopes(Old INTEGER PRIMARY KEY, New INTEGER);"
+   "INSERT INTO MergeScopes SELECT p.rowid,m.rowid"
+   " FROM Partial.Scopes p JOIN main.Scopes m ON m.Scope=p.Scope;"
+
+   /* The entries of the new contents */
+   "INSERT INTO main.Regions SELECT c.New,r.Line,r.Lines,r.Digest"
+   " FROM Partial.Regions r JOIN MergeContents c ON c.Old=r.Content;"
+   "INSERT INTO main.Defs(rowid,Content,Line,ColumnStart,Scope,Type,Identifier,ColumnEnd)"
+   " SELECT d.rowid+(SELECT Defs FROM MergeBase),c.New,d.Line,d.ColumnStart,s.New,d.Type,i.New,d.ColumnEnd"
+   " FROM Partial.Defs d JOIN MergeContents c ON c.Old=d.Content"
+   " JOIN MergeScopes s ON s.Old=d.Scope JOIN MergeIdentifiers i ON i.Old=d.Identifier;"
+   "INSERT INTO main.Decls"
+   " SELECT c.New,d.Line,d.ColumnStart,s.New,d.Type,i.New,d.ColumnEnd"
+   " FROM Partial.Decls d JOIN MergeContents c ON c.Old=d.Content"
+   " JOIN MergeScopes s ON s.Old=d.Scope JOIN MergeIdentifiers i ON i.Old=d.Identifier;"
+   "INSERT INTO main.Calls"
+   " SELECT c.New,d.Line,d.ColumnStart,s.New,d.Type,i.New,d.ColumnEnd,d.Caller+(SELECT Defs FROM MergeBase)"
+   " FROM Partial.Calls d JOIN MergeContents c ON c.Old=d.Content"
+   " JOIN MergeScopes s ON s.Old=d.Scope JOIN MergeIdentifiers i ON i.Old=d.Identifier;"
+
+   /* and the files, noted for the servers following the changes */
+   "INSERT INTO main.Files(Digest,Filename,Size,Mtime,Inode,Content)"
+   " SELECT f.Digest,f.Filename,f.Size,f.Mtime,f.Inode,m.rowid"
+   " FROM Partial.Files f JOIN Partial.Contents p ON p.rowid=f.Content"
+   " JOIN main.Contents m ON m.Digest=p.Digest AND m.Lang=p.Lang"
+   " WHERE f.rowid IN MergeFiles ORDER BY f.rowid;"
+   "INSERT INTO main.Changes SELECT Filename,Content FROM main.Files"
+   " WHERE rowid>(SELECT Files FROM MergeBase);";
+
+static const char *merge_drop_sql =
+   "DROP TABLE IF EXISTS temp.MergeReplaced;"
+   "DROP TABLE IF EXISTS temp.MergeReleased;"
+   "DROP TABLE IF EXISTS temp.MergeBase;"
+   "DROP TABLE IF EXISTS temp.MergeFiles;"
+   "DROP TABLE IF EXISTS temp.MergeContents;"
+   "DROP TABLE IF EXISTS temp.MergeIdentifiers;"
+   "DROP TABLE IF EXISTS temp.MergeScopes;";
+
+
+/* Run a query of one number */
+static int merge_count(const char *sql, sqlite3_int64& count)
+{
+   sqlite3_stmt *stmt = NULL;
+   int result;
+
+   count  = 0;
+   result = sqlite3_prepare_v2(cpd.index, sql, -1, &stmt, NULL);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(stmt);
+      if (result == SQLITE_ROW)
+      {
+         count  = sqlite3_column_int64(stmt, 0);
+         result = SQLITE_OK;
+      }
+   }
+   (void) sqlite3_finalize(stmt);
+
+   return(result);
+}
+
+
+/* Give the references the scope rows of the open index, false for an unknown scope */
+static bool merge_map_scopes(const unordered_map<sqlite3_int64, sqlite3_int64>& scopes,
+                             vector<block_ref>& refs)
+{
+   for (size_t idx = 0; idx < refs.size(); idx++)
+   {
+      unordered_map<sqlite3_int64, sqlite3_int64>::const_iterator it = scopes.find(refs[idx].scope);
+
+      if (it == scopes.end())
+      {
+         return(false);
+      }
+      refs[idx].scope = it->second;
+   }
+   return(true);
+}
+
+
+/**
+ * Copy the reference blocks of the new contents. The scope rows in a block
+ * are mapped to those of the open index, unless all scopes kept their rows.
+ */
+static int merge_ref_blocks(void)
+{
+   unordered_map<sqlite3_int64, sqlite3_int64> scopes;
+   sqlite3_stmt *stmt = NULL, *stmt_insert = NULL;
+   vector<block_ref> refs;
+   vector<UINT8> block;
+   sqlite3_int64 moved;
+   int result;
+
+   result = merge_count("SELECT count(*) FROM MergeScopes WHERE Old<>New", moved);
+
+   if ((result == SQLITE_OK) && (moved > 0))
+   {
+      result = sqlite3_prepare_v2(cpd.index, "SELECT Old,New FROM MergeScopes", -1, &stmt, NULL);
+      if (result == SQLITE_OK)
+      {
+         while ((result = sqlite3_step(stmt)) == SQLITE_ROW)
+         {
+            scopes[sqlite3_column_int64(stmt, 0)] = sqlite3_column_int64(stmt, 1);
+         }
+         if (result == SQLITE_DONE)
+         {
+            result = SQLITE_OK;
+         }
+      }
+      (void) sqlite3_finalize(stmt);
+      stmt = NULL;
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "SELECT c.New,i.New,r.Refs FROM Partial.RefBlocks r"
+                                  " JOIN MergeContents c ON c.Old=r.Content"
+                                  " JOIN MergeIdentifiers i ON i.Old=r.Identifier",
+                                  -1,
+                                  &stmt,
+                                  NULL);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_prepare_v2(cpd.index,
+                                  "INSERT INTO main.RefBlocks VALUES(?,?,?)",
+                                  -1,
+                                  &stmt_insert,
+                                  NULL);
+   }
+
+   while ((result == SQLITE_OK) && ((result = sqlite3_step(stmt)) == SQLITE_ROW))
+   {
+      const void *data = sqlite3_column_blob(stmt, 2);
+      int size = sqlite3_column_bytes(stmt, 2);
+
+      if (!scopes.empty())
+      {
+         refs.clear();
+         if (!index_decode_refs(data, size, refs) || !merge_map_scopes(scopes, refs))
+         {
+            result = SQLITE_CORRUPT;
+            break;
+         }
+         index_encode_refs(refs, block);
+         data = block.empty() ? NULL : &block[0];
+         size = (int) block.size();
+      }
+
+      result = sqlite3_bind_int64(stmt_insert, 1, sqlite3_column_int64(stmt, 0));
+      result |= sqlite3_bind_int64(stmt_insert, 2, sqlite3_column_int64(stmt, 1));
+      result |= sqlite3_bind_blob(stmt_insert, 3, data, size, SQLITE_STATIC);
+
+      if (result == SQLITE_OK)
+      {
+         result = sqlite3_step(stmt_insert);
+         if (result == SQLITE_DONE)
+         {
+            result = sqlite3_reset(stmt_insert);
+         }
+      }
+   }
+   if (result == SQLITE_DONE)
+   {
+      result = SQLITE_OK;
+   }
+
+   (void) sqlite3_finalize(stmt);
+   (void) sqlite3_finalize(stmt_insert);
+
+   return(result);
+}
+
+
+/**
+ * Add the files of a partial index to the open index, in one transaction.
+ * index_end_merge() finishes the index once all partial indexes are in.
+ */
+bool merge_index(const char *partial_file)
+{
+   sqlite3_stmt *stmt = NULL;
+   sqlite3_int64 files = 0, replaced = 0;
+   char *errmsg = NULL;
+   sqlite3 *db;
+   int result;
+
+   /* Checks the version, and that it exists, ATTACH would create it */
+   if (!index_open_shard(partial_file, &db))
+   {
+      return(false);
+   }
+   (void) sqlite3_close(db);
+
+   result = sqlite3_prepare_v2(cpd.index, "ATTACH ? AS Partial", -1, &stmt, NULL);
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_bind_text(stmt, 1, partial_file, -1, SQLITE_STATIC);
+   }
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_step(stmt);
+      if (result == SQLITE_DONE)
+      {
+         result = SQLITE_OK;
+      }
+   }
+   (void) sqlite3_finalize(stmt);
+
+   if (result != SQLITE_OK)
+   {
+      LOG_FMT(LERR, "Unable to open the partial index %s (%d: %s)\n", partial_file, result,
+              sqlite3_errmsg(cpd.index));
+      return(false);
+   }
+
+   result = sqlite3_exec(cpd.index, merge_drop_sql, NULL, NULL, &errmsg);
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_exec(cpd.index, "BEGIN", NULL, NULL, &errmsg);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_exec(cpd.index, merge_tables_sql, NULL, NULL, &errmsg);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = merge_ref_blocks();
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = merge_count("SELECT count(*) FROM MergeFiles", files);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = merge_count("SELECT count(*) FROM MergeReplaced", replaced);
+   }
+
+   if (result == SQLITE_OK)
+   {
+      result = sqlite3_exec(cpd.index, "COMMIT", NULL, NULL, &errmsg);
+   }
+
+   if (result != SQLITE_OK)
+   {
+      LOG_FMT(LERR, "merge_index: %s: access error (%d: %s)\n", partial_file, result,
+              (errmsg != NULL) ? errmsg : sqlite3_errstr(result));
+      if (sqlite3_get_autocommit(cpd.index) == 0)
+      {
+         (void) sqlite3_exec(cpd.index, "ROLLBACK", NULL, NULL, NULL);
+      }
+   }
+   sqlite3_free(errmsg);
+
+   (void) sqlite3_exec(cpd.index, merge_drop_sql, NULL, NULL, NULL);
+   (void) sqlite3_exec(cpd.index, "DETACH Partial", NULL, NULL, NULL);
+
+   if (result != SQLITE_OK)
+   {
+      return(false);
+   }
+
+   LOG_FMT(LNOTE, "Merged %d files from %s, %d of them replaced those the index had\n",
+           (int) files, partial_file, (int) replaced);
+   return(true);
+}
@@ -11,6 +11,7 @@
 #include "chunk_list.h"
 #include <cctype>
 #include <cstdlib>
+#include <cstring>
 
 
 const char *type_strings[] =
@@ -53,7 +54,141 @@ static id_sub_type sub_type_from_flags(chunk_t *pc)
       return IST_REFERENCE;
 }
 
-void output_identifier(
+static const char *const format_names[] =
+{
+   "text",
+   "json",
+   "null-separated",
+   "vim-quickfix",
+};
+
+
+/**
+ * Finds the output format with the name given to --format.
+ *
+ * @return false if there is no such format
+ */
+bool output_format_from_name(const char *name, output_format& format)
+{
+   for (int idx = 0; idx < (int)ARRAY_SIZE(format_names); idx++)
+   {
+      if (strcmp(name, format_names[idx]) == 0)
+      {
+         format = (output_format)idx;
+         return(true);
+      }
+   }
+   return(false);
+}
+
+
+void output_sink_init(output_sink& sink, FILE *out, output_format format, int limit)
+{
+   sink.out    = out;
+   sink.format = format;
+   sink.limit  = limit;
+   sink.count  = 0;
+   sink.query  = NULL;
+   sink.rows   = NULL;
+   sink.len    = 0;
+}
+
+
+/* Write the buffered results to the stream */
+bool output_flush(output_sink& sink)
+{
+   bool ok = true;
+
+   if (sink.len > 0)
+   {
+      ok       = (fwrite(sink.buf, sink.len, 1, sink.out) == 1);
+      sink.len = 0;
+   }
+   return(ok);
+}
+
+
+static void sink_put(output_sink& sink, const char *str, int len)
+{
+   if (sink.len + len > OUTPUT_SINK_SIZE)
+   {
+      (void)output_flush(sink);
+      if (len > OUTPUT_SINK_SIZE)
+      {
+         (void)fwrite(str, len, 1, sink.out);
+         return;
+      }
+   }
+   memcpy(&sink.buf[sink.len], str, len);
+   sink.len += len;
+}
+
+
+static void sink_char(output_sink& sink, char ch)
+{
+   if (sink.len == OUTPUT_SINK_SIZE)
+   {
+      (void)output_flush(sink);
+   }
+   sink.buf[sink.len++] = ch;
+}
+
+
+static void sink_str(output_sink& sink, const char *str)
+{
+   sink_put(sink, str, strlen(str));
+}
+
+
+static void sink_uint(output_sink& sink, UINT32 value)
+{
+   char digits[10];
+   int  idx = sizeof(digits);
+
+   do
+   {
+      digits[--idx] = (char)('0' + (value % 10));
+      value        /= 10;
+   } while (value != 0);
+
+   sink_put(sink, &digits[idx], sizeof(digits) - idx);
+}
+
+
+static void sink_json_str(output_sink& sink, const char *str)
+{
+   sink_char(sink, '"');
+   for ( ; *str != 0; str++)
+   {
+      UINT8 ch = (UINT8)*str;
+
+      if ((ch == '"') || (ch == '\\'))
+      {
+         sink_char(sink, '\\');
+         sink_char(sink, ch);
+      }
+      else if (ch < 0x20)
+      {
+         sink_str(sink, "\\u00");
+         sink_char(sink, to_hex_char(ch >> 4));
+         sink_char(sink, to_hex_char(ch));
+      }
+      else
+      {
+         sink_char(sink, ch);
+      }
+   }
+   sink_char(sink, '"');
+}
+
+
+/**
+ * Adds a lookup result to the sink in its format.
+ *
+ * @return false once the limit of the sink is reached
+ */
+bool output_identifier(
+   output_sink& sink,
    const char *filename,
    UINT32 line,
    UINT32 column_start,
@@ -62,17 +197,116 @@ void output_identifier(
    id_sub_type sub_type,
    const char *identifier)
 {
-   printf("%s:%u:%d %s %s %s %s\n", filename, line, column_start, scope, type_strings[type], sub_type_strings[sub_type], identifier);
+   switch (sink.format)
+   {
+      case OF_TEXT:
+      case OF_VIM:
+         /* The quickfix list only understands its own lines */
+         if ((sink.query != NULL) && (sink.format == OF_TEXT))
+         {
+            sink_str(sink, sink.query);
+            sink_char(sink, '\t');
+         }
+         sink_str(sink, filename);
+         sink_char(sink, ':');
+         sink_uint(sink, line);
+         sink_char(sink, ':');
+         sink_uint(sink, column_start);
+         if (sink.format == OF_VIM)
+         {
+            sink_char(sink, ':');
+         }
+         sink_char(sink, ' ');
+         sink_str(sink, scope);
+         sink_char(sink, ' ');
+         sink_str(sink, type_strings[type]);
+         sink_char(sink, ' ');
+         sink_str(sink, sub_type_strings[sub_type]);
+         sink_char(sink, ' ');
+         sink_str(sink, identifier);
+         sink_char(sink, '\n');
+         break;
+
+      case OF_JSON:
+         if (sink.query != NULL)
+         {
+            sink_str(sink, "{\"query\":");
+            sink_json_str(sink, sink.query);
+            sink_str(sink, ",\"file\":");
+         }
+         else
+         {
+            sink_str(sink, "{\"file\":");
+         }
+         sink_json_str(sink, filename);
+         sink_str(sink, ",\"line\":");
+         sink_uint(sink, line);
+         sink_str(sink, ",\"column\":");
+         sink_uint(sink, column_start);
+         sink_str(sink, ",\"scope\":");
+         sink_json_str(sink, scope);
+         sink_str(sink, ",\"type\":\"");
+         sink_str(sink, type_strings[type]);
+         sink_str(sink, "\",\"sub_type\":\"");
+         sink_str(sink, sub_type_strings[sub_type]);
+         sink_str(sink, "\",\"identifier\":");
+         sink_json_str(sink, identifier);
+         sink_str(sink, "}\n");
+         break;
+
+      case OF_NUL:
+         if (sink.query != NULL)
+         {
+            sink_put(sink, sink.query, strlen(sink.query) + 1);
+         }
+         sink_put(sink, filename, strlen(filename) + 1);
+         sink_uint(sink, line);
+         sink_char(sink, 0);
+         sink_uint(sink, column_start);
+         sink_char(sink, 0);
+         sink_put(sink, scope, strlen(scope) + 1);
+         sink_put(sink, type_strings[type], strlen(type_strings[type]) + 1);
+         sink_put(sink, sub_type_strings[sub_type], strlen(sub_type_strings[sub_type]) + 1);
+         sink_put(sink, identifier, strlen(identifier) + 1);
+         break;
+   }
+
+   sink.count++;
+   return((sink.limit == 0) || (sink.count < sink.limit));
 }
 
+/* A function body being output, its calls are made by the definition */
+struct output_body
+{
+   chunk_t *close;
+   int     definition;  // index into fp_data::entries
+};
+
 void output(fp_data& fpd)
 {
    chunk_t *pc;
    id_type type;
    id_sub_type sub_type;
+   vector<output_body> bodies;
+   int definition = -1;
 
    for (pc = chunk_get_head(fpd); pc != NULL; pc = chunk_get_next(pc))
    {
+      if (!bodies.empty() && (pc == bodies.back().close))
+         bodies.pop_back();
+
+      if ((pc->type == CT_BRACE_OPEN) && (definition >= 0) &&
+          ((pc->parent_type == CT_FUNC_DEF) || (pc->parent_type == CT_FUNC_CLASS)))
+      {
+         output_body body;
+
+         body.close = chunk_skip_to_match(pc);
+         body.definition = definition;
+         if (body.close != NULL)
+            bodies.push_back(body);
+         definition = -1;
+      }
+
       if (pc->flags & PCF_PUNCTUATOR)
          continue;
 
@@ -191,13 +425,25 @@ void output(fp_data& fpd)
             continue;
       }
 
-      (void) index_insert_entry(fpd,
-                                pc->orig_line,
-                                pc->orig_col,
-                                pc->scope.c_str(),
-                                type,
-                                sub_type,
-                                pc->str.c_str());
+      fpd.entries.push_back(index_entry());
+      index_entry& entry = fpd.entries.back();
+      entry.line = pc->orig_line;
+      entry.column_start = pc->orig_col;
+      entry.column_end = pc->orig_col_end;
+      entry.type = type;
+      entry.sub_type = sub_type;
+      entry.scope = pc->scope;
+      entry.identifier.assign(pc->text(), pc->len());
+      entry.caller = -1;
+
+      if ((type == IT_FUNCTION) && (sub_type == IST_DEFINITION))
+      {
+         definition = (int) fpd.entries.size() - 1;
+      }
+      else if ((pc->type == CT_FUNC_CALL) && !bodies.empty())
+      {
+         entry.caller = bodies.back().definition;
+      }
    }
 }
 
@@ -216,7 +462,7 @@ void output_dump_tokens(fp_data& fpd)
       }
       printf("\n%4d %-13.13s %-13.13s %-13.13s [%2d-%2d][%d/%d/%d]",
               pc->orig_line, get_token_name(pc->type),
-              get_token_name(pc->parent_type), pc->scope_text(),
+              get_token_name(pc->parent_type), scope_name(fpd, pc->scope).c_str(),
               pc->orig_col, pc->orig_col_end,
               pc->brace_level, pc->level, pc->pp_level);
 
@@ -226,7 +472,7 @@ void output_dump_tokens(fp_data& fpd)
       }
       else if (pc->len() != 0)
       {
-         printf(" %-15s ", pc->str.c_str());
+         printf(" %-15.*s ", pc->len(), pc->text());
       }
       else
       {
@@ -0,0 +1,284 @@
+/**
+ * @file parallel.cpp
+ * Analyzes source files on a pool of worker threads, while the calling thread
+ * is the only one writing to the index.
+ *
+ * Results are stored in the order the files were queued, so the index ends up
+ * identical to the one built by a sequential run.
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+#include "WorkQueue.h"
+#include "SourceList.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+struct file_job
+{
+   size_t  seq;
+   string  filename;
+   fp_data *fpd;
+   bool    changed;   /* read and needs to be checked against the index */
+   bool    analyzed;
+   bool    failed;    /* could not be read */
+};
+
+
+struct parallel_ctx
+{
+   WorkQueue<file_job *>     input;
+   std::mutex                lock;
+   std::condition_variable   changed;
+   map<size_t, file_job *>   done;        /* finished, waiting to be stored */
+   size_t                    next_store;  /* seq of the next job to store */
+   size_t                    window;      /* max jobs ahead of next_store */
+   int                       running;     /* workers still running */
+   const indexed_file_map    *files;     /* snapshot of the index */
+   indexed_content_set       contents;   /* analyzed or being analyzed */
+   bool                      dump;
+};
+
+
+static void worker_main(parallel_ctx *ctx)
+{
+   file_job *job;
+
+   while (ctx->input.Pop(job))
+   {
+      {
+         /* Don't get too far ahead of the index writer */
+         std::unique_lock<std::mutex> guard(ctx->lock);
+         while (job->seq >= ctx->next_store + ctx->window)
+         {
+            ctx->changed.wait(guard);
+         }
+      }
+
+      job->fpd = new fp_data;
+      job->changed = stat_source_file(*job->fpd, job->filename.c_str());
+      job->failed  = !job->changed;
+
+      indexed_file_map::const_iterator it = ctx->files->find(job->filename);
+      bool indexed = (it != ctx->files->end());
+
+      /* Skip files that haven't been touched since they were indexed */
+      if (job->changed && indexed && (it->second.stat == job->fpd->stat))
+      {
+         job->changed = false;
+      }
+
+      if (job->changed)
+      {
+         job->changed = read_source_file(*job->fpd);
+         job->failed  = !job->changed;
+      }
+
+      /* Only the stat information changed if the digest is the same. The
+       * writer takes care of updating it.
+       */
+      job->analyzed = job->changed &&
+                      !(indexed && (it->second.digest == job->fpd->digest));
+
+      /* A copy of a content another file has is linked to its entries */
+      if (job->analyzed)
+      {
+         std::unique_lock<std::mutex> guard(ctx->lock);
+         job->analyzed = ctx->contents.insert(make_pair(job->fpd->digest,
+                                                        job->fpd->lang_flags)).second;
+      }
+
+      if (job->analyzed)
+      {
+         analyze_source_file(*job->fpd, ctx->dump);
+
+         /* Only the entries are needed from here on, unless the writer
+          * finds regions of a large file to keep
+          */
+         if (!(indexed && region_candidate(*job->fpd)))
+         {
+            job->fpd->data.Release();
+         }
+      }
+
+      std::unique_lock<std::mutex> guard(ctx->lock);
+      ctx->done[job->seq] = job;
+      ctx->changed.notify_all();
+   }
+
+   std::unique_lock<std::mutex> guard(ctx->lock);
+   ctx->running--;
+   ctx->changed.notify_all();
+}
+
+
+/* Queue the source files for the workers */
+static void feeder_main(parallel_ctx *ctx, SourceList *source_files)
+{
+   string filename;
+   size_t seq = 0;
+
+   while (source_files->Next(filename))
+   {
+      file_job *job = new file_job;
+      job->seq      = seq++;
+      job->filename = filename;
+      job->fpd      = NULL;
+      job->changed  = false;
+      job->analyzed = false;
+      job->failed   = false;
+      ctx->input.Push(job);
+   }
+   ctx->input.Close();
+}
+
+
+/* Store the finished jobs in queue order, returns when all workers are done */
+static void store_results(parallel_ctx& ctx)
+{
+   std::unique_lock<std::mutex> guard(ctx.lock);
+
+   while (true)
+   {
+      map<size_t, file_job *>::iterator it = ctx.done.find(ctx.next_store);
+
+      if (it == ctx.done.end())
+      {
+         if ((ctx.running == 0) && ctx.done.empty())
+         {
+            break;
+         }
+         ctx.changed.wait(guard);
+         continue;
+      }
+
+      file_job *job = it->second;
+      ctx.done.erase(it);
+      guard.unlock();
+
+      if (job->changed && index_prepare_for_file(*job->fpd))
+      {
+         /* The index changed since the snapshot was taken, or the file
+          * with the same content comes later. A large file that keeps some
+          * of its regions has only the window between them analyzed again.
+          */
+         if (!job->analyzed || job->fpd->window.partial)
+         {
+            analyze_source_file(*job->fpd, ctx.dump);
+         }
+         stats_file(*job->fpd);
+         (void) index_insert_entries(*job->fpd);
+      }
+      else
+      {
+         if (job->failed)
+         {
+            cpd.failed_files++;
+         }
+         stats_skipped();
+      }
+      delete job->fpd;
+      delete job;
+
+      guard.lock();
+      ctx.next_store++;
+      ctx.changed.notify_all();
+   }
+}
+
+
+/**
+ * Analyze the source files using a number of worker threads and store the
+ * results in the index from the calling thread.
+ *
+ * @param source_files  The files to analyze, read on a separate thread
+ * @param jobs          Number of worker threads
+ * @param dump          Dump the tokens of each analyzed file
+ * @return              false if the index could not be read
+ */
+bool index_files_parallel(SourceList& source_files, int jobs, bool dump)
+{
+   indexed_file_map files;
+   parallel_ctx   ctx;
+   vector<std::thread> workers;
+
+   if (!index_load_files(files, ctx.contents))
+   {
+      return(false);
+   }
+
+   ctx.next_store = 0;
+   ctx.window     = 4 * jobs;
+   ctx.running    = jobs;
+   ctx.files      = &files;
+   ctx.dump       = dump;
+
+   LOG_FMT(LNOTE, "Analyzing files using %d threads\n", jobs);
+
+   for (int i = 0; i < jobs; i++)
+   {
+      workers.push_back(std::thread(worker_main, &ctx));
+   }
+
+   /* The list may still be arriving, so it is read while storing results */
+   std::thread feeder(feeder_main, &ctx, &source_files);
+
+   store_results(ctx);
+
+   feeder.join();
+   for (size_t i = 0; i < workers.size(); i++)
+   {
+      workers[i].join();
+   }
+
+   return(true);
+}
+
+
+static void exist_main(const vector<string> *filenames, vector<char> *exists,
+                       std::atomic<size_t> *next)
+{
+   size_t idx;
+
+   while ((idx = (*next)++) < filenames->size())
+   {
+      struct stat buffer;
+      (*exists)[idx] = (stat((*filenames)[idx].c_str(), &buffer) == 0);
+   }
+}
+
+
+/**
+ * Check which files exist, spread over a number of threads.
+ *
+ * @param filenames  The files to check
+ * @param exists     Gets a flag per file
+ * @param jobs       Number of threads
+ */
+void files_exist(const vector<string>& filenames, vector<char>& exists, int jobs)
+{
+   std::atomic<size_t> next(0);
+   vector<std::thread> workers;
+
+   exists.assign(filenames.size(), 0);
+
+   for (int i = 1; (i < jobs) && ((size_t) i < filenames.size()); i++)
+   {
+      workers.push_back(std::thread(exist_main, &filenames, &exists, &next));
+   }
+   exist_main(&filenames, &exists, &next);
+
+   for (size_t i = 0; i < workers.size(); i++)
+   {
+      workers[i].join();
+   }
+}
@@ -11,6 +11,8 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cstddef>
+#include <algorithm>
 
 /**
  * Logs one parse frame
@@ -69,11 +71,28 @@ static void pf_log_all(fp_data& fpd, log_sev_t logsev)
 
 
 /**
- * Copies src to dst.
+ * Copies src to dst, of the paren stack only the entries in use. Dense
+ * #ifdef ladders copy frames all the time and seldom have more than a few
+ * of the 128 entries in use.
  */
 static void pf_copy(struct parse_frame *dst, const struct parse_frame *src)
 {
-   memcpy(dst, src, sizeof(struct parse_frame));
+   const size_t pse_end = offsetof(struct parse_frame, pse_tos);
+   int          used    = min(max(src->pse_tos + 1, 0), (int)ARRAY_SIZE(src->pse));
+
+   memcpy(dst, src, offsetof(struct parse_frame, pse));
+   memcpy(dst->pse, src->pse, used * sizeof(src->pse[0]));
+   memcpy((char *) dst + pse_end, (const char *) src + pse_end, sizeof(*src) - pse_end);
+}
+
+
+/* Make room for one more frame on the stack, it has no limit */
+static void pf_grow(fp_data& fpd)
+{
+   if (fpd.frame_count >= (int)fpd.frames.size())
+   {
+      fpd.frames.resize(fpd.frame_count + 1);
+   }
 }
 
 
@@ -83,14 +102,10 @@ static void pf_copy(struct parse_frame *dst, const struct parse_frame *src)
  */
 void pf_push(fp_data& fpd, struct parse_frame *pf)
 {
-   static int ref_no = 1;
-
-   if (fpd.frame_count < (int)ARRAY_SIZE(fpd.frames))
-   {
-      pf_copy(&fpd.frames[fpd.frame_count], pf);
-      fpd.frame_count++;
-      pf->ref_no = ref_no++;
-   }
+   pf_grow(fpd);
+   pf_copy(&fpd.frames[fpd.frame_count], pf);
+   fpd.frame_count++;
+   pf->ref_no = ++fpd.frame_ref_no;
    LOG_FMT(LPF, "%s: count = %d\n", __func__, fpd.frame_count);
 }
 
@@ -107,9 +122,9 @@ void pf_push_under(fp_data& fpd, struct parse_frame *pf)
 
    LOG_FMT(LPF, "%s: before count = %d\n", __func__, fpd.frame_count);
 
-   if ((fpd.frame_count < (int)ARRAY_SIZE(fpd.frames)) &&
-       (fpd.frame_count >= 1))
+   if (fpd.frame_count >= 1)
    {
+      pf_grow(fpd);
       npf1 = &fpd.frames[fpd.frame_count - 1];
       npf2 = &fpd.frames[fpd.frame_count];
       pf_copy(npf2, npf1);
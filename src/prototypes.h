@@ -14,15 +14,94 @@
 #include <string>
 #include <deque>
 
+class SourceList;
+
 /*
  *  toks.cpp
  */
 
 const char *get_token_name(c_token_t token);
 c_token_t find_token_name(const char *text);
+const char *get_stage_name(stage_t stage);
+const char *get_limit_name(file_limit limit);
+UINT64 stage_clock();
 const char *path_basename(const char *path);
 int path_dirname_len(const char *filename);
 const char *get_file_extension(int& idx);
+bool is_source_file(const char *filename);
+bool stat_source_file(fp_data& fpd, const char *filename);
+bool get_file_stat(const char *filename, file_stat& st);
+bool read_source_file(fp_data& fpd);
+void analyze_source_file(fp_data& fpd, bool dump);
+bool analysis_overdue(fp_data& fpd);
+bool index_source_files(SourceList& source_files, int jobs, bool dump);
+bool index_source_list(SourceList& source_files, int jobs, bool dump, bool prune_unlisted);
+
+
+/*
+ *  parallel.cpp
+ */
+
+bool index_files_parallel(SourceList& source_files, int jobs, bool dump);
+void files_exist(const vector<string>& filenames, vector<char>& exists, int jobs);
+
+
+/*
+ *  git.cpp
+ */
+
+bool git_index_revision(const char *rev, int jobs, bool dump);
+
+
+/*
+ *  watch.cpp
+ */
+
+bool index_watch(const char *dir, int jobs, bool dump);
+
+
+/*
+ *  shards.cpp
+ */
+
+bool shards_is_sharded(const char *index_file);
+UINT32 shards_hash(const string& filename);
+bool shards_index_files(const char *dir, const char *shard_by, SourceList& source_files,
+                        int jobs, bool dump, bool prune_unlisted);
+bool shards_open(const char *dir);
+bool shards_opened();
+bool shards_lookup_identifier(output_sink& sink, const char *identifier, int sub_types,
+                              bool ranked, const char *near);
+void shards_close();
+
+
+/*
+ *  compact.cpp
+ */
+
+bool compact_export(const char *filename);
+bool compact_is_compact(const char *filename);
+bool compact_open(const char *filename);
+bool compact_opened();
+bool compact_lookup_identifier(output_sink& sink, const char *identifier, int sub_types,
+                               bool ranked, const char *near);
+void compact_close();
+
+
+
+/*
+ *  merge.cpp
+ */
+
+bool merge_index(const char *partial_file);
+
+/*
+ *  server.cpp
+ */
+
+bool index_serve(const char *socket_path);
+bool index_query_server(const char *socket_path, const char *identifier, int sub_types,
+                        output_format format, int limit, bool ranked, const char *near);
 
 
 /*
@@ -31,7 +110,11 @@ const char *get_file_extension(int& idx);
 
 void output(fp_data& fpd);
 void output_dump_tokens(fp_data& fpd);
-void output_identifier(
+bool output_format_from_name(const char *name, output_format& format);
+void output_sink_init(output_sink& sink, FILE *out, output_format format, int limit);
+bool output_flush(output_sink& sink);
+bool output_identifier(
+   output_sink& sink,
    const char *filename,
    UINT32 line,
    UINT32 column_start,
@@ -46,6 +129,7 @@ void output_identifier(
  */
 
 void fix_symbols(fp_data& fpd);
+void fix_symbols_degraded(fp_data& fpd);
 void combine_labels(fp_data& fpd);
 void make_type(chunk_t *pc);
 
@@ -79,10 +163,24 @@ void tokenize_cleanup(fp_data& fpd);
 void brace_cleanup(fp_data& fpd);
 
 
+/*
+ *  stats.cpp
+ */
+
+bool stats_open(const char *path);
+bool stats_enabled();
+void stats_file(const fp_data& fpd);
+void stats_skipped();
+void stats_commit(UINT64 ns);
+void stats_create_indexes(UINT64 ns);
+void stats_close();
+
+
 /*
  *  keywords.cpp
  */
 
+void init_keywords();
 bool load_keyword_file(const char *filename);
 c_token_t find_keyword_type(const char *word, int len, c_token_t in_preproc, int lang_flags);
 void add_keyword(const char *tag, c_token_t type);
@@ -119,13 +217,25 @@ chunk_t *pawn_add_vsemi_after(fp_data& fpd, chunk_t *pc);
 /*
  * unicode.cpp
  */
-bool decode_file(vector<UINT8>& out_data, const char *filename);
+bool decode_file(SourceBuffer& out_data, const char *filename, bool read);
+
+
+/*
+ * regions.cpp
+ */
+bool region_candidate(const fp_data& fpd);
+bool region_window(fp_data& fpd, const vector<file_region>& old);
+bool region_window_complete(fp_data& fpd);
+void region_window_all(fp_data& fpd);
+void find_regions(fp_data& fpd);
 
 
 /*
  * scope.cpp
  */
 void assign_scope(fp_data& fpd);
+void assign_scope_degraded(fp_data& fpd);
+const string& scope_name(fp_data& fpd, int scope);
 
 
 /*
@@ -133,23 +243,39 @@ void assign_scope(fp_data& fpd);
  */
 bool index_open(const char *index_file, bool create);
 bool index_close(void);
+bool index_replaced(void);
 bool index_prepare_for_analysis(void);
-void index_end_analysis(void);
-bool index_prune_files(void);
+bool index_end_analysis(void);
+bool index_end_merge(void);
+bool index_prune_files(int jobs, const deque<string> *listed);
+bool index_remove_files(const vector<string>& filenames);
+bool index_unknown_files(const vector<string>& filenames, vector<string>& unknown);
+void index_git_commit(string& commit);
+bool index_set_git_commit(const string& commit);
 bool index_prepare_for_file(fp_data& fpd);
-void index_begin_file(fp_data& fpd);
-void index_end_file(fp_data& fpd);
-bool index_insert_entry(
-   fp_data& fpd,
-   UINT32 line,
-   UINT32 column_start,
-   const char *scope,
-   id_type type,
-   id_sub_type sub_type,
-   const char *identifier);
+bool index_insert_entries(fp_data& fpd);
+bool index_load_files(indexed_file_map& files, indexed_content_set& contents);
+bool index_file_unchanged(fp_data& fpd);
 bool index_lookup_identifier(
+   output_sink& sink,
    const char *identifier,
-   id_sub_type sub_type);
+   int sub_types,
+   bool ranked,
+   const char *near);
+bool index_lookup_batch(output_sink& sink, const char *list_file, int sub_types,
+                        bool ranked, const char *near);
+void index_near_directory(const char *near, string& dir);
+bool index_lookup_at(output_sink& sink, const char *position);
+bool index_lookup_calls(output_sink& sink, const char *function, bool callers, int depth);
+bool index_lookup_in(sqlite3 *db, sqlite3_stmt **stmts, index_bloom& bloom, output_sink& sink,
+                     const char *identifier, int sub_types, bool ranked, const char *near);
+bool index_open_shard(const char *index_file, sqlite3 **db);
+void index_close_shard(sqlite3 *db, sqlite3_stmt **stmts);
+bool index_load_into_memory(void);
+void index_encode_refs(vector<block_ref>& refs, vector<UINT8>& block);
+bool index_decode_refs(const void *data, int size, vector<block_ref>& refs);
+bool index_read_changes(sqlite3_int64& last, size_t max_changes, vector<string>& files,
+                        unordered_set<string>& identifiers, bool& all);
 
 
 /* Options we couldn't quite get rid of */
@@ -113,43 +113,28 @@ static const chunk_tag_t symbols1[] =
 
 #include "punctuators.h"
 
+/**
+ * Finds the longest punctuator at str that the language has.
+ *
+ * @param str  At least 4 chars or up to a NUL
+ */
 const chunk_tag_t *find_punctuator(const char *str, int lang_flags)
 {
-   const chunk_tag_t    *p_match = NULL;
-   const lookup_entry_t *p_tab   = punc_table;
-
-   int ch_idx = 0;
+   const chunk_tag_t *p_match = NULL;
+   int               state    = 0;
 
-   /*REVISIT: it might be faster to do a bsearch() on the first char.
-    *         the rest of the group have at most 5 entries, so it wouldn't help
-    */
-
-   while (ch_idx < 4)
+   for (int ch_idx = 0; ch_idx < 4; ch_idx++)
    {
-      if (p_tab->ch == str[ch_idx])
-      {
-         /* Match */
-         if ((p_tab->tag != NULL) &&
-             ((p_tab->tag->lang_flags & lang_flags) != 0))
-         {
-            p_match = p_tab->tag;
-         }
-         if (p_tab->next_idx == 0)
-         {
-            /* This is the end of the chain */
-            break;
-         }
-         p_tab = &punc_table[p_tab->next_idx];
-         ch_idx++;
-      }
-      else if (p_tab->left_in_group == 0)
+      state = punc_next[state][punc_class[(UINT8)str[ch_idx]]];
+      if (state == 0)
       {
-         /* The last entry in this group didn't match */
          break;
       }
-      else
+
+      const chunk_tag_t *tag = punc_accept[state];
+      if ((tag != NULL) && ((tag->lang_flags & lang_flags) != 0))
       {
-         p_tab++;
+         p_match = tag;
       }
    }
    return(p_match);
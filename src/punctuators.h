@@ -2,79 +2,184 @@
  * @file punctuators.h
  * Automatically generated
  */
-static const lookup_entry_t punc_table[] =
+
+#define PUNC_CLASSES    28
+
+/* The class of each character, 0 if it is in no punctuator */
+static const UINT8 punc_class[256] =
 {
-   { '!', 26, 27, &symbols1[0]  },   //   0: '!'
-   { '#', 25, 36, &symbols1[1]  },   //   1: '#'
-   { '$', 24,  0, &symbols1[2]  },   //   2: '$'
-   { '%', 23, 38, &symbols1[3]  },   //   3: '%'
-   { '&', 22, 39, &symbols1[4]  },   //   4: '&'
-   { '(', 21,  0, &symbols1[5]  },   //   5: '('
-   { ')', 20,  0, &symbols1[6]  },   //   6: ')'
-   { '*', 19, 41, &symbols1[7]  },   //   7: '*'
-   { '+', 18, 42, &symbols1[8]  },   //   8: '+'
-   { ',', 17,  0, &symbols1[9]  },   //   9: ','
-   { '-', 16, 44, &symbols1[10] },   //  10: '-'
-   { '.', 15, 48, &symbols1[11] },   //  11: '.'
-   { '/', 14, 51, &symbols1[12] },   //  12: '/'
-   { ':', 13, 52, &symbols1[13] },   //  13: ':'
-   { ';', 12,  0, &symbols1[14] },   //  14: ';'
-   { '<', 11, 53, &symbols1[15] },   //  15: '<'
-   { '=', 10, 58, &symbols1[16] },   //  16: '='
-   { '>',  9, 61, &symbols1[17] },   //  17: '>'
-   { '?',  8, 66, &symbols1[19] },   //  18: '?'
-   { '@',  7,  0, &symbols1[18] },   //  19: '@'
-   { '[',  6, 67, &symbols1[20] },   //  20: '['
-   { ']',  5,  0, &symbols1[21] },   //  21: ']'
-   { '^',  4, 68, &symbols1[22] },   //  22: '^'
-   { '{',  3,  0, &symbols1[23] },   //  23: '{'
-   { '|',  2, 69, &symbols1[24] },   //  24: '|'
-   { '}',  1,  0, &symbols1[25] },   //  25: '}'
-   { '~',  0, 71, &symbols1[26] },   //  26: '~'
-   { '<',  3, 31, &symbols2[0]  },   //  27: '!<'
-   { '=',  2, 34, &symbols2[1]  },   //  28: '!='
-   { '>',  1, 35, &symbols2[2]  },   //  29: '!>'
-   { '~',  0,  0, &symbols2[3]  },   //  30: '!~'
-   { '=',  1,  0, &symbols3[0]  },   //  31: '!<='
-   { '>',  0, 33, &symbols3[1]  },   //  32: '!<>'
-   { '=',  0,  0, &symbols4[0]  },   //  33: '!<>='
-   { '=',  0,  0, &symbols3[2]  },   //  34: '!=='
-   { '=',  0,  0, &symbols3[3]  },   //  35: '!>='
-   { '#',  1,  0, &symbols2[4]  },   //  36: '##'
-   { '@',  0,  0, &symbols2[5]  },   //  37: '#@'
-   { '=',  0,  0, &symbols2[6]  },   //  38: '%='
-   { '&',  1,  0, &symbols2[7]  },   //  39: '&&'
-   { '=',  0,  0, &symbols2[8]  },   //  40: '&='
-   { '=',  0,  0, &symbols2[9]  },   //  41: '*='
-   { '+',  1,  0, &symbols2[10] },   //  42: '++'
-   { '=',  0,  0, &symbols2[11] },   //  43: '+='
-   { '-',  2,  0, &symbols2[12] },   //  44: '--'
-   { '=',  1,  0, &symbols2[13] },   //  45: '-='
-   { '>',  0, 47, &symbols2[14] },   //  46: '->'
-   { '*',  0,  0, &symbols3[4]  },   //  47: '->*'
-   { '*',  1,  0, &symbols2[15] },   //  48: '.*'
-   { '.',  0, 50, &symbols2[16] },   //  49: '..'
-   { '.',  0,  0, &symbols3[5]  },   //  50: '...'
-   { '=',  0,  0, &symbols2[17] },   //  51: '/='
-   { ':',  0,  0, &symbols2[18] },   //  52: '::'
-   { '<',  2, 56, &symbols2[19] },   //  53: '<<'
-   { '=',  1,  0, &symbols2[20] },   //  54: '<='
-   { '>',  0, 57, &symbols2[21] },   //  55: '<>'
-   { '=',  0,  0, &symbols3[6]  },   //  56: '<<='
-   { '=',  0,  0, &symbols3[7]  },   //  57: '<>='
-   { '=',  1, 60, &symbols2[22] },   //  58: '=='
-   { '>',  0,  0, &symbols2[31] },   //  59: '=>'
-   { '=',  0,  0, &symbols3[8]  },   //  60: '==='
-   { '=',  1,  0, &symbols2[23] },   //  61: '>='
-   { '>',  0, 63, &symbols2[24] },   //  62: '>>'
-   { '=',  1,  0, &symbols3[9]  },   //  63: '>>='
-   { '>',  0, 65, &symbols3[10] },   //  64: '>>>'
-   { '=',  0,  0, &symbols4[1]  },   //  65: '>>>='
-   { '?',  0,  0, &symbols2[32] },   //  66: '??'
-   { ']',  0,  0, &symbols2[25] },   //  67: '[]'
-   { '=',  0,  0, &symbols2[26] },   //  68: '^='
-   { '=',  1,  0, &symbols2[27] },   //  69: '|='
-   { '|',  0,  0, &symbols2[28] },   //  70: '||'
-   { '=',  1,  0, &symbols2[29] },   //  71: '~='
-   { '~',  0,  0, &symbols2[30] },   //  72: '~~'
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0x00
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0x10
+    0,  1,  0,  2,  3,  4,  5,  0,  6,  7,  8,  9, 10, 11, 12, 13,   // 0x20
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 14, 15, 16, 17, 18, 19,   // 0x30
+   20,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0x40
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 21,  0, 22, 23,  0,   // 0x50
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0x60
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 24, 25, 26, 27,  0,   // 0x70
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0x80
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0x90
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0xa0
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0xb0
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0xc0
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0xd0
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0xe0
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0xf0
+};
+
+/* The state after a character class, 0 if no punctuator continues */
+static const UINT8 punc_next[][PUNC_CLASSES] =
+{
+   {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27 },   //   0: ''
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 28, 29, 30,  0,  0,  0,  0,  0,  0,  0,  0, 31 },   //   1: '!'
+   {  0,  0, 32,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 33,  0,  0,  0,  0,  0,  0,  0 },   //   2: '#'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //   3: '$'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 34,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //   4: '%'
+   {  0,  0,  0,  0,  0, 35,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 36,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //   5: '&'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //   6: '('
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //   7: ')'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 37,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //   8: '*'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0, 38,  0,  0,  0,  0,  0,  0,  0, 39,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //   9: '+'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  10: ','
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 40,  0,  0,  0,  0,  0, 41, 42,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  11: '-'
+   {  0,  0,  0,  0,  0,  0,  0,  0, 43,  0,  0,  0, 44,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  12: '.'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 45,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  13: '/'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 46,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  14: ':'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  15: ';'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 47, 48, 49,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  16: '<'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 50, 51,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  17: '='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 52, 53,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  18: '>'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 54,  0,  0,  0,  0,  0,  0,  0,  0 },   //  19: '?'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  20: '@'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 55,  0,  0,  0,  0,  0 },   //  21: '['
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  22: ']'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 56,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  23: '^'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  24: '{'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 57,  0,  0,  0,  0,  0,  0,  0, 58,  0,  0 },   //  25: '|'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  26: '}'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 59,  0,  0,  0,  0,  0,  0,  0,  0,  0, 60 },   //  27: '~'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 61, 62,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  28: '!<'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 63,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  29: '!='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 64,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  30: '!>'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  31: '!~'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  32: '##'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  33: '#@'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  34: '%='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  35: '&&'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  36: '&='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  37: '*='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  38: '++'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  39: '+='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  40: '--'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  41: '-='
+   {  0,  0,  0,  0,  0,  0,  0,  0, 65,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  42: '->'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  43: '.*'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 66,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  44: '..'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  45: '/='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  46: '::'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 67,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  47: '<<'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  48: '<='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 68,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  49: '<>'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 69,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  50: '=='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  51: '=>'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  52: '>='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 70, 71,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  53: '>>'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  54: '??'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  55: '[]'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  56: '^='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  57: '|='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  58: '||'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  59: '~='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  60: '~~'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  61: '!<='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 72,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  62: '!<>'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  63: '!=='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  64: '!>='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  65: '->*'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  66: '...'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  67: '<<='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  68: '<>='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  69: '==='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  70: '>>='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 73,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  71: '>>>'
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  72: '!<>='
+   {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },   //  73: '>>>='
+};
+
+/* The punctuator a state ends, NULL if it only leads to longer ones */
+static const chunk_tag_t *const punc_accept[] =
+{
+   NULL,            //   0: ''
+   &symbols1[0],    //   1: '!'
+   &symbols1[1],    //   2: '#'
+   &symbols1[2],    //   3: '$'
+   &symbols1[3],    //   4: '%'
+   &symbols1[4],    //   5: '&'
+   &symbols1[5],    //   6: '('
+   &symbols1[6],    //   7: ')'
+   &symbols1[7],    //   8: '*'
+   &symbols1[8],    //   9: '+'
+   &symbols1[9],    //  10: ','
+   &symbols1[10],   //  11: '-'
+   &symbols1[11],   //  12: '.'
+   &symbols1[12],   //  13: '/'
+   &symbols1[13],   //  14: ':'
+   &symbols1[14],   //  15: ';'
+   &symbols1[15],   //  16: '<'
+   &symbols1[16],   //  17: '='
+   &symbols1[17],   //  18: '>'
+   &symbols1[19],   //  19: '?'
+   &symbols1[18],   //  20: '@'
+   &symbols1[20],   //  21: '['
+   &symbols1[21],   //  22: ']'
+   &symbols1[22],   //  23: '^'
+   &symbols1[23],   //  24: '{'
+   &symbols1[24],   //  25: '|'
+   &symbols1[25],   //  26: '}'
+   &symbols1[26],   //  27: '~'
+   &symbols2[0],    //  28: '!<'
+   &symbols2[1],    //  29: '!='
+   &symbols2[2],    //  30: '!>'
+   &symbols2[3],    //  31: '!~'
+   &symbols2[4],    //  32: '##'
+   &symbols2[5],    //  33: '#@'
+   &symbols2[6],    //  34: '%='
+   &symbols2[7],    //  35: '&&'
+   &symbols2[8],    //  36: '&='
+   &symbols2[9],    //  37: '*='
+   &symbols2[10],   //  38: '++'
+   &symbols2[11],   //  39: '+='
+   &symbols2[12],   //  40: '--'
+   &symbols2[13],   //  41: '-='
+   &symbols2[14],   //  42: '->'
+   &symbols2[15],   //  43: '.*'
+   &symbols2[16],   //  44: '..'
+   &symbols2[17],   //  45: '/='
+   &symbols2[18],   //  46: '::'
+   &symbols2[19],   //  47: '<<'
+   &symbols2[20],   //  48: '<='
+   &symbols2[21],   //  49: '<>'
+   &symbols2[22],   //  50: '=='
+   &symbols2[31],   //  51: '=>'
+   &symbols2[23],   //  52: '>='
+   &symbols2[24],   //  53: '>>'
+   &symbols2[32],   //  54: '??'
+   &symbols2[25],   //  55: '[]'
+   &symbols2[26],   //  56: '^='
+   &symbols2[27],   //  57: '|='
+   &symbols2[28],   //  58: '||'
+   &symbols2[29],   //  59: '~='
+   &symbols2[30],   //  60: '~~'
+   &symbols3[0],    //  61: '!<='
+   &symbols3[1],    //  62: '!<>'
+   &symbols3[2],    //  63: '!=='
+   &symbols3[3],    //  64: '!>='
+   &symbols3[4],    //  65: '->*'
+   &symbols3[5],    //  66: '...'
+   &symbols3[6],    //  67: '<<='
+   &symbols3[7],    //  68: '<>='
+   &symbols3[8],    //  69: '==='
+   &symbols3[9],    //  70: '>>='
+   &symbols3[10],   //  71: '>>>'
+   &symbols4[0],    //  72: '!<>='
+   &symbols4[1],    //  73: '>>>='
 };
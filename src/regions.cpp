@@ -0,0 +1,319 @@
+/**
+ * @file regions.cpp
+ * Top level regions of large C and C++ files, so a change only analyzes the
+ * lines around it again.
+ *
+ * A region ends with a statement or function body at brace level 0 outside
+ * of any #if, or with a preprocessor line there, and only where a line
+ * ends. The parser is in the same state at every region start, so the
+ * changed regions can be analyzed on their own. The index keeps the lines
+ * and a digest of every region. When the only file with a content changes
+ * it keeps the entries of the unchanged regions at its start and end,
+ * moving the latter by the number of lines added or removed, and only the
+ * lines in between are analyzed.
+ *
+ * Note that a file wrapped in a namespace or extern "C" block is a single
+ * region.
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+#include "chunk_list.h"
+
+
+/* Smaller files are always analyzed completely */
+#define REGION_MIN_SIZE    (64 * 1024)
+
+
+/* Whether regions are kept for the file */
+bool region_candidate(const fp_data& fpd)
+{
+   return((fpd.data.Size() >= REGION_MIN_SIZE) &&
+          ((fpd.lang_flags & ~LANG_CCPP) == 0));
+}
+
+
+/**
+ * The offsets of the lines of a text, counted like the tokenizer does. A
+ * line end at the very end doesn't start another line.
+ */
+static void region_line_starts(const UINT8 *data, size_t size, vector<size_t>& starts)
+{
+   starts.clear();
+   if (size > 0)
+   {
+      starts.push_back(0);
+   }
+   for (size_t i = 0; i < size; i++)
+   {
+      if (data[i] == '\r')
+      {
+         starts.push_back(i + 1);
+      }
+      else if (data[i] == '\n')
+      {
+         if ((i > 0) && (data[i - 1] == '\r'))
+         {
+            starts.back() = i + 1;
+         }
+         else
+         {
+            starts.push_back(i + 1);
+         }
+      }
+   }
+   if ((starts.size() > 1) && (starts.back() == size))
+   {
+      starts.pop_back();
+   }
+}
+
+
+/* Offset of the line idx of the text, the end for the lines after it */
+static size_t region_offset(const vector<size_t>& starts, size_t size, int idx)
+{
+   return(((idx >= 0) && ((size_t) idx < starts.size())) ? starts[idx] : size);
+}
+
+
+/* Whether a chunk ends a region, if a line end follows */
+static bool region_end_chunk(chunk_t *pc)
+{
+   if ((pc->level != 0) || (pc->brace_level != 0) || (pc->pp_level != 0) ||
+       ((pc->flags & PCF_IN_PREPROC) != 0))
+   {
+      return(false);
+   }
+
+   return((pc->type == CT_SEMICOLON) ||
+          ((pc->type == CT_BRACE_CLOSE) &&
+           ((pc->parent_type == CT_FUNC_DEF) ||
+            (pc->parent_type == CT_FUNC_CLASS) ||
+            (pc->parent_type == CT_NAMESPACE) ||
+            (pc->parent_type == CT_EXTERN))));
+}
+
+
+/**
+ * Collect the lines starting a region after the first one in the analyzed
+ * lines.
+ *
+ * @param open  Set if the last region doesn't end like a region should
+ */
+static void region_starts(fp_data& fpd, vector<int>& starts, bool& open)
+{
+   chunk_t *prev = NULL;
+
+   open = false;
+   for (chunk_t *pc = chunk_get_head(fpd); pc != NULL; prev = pc, pc = pc->next)
+   {
+      if (pc->type == CT_NEWLINE)
+      {
+         /* After a complete preprocessor line between statements */
+         if ((prev != NULL) && ((prev->flags & PCF_IN_PREPROC) != 0) && !open &&
+             (pc->level == 0) && (pc->brace_level == 0) && (pc->pp_level == 0))
+         {
+            starts.push_back(pc->orig_line + 1);
+         }
+         continue;
+      }
+
+      if ((pc->flags & PCF_IN_PREPROC) != 0)
+      {
+         continue;
+      }
+
+      open = true;
+      if (region_end_chunk(pc) && (pc->next != NULL) && (pc->next->type == CT_NEWLINE))
+      {
+         starts.push_back(pc->next->orig_line + 1);
+         open = false;
+      }
+   }
+}
+
+
+/**
+ * Plan the analysis of a changed file, whose content had the regions old.
+ * Keeps the unchanged regions at the start and the end and sets the window
+ * to analyze the lines between them.
+ *
+ * @return false if no region is unchanged
+ */
+bool region_window(fp_data& fpd, const vector<file_region>& old)
+{
+   const UINT8 *data = fpd.data.Data();
+   size_t size = fpd.data.Size();
+   vector<size_t> starts;
+   size_t first, last;
+   int lines, shift, window_end;
+
+   if (old.empty())
+   {
+      return(false);
+   }
+
+   region_line_starts(data, size, starts);
+   lines = (int) starts.size();
+   shift = lines - (old.back().line + old.back().lines - 1);
+
+   /* The unchanged regions at the start */
+   for (first = 0; first < old.size(); first++)
+   {
+      const file_region& region = old[first];
+      size_t start = region_offset(starts, size, region.line - 1);
+      size_t end   = region_offset(starts, size, region.line + region.lines - 1);
+
+      if ((region.line + region.lines - 1 > lines) ||
+          (Digest::Calc(data + start, end - start) != region.digest))
+      {
+         break;
+      }
+   }
+   fpd.window.keep_before = (first > 0) ? old[first - 1].line + old[first - 1].lines : 1;
+
+   /* and at the end */
+   for (last = old.size(); last > first; last--)
+   {
+      const file_region& region = old[last - 1];
+      int line = region.line + shift;
+      size_t start = region_offset(starts, size, line - 1);
+      size_t end   = region_offset(starts, size, line + region.lines - 1);
+
+      if ((line < fpd.window.keep_before) ||
+          (Digest::Calc(data + start, end - start) != region.digest))
+      {
+         break;
+      }
+   }
+
+   if ((first == 0) && (last == old.size()))
+   {
+      return(false);
+   }
+
+   window_end = (last < old.size()) ? old[last].line + shift : lines + 1;
+
+   fpd.window.offset       = region_offset(starts, size, fpd.window.keep_before - 1);
+   fpd.window.size         = region_offset(starts, size, window_end - 1) - fpd.window.offset;
+   fpd.window.line         = fpd.window.keep_before;
+   fpd.window.partial      = true;
+   fpd.window.keep_from    = (last < old.size()) ? old[last].line : 0;
+   fpd.window.shift        = shift;
+
+   fpd.window.kept.assign(old.begin(), old.begin() + first);
+   for (size_t idx = last; idx < old.size(); idx++)
+   {
+      fpd.window.kept.push_back(old[idx]);
+      fpd.window.kept.back().line += shift;
+   }
+
+   LOG_FMT(LNOTE, "File %s keeps %d of %d regions, analyzing lines %d to %d\n",
+           fpd.filename, (int) fpd.window.kept.size(), (int) old.size(),
+           fpd.window.line, window_end - 1);
+   return(true);
+}
+
+
+/**
+ * Whether the analyzed window ends where the kept regions after it start,
+ * else the parser may not be in the state they were analyzed in. That
+ * includes an #if left open by the window, which only the preprocessor
+ * frames show.
+ */
+bool region_window_complete(fp_data& fpd)
+{
+   vector<int> starts;
+   bool open;
+
+   if (!fpd.window.partial || (fpd.window.keep_from == 0))
+   {
+      return(true);
+   }
+   if ((fpd.frame_pp_level != 0) || (fpd.frame_count != 0))
+   {
+      return(false);
+   }
+   region_starts(fpd, starts, open);
+   return(!open);
+}
+
+
+/**
+ * Analyze all lines of a file after all, all entries of the content are
+ * replaced
+ */
+void region_window_all(fp_data& fpd)
+{
+   fpd.window.offset      = 0;
+   fpd.window.size        = fpd.data.Size();
+   fpd.window.line        = 1;
+   fpd.window.keep_before = 0;
+   fpd.window.keep_from   = 0;
+   fpd.window.shift       = 0;
+   fpd.window.kept.clear();
+}
+
+
+/**
+ * Find the regions of the analyzed lines and add the kept ones, for a file
+ * that region_candidate() accepts.
+ */
+void find_regions(fp_data& fpd)
+{
+   const UINT8 *data = fpd.data.Data();
+   size_t size = fpd.data.Size();
+   vector<size_t> lines;
+   vector<int> starts;
+   bool open;
+   int end;
+
+   fpd.regions.clear();
+   if (!region_candidate(fpd))
+   {
+      return;
+   }
+
+   if (fpd.window.partial)
+   {
+      data += fpd.window.offset;
+      size  = fpd.window.size;
+   }
+   region_line_starts(data, size, lines);
+   end = fpd.window.line + (int) lines.size();
+
+   starts.push_back(fpd.window.line);
+   region_starts(fpd, starts, open);
+   starts.push_back(end);
+
+   /* The kept regions before the window, the found ones and those after */
+   for (size_t idx = 0; idx < fpd.window.kept.size(); idx++)
+   {
+      if (fpd.window.kept[idx].line < fpd.window.line)
+      {
+         fpd.regions.push_back(fpd.window.kept[idx]);
+      }
+   }
+   for (size_t idx = 0; idx + 1 < starts.size(); idx++)
+   {
+      if (starts[idx] < starts[idx + 1])
+      {
+         file_region region;
+         size_t start = region_offset(lines, size, starts[idx] - fpd.window.line);
+         size_t stop  = region_offset(lines, size, starts[idx + 1] - fpd.window.line);
+
+         region.line   = starts[idx];
+         region.lines  = starts[idx + 1] - starts[idx];
+         region.digest = Digest::Calc(data + start, stop - start);
+         fpd.regions.push_back(region);
+      }
+   }
+   for (size_t idx = 0; idx < fpd.window.kept.size(); idx++)
+   {
+      if (fpd.window.kept[idx].line >= end)
+      {
+         fpd.regions.push_back(fpd.window.kept[idx]);
+      }
+   }
+}
@@ -0,0 +1,185 @@
+/**
+ * @file scan.h
+ * Fast scans over the source text for the tokenizer: identifier runs,
+ * space runs and the next interesting byte in a comment. SSE2 handles 16
+ * bytes per step, other targets use the scalar loops. Nothing is read
+ * past the length given.
+ *
+ * @license GPL v2+
+ */
+#ifndef SCAN_H_INCLUDED
+#define SCAN_H_INCLUDED
+
+#include "base_types.h"
+#include "char_table.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+
+#ifdef SCAN_SSE2
+
+/* Mask of the bytes of v in [lo, hi] */
+static inline __m128i scan_in_range(__m128i v, char lo, char hi)
+{
+   __m128i off = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+
+   return(_mm_cmpeq_epi8(_mm_subs_epu8(off, _mm_set1_epi8((char) (hi - lo))),
+                         _mm_setzero_si128()));
+}
+
+
+/* Mask of the bytes of v that CharTable::IsKw2() accepts, high gets the
+ * mask of the non-ASCII ones
+ */
+static inline int scan_word_mask(__m128i v, int *high)
+{
+   __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+   __m128i ok    = scan_in_range(lower, 'a', 'z');
+
+   ok = _mm_or_si128(ok, scan_in_range(v, '0', '9'));
+   ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+   ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('$')));
+   ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('@')));
+
+   *high = _mm_movemask_epi8(v);
+   return(_mm_movemask_epi8(ok) | *high);
+}
+
+#endif
+
+
+/**
+ * Number of leading bytes that may continue an identifier.
+ *
+ * @param high  Set if any of them is not ASCII
+ */
+static inline int scan_word(const UINT8 *p, int n, bool *high)
+{
+   int i = 0;
+
+#ifdef SCAN_SSE2
+   for ( ; i + 16 <= n; i += 16)
+   {
+      int top;
+      int ok = scan_word_mask(_mm_loadu_si128((const __m128i *) (p + i)), &top);
+
+      if (ok != 0xffff)
+      {
+         int end = __builtin_ctz(~ok);
+
+         if ((top & ((1 << end) - 1)) != 0)
+         {
+            *high = true;
+         }
+         return(i + end);
+      }
+      if (top != 0)
+      {
+         *high = true;
+      }
+   }
+#endif
+
+   for ( ; (i < n) && CharTable::IsKw2(p[i]); i++)
+   {
+      if (p[i] > 0x7f)
+      {
+         *high = true;
+      }
+   }
+   return(i);
+}
+
+
+/* Number of leading space characters */
+static inline int scan_spaces(const UINT8 *p, int n)
+{
+   int i = 0;
+
+#ifdef SCAN_SSE2
+   for ( ; i + 16 <= n; i += 16)
+   {
+      __m128i v  = _mm_loadu_si128((const __m128i *) (p + i));
+      int     sp = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+
+      if (sp != 0xffff)
+      {
+         return(i + __builtin_ctz(~sp));
+      }
+   }
+#endif
+
+   while ((i < n) && (p[i] == ' '))
+   {
+      i++;
+   }
+   return(i);
+}
+
+
+/* Number of leading bytes that are none of a, b, c and d */
+static inline int scan_until(const UINT8 *p, int n, UINT8 a, UINT8 b, UINT8 c, UINT8 d)
+{
+   int i = 0;
+
+#ifdef SCAN_SSE2
+   __m128i va = _mm_set1_epi8((char) a);
+   __m128i vb = _mm_set1_epi8((char) b);
+   __m128i vc = _mm_set1_epi8((char) c);
+   __m128i vd = _mm_set1_epi8((char) d);
+
+   for ( ; i + 16 <= n; i += 16)
+   {
+      __m128i v   = _mm_loadu_si128((const __m128i *) (p + i));
+      __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                              _mm_cmpeq_epi8(v, vb)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, vc),
+                                              _mm_cmpeq_epi8(v, vd)));
+      int     m   = _mm_movemask_epi8(hit);
+
+      if (m != 0)
+      {
+         return(i + __builtin_ctz(m));
+      }
+   }
+#endif
+
+   while ((i < n) && (p[i] != a) && (p[i] != b) && (p[i] != c) && (p[i] != d))
+   {
+      i++;
+   }
+   return(i);
+}
+
+
+/* Number of UTF-8 continuation bytes, they don't take a column */
+static inline int scan_continuation_bytes(const UINT8 *p, int n)
+{
+   int i     = 0;
+   int count = 0;
+
+#ifdef SCAN_SSE2
+   for ( ; i + 16 <= n; i += 16)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+
+      /* 0x80..0xbf are the signed bytes below -64 */
+      count += __builtin_popcount(
+         _mm_movemask_epi8(_mm_cmplt_epi8(v, _mm_set1_epi8(-64))));
+   }
+#endif
+
+   for ( ; i < n; i++)
+   {
+      if ((p[i] & 0xC0) == 0x80)
+      {
+         count++;
+      }
+   }
+   return(count);
+}
+
+#endif /* SCAN_H_INCLUDED */
@@ -17,54 +17,113 @@
 #include <cctype>
 #include <cassert>
 
-static void mark_resolved_scopes(chunk_t *pc, string& res_scopes)
+/**
+ * Returns the id of a scope name, adding it to the scope table if needed
+ */
+static int scope_intern(fp_data& fpd, const string& name)
 {
-   if (res_scopes.size() > 0)
+   unordered_map<string, int>::iterator it = fpd.scope_ids.find(name);
+
+   if (it != fpd.scope_ids.end())
    {
-      if (pc->scope.size() > 0)
-      {
-         pc->scope += ":";
-      }
-      pc->scope += res_scopes;
+      return(it->second);
+   }
+
+   int id = fpd.scopes.size();
+   fpd.scopes.push_back(name);
+   fpd.scope_ids[name] = id;
+   return(id);
+}
+
+
+/**
+ * Returns the id of the scope "scope:suffix", or just suffix if scope is empty
+ */
+static int scope_join(fp_data& fpd, int scope, int suffix)
+{
+   if (scope == 0)
+   {
+      return(suffix);
+   }
+
+   UINT64 key = ((UINT64) scope << 32) | (UINT32) suffix;
+   unordered_map<UINT64, int>::iterator it = fpd.scope_joins.find(key);
+
+   if (it != fpd.scope_joins.end())
+   {
+      return(it->second);
    }
+
+   string name = fpd.scopes[scope];
+   name += ":";
+   name += fpd.scopes[suffix];
+
+   int id = scope_intern(fpd, name);
+   fpd.scope_joins[key] = id;
+   return(id);
 }
 
-static void mark_scope_single(chunk_t *pc,
-                              chunk_t *scope,
-                              const char *decoration,
-                              string& res_scopes)
+
+const string& scope_name(fp_data& fpd, int scope)
 {
-   if (pc->scope.size() > 0)
+   return(fpd.scopes[scope]);
+}
+
+
+static void mark_resolved_scopes(fp_data& fpd, chunk_t *pc, string& res_scopes)
+{
+   if (res_scopes.size() > 0)
    {
-      pc->scope += ":";
+      pc->scope = scope_join(fpd, pc->scope, scope_intern(fpd, res_scopes));
    }
+}
+
+
+/**
+ * Builds the part of the scope added by the scope chunk, ie. "ns:~name()"
+ */
+static int scope_suffix(fp_data& fpd,
+                        chunk_t *scope,
+                        const char *decoration,
+                        string& res_scopes)
+{
+   string suffix;
 
    if (res_scopes.size() > 0)
    {
-      pc->scope += res_scopes;
-      pc->scope += ":";
+      suffix += res_scopes;
+      suffix += ":";
    }
 
    if ((scope->type == CT_FUNC_CLASS) &&
        (scope->parent_type == CT_DESTRUCTOR))
    {
-      pc->scope += "~";
+      suffix += "~";
    }
 
-   pc->scope += scope->str;
+   suffix.append(scope->text(), scope->len());
 
    if (decoration != NULL)
    {
-      pc->scope += decoration;
+      suffix += decoration;
    }
+
+   return(scope_intern(fpd, suffix));
 }
 
-static chunk_t *mark_scope(chunk_t *popen,
+
+static chunk_t *mark_scope(fp_data& fpd,
+                           chunk_t *popen,
                            chunk_t *scope,
                            const char *decoration,
                            string& res_scopes)
 {
    chunk_t *pc = popen;
+   int     suffix = scope_suffix(fpd, scope, decoration, res_scopes);
+
+   /* Most chunks in a body have the same scope, so remember the last join */
+   int     last_scope = -1;
+   int     last_joined = 0;
 
    for (pc = popen;
         pc != NULL;
@@ -72,7 +131,12 @@ static chunk_t *mark_scope(chunk_t *popen,
    {
       if (!(pc->flags & (PCF_PUNCTUATOR | PCF_KEYWORD)))
       {
-         mark_scope_single(pc, scope, decoration, res_scopes);
+         if (pc->scope != last_scope)
+         {
+            last_scope  = pc->scope;
+            last_joined = scope_join(fpd, pc->scope, suffix);
+         }
+         pc->scope = last_joined;
       }
 
       if (((pc->type == (popen->type + 1)) &&
@@ -110,7 +174,7 @@ static void get_resolved_scopes(chunk_t *scope, string& res_scopes)
          res_scopes.insert(0, ":");
       }
       first = false;
-      res_scopes.insert(0, prev->str);
+      res_scopes.insert(0, prev->text(), prev->len());
       prev = chunk_get_prev_nnl(prev, CNAV_PREPROC);
    }
 }
@@ -121,8 +185,17 @@ void assign_scope(fp_data& fpd)
    chunk_t *pc;
    string res_scopes;
 
+   fpd.scopes.clear();
+   fpd.scope_ids.clear();
+   fpd.scope_joins.clear();
+   (void) scope_intern(fpd, "");
+
+   int local_scope   = scope_intern(fpd, "<local>");
+   int preproc_scope = scope_intern(fpd, "<preproc>");
+   int global_scope  = scope_intern(fpd, "<global>");
+
    for (pc = chunk_get_head(fpd);
-        pc != NULL;
+        (pc != NULL) && !analysis_overdue(fpd);
         pc = chunk_get_next(pc))
    {
       if (pc->flags & (PCF_PUNCTUATOR | PCF_KEYWORD))
@@ -140,11 +213,11 @@ void assign_scope(fp_data& fpd)
                chunk_t *next = chunk_get_next_nnl(pc, CNAV_PREPROC);
 
                get_resolved_scopes(pc, res_scopes);
-               mark_resolved_scopes(pc, res_scopes);
+               mark_resolved_scopes(fpd, pc, res_scopes);
 
                if (next->type == CT_BRACE_OPEN)
                {
-                  mark_scope(next, pc, NULL, res_scopes);
+                  mark_scope(fpd, next, pc, NULL, res_scopes);
                }
             }
             break;
@@ -160,11 +233,11 @@ void assign_scope(fp_data& fpd)
                chunk_t *next = chunk_get_next_nnl(pc, CNAV_PREPROC);
 
                get_resolved_scopes(pc, res_scopes);
-               mark_resolved_scopes(pc, res_scopes);
+               mark_resolved_scopes(fpd, pc, res_scopes);
 
                if (next->type == CT_BRACE_OPEN)
                {
-                  mark_scope(next, pc, NULL, res_scopes);
+                  mark_scope(fpd, next, pc, NULL, res_scopes);
                }
             }
             break;
@@ -174,11 +247,11 @@ void assign_scope(fp_data& fpd)
             chunk_t *next = chunk_get_next_nnl(pc, CNAV_PREPROC);
 
             get_resolved_scopes(pc, res_scopes);
-            mark_resolved_scopes(pc, res_scopes);
+            mark_resolved_scopes(fpd, pc, res_scopes);
 
             if (next->type == CT_FPAREN_OPEN)
             {
-               mark_scope(next, pc, "()", res_scopes);
+               mark_scope(fpd, next, pc, "()", res_scopes);
             }
             break;
          }
@@ -187,11 +260,11 @@ void assign_scope(fp_data& fpd)
             chunk_t *next = chunk_get_next_nnl(pc, CNAV_PREPROC);
 
             get_resolved_scopes(pc, res_scopes);
-            mark_resolved_scopes(pc, res_scopes);
+            mark_resolved_scopes(fpd, pc, res_scopes);
 
             if (next->type == CT_FPAREN_OPEN)
             {
-               next = mark_scope(next, pc, "()", res_scopes);
+               next = mark_scope(fpd, next, pc, "()", res_scopes);
             }
 
             next = chunk_get_next_nnl(next, CNAV_PREPROC);
@@ -204,7 +277,7 @@ void assign_scope(fp_data& fpd)
 
             if ((next != NULL) && (next->type == CT_BRACE_OPEN))
             {
-               mark_scope(next, pc, "{}", res_scopes);
+               mark_scope(fpd, next, pc, "{}", res_scopes);
             }
             break;
          }
@@ -215,25 +288,27 @@ void assign_scope(fp_data& fpd)
                chunk_t *next = chunk_get_next_nnl(pc, CNAV_PREPROC);
 
                get_resolved_scopes(pc, res_scopes);
-               mark_resolved_scopes(pc, res_scopes);
+               mark_resolved_scopes(fpd, pc, res_scopes);
 
                if (next->type == CT_FPAREN_OPEN)
                {
-                  next = mark_scope(next, pc, "()", res_scopes);
+                  next = mark_scope(fpd, next, pc, "()", res_scopes);
                }
 
                if (pc->flags & PCF_DEF)
                {
                   /* Skip default args (while marking them) */
+                  int suffix = scope_suffix(fpd, pc, "()", res_scopes);
+
                   while ((next != NULL) && (next->flags & PCF_IN_CONST_ARGS))
                   {
-                     mark_scope_single(next, pc, "()", res_scopes);
+                     next->scope = scope_join(fpd, next->scope, suffix);
                      next = chunk_get_next_nnl(next, CNAV_PREPROC);
                   }
 
                   if ((next != NULL) && (next->type == CT_BRACE_OPEN))
                   {
-                     mark_scope(next, pc, "{}", res_scopes);
+                     mark_scope(fpd, next, pc, "{}", res_scopes);
                   }
                }
             }
@@ -243,20 +318,75 @@ void assign_scope(fp_data& fpd)
             break;
       }
 
-      if (pc->scope.size() == 0)
+      if (pc->scope == 0)
       {
          if (pc->flags & PCF_STATIC)
          {
-            pc->scope = "<local>";
+            pc->scope = local_scope;
          }
          else if (pc->flags & PCF_IN_PREPROC)
          {
-            pc->scope = "<preproc>";
+            pc->scope = preproc_scope;
          }
          else
          {
-            pc->scope = "<global>";
+            pc->scope = global_scope;
          }
       }
    }
 }
+
+
+/**
+ * The scopes of a file in degraded mode, after fix_symbols_degraded():
+ * the chunks in a function body are in the "name{}" scope of the function,
+ * the others are global or in the preprocessor.
+ */
+void assign_scope_degraded(fp_data& fpd)
+{
+   chunk_t *close = NULL;
+   int     body_scope = 0;
+
+   fpd.scopes.clear();
+   fpd.scope_ids.clear();
+   fpd.scope_joins.clear();
+   (void) scope_intern(fpd, "");
+
+   int preproc_scope = scope_intern(fpd, "<preproc>");
+   int global_scope  = scope_intern(fpd, "<global>");
+
+   for (chunk_t *pc = chunk_get_head(fpd); pc != NULL; pc = chunk_get_next(pc))
+   {
+      if (pc == close)
+      {
+         close = NULL;
+      }
+
+      if ((pc->type == CT_BRACE_OPEN) && (pc->parent_type == CT_FUNC_DEF) && (close == NULL))
+      {
+         chunk_t *name = chunk_get_prev_type(pc, CT_FUNC_DEF, 0, CNAV_PREPROC);
+
+         close = chunk_skip_to_match(pc, CNAV_PREPROC);
+         body_scope = scope_intern(fpd, (name != NULL) ?
+                                   string(name->text(), name->len()) + "{}" : "{}");
+      }
+
+      if (pc->flags & (PCF_PUNCTUATOR | PCF_KEYWORD))
+      {
+         continue;
+      }
+
+      if ((close != NULL) && ((pc->flags & PCF_IN_PREPROC) == 0))
+      {
+         pc->scope = body_scope;
+      }
+      else if (pc->flags & PCF_IN_PREPROC)
+      {
+         pc->scope = preproc_scope;
+      }
+      else
+      {
+         pc->scope = global_scope;
+      }
+   }
+}
@@ -0,0 +1,570 @@
+/**
+ * @file server.cpp
+ * Answers identifier lookups over a Unix socket, so an editor that looks up
+ * many identifiers doesn't pay for opening the index every time.
+ *
+ * A request is one line with the IST_MASK() set of sub types, the
+ * output_format, the limit and 1 for a ranked lookup in decimal, then the
+ * identifier and optionally the path to rank near, separated by spaces. The
+ * answer is the output of index_lookup_identifier() followed by a newline.
+ * A connection may send any number of requests. The clients are polled,
+ * so a slow or silent one doesn't hold up the others, and a request line
+ * longer than SERVER_MAX_REQUEST drops its client.
+ *
+ * When --snapshot puts a new index in place, the server opens it before
+ * answering the next connection.
+ *
+ * The answers of recent lookups in a single index are kept in a
+ * LookupCache. Before every request the server reads the Changes table of
+ * the index, where every run notes the files it stores or removes, and
+ * drops the answers those files may change.
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+#include "LookupCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef WIN32
+
+bool index_serve(const char *socket_path)
+{
+   LOG_FMT(LERR, "--serve is not supported on this platform\n");
+   return(false);
+}
+
+
+bool index_query_server(const char *socket_path, const char *identifier, int sub_types,
+                        output_format format, int limit, bool ranked, const char *near)
+{
+   return(false);
+}
+
+#else
+
+/* Seconds a connected client may stay silent before it is dropped */
+#define SERVER_CLIENT_TIMEOUT    10
+
+/* Longer request lines drop the client */
+#define SERVER_MAX_REQUEST       (64 * 1024)
+
+/* Answers kept and their bytes, see LookupCache */
+#define SERVER_CACHE_ANSWERS     1024
+#define SERVER_CACHE_BYTES       (64 * 1024 * 1024)
+
+/* More changes at once drop all answers */
+#define SERVER_CACHE_CHANGES     256
+
+/* A connected client, answered whenever it has sent a complete line */
+struct server_client
+{
+   int    fd;
+   FILE   *out;
+   string pending;   // received after the last complete line
+   time_t last;      // when it last sent something
+};
+
+static volatile sig_atomic_t server_stop;
+
+static LookupCache   server_cache(SERVER_CACHE_ANSWERS, SERVER_CACHE_BYTES);
+static sqlite3_int64 server_last_change = -1;
+
+
+static void server_signal(int sig)
+{
+   server_stop = 1;
+}
+
+
+/* Fill in the address of a socket, false if the path doesn't fit */
+static bool server_address(const char *socket_path, struct sockaddr_un& addr)
+{
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+
+   if (strlen(socket_path) >= sizeof(addr.sun_path))
+   {
+      LOG_FMT(LERR, "Socket path too long: %s\n", socket_path);
+      return(false);
+   }
+   strcpy(addr.sun_path, socket_path);
+   return(true);
+}
+
+
+/* Lookups only read, a bigger page cache keeps the index hot */
+static void server_tune_index(void)
+{
+   if (cpd.index != NULL)
+   {
+      (void) sqlite3_exec(cpd.index,
+                          "PRAGMA cache_size=-65536;"
+                          "PRAGMA mmap_size=1073741824;",
+                          NULL,
+                          NULL,
+                          NULL);
+   }
+}
+
+
+/* Open the index again if a new one was put in its place */
+static bool server_reopen_index(void)
+{
+   string index_file = cpd.index_file;
+
+   if (!index_replaced())
+   {
+      return(true);
+   }
+
+   LOG_FMT(LNOTE, "The index %s was replaced, opening it again\n", index_file.c_str());
+   server_cache.Clear();
+   server_last_change = -1;
+   (void) index_close();
+   if (!index_open(index_file.c_str(), false))
+   {
+      cpd.index = NULL;
+      return(false);
+   }
+   server_tune_index();
+   return(true);
+}
+
+
+/* Whether answers are cached, the shards of a sharded index change on their own */
+static bool server_caching(void)
+{
+   return((cpd.index != NULL) && !shards_opened() && !compact_opened());
+}
+
+
+/* Drop the cached answers the changes of the index since the last request may affect */
+static void server_follow_changes(void)
+{
+   vector<string> files;
+   unordered_set<string> identifiers;
+   bool all;
+
+   if (!index_read_changes(server_last_change, SERVER_CACHE_CHANGES, files, identifiers, all) ||
+       all)
+   {
+      server_cache.Clear();
+   }
+   else if (!files.empty())
+   {
+      LOG_FMT(LNOTE, "%d files changed, dropping the answers they affect\n", (int) files.size());
+      server_cache.Changed(files, identifiers);
+   }
+}
+
+
+/**
+ * Look up an identifier for a request, from the cache if it has the
+ * answer. A lookup done is written out and then kept.
+ */
+static void server_lookup(output_sink& sink, const char *line, const char *identifier,
+                          int sub_types, bool ranked, const char *near)
+{
+   static output_sink answer_sink;
+   vector<lookup_row> rows;
+   vector<string> files;
+   const string *cached;
+   string key(line);
+   char *answer = NULL;
+   size_t size = 0;
+   bool complete;
+   FILE *mem;
+
+   cached = server_cache.Find(key);
+   if (cached != NULL)
+   {
+      LOG_FMT(LNOTE, "Answered %s from the cache\n", identifier);
+      (void) fwrite(cached->data(), cached->size(), 1, sink.out);
+      return;
+   }
+
+   /* An answer that may be incomplete is not kept */
+   sink.rows = &rows;
+   complete  = index_lookup_identifier(sink, identifier, sub_types, ranked, near);
+   sink.rows = NULL;
+
+   mem = open_memstream(&answer, &size);
+   output_sink_init(answer_sink, (mem != NULL) ? mem : sink.out, sink.format, 0);
+   for (size_t i = 0; i < rows.size(); i++)
+   {
+      (void) output_identifier(answer_sink, rows[i].filename.c_str(), rows[i].line,
+                               rows[i].column_start, rows[i].scope.c_str(), rows[i].type,
+                               rows[i].sub_type, rows[i].identifier.c_str());
+   }
+   (void) output_flush(answer_sink);
+
+   if (mem != NULL)
+   {
+      fclose(mem);
+      (void) fwrite(answer, size, 1, sink.out);
+      if (complete)
+      {
+         for (size_t i = 0; i < rows.size(); i++)
+         {
+            files.push_back(rows[i].filename);
+         }
+         server_cache.Add(key, identifier, string(answer, size), files);
+      }
+   }
+   free(answer);
+}
+
+
+/* Answer one request line of a client, false if the answer could not be sent */
+static bool server_request(FILE *out, string& request)
+{
+   static output_sink sink;
+   string line(request);
+   char *identifier;
+   int  sub_types = (int) strtol(&line[0], &identifier, 10);
+   int  format    = (int) strtol(identifier, &identifier, 10);
+   int  limit     = (int) strtol(identifier, &identifier, 10);
+   bool ranked    = (strtol(identifier, &identifier, 10) != 0);
+   char *near     = NULL;
+   int  len;
+
+   while (*identifier == ' ')
+   {
+      identifier++;
+   }
+   len = strlen(identifier);
+   while ((len > 0) &&
+          ((identifier[len - 1] == '\n') || (identifier[len - 1] == '\r')))
+   {
+      len--;
+   }
+   identifier[len] = 0;
+
+   /* An identifier has no spaces, the rest is the near path */
+   if ((near = strchr(identifier, ' ')) != NULL)
+   {
+      *near++ = 0;
+      len     = strlen(identifier);
+   }
+
+   LOG_FMT(LNOTE, "Lookup %s (%d)\n", identifier, sub_types);
+
+   if ((format < OF_TEXT) || (format > OF_VIM))
+   {
+      format = OF_TEXT;
+   }
+   output_sink_init(sink, out, (output_format) format, (limit > 0) ? limit : 0);
+   if ((len > 0) && server_caching())
+   {
+      server_follow_changes();
+      server_lookup(sink, request.c_str(), identifier, sub_types, ranked, near);
+   }
+   else if (len > 0)
+   {
+      (void) index_lookup_identifier(sink, identifier, sub_types, ranked, near);
+   }
+   fputc('\n', out);
+   return(fflush(out) == 0);
+}
+
+
+/* Start serving a connected client, false if it could not be set up */
+static bool server_add_client(vector<server_client>& clients, int fd)
+{
+   struct timeval timeout = { SERVER_CLIENT_TIMEOUT, 0 };
+   server_client client;
+
+   /* An answer the client doesn't read doesn't hold up the others for long */
+   (void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+   client.fd   = fd;
+   client.out  = fdopen(fd, "w");
+   client.last = time(NULL);
+   if (client.out == NULL)
+   {
+      LOG_FMT(LERR, "%s: fdopen failed: %s (%d)\n", __func__, strerror(errno), errno);
+      close(fd);
+      return(false);
+   }
+   clients.push_back(client);
+   return(true);
+}
+
+
+/**
+ * Read what a client sent and answer the complete lines, false once the
+ * client is done or is to be dropped.
+ */
+static bool server_read_client(server_client& client)
+{
+   char    buf[4096];
+   size_t  pos;
+   ssize_t len;
+
+   len = read(client.fd, buf, sizeof(buf));
+   if (len < 0)
+   {
+      return(errno == EINTR);
+   }
+   if (len == 0)
+   {
+      return(false);
+   }
+   client.last = time(NULL);
+   client.pending.append(buf, len);
+
+   while (!server_stop && ((pos = client.pending.find('\n')) != string::npos))
+   {
+      string request(client.pending, 0, pos + 1);
+
+      client.pending.erase(0, pos + 1);
+      if (!server_request(client.out, request))
+      {
+         return(false);
+      }
+   }
+
+   if (client.pending.size() > SERVER_MAX_REQUEST)
+   {
+      LOG_FMT(LERR, "%s: request longer than %d bytes, dropping the client\n",
+              __func__, SERVER_MAX_REQUEST);
+      return(false);
+   }
+   return(true);
+}
+
+
+/**
+ * Serve lookups from the open index until SIGINT or SIGTERM.
+ *
+ * @param socket_path  The Unix socket to listen on, replaced if it exists
+ * @return             false if the socket could not be set up
+ */
+bool index_serve(const char *socket_path)
+{
+   struct sockaddr_un addr;
+   struct sigaction   action;
+   struct stat        st;
+   vector<server_client> clients;
+   int                fd;
+
+   if (!server_address(socket_path, addr))
+   {
+      return(false);
+   }
+
+   server_tune_index();
+
+   /* A socket left behind by a server that died */
+   if ((stat(socket_path, &st) == 0) && S_ISSOCK(st.st_mode))
+   {
+      (void) unlink(socket_path);
+   }
+
+   fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if ((fd < 0) ||
+       (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) ||
+       (listen(fd, 16) != 0))
+   {
+      LOG_FMT(LERR, "%s: unable to listen on %s: %s (%d)\n",
+              __func__, socket_path, strerror(errno), errno);
+      if (fd >= 0)
+      {
+         close(fd);
+      }
+      return(false);
+   }
+
+   /* No SA_RESTART, so poll() returns when asked to stop */
+   memset(&action, 0, sizeof(action));
+   action.sa_handler = server_signal;
+   sigemptyset(&action.sa_mask);
+   (void) sigaction(SIGINT, &action, NULL);
+   (void) sigaction(SIGTERM, &action, NULL);
+   (void) signal(SIGPIPE, SIG_IGN);
+
+   LOG_FMT(LNOTE, "Serving lookups on %s\n", socket_path);
+
+   while (!server_stop)
+   {
+      vector<struct pollfd> fds(clients.size() + 1);
+      time_t now;
+      int    ready;
+
+      fds[0].fd     = fd;
+      fds[0].events = POLLIN;
+      for (size_t idx = 0; idx < clients.size(); idx++)
+      {
+         fds[idx + 1].fd     = clients[idx].fd;
+         fds[idx + 1].events = POLLIN;
+      }
+
+      /* Wake up now and then to drop the silent clients */
+      ready = poll(&fds[0], fds.size(), clients.empty() ? -1 : 1000);
+      if (ready < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         LOG_FMT(LERR, "%s: poll failed: %s (%d)\n", __func__, strerror(errno), errno);
+         break;
+      }
+
+      /* Answer the clients first, a new one has a slot at the end */
+      now = time(NULL);
+      for (size_t idx = clients.size(); idx-- > 0; )
+      {
+         bool keep;
+
+         if ((fds[idx + 1].revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+         {
+            keep = server_read_client(clients[idx]);
+         }
+         else
+         {
+            keep = (now - clients[idx].last < SERVER_CLIENT_TIMEOUT);
+         }
+         if (!keep)
+         {
+            fclose(clients[idx].out);
+            clients.erase(clients.begin() + idx);
+         }
+      }
+
+      if ((fds[0].revents & POLLIN) != 0)
+      {
+         int client = accept(fd, NULL, NULL);
+
+         if (client < 0)
+         {
+            if ((errno == EINTR) || (errno == ECONNABORTED))
+            {
+               continue;
+            }
+            LOG_FMT(LERR, "%s: accept failed: %s (%d)\n", __func__, strerror(errno), errno);
+            break;
+         }
+         if (!server_reopen_index())
+         {
+            close(client);
+            break;
+         }
+         (void) server_add_client(clients, client);
+      }
+   }
+
+   for (size_t idx = 0; idx < clients.size(); idx++)
+   {
+      fclose(clients[idx].out);
+   }
+   close(fd);
+   (void) unlink(socket_path);
+
+   return(true);
+}
+
+
+/**
+ * Look up an identifier with a server started by index_serve(), printing
+ * the result to stdout.
+ *
+ * @return false if there is no server, the caller can use the index itself
+ */
+bool index_query_server(const char *socket_path, const char *identifier, int sub_types,
+                        output_format format, int limit, bool ranked, const char *near)
+{
+   struct sockaddr_un addr;
+   string  line;
+   char    buf[4096];
+   char    last[2] = { 0, 0 };
+   bool    pending = false;
+   UINT64  total   = 0;
+   ssize_t len;
+   int     fd;
+
+   if (!server_address(socket_path, addr))
+   {
+      return(false);
+   }
+
+   fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if ((fd < 0) ||
+       (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0))
+   {
+      LOG_FMT(LNOTE, "No server on %s: %s (%d)\n", socket_path, strerror(errno), errno);
+      if (fd >= 0)
+      {
+         close(fd);
+      }
+      return(false);
+   }
+
+   snprintf(buf, sizeof(buf), "%d %d %d %d ", sub_types, (int) format, limit, ranked ? 1 : 0);
+   line = string(buf) + identifier + ((near != NULL) ? " " : "") + ((near != NULL) ? near : "") +
+          "\n";
+   if (write(fd, line.data(), line.size()) != (ssize_t) line.size())
+   {
+      LOG_FMT(LNOTE, "%s: write failed: %s (%d)\n", __func__, strerror(errno), errno);
+      close(fd);
+      return(false);
+   }
+   (void) shutdown(fd, SHUT_WR);
+
+   /* The server closes the connection after the answer. Results may contain
+    * NULs, so copy everything but the final byte: the answer is complete if
+    * that is the newline after the results, which end in a newline or a NUL.
+    */
+   while (((len = read(fd, buf, sizeof(buf))) > 0) ||
+          ((len < 0) && (errno == EINTR)))
+   {
+      if (len <= 0)
+      {
+         continue;
+      }
+      if (pending)
+      {
+         fputc(last[1], stdout);
+      }
+      (void) fwrite(buf, len - 1, 1, stdout);
+      last[0] = (len > 1) ? buf[len - 2] : last[1];
+      last[1] = buf[len - 1];
+      pending = true;
+      total  += len;
+   }
+   close(fd);
+
+   /* Part of the answer may be printed already, so don't retry */
+   if (!pending ||
+       (last[1] != '\n') ||
+       ((total > 1) && (last[0] != '\n') && (last[0] != 0)))
+   {
+      if (pending)
+      {
+         fputc(last[1], stdout);
+      }
+      LOG_FMT(LERR, "Incomplete answer from the server on %s\n", socket_path);
+   }
+
+   return(true);
+}
+
+#endif
@@ -0,0 +1,727 @@
+/**
+ * @file shards.cpp
+ * A sharded index is a directory of ordinary indexes, the shards, named
+ * <key>.toks. The SHARDS file in it tells how a file is given its shard:
+ *
+ *    dir       the first directory of the file name, _ if there is none.
+ *              An absolute name counts from below the directories it
+ *              shares with the current one.
+ *    hash <n>  one of n shards by a hash of the file name
+ *
+ * Every file is in exactly one shard, so separate processes can build the
+ * shards of different parts of the tree at the same time, and a change only
+ * touches the shards of the files that are given. A file new to its shard
+ * is removed from the others, in case it was given another key before.
+ * Lookups run on all shards at once, on a pool of threads with a
+ * connection per shard, and the results are merged in the order a single
+ * index gives them.
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+#include "SourceList.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+#define SHARDS_LAYOUT_FILE    "SHARDS"
+#define SHARDS_EXTENSION      ".toks"
+
+
+/** How files are assigned to shards, see the file comment */
+struct shard_layout
+{
+   bool by_hash;
+   int  count;     // shards with by_hash
+};
+
+
+/** An open shard for lookups */
+struct shard
+{
+   string             path;
+   sqlite3            *db;
+   sqlite3_stmt       *stmts[INDEX_LOOKUP_STATEMENTS];
+   index_bloom        bloom;
+   vector<lookup_row> rows;  // results of the current lookup
+   bool               ok;
+};
+
+
+/** A lookup shared by the threads running it, see shards_lookup_identifier() */
+struct shard_query
+{
+   const char          *identifier;
+   int                 sub_types;
+   bool                ranked;
+   const char          *near;
+   int                 limit;
+   std::atomic<size_t> next;      // the next shard to look up
+};
+
+
+/** The threads looking up the shards with the calling one, see shards_open() */
+struct shard_pool
+{
+   std::mutex              lock;
+   std::condition_variable wake;        // a lookup is posted or the pool stops
+   std::condition_variable done;        // a thread finished its part
+   shard_query             *query;
+   UINT64                  generation;  // counts the lookups posted
+   int                     busy;        // threads still on the current lookup
+   bool                    stop;
+   vector<std::thread>     threads;
+};
+
+
+static vector<shard *> open_shards;
+static bool            shards_are_open;
+static shard_pool      pool;
+
+static void shards_pool_start(void);
+static void shards_pool_stop(void);
+
+
+/**
+ * Whether -i names a sharded index: an existing directory, or a name
+ * ending in a / for a new one.
+ */
+bool shards_is_sharded(const char *index_file)
+{
+   struct stat st;
+   size_t      len;
+
+   if (index_file == NULL)
+   {
+      return(false);
+   }
+   len = strlen(index_file);
+   return(((len > 0) && (index_file[len - 1] == '/')) ||
+          ((stat(index_file, &st) == 0) && S_ISDIR(st.st_mode)));
+}
+
+
+static string shards_path(const char *dir, const string& name)
+{
+   string path(dir);
+
+   if (!path.empty() && (path[path.size() - 1] != '/'))
+   {
+      path += '/';
+   }
+   return(path + name);
+}
+
+
+/* Parse a --shard-by value, dir or hash:<n> */
+static bool shards_parse_layout(const char *text, shard_layout& layout)
+{
+   if (strcmp(text, "dir") == 0)
+   {
+      layout.by_hash = false;
+      layout.count   = 0;
+      return(true);
+   }
+   if ((strncmp(text, "hash", 4) == 0) && ((text[4] == ':') || (text[4] == ' ')))
+   {
+      layout.by_hash = true;
+      layout.count   = atoi(&text[5]);
+      return(layout.count > 0);
+   }
+   return(false);
+}
+
+
+/**
+ * Get the layout of a sharded index, when indexing creating the directory
+ * and its SHARDS file as needed.
+ *
+ * @param shard_by  NULL or the --shard-by value, must match an existing layout
+ */
+static bool shards_layout(const char *dir, const char *shard_by, shard_layout& layout)
+{
+   string layout_path = shards_path(dir, SHARDS_LAYOUT_FILE);
+   char   line[64];
+   FILE   *fp;
+   bool   known = false;
+
+   if ((mkdir(dir, 0777) != 0) && (errno != EEXIST))
+   {
+      LOG_FMT(LERR, "Unable to create %s: %s (%d)\n", dir, strerror(errno), errno);
+      return(false);
+   }
+
+   if ((fp = fopen(layout_path.c_str(), "r")) != NULL)
+   {
+      if (fgets(line, sizeof(line), fp) != NULL)
+      {
+         line[strcspn(line, "\r\n")] = 0;
+         known = shards_parse_layout(line, layout);
+      }
+      fclose(fp);
+      if (!known)
+      {
+         LOG_FMT(LERR, "Unknown shard layout in %s\n", layout_path.c_str());
+         return(false);
+      }
+   }
+
+   if (shard_by != NULL)
+   {
+      shard_layout wanted;
+
+      if (!shards_parse_layout(shard_by, wanted))
+      {
+         LOG_FMT(LERR, "Unknown --shard-by %s, use dir or hash:<n>\n", shard_by);
+         return(false);
+      }
+      if (known &&
+          ((wanted.by_hash != layout.by_hash) || (wanted.count != layout.count)))
+      {
+         LOG_FMT(LERR, "%s is sharded differently than --shard-by %s\n", dir, shard_by);
+         return(false);
+      }
+      layout = wanted;
+   }
+   else if (!known)
+   {
+      layout.by_hash = false;
+      layout.count   = 0;
+   }
+
+   if (!known)
+   {
+      if ((fp = fopen(layout_path.c_str(), "w")) == NULL)
+      {
+         LOG_FMT(LERR, "Unable to open %s for write: %s (%d)\n",
+                 layout_path.c_str(), strerror(errno), errno);
+         return(false);
+      }
+      if (layout.by_hash)
+      {
+         fprintf(fp, "hash %d\n", layout.count);
+      }
+      else
+      {
+         fputs("dir\n", fp);
+      }
+      fclose(fp);
+   }
+
+   return(true);
+}
+
+
+/**
+ * A hash of a file name that is the same on every machine, for the hash
+ * layout and the slices of --shard
+ */
+UINT32 shards_hash(const string& filename)
+{
+   UINT32 hash = 2166136261u;
+
+   for (size_t idx = 0; idx < filename.size(); idx++)
+   {
+      hash = (hash ^ (UINT8)filename[idx]) * 16777619u;
+   }
+   return(hash);
+}
+
+
+/**
+ * Where the name of a file starts below the directories it shares with
+ * the directory cwd, 0 if it shares none
+ */
+static size_t shards_common_dirs(const string& cwd, const string& filename)
+{
+   size_t common = 0;
+   size_t pos    = 1;
+   size_t slash;
+
+   while ((pos <= cwd.size()) && ((slash = filename.find('/', pos)) != string::npos))
+   {
+      /* The directory has to be all of the next one of cwd */
+      if ((cwd.compare(pos, slash - pos, filename, pos, slash - pos) != 0) ||
+          ((slash < cwd.size()) && (cwd[slash] != '/')))
+      {
+         break;
+      }
+      common = slash + 1;
+      pos    = slash + 1;
+   }
+   return(common);
+}
+
+
+/**
+ * The shard a file belongs to. An absolute name is keyed by its first
+ * directory that isn't one of the current directory, cwd.
+ */
+static string shards_key(const shard_layout& layout, const string& cwd, const string& filename)
+{
+   char   key[32];
+   size_t pos = 0;
+   size_t slash;
+
+   if (layout.by_hash)
+   {
+      snprintf(key, sizeof(key), "hash%d", (int)(shards_hash(filename) % (UINT32)layout.count));
+      return(key);
+   }
+
+   if (!filename.empty() && (filename[0] == '/') && !cwd.empty())
+   {
+      pos = shards_common_dirs(cwd, filename);
+   }
+
+   /* Leading ./ and / don't name a directory */
+   while (pos < filename.size())
+   {
+      if (filename.compare(pos, 2, "./") == 0)
+      {
+         pos += 2;
+      }
+      else if (filename[pos] == '/')
+      {
+         pos++;
+      }
+      else
+      {
+         break;
+      }
+   }
+
+   slash = filename.find('/', pos);
+   if (slash == string::npos)
+   {
+      return("_");
+   }
+
+   string name = filename.substr(pos, slash - pos);
+
+   /* Keep .. and hidden directories from naming odd files */
+   if (name[0] == '.')
+   {
+      name[0] = '_';
+   }
+   return(name);
+}
+
+
+/* The keys of the shards in a directory, sorted */
+static void shards_list(const char *dir, vector<string>& keys)
+{
+   DIR           *dp = opendir(dir);
+   struct dirent *de;
+   size_t        ext = strlen(SHARDS_EXTENSION);
+
+   keys.clear();
+   if (dp == NULL)
+   {
+      return;
+   }
+   while ((de = readdir(dp)) != NULL)
+   {
+      size_t len = strlen(de->d_name);
+
+      if ((len > ext) && (strcmp(&de->d_name[len - ext], SHARDS_EXTENSION) == 0))
+      {
+         keys.push_back(string(de->d_name, len - ext));
+      }
+   }
+   closedir(dp);
+   sort(keys.begin(), keys.end());
+}
+
+
+/**
+ * Remove the files new to their shards from all other shards, where they
+ * may be from an earlier run that gave them another key
+ *
+ * @param added  The files new to each shard, by key
+ */
+static bool shards_remove_moved(const char *dir, const map<string, vector<string> >& added)
+{
+   vector<string> keys;
+   bool           retval = true;
+
+   shards_list(dir, keys);
+   for (size_t idx = 0; idx < keys.size(); idx++)
+   {
+      vector<string> moved;
+
+      for (map<string, vector<string> >::const_iterator it = added.begin();
+           it != added.end(); ++it)
+      {
+         if (it->first != keys[idx])
+         {
+            moved.insert(moved.end(), it->second.begin(), it->second.end());
+         }
+      }
+      if (moved.empty())
+      {
+         continue;
+      }
+
+      string path = shards_path(dir, keys[idx] + SHARDS_EXTENSION);
+
+      if (!index_open(path.c_str(), false))
+      {
+         retval = false;
+         continue;
+      }
+      retval = index_remove_files(moved) && retval;
+      (void) index_close();
+   }
+
+   return(retval);
+}
+
+
+/**
+ * Index the source files into their shards, one shard after the other.
+ * Only the shards of the given files are opened, so files that no longer
+ * exist are pruned from those. With prune_unlisted every shard is opened
+ * and keeps only the listed files.
+ *
+ * @return false if a file could not be stored or removed
+ */
+bool shards_index_files(const char *dir, const char *shard_by, SourceList& source_files,
+                        int jobs, bool dump, bool prune_unlisted)
+{
+   map<string, vector<string> > shard_files, added;
+   shard_layout layout;
+   string       filename, cwd;
+   char         buf[PATH_MAX];
+   bool         retval = true;
+
+   if (!shards_layout(dir, shard_by, layout))
+   {
+      return(false);
+   }
+
+   if (getcwd(buf, sizeof(buf)) != NULL)
+   {
+      cwd = buf;
+   }
+
+   while (source_files.Next(filename))
+   {
+      shard_files[shards_key(layout, cwd, filename)].push_back(filename);
+   }
+
+   if (prune_unlisted)
+   {
+      vector<string> keys;
+
+      shards_list(dir, keys);
+      for (size_t idx = 0; idx < keys.size(); idx++)
+      {
+         (void) shard_files[keys[idx]];
+      }
+   }
+
+   for (map<string, vector<string> >::iterator it = shard_files.begin();
+        it != shard_files.end(); ++it)
+   {
+      string     path = shards_path(dir, it->first + SHARDS_EXTENSION);
+      SourceList files;
+
+      LOG_FMT(LNOTE, "Shard %s: %d files\n", path.c_str(), (int)it->second.size());
+
+      if (!index_open(path.c_str(), true))
+      {
+         retval = false;
+         continue;
+      }
+      if (index_unknown_files(it->second, added[it->first]) &&
+          index_prepare_for_analysis())
+      {
+         for (size_t idx = 0; idx < it->second.size(); idx++)
+         {
+            files.Add(it->second[idx].c_str());
+         }
+         files.Remember(prune_unlisted);
+
+         retval = index_source_list(files, jobs, dump, prune_unlisted) && retval;
+         retval = index_end_analysis() && retval;
+      }
+      else
+      {
+         retval = false;
+      }
+      (void) index_close();
+   }
+
+   return(shards_remove_moved(dir, added) && retval);
+}
+
+
+/* Open all shards of a sharded index for lookups */
+bool shards_open(const char *dir)
+{
+   vector<string> keys;
+
+   shards_list(dir, keys);
+   if (keys.empty())
+   {
+      LOG_FMT(LERR, "No shards in %s\n", dir);
+      return(false);
+   }
+
+   for (size_t idx = 0; idx < keys.size(); idx++)
+   {
+      shard *sh = new shard;
+
+      sh->path = shards_path(dir, keys[idx] + SHARDS_EXTENSION);
+      memset(sh->stmts, 0, sizeof(sh->stmts));
+      if (!index_open_shard(sh->path.c_str(), &sh->db))
+      {
+         delete sh;
+         shards_close();
+         return(false);
+      }
+      open_shards.push_back(sh);
+   }
+
+   shards_pool_start();
+   shards_are_open = true;
+   return(true);
+}
+
+
+bool shards_opened()
+{
+   return(shards_are_open);
+}
+
+
+void shards_close()
+{
+   shards_pool_stop();
+   for (size_t idx = 0; idx < open_shards.size(); idx++)
+   {
+      index_close_shard(open_shards[idx]->db, open_shards[idx]->stmts);
+      delete open_shards[idx];
+   }
+   open_shards.clear();
+   shards_are_open = false;
+}
+
+
+/* Look up the next shards of a query until all are taken */
+static void shard_lookup(shard_query *query, output_sink& sink)
+{
+   size_t idx;
+
+   while ((idx = query->next++) < open_shards.size())
+   {
+      shard *sh = open_shards[idx];
+
+      sh->rows.clear();
+      output_sink_init(sink, NULL, OF_TEXT, query->limit);
+      sink.rows = &sh->rows;
+      sh->ok = index_lookup_in(sh->db, sh->stmts, sh->bloom, sink, query->identifier,
+                               query->sub_types, query->ranked, query->near);
+   }
+}
+
+
+/* A thread of the pool, takes part in every lookup posted until stopped */
+static void shard_worker(void)
+{
+   output_sink *sink = new output_sink;
+   UINT64      seen  = 0;
+   std::unique_lock<std::mutex> guard(pool.lock);
+
+   while (true)
+   {
+      while (!pool.stop && (pool.generation == seen))
+      {
+         pool.wake.wait(guard);
+      }
+      if (pool.stop)
+      {
+         break;
+      }
+      seen = pool.generation;
+
+      shard_query *query = pool.query;
+      guard.unlock();
+      shard_lookup(query, *sink);
+      guard.lock();
+
+      if (--pool.busy == 0)
+      {
+         pool.done.notify_all();
+      }
+   }
+
+   delete sink;
+}
+
+
+/* Start a thread per shard up to the number of cores, the caller is one */
+static void shards_pool_start(void)
+{
+   int count = (int)std::thread::hardware_concurrency();
+
+   count           = std::min(std::max(count, 1), (int)open_shards.size());
+   pool.query      = NULL;
+   pool.generation = 0;
+   pool.busy       = 0;
+   pool.stop       = false;
+   for (int idx = 1; idx < count; idx++)
+   {
+      pool.threads.push_back(std::thread(shard_worker));
+   }
+}
+
+
+static void shards_pool_stop(void)
+{
+   {
+      std::unique_lock<std::mutex> guard(pool.lock);
+      pool.stop = true;
+      pool.wake.notify_all();
+   }
+   for (size_t idx = 0; idx < pool.threads.size(); idx++)
+   {
+      pool.threads[idx].join();
+   }
+   pool.threads.clear();
+}
+
+
+static int sub_type_rank(id_sub_type sub_type, bool ranked)
+{
+   if (ranked)
+   {
+      return((sub_type == IST_DEFINITION) ? 0 : (sub_type == IST_DECLARATION) ? 1 : 2);
+   }
+   return((sub_type == IST_DECLARATION) ? 0 : (sub_type == IST_DEFINITION) ? 1 : 2);
+}
+
+
+/**
+ * The order of the results of a single index, see index_lookup_in() and
+ * index_lookup_statement(). Unranked, the sub types in the order of their
+ * lookups.
+ */
+struct shard_row_order
+{
+   bool ranked;
+
+   bool operator()(const lookup_row *a, const lookup_row *b) const
+   {
+      if (sub_type_rank(a->sub_type, ranked) != sub_type_rank(b->sub_type, ranked))
+      {
+         return(sub_type_rank(a->sub_type, ranked) < sub_type_rank(b->sub_type, ranked));
+      }
+      if (!ranked)
+      {
+         return(false);
+      }
+      if (a->near != b->near)
+      {
+         return(a->near);
+      }
+      return(a->mtime > b->mtime);
+   }
+};
+
+
+/**
+ * Look up an identifier in all shards, see index_lookup_in(). Each shard
+ * gives at most the limit of the sink. The results are sorted like those
+ * of a single index, with ties in shard order. Nothing is printed if a
+ * shard fails.
+ */
+bool shards_lookup_identifier(output_sink& sink, const char *identifier, int sub_types,
+                              bool ranked, const char *near)
+{
+   vector<const lookup_row *> rows;
+   shard_query              query;
+   shard_row_order          order;
+   bool                     retval = true;
+
+   query.identifier = identifier;
+   query.sub_types  = sub_types;
+   query.ranked     = ranked;
+   query.near       = near;
+   query.limit      = sink.limit;
+   query.next       = 0;
+
+   {
+      std::unique_lock<std::mutex> guard(pool.lock);
+      pool.query = &query;
+      pool.busy  = (int)pool.threads.size();
+      pool.generation++;
+      pool.wake.notify_all();
+   }
+
+   output_sink *shard_sink = new output_sink;
+   shard_lookup(&query, *shard_sink);
+   delete shard_sink;
+
+   {
+      /* The query lives until every thread is done with it */
+      std::unique_lock<std::mutex> guard(pool.lock);
+      while (pool.busy > 0)
+      {
+         pool.done.wait(guard);
+      }
+   }
+
+   for (size_t idx = 0; idx < open_shards.size(); idx++)
+   {
+      if (!open_shards[idx]->ok)
+      {
+         LOG_FMT(LERR, "Lookup of %s failed in %s\n", identifier, open_shards[idx]->path.c_str());
+         retval = false;
+      }
+      for (size_t row = 0; row < open_shards[idx]->rows.size(); row++)
+      {
+         rows.push_back(&open_shards[idx]->rows[row]);
+      }
+   }
+
+   order.ranked = ranked;
+   stable_sort(rows.begin(), rows.end(), order);
+
+   for (size_t idx = 0; retval && (idx < rows.size()); idx++)
+   {
+      const lookup_row *row = rows[idx];
+
+      if (!output_identifier(sink, row->filename.c_str(), row->line, row->column_start,
+                             row->scope.c_str(), row->type, row->sub_type,
+                             row->identifier.c_str()))
+      {
+         break;
+      }
+   }
+   (void) output_flush(sink);
+
+   for (size_t idx = 0; idx < open_shards.size(); idx++)
+   {
+      open_shards[idx]->rows.clear();
+   }
+
+   return(retval);
+}
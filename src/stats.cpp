@@ -0,0 +1,220 @@
+/**
+ * @file stats.cpp
+ * Collects the counters and stage times of a run for --stats and writes
+ * them as JSON: one object per analyzed file, streamed as the files are
+ * stored, followed by the totals.
+ *
+ *    { "files": [ { "file": ..., "bytes": ..., "chunks": ...,
+ *                   "entries": { "references": ..., ... },
+ *                   "ms": { "decode": ..., ... } }, ... ],
+ *      "total": { "files": ..., "skipped": ..., "limited": ...,
+ *                 "bytes": ..., "chunks": ...,
+ *                 "entries": { ... }, "ms": { ..., "commit": ...,
+ *                 "create_indexes": ..., "wall": ... } } }
+ *
+ * A file over one of the --max-size, --max-chunks and --max-time limits has
+ * a "limit" naming it after its "file".
+ *
+ * Only the thread that stores the files in the index calls these.
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+
+static const char *const entry_names[] =
+{
+   "references",
+   "definitions",
+   "declarations",
+};
+
+static FILE   *stats_out;
+static bool   stats_first_file;
+static UINT64 stats_start;
+
+static int    total_files;
+static int    total_skipped;
+static int    total_limited;
+static UINT64 total_bytes;
+static UINT64 total_chunks;
+static UINT64 total_entries[3];
+static UINT64 total_stage_ns[STAGE_COUNT];
+static UINT64 total_commit_ns;
+static UINT64 total_create_indexes_ns;
+
+
+/**
+ * Start collecting statistics.
+ *
+ * @param path  The file to write the JSON to, - for stdout
+ * @return      false if it could not be opened
+ */
+bool stats_open(const char *path)
+{
+   stats_out = (strcmp(path, "-") == 0) ? stdout : fopen(path, "w");
+   if (stats_out == NULL)
+   {
+      LOG_FMT(LERR, "Unable to open %s for write: %s (%d)\n", path, strerror(errno), errno);
+      return(false);
+   }
+
+   stats_first_file = true;
+   stats_start      = stage_clock();
+   fputs("{\n  \"files\": [", stats_out);
+   return(true);
+}
+
+
+bool stats_enabled()
+{
+   return(stats_out != NULL);
+}
+
+
+static void stats_string(const char *str)
+{
+   fputc('"', stats_out);
+   for ( ; *str != 0; str++)
+   {
+      UINT8 ch = (UINT8)*str;
+
+      if ((ch == '"') || (ch == '\\'))
+      {
+         fprintf(stats_out, "\\%c", ch);
+      }
+      else if (ch < 0x20)
+      {
+         fprintf(stats_out, "\\u%04x", ch);
+      }
+      else
+      {
+         fputc(ch, stats_out);
+      }
+   }
+   fputc('"', stats_out);
+}
+
+
+static void stats_entries(const UINT64 *entries)
+{
+   fputs("\"entries\": {", stats_out);
+   for (int idx = 0; idx < 3; idx++)
+   {
+      fprintf(stats_out, "%s\"%s\": %llu", (idx > 0) ? ", " : " ",
+              entry_names[idx], (unsigned long long)entries[idx]);
+   }
+   fputs(" }", stats_out);
+}
+
+
+static void stats_stages(const UINT64 *stage_ns)
+{
+   for (int stage = 0; stage < STAGE_COUNT; stage++)
+   {
+      fprintf(stats_out, "%s\"%s\": %.3f", (stage > 0) ? ", " : " ",
+              get_stage_name((stage_t)stage), stage_ns[stage] / 1e6);
+   }
+}
+
+
+/* Record a file that was analyzed, before its entries are stored */
+void stats_file(const fp_data& fpd)
+{
+   UINT64 entries[3] = { 0, 0, 0 };
+
+   if (stats_out == NULL)
+   {
+      return;
+   }
+
+   for (size_t idx = 0; idx < fpd.entries.size(); idx++)
+   {
+      entries[fpd.entries[idx].sub_type]++;
+   }
+
+   fputs(stats_first_file ? "\n    { \"file\": " : ",\n    { \"file\": ", stats_out);
+   stats_first_file = false;
+   stats_string(fpd.filename);
+   if (fpd.limit != FL_NONE)
+   {
+      fprintf(stats_out, ", \"limit\": \"%s\"", get_limit_name(fpd.limit));
+      total_limited++;
+   }
+   fprintf(stats_out, ", \"bytes\": %llu, \"chunks\": %d, ",
+           (unsigned long long)fpd.data.Size(), fpd.chunk_count);
+   stats_entries(entries);
+   fputs(", \"ms\": {", stats_out);
+   stats_stages(fpd.stage_ns);
+   fputs(" } }", stats_out);
+
+   total_files++;
+   total_bytes  += fpd.data.Size();
+   total_chunks += fpd.chunk_count;
+   for (int idx = 0; idx < 3; idx++)
+   {
+      total_entries[idx] += entries[idx];
+   }
+   for (int stage = 0; stage < STAGE_COUNT; stage++)
+   {
+      total_stage_ns[stage] += fpd.stage_ns[stage];
+   }
+}
+
+
+/* Record a file that was unchanged or could not be read */
+void stats_skipped()
+{
+   total_skipped++;
+}
+
+
+/* Time spent committing the index */
+void stats_commit(UINT64 ns)
+{
+   total_commit_ns += ns;
+}
+
+
+/* Time spent creating the indexes of the index */
+void stats_create_indexes(UINT64 ns)
+{
+   total_create_indexes_ns += ns;
+}
+
+
+/* Write the totals and close the output */
+void stats_close()
+{
+   if (stats_out == NULL)
+   {
+      return;
+   }
+
+   fprintf(stats_out,
+           "\n  ],\n  \"total\": { \"files\": %d, \"skipped\": %d, \"limited\": %d, "
+           "\"bytes\": %llu, \"chunks\": %llu, ",
+           total_files, total_skipped, total_limited,
+           (unsigned long long)total_bytes, (unsigned long long)total_chunks);
+   stats_entries(total_entries);
+   fputs(", \"ms\": {", stats_out);
+   stats_stages(total_stage_ns);
+   fprintf(stats_out, ", \"commit\": %.3f, \"create_indexes\": %.3f, \"wall\": %.3f } }\n}\n",
+           total_commit_ns / 1e6, total_create_indexes_ns / 1e6,
+           (stage_clock() - stats_start) / 1e6);
+
+   if (stats_out != stdout)
+   {
+      fclose(stats_out);
+   }
+   else
+   {
+      fflush(stats_out);
+   }
+   stats_out = NULL;
+}
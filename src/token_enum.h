@@ -15,8 +15,10 @@
  *
  * The script 'make_token_names.sh' creates token_names.h, so be sure to run
  * that after adding or removing an entry.
+ *
+ * It is stored in 16 bits, so chunk_t stays small.
  */
-typedef enum
+typedef enum : UINT16
 {
    CT_NONE,
    CT_EOF,
@@ -2,7 +2,8 @@
  * @file tokenize.cpp
  * This file breaks up the text stream into tokens or chunks.
  *
- * Each routine needs to set pc.len and pc.type.
+ * Each routine consumes the text of a token and sets pc.type. The token text
+ * is whatever the routine consumed, see tokenize().
  *
  * @author  Ben Gardner
  * @license GPL v2+
@@ -11,6 +12,7 @@
 #include "char_table.h"
 #include "prototypes.h"
 #include "chunk_list.h"
+#include "scan.h"
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -30,7 +32,7 @@ struct tok_info
 
 struct tok_ctx
 {
-   tok_ctx(const vector<UINT8>& d) : data(d)
+   tok_ctx(const SourceBuffer& d) : data(d.Data()), size(d.Size()), tok_start(0)
    {
    }
 
@@ -56,7 +58,7 @@ struct tok_ctx
 
    bool more()
    {
-      return(c.idx < (int)data.size());
+      return(c.idx < size);
    }
 
    int peek()
@@ -67,7 +69,7 @@ struct tok_ctx
    int peek(int idx)
    {
       idx += c.idx;
-      return((idx < (int)data.size()) ? data[idx] : -1);
+      return((idx < size) ? data[idx] : -1);
    }
 
    int get()
@@ -106,6 +108,45 @@ struct tok_ctx
       return -1;
    }
 
+   /* Consume n bytes known to hold no tab, carriage return or newline */
+   void skip_plain(int n)
+   {
+      if (n > 0)
+      {
+         c.col    += n - scan_continuation_bytes(&data[c.idx], n);
+         c.idx    += n;
+         c.last_ch = data[c.idx - 1];
+      }
+   }
+
+   /* The bytes not consumed yet */
+   const UINT8 *rest()
+   {
+      return(&data[c.idx]);
+   }
+
+   int rest_len()
+   {
+      return(size - c.idx);
+   }
+
+   /* Marks the start of the next token */
+   void start_token()
+   {
+      tok_start = c.idx;
+   }
+
+   /* The text consumed so far for the current token */
+   const char *tok_text()
+   {
+      return((const char *)&data[tok_start]);
+   }
+
+   int tok_len()
+   {
+      return(c.idx - tok_start);
+   }
+
    bool expect(int ch)
    {
       if (peek() == ch)
@@ -116,9 +157,11 @@ struct tok_ctx
       return false;
    }
 
-   const vector<UINT8>& data;
+   const UINT8       *data;
+   int               size;
    tok_info          c; /* current */
    tok_info          s; /* saved */
+   int               tok_start;
 };
 
 static bool parse_string(tok_ctx& ctx, chunk_t& pc, int quote_idx, bool allow_escape);
@@ -157,10 +200,9 @@ static bool d_parse_string(tok_ctx& ctx, chunk_t& pc)
    {
       ctx.save();
       int cnt;
-      pc.str.clear();
       while (ctx.peek() == '\\')
       {
-         pc.str.append(1, ctx.get());
+         ctx.get();
          /* Check for end of file */
          switch (ctx.peek())
          {
@@ -169,7 +211,7 @@ static bool d_parse_string(tok_ctx& ctx, chunk_t& pc)
             cnt = 3;
             while (cnt--)
             {
-               pc.str.append(1, ctx.get());
+               ctx.get();
             }
             break;
 
@@ -178,7 +220,7 @@ static bool d_parse_string(tok_ctx& ctx, chunk_t& pc)
             cnt = 5;
             while (cnt--)
             {
-               pc.str.append(1, ctx.get());
+               ctx.get();
             }
             break;
 
@@ -187,7 +229,7 @@ static bool d_parse_string(tok_ctx& ctx, chunk_t& pc)
             cnt = 9;
             while (cnt--)
             {
-               pc.str.append(1, ctx.get());
+               ctx.get();
             }
             break;
 
@@ -200,40 +242,40 @@ static bool d_parse_string(tok_ctx& ctx, chunk_t& pc)
          case '6':
          case '7':
             /* handle up to 3 octal digits */
-            pc.str.append(1, ctx.get());
+            ctx.get();
             ch = ctx.peek();
             if ((ch >= '0') && (ch <= '7'))
             {
-               pc.str.append(1, ctx.get());
+               ctx.get();
                ch = ctx.peek();
                if ((ch >= '0') && (ch <= '7'))
                {
-                  pc.str.append(1, ctx.get());
+                  ctx.get();
                }
             }
             break;
 
          case '&':
             /* \& NamedCharacterEntity ; */
-            pc.str.append(1, ctx.get());
+            ctx.get();
             while (isalpha(ctx.peek()))
             {
-               pc.str.append(1, ctx.get());
+               ctx.get();
             }
             if (ctx.peek() == ';')
             {
-               pc.str.append(1, ctx.get());
+               ctx.get();
             }
             break;
 
          default:
             /* Everything else is a single character */
-            pc.str.append(1, ctx.get());
+            ctx.get();
             break;
          }
       }
 
-      if (pc.str.size() > 1)
+      if (ctx.tok_len() > 1)
       {
          pc.type = CT_STRING;
          return(true);
@@ -278,10 +320,11 @@ static bool d_parse_string(tok_ctx& ctx, chunk_t& pc)
  * @param pc   The structure to update, str is an input.
  * @return     Whether a comment was parsed
  */
+template <int LANGS>
 static bool parse_comment(fp_data& fpd, tok_ctx& ctx, chunk_t& pc)
 {
    int  ch;
-   bool is_d    = (fpd.lang_flags & LANG_D) != 0;
+   bool is_d    = lang_is<LANGS>(fpd, LANG_D);
    int  d_level = 0;
    int  bs_cnt;
 
@@ -307,8 +350,19 @@ static bool parse_comment(fp_data& fpd, tok_ctx& ctx, chunk_t& pc)
       while (true)
       {
          bs_cnt = 0;
-         while ((ch = ctx.peek()) >= 0)
+         while (true)
          {
+            int plain = scan_until(ctx.rest(), ctx.rest_len(), '\r', '\n', '\\', '\t');
+
+            if (plain > 0)
+            {
+               ctx.skip_plain(plain);
+               bs_cnt = 0;
+            }
+            if ((ch = ctx.peek()) < 0)
+            {
+               break;
+            }
             if ((ch == '\r') || (ch == '\n'))
             {
                break;
@@ -350,8 +404,13 @@ static bool parse_comment(fp_data& fpd, tok_ctx& ctx, chunk_t& pc)
    else if (ch == '*')
    {
       pc.type = CT_WHITESPACE;
-      while ((ch = ctx.get()) >= 0)
+      while (true)
       {
+         ctx.skip_plain(scan_until(ctx.rest(), ctx.rest_len(), '*', '\r', '\n', '\t'));
+         if ((ch = ctx.get()) < 0)
+         {
+            break;
+         }
          if (ch == '*' && ctx.peek() == '/')
          {
             (void) ctx.get(); /* discard the '/' */
@@ -406,7 +465,6 @@ static void parse_suffix(tok_ctx& ctx, chunk_t& pc, bool forstring = false)
    if (CharTable::IsKw1(ctx.peek()))
    {
       int slen = 0;
-      int oldsize = pc.str.size();
       tok_info ss;
 
       /* don't add the suffix if we see L" or L' or S" */
@@ -422,15 +480,14 @@ static void parse_suffix(tok_ctx& ctx, chunk_t& pc, bool forstring = false)
       while (ctx.more() && CharTable::IsKw2(ctx.peek()))
       {
          slen++;
-         pc.str.append(1, ctx.get());
+         ctx.get();
       }
 
       if (forstring && (slen >= 4) &&
-          ((pc.str.substr(0, 3) == "PRI") ||
-           (pc.str.substr(0, 3) == "SCN")))
+          ((memcmp(ctx.tok_text(), "PRI", 3) == 0) ||
+           (memcmp(ctx.tok_text(), "SCN", 3) == 0)))
       {
          ctx.restore(ss);
-         pc.str.resize(oldsize);
       }
    }
 }
@@ -518,7 +575,7 @@ static bool parse_number(tok_ctx& ctx, chunk_t& pc)
     */
    if (ctx.peek() == '0')
    {
-      pc.str.append(1, ctx.get());  /* store the '0' */
+      ctx.get();  /* take the '0' */
 
       switch (toupper(ctx.peek()))
       {
@@ -526,14 +583,14 @@ static bool parse_number(tok_ctx& ctx, chunk_t& pc)
          did_hex = true;
          do
          {
-            pc.str.append(1, ctx.get());  /* store the 'x' and then the rest */
+            ctx.get();  /* take the 'x' and then the rest */
          } while (is_hex_(ctx.peek()));
          break;
 
       case 'B':               /* binary */
          do
          {
-            pc.str.append(1, ctx.get());  /* store the 'b' and then the rest */
+            ctx.get();  /* take the 'b' and then the rest */
          } while (is_bin_(ctx.peek()));
          break;
 
@@ -549,7 +606,7 @@ static bool parse_number(tok_ctx& ctx, chunk_t& pc)
       case '9':
          do
          {
-            pc.str.append(1, ctx.get());
+            ctx.get();
          } while (is_oct_(ctx.peek()));
          break;
 
@@ -563,27 +620,27 @@ static bool parse_number(tok_ctx& ctx, chunk_t& pc)
       /* Regular int or float */
       while (is_dec_(ctx.peek()))
       {
-         pc.str.append(1, ctx.get());
+         ctx.get();
       }
    }
 
    /* Check if we stopped on a decimal point & make sure it isn't '..' */
    if ((ctx.peek() == '.') && (ctx.peek(1) != '.'))
    {
-      pc.str.append(1, ctx.get());
+      ctx.get();
       is_float = true;
       if (did_hex)
       {
          while (is_hex_(ctx.peek()))
          {
-            pc.str.append(1, ctx.get());
+            ctx.get();
          }
       }
       else
       {
          while (is_dec_(ctx.peek()))
          {
-            pc.str.append(1, ctx.get());
+            ctx.get();
          }
       }
    }
@@ -597,14 +654,14 @@ static bool parse_number(tok_ctx& ctx, chunk_t& pc)
    if ((tmp == 'E') || (tmp == 'P'))
    {
       is_float = true;
-      pc.str.append(1, ctx.get());
+      ctx.get();
       if ((ctx.peek() == '+') || (ctx.peek() == '-'))
       {
-         pc.str.append(1, ctx.get());
+         ctx.get();
       }
       while (is_dec_(ctx.peek()))
       {
-         pc.str.append(1, ctx.get());
+         ctx.get();
       }
    }
 
@@ -630,14 +687,14 @@ static bool parse_number(tok_ctx& ctx, chunk_t& pc)
       {
          break;
       }
-      pc.str.append(1, ctx.get());
+      ctx.get();
    }
 
    /* skip the Microsoft-specific '64' suffix */
    if ((ctx.peek() == '6') && (ctx.peek(1) == '4'))
    {
-      pc.str.append(1, ctx.get());
-      pc.str.append(1, ctx.get());
+      ctx.get();
+      ctx.get();
    }
 
    pc.type = is_float ? CT_NUMBER_FP : CT_NUMBER;
@@ -666,20 +723,18 @@ static bool parse_string(tok_ctx& ctx, chunk_t& pc, int quote_idx, bool allow_es
    char escape_char  = UO_string_escape_char;
    char escape_char2 = UO_string_escape_char2;
 
-   pc.str.clear();
    while (quote_idx-- > 0)
    {
-      pc.str.append(1, ctx.get());
+      ctx.get();
    }
 
    pc.type = CT_STRING;
    end_ch  = CharTable::Get(ctx.peek()) & 0xff;
-   pc.str.append(1, ctx.get());  /* store the " */
+   ctx.get();  /* take the " */
 
    while (ctx.more())
    {
       int ch = ctx.get();
-      pc.str.append(1, ch);
       if (ch == '\n')
       {
          pc.type = CT_STRING_MULTI;
@@ -688,7 +743,7 @@ static bool parse_string(tok_ctx& ctx, chunk_t& pc, int quote_idx, bool allow_es
       }
       if ((ch == '\r') && (ctx.peek() != '\n'))
       {
-         pc.str.append(1, ctx.get());
+         ctx.get();
          pc.type = CT_STRING_MULTI;
          escaped = 0;
          continue;
@@ -728,19 +783,18 @@ static bool parse_string(tok_ctx& ctx, chunk_t& pc, int quote_idx, bool allow_es
  */
 static bool parse_cs_string(tok_ctx& ctx, chunk_t& pc)
 {
-   pc.str = ctx.get();
-   pc.str.append(1, ctx.get());
+   ctx.get();
+   ctx.get();
 
    /* go until we hit a zero (end of file) or a single " */
    while (ctx.more())
    {
       int ch = ctx.get();
-      pc.str.append(1, ch);
       if (ch == '"')
       {
          if (ctx.peek() == '"')
          {
-            pc.str.append(1, ctx.get());
+            ctx.get();
          }
          else
          {
@@ -754,7 +808,7 @@ static bool parse_cs_string(tok_ctx& ctx, chunk_t& pc)
 }
 
 
-static bool tag_compare(const vector<UINT8>& d, int a_idx, int b_idx, int len)
+static bool tag_compare(const UINT8 *d, int a_idx, int b_idx, int len)
 {
    if (a_idx != b_idx)
    {
@@ -783,18 +837,17 @@ static bool parse_cr_string(tok_ctx& ctx, chunk_t& pc, int q_idx)
    ctx.save();
 
    /* Copy the prefix + " to the string */
-   pc.str.clear();
    cnt = q_idx + 1;
    while (cnt--)
    {
-      pc.str.append(1, ctx.get());
+      ctx.get();
    }
 
    /* Add the tag and get the length of the tag */
    while (ctx.more() && (ctx.peek() != '('))
    {
       tag_len++;
-      pc.str.append(1, ctx.get());
+      ctx.get();
    }
    if (ctx.peek() != '(')
    {
@@ -812,19 +865,19 @@ static bool parse_cr_string(tok_ctx& ctx, chunk_t& pc, int q_idx)
          cnt = tag_len + 2;   /* for the )" */
          while (cnt--)
          {
-            pc.str.append(1, ctx.get());
+            ctx.get();
          }
          parse_suffix(ctx, pc);
          return(true);
       }
       if (ctx.peek() == '\n')
       {
-         pc.str.append(1, ctx.get());
+         ctx.get();
          pc.type = CT_STRING_MULTI;
       }
       else
       {
-         pc.str.append(1, ctx.get());
+         ctx.get();
       }
    }
    ctx.restore();
@@ -839,24 +892,20 @@ static bool parse_cr_string(tok_ctx& ctx, chunk_t& pc, int q_idx)
  * @param pc   The structure to update, str is an input.
  * @return     Whether a word was parsed (always true)
  */
+template <int LANGS>
 static bool parse_word(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, bool skipcheck, int preproc_ncnl_count, c_token_t in_preproc)
 {
-   int             ch;
+   bool high = false;
 
    /* The first character is already valid */
-   pc.str.clear();
-   pc.str.append(1, ctx.get());
+   ctx.get();
 
-   while (ctx.more() && CharTable::IsKw2(ctx.peek()))
-   {
-      ch = ctx.get();
-      pc.str.append(1, ch);
+   ctx.skip_plain(scan_word(ctx.rest(), ctx.rest_len(), &high));
 
-      /* HACK: Non-ASCII character are only allowed in identifiers */
-      if (ch > 0x7f)
-      {
-         skipcheck = true;
-      }
+   /* HACK: Non-ASCII character are only allowed in identifiers */
+   if (high)
+   {
+      skipcheck = true;
    }
    pc.type = CT_WORD;
 
@@ -881,15 +930,15 @@ static bool parse_word(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, bool skipcheck,
    else
    {
       /* '@interface' is reserved, not an interface itself */
-      if ((fpd.lang_flags & LANG_JAVA) && (pc.str.substr(0, 1) == "@") &&
-          (pc.str != "@interface"))
+      if (lang_is<LANGS>(fpd, LANG_JAVA) && (*ctx.tok_text() == '@') &&
+          !((ctx.tok_len() == 10) && (memcmp(ctx.tok_text(), "@interface", 10) == 0)))
       {
          pc.type = CT_ANNOTATION;
       }
       else
       {
          /* Turn it into a keyword now */
-         pc.type = find_keyword_type(pc.str.c_str(), pc.str.size(), in_preproc, fpd.lang_flags);
+         pc.type = find_keyword_type(ctx.tok_text(), ctx.tok_len(), in_preproc, fpd.lang_flags);
          if (pc.type != CT_WORD)
          {
              pc.flags |= PCF_KEYWORD;
@@ -912,8 +961,19 @@ static bool parse_whitespace(tok_ctx& ctx, chunk_t& pc)
    bool nl_found = false;
    bool ret = false;
 
-   while (isspace(ctx.peek()))
+   while (true)
    {
+      int spaces = scan_spaces(ctx.rest(), ctx.rest_len());
+
+      if (spaces > 0)
+      {
+         ctx.skip_plain(spaces);
+         ret = true;
+      }
+      if (!isspace(ctx.peek()))
+      {
+         break;
+      }
       if (ctx.get() == '\n')
       {
          nl_found = true;
@@ -950,7 +1010,6 @@ static bool parse_bs_newline(tok_ctx& ctx, chunk_t& pc)
          {
             ctx.expect('\n');
          }
-         pc.str      = "\\";
          pc.type     = CT_NL_CONT;
          return(true);
       }
@@ -971,6 +1030,7 @@ static bool parse_bs_newline(tok_ctx& ctx, chunk_t& pc)
  * @param pc      The structure to update, str is an input.
  * @return        true/false - whether anything was parsed
  */
+template <int LANGS>
 static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl_count, c_token_t in_preproc)
 {
    const chunk_tag_t *punc;
@@ -996,7 +1056,6 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
    if ((in_preproc > CT_PP_BODYCHUNK) &&
        (in_preproc <= CT_PP_OTHER))
    {
-      pc.str.clear();
       tok_info ss;
       ctx.save(ss);
       /* Chunk to a newline or comment */
@@ -1012,7 +1071,6 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
             if (last == '\\')
             {
                ctx.restore(ss);
-               pc.str.resize(pc.str.length() - 1);
             }
             break;
          }
@@ -1025,9 +1083,9 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
          last = ch;
          ctx.save(ss);
 
-         pc.str.append(1, ctx.get());
+         ctx.get();
       }
-      if (pc.str.size() > 0)
+      if (ctx.tok_len() > 0)
       {
          return(true);
       }
@@ -1044,13 +1102,13 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
    /**
     * Parse comments
     */
-   if (parse_comment(fpd, ctx, pc))
+   if (parse_comment<LANGS>(fpd, ctx, pc))
    {
       return(true);
    }
 
    /* Check for C# literal strings, ie @"hello" and identifiers @for*/
-   if (((fpd.lang_flags & LANG_CS) != 0) && (ctx.peek() == '@'))
+   if (lang_is<LANGS>(fpd, LANG_CS) && (ctx.peek() == '@'))
    {
       if (ctx.peek(1) == '"')
       {
@@ -1060,14 +1118,14 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
       /* check for non-keyword identifiers such as @if @switch, etc */
       if (CharTable::IsKw1(ctx.peek(1)))
       {
-         parse_word(fpd, ctx, pc, true, preproc_ncnl_count, in_preproc);
+         parse_word<LANGS>(fpd, ctx, pc, true, preproc_ncnl_count, in_preproc);
          return(true);
       }
    }
 
    /* handle C++0x strings u8"x" u"x" U"x" R"x" u8R"XXX(I'm a "raw UTF-8" string.)XXX" */
    ch = ctx.peek();
-   if (((fpd.lang_flags & LANG_CPP) != 0) &&
+   if (lang_is<LANGS>(fpd, LANG_CPP) &&
        ((ch == 'u') || (ch == 'U') || (ch == 'R')))
    {
       int idx = 0;
@@ -1108,7 +1166,7 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
    }
 
    /* PAWN specific stuff */
-   if ((fpd.lang_flags & LANG_PAWN) != 0)
+   if (lang_is<LANGS>(fpd, LANG_PAWN))
    {
       /* Check for PAWN strings: \"hi" or !"hi" or !\"hi" or \!"hi" */
       if ((ctx.peek() == '\\') || (ctx.peek() == '!'))
@@ -1136,7 +1194,7 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
       return(true);
    }
 
-   if ((fpd.lang_flags & LANG_D) != 0)
+   if (lang_is<LANGS>(fpd, LANG_D))
    {
       /* D specific stuff */
       if (d_parse_string(ctx, pc))
@@ -1173,7 +1231,7 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
    }
 
    /* Check for Objective C literals */
-   if ((fpd.lang_flags & LANG_OC) && (ctx.peek() == '@'))
+   if (lang_is<LANGS>(fpd, LANG_OC) && (ctx.peek() == '@'))
    {
       int nc = ctx.peek(1);
       if ((nc == '"') || (nc == '\''))
@@ -1185,7 +1243,7 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
       else if ((nc >= '0') && (nc <= '9'))
       {
          /* literal number */
-         pc.str.append(1, ctx.get());  /* store the '@' */
+         ctx.get();  /* take the '@' */
          parse_number(ctx, pc);
          return true;
       }
@@ -1195,7 +1253,7 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
    if (CharTable::IsKw1(ctx.peek()) ||
        ((ctx.peek() == '@') && CharTable::IsKw1(ctx.peek(1))))
    {
-      parse_word(fpd, ctx, pc, false, preproc_ncnl_count, in_preproc);
+      parse_word<LANGS>(fpd, ctx, pc, false, preproc_ncnl_count, in_preproc);
       return(true);
    }
 
@@ -1210,7 +1268,7 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
       int cnt = strlen(punc->tag);
       while (cnt--)
       {
-         pc.str.append(1, ctx.get());
+         ctx.get();
       }
       pc.type   = punc->type;
       pc.flags |= PCF_PUNCTUATOR;
@@ -1219,10 +1277,10 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
 
    /* throw away this character */
    pc.type = CT_UNKNOWN;
-   pc.str.append(1, ctx.get());
+   ctx.get();
 
    LOG_FMT(LWARN, "%s:%d Garbage in col %d: %x\n",
-           fpd.filename, pc.orig_line, (int)ctx.c.col, pc.str[0]);
+           fpd.filename, pc.orig_line, (int)ctx.c.col, *ctx.tok_text());
    return(true);
 }
 
@@ -1235,7 +1293,8 @@ static bool parse_next(fp_data& fpd, tok_ctx& ctx, chunk_t& pc, int preproc_ncnl
  *  - leading space & tabs are converted to the appropriate format.
  *
  */
-void tokenize(fp_data& fpd)
+template <int LANGS>
+static void tokenize_langs(fp_data& fpd)
 {
    tok_ctx            ctx(fpd.data);
    chunk_t            chunk;
@@ -1247,10 +1306,19 @@ void tokenize(fp_data& fpd)
 
    memset(&frm, 0, sizeof(frm));
 
+   /* Only the changed lines, see region_window() */
+   if (fpd.window.partial)
+   {
+      ctx.data  += fpd.window.offset;
+      ctx.size   = (int) fpd.window.size;
+      ctx.c.row  = fpd.window.line;
+   }
+
    while (ctx.more())
    {
       chunk.reset();
-      if (!parse_next(fpd, ctx, chunk, preproc_ncnl_count, in_preproc))
+      ctx.start_token();
+      if (!parse_next<LANGS>(fpd, ctx, chunk, preproc_ncnl_count, in_preproc))
       {
          LOG_FMT(LWARN, "%s:%d Bailed before the end?\n",
                  fpd.filename, ctx.c.row);
@@ -1265,7 +1333,12 @@ void tokenize(fp_data& fpd)
 
       if (chunk.type == CT_NL_CONT)
       {
-         chunk.str       = "\\\n";
+         chunk.str.assign("\\\n", 2);
+      }
+      else if (chunk.type != CT_NEWLINE)
+      {
+         /* The text is everything consumed by parse_next() */
+         chunk.str.assign(ctx.tok_text(), ctx.tok_len());
       }
 
       /* Strip trailing whitespace (for CPP comments and PP blocks) */
@@ -1273,7 +1346,7 @@ void tokenize(fp_data& fpd)
              ((chunk.str[chunk.str.size() - 1] == ' ') ||
               (chunk.str[chunk.str.size() - 1] == '\t')))
       {
-         chunk.str.resize(chunk.str.length() - 1);
+         chunk.str.resize(chunk.str.size() - 1);
       }
 
       /* Store off the end column */
@@ -1336,6 +1409,19 @@ void tokenize(fp_data& fpd)
 }
 
 
+void tokenize(fp_data& fpd)
+{
+   if ((fpd.lang_flags & ~LANG_CCPP) == 0)
+   {
+      tokenize_langs<LANG_CCPP>(fpd);
+   }
+   else
+   {
+      tokenize_langs<LANG_ALL>(fpd);
+   }
+}
+
+
 // /**
 //  * A simplistic fixed-sized needle in the fixed-size haystack string search.
 //  */
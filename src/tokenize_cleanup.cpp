@@ -34,7 +34,7 @@ static chunk_t *handle_double_angle_close(fp_data& fpd, chunk_t *pc)
           ((pc->orig_col_end + 1) == next->orig_col) &&
           (next->parent_type == CT_NONE))
       {
-         pc->str.append(1, '>');
+         chunk_append_text(fpd, pc, next->text(), next->len());
          pc->type = CT_ARITH;
          pc->orig_col_end = next->orig_col_end;
 
@@ -70,13 +70,14 @@ static void split_off_angle_close(fp_data& fpd, chunk_t *pc)
    pc->type = CT_ANGLE_CLOSE;
 
    nc.type = ct->type;
-   nc.str.assign(pc->str, 1, pc->str.length() - 1);
+   nc.str.assign(nc.text() + 1, nc.len() - 1);
    nc.orig_col++;
    chunk_add_after(fpd, &nc, pc);
 }
 
 
-void tokenize_cleanup(fp_data& fpd)
+template <int LANGS>
+static void tokenize_cleanup_langs(fp_data& fpd)
 {
    chunk_t *pc;
    chunk_t *prev = NULL;
@@ -97,7 +98,7 @@ void tokenize_cleanup(fp_data& fpd)
          {
             /* Change '[' + ']' into '[]' */
             pc->type = CT_TSQUARE;
-            pc->str  = "[]";
+            pc->str.assign("[]", 2);
             chunk_del(fpd, next);
             pc->orig_col_end += 1;
          }
@@ -116,7 +117,7 @@ void tokenize_cleanup(fp_data& fpd)
    next = chunk_get_next_nnl(pc);
    while ((pc != NULL) && (next != NULL))
    {
-      if ((pc->type == CT_DOT) && ((fpd.lang_flags & LANG_ALLC) != 0))
+      if ((pc->type == CT_DOT) && lang_is<LANGS>(fpd, LANG_ALLC))
       {
          pc->type = CT_MEMBER;
       }
@@ -249,7 +250,7 @@ void tokenize_cleanup(fp_data& fpd)
          }
       }
 
-      if ((fpd.lang_flags & LANG_D) != 0)
+      if (lang_is<LANGS>(fpd, LANG_D))
       {
          /* Check for the D string concat symbol '~' */
          if ((pc->type == CT_INV) &&
@@ -277,7 +278,7 @@ void tokenize_cleanup(fp_data& fpd)
          }
       }
 
-      if ((fpd.lang_flags & LANG_CPP) != 0)
+      if (lang_is<LANGS>(fpd, LANG_CPP))
       {
          /* Change Word before '::' into a type */
          if ((pc->type == CT_WORD) && (next->type == CT_DC_MEMBER))
@@ -336,7 +337,7 @@ void tokenize_cleanup(fp_data& fpd)
             tmp = chunk_get_next(next);
             if ((tmp != NULL) && (tmp->type == CT_PAREN_CLOSE))
             {
-               next->str  = "()";
+               next->str.assign("()", 2);
                next->type = CT_OPERATOR_VAL;
                chunk_del(fpd, tmp);
                next->orig_col_end += 1;
@@ -346,7 +347,7 @@ void tokenize_cleanup(fp_data& fpd)
                   tmp2 && (tmp2->type == CT_ANGLE_CLOSE) &&
                   (tmp2->orig_col == next->orig_col_end))
          {
-            next->str.append(1, '>');
+            chunk_append_text(fpd, next, tmp2->text(), tmp2->len());
             next->orig_col_end++;
             next->type = CT_OPERATOR_VAL;
             chunk_del(fpd, tmp2);
@@ -375,7 +376,7 @@ void tokenize_cleanup(fp_data& fpd)
                   break;
                }
 
-               next->str.append(tmp->str);
+               chunk_append_text(fpd, next, tmp->text(), tmp->len());
                tmp2 = tmp;
             }
 
@@ -390,8 +391,8 @@ void tokenize_cleanup(fp_data& fpd)
          }
          next->parent_type = CT_OPERATOR;
 
-         LOG_FMT(LOPERATOR, "%s: %d:%d operator '%s'\n",
-                 __func__, pc->orig_line, pc->orig_col, next->str.c_str());
+         LOG_FMT(LOPERATOR, "%s: %d:%d operator '%.*s'\n",
+                 __func__, pc->orig_line, pc->orig_col, next->len(), next->text());
       }
 
       /* Change private, public, protected into either a qualifier or label */
@@ -461,8 +462,8 @@ void tokenize_cleanup(fp_data& fpd)
           (next == chunk_get_next(pc)))
       {
          /* merge the two with a space between */
-         pc->str.append(1, ' ');
-         pc->str += next->str;
+         chunk_append_text(fpd, pc, " ", 1);
+         chunk_append_text(fpd, pc, next->text(), next->len());
          pc->orig_col_end = next->orig_col_end;
          chunk_del(fpd, next);
          next = chunk_get_next_nnl(pc);
@@ -485,7 +486,7 @@ void tokenize_cleanup(fp_data& fpd)
       /* ObjectiveC allows keywords to be used as identifiers in some situations
        * This is a dirty hack to allow some of the more common situations.
        */
-      if (fpd.lang_flags & LANG_OC)
+      if (lang_is<LANGS>(fpd, LANG_OC))
       {
          if (((pc->type == CT_IF) ||
               (pc->type == CT_FOR) ||
@@ -541,8 +542,8 @@ void tokenize_cleanup(fp_data& fpd)
          {
             if (get_token_pattern_class(tmp->type) != PATCLS_NONE)
             {
-               LOG_FMT(LOBJCWORD, "@interface %d:%d change '%s' (%s) to CT_WORD\n",
-                       pc->orig_line, pc->orig_col, tmp->str.c_str(),
+               LOG_FMT(LOBJCWORD, "@interface %d:%d change '%.*s' (%s) to CT_WORD\n",
+                       pc->orig_line, pc->orig_col, tmp->len(), tmp->text(),
                        get_token_name(tmp->type));
                tmp->type = CT_WORD;
             }
@@ -654,8 +655,8 @@ void tokenize_cleanup(fp_data& fpd)
       /* Detect "pragma region" and "pragma endregion" */
       if ((pc->type == CT_PP_PRAGMA) && (next->type == CT_PREPROC_BODY))
       {
-         if ((memcmp(next->str.c_str(), "region", 6) == 0) ||
-             (memcmp(next->str.c_str(), "endregion", 9) == 0))
+         if (((next->len() >= 6) && (memcmp(next->text(), "region", 6) == 0)) ||
+             ((next->len() >= 9) && (memcmp(next->text(), "endregion", 9) == 0)))
          {
             pc->type = (*next->str.data() == 'r') ? CT_PP_REGION : CT_PP_ENDREGION;
 
@@ -664,7 +665,7 @@ void tokenize_cleanup(fp_data& fpd)
       }
 
       /* Check for C# nullable types '?' is in next */
-      if ((fpd.lang_flags & LANG_CS) &&
+      if (lang_is<LANGS>(fpd, LANG_CS) &&
           (next->type == CT_QUESTION) &&
           (next->orig_col == (pc->orig_col + pc->len())))
       {
@@ -688,7 +689,7 @@ void tokenize_cleanup(fp_data& fpd)
 
             if (doit)
             {
-               pc->str += next->str;
+               chunk_append_text(fpd, pc, next->text(), next->len());
                chunk_del(fpd, next);
                next = tmp;
             }
@@ -696,7 +697,7 @@ void tokenize_cleanup(fp_data& fpd)
       }
 
       /* Change 'default(' into a sizeof-like statement */
-      if ((fpd.lang_flags & LANG_CS) &&
+      if (lang_is<LANGS>(fpd, LANG_CS) &&
           (pc->type == CT_DEFAULT) &&
           (next->type == CT_PAREN_OPEN))
       {
@@ -740,6 +741,19 @@ void tokenize_cleanup(fp_data& fpd)
 }
 
 
+void tokenize_cleanup(fp_data& fpd)
+{
+   if ((fpd.lang_flags & ~LANG_CCPP) == 0)
+   {
+      tokenize_cleanup_langs<LANG_CCPP>(fpd);
+   }
+   else
+   {
+      tokenize_cleanup_langs<LANG_ALL>(fpd);
+   }
+}
+
+
 /**
  * If there is nothing but CT_WORD and CT_MEMBER, then it's probably a
  * template thingy.  Otherwise, it's likely a comparison.
@@ -774,8 +788,8 @@ static void check_template(fp_data& fpd, chunk_t *start)
 
          if ((pc->str[0] == '>') && (pc->len() > 1))
          {
-            LOG_FMT(LTEMPL, " {split '%s' at %d:%d}",
-                    pc->str.c_str(), pc->orig_line, pc->orig_col);
+            LOG_FMT(LTEMPL, " {split '%.*s' at %d:%d}",
+                    pc->len(), pc->text(), pc->orig_line, pc->orig_col);
             split_off_angle_close(fpd, pc);
          }
 
@@ -859,8 +873,8 @@ static void check_template(fp_data& fpd, chunk_t *start)
              (UO_tok_split_gte ||
               (chunk_is_str(pc, ">>", 2) && ((fpd.lang_flags & LANG_CPP) == 0))))
          {
-            LOG_FMT(LTEMPL, " {split '%s' at %d:%d}",
-                    pc->str.c_str(), pc->orig_line, pc->orig_col);
+            LOG_FMT(LTEMPL, " {split '%.*s' at %d:%d}",
+                    pc->len(), pc->text(), pc->orig_line, pc->orig_col);
             split_off_angle_close(fpd, pc);
          }
 
@@ -17,7 +17,9 @@
 #include "args.h"
 #include "logger.h"
 #include "log_levels.h"
-#include "md5.h"
+#include "digest.h"
+#include "SourceList.h"
+#include "FilePrefetch.h"
 #include "sqlite3080200.h"
 
 #include <cstdio>
@@ -26,22 +28,52 @@
 #include <cerrno>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <cctype>
 #include <strings.h>  /* strcasecmp() */
 #include <vector>
 #include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
 
 /* Global data */
 struct cp_data cpd;
 
+/* Default index commit policy, see --commit-files and --commit-entries */
+#define DEFAULT_COMMIT_FILES      1000
+#define DEFAULT_COMMIT_ENTRIES    1000000
+
+/* Read-ahead of sequential runs, see --prefetch */
+#define DEFAULT_PREFETCH_FILES    16
+#define PREFETCH_BUDGET           (64 * 1024 * 1024)
+
+/* Shorter lists are all read ahead, without a snapshot of the index */
+#define PREFETCH_SNAPSHOT_FILES   256
+
+/* How many analysis_overdue() calls read the clock once */
+#define DEADLINE_CHECK_INTERVAL   1024
+
+/* A file changed this recently may change again with the same mtime, FAT
+ * keeps 2 seconds apart, see get_file_stat()
+ */
+#define RACY_MTIME_NS             (2 * (INT64) 1000000000)
+
+#define xstr(a) str(a)
+#define str(a) #a
+
+/* Serializes token dumps when files are analyzed in parallel */
+static std::mutex dump_lock;
+
 
 static int language_from_tag(const char *tag);
 static int language_from_filename(const char *filename);
 static const char *language_to_string(int lang);
 static void toks_start(fp_data& fpd);
+static void toks_start_degraded(fp_data& fpd);
 static void toks_end(fp_data& fpd);
+static void time_stage(fp_data& fpd, stage_t stage, void (*run)(fp_data& fpd));
 static void do_source_file(const char *filename_in, bool dump);
-static bool process_source_list(const char *source_list, deque<string>& source_files);
 
 
 /**
@@ -111,16 +143,52 @@ static void usage_exit(const char *msg, const char *argv0, int code)
            "\n"
            "Basic Options:\n"
            " -F <file>     : Read files to process from file, one filename per line (- is stdin)\n"
+           " -r <dir>      : Process the source files below dir, skipping what .gitignore excludes\n"
+           " -0            : The file names given with -F are separated by NUL characters\n"
            " -i <file>     : Use file as index (default: TOKS)\n"
            " -o <file>     : Redirect output to file\n"
            " -l <language> : Language override: C, CPP, D, CS, JAVA, PAWN, OC, OC+\n"
            " -t            : Load a file with types (usually not needed)\n"
+           " -j <n>        : Analyze files using n threads (0 = one per cpu, default: 1)\n"
+           "\n"
+           "Index Options:\n"
+           " --commit-files <n>   : Commit the index after every n files (0 = at the end, default: " xstr(DEFAULT_COMMIT_FILES) ")\n"
+           " --commit-entries <n> : Commit the index after about n entries (0 = at the end, default: " xstr(DEFAULT_COMMIT_ENTRIES) ")\n"
+           " --prune-unlisted     : Remove all files that are not given from the index\n"
+           " --wal                : Keep the index in WAL mode, lookups read the last commit while indexing\n"
+           " --snapshot           : Index into a copy of the index and put it in place when done\n"
+           " --prefetch <n>       : Without -j, read up to n files ahead of the analysis (0 = off, default: " xstr(DEFAULT_PREFETCH_FILES) ")\n"
+           " --max-size <bytes>   : Index only the tokens and functions of larger files (0 = no limit, default)\n"
+           " --max-chunks <n>     : The same for files of more than n tokens (0 = no limit, default)\n"
+           " --max-time <ms>      : The same for files whose analysis takes longer (0 = no limit, default)\n"
+           " --stats <file>       : Write the times and counts of each file as JSON (- is stdout)\n"
+           " --shard-by <how>     : For -i <dir>/, put the files in shards by 'dir' (default) or 'hash:<n>'\n"
+           " --shard <k/n>        : Index only slice k of n of the files, by a hash of the file name\n"
+           " --partial            : Leave out the lookup indexes, for an index that is merged with --merge\n"
+           " --merge              : Merge the partial indexes given instead of files into -i <file>\n"
+           " --git <rev>          : Index the files of a git commit, only those changed since the last --git run\n"
+           " --watch <dir>        : Index the source files below dir and keep them indexed until interrupted\n"
+           " --compact <file>     : Export the index to a compact read-only index for lookups, used with -i <file>\n"
            "\n"
            "Lookup Options (can be combined, supports ? and * wildcards):\n"
            " --id <name>          : Identifier name to search for\n"
+           " --id-from <file>     : Search for the identifiers listed in file (- is stdin), one per line\n"
            " --refs               : Show only references\n"
            " --defs               : Show only definitions\n"
            " --decls              : Show only declarations\n"
+           " --format <format>    : Print the entries as text (default), json, null-separated or vim-quickfix\n"
+           " --limit <n>          : Print at most n entries (0 = all, default: 0)\n"
+           " --rank               : Print definitions, declarations, then references, recently modified files first\n"
+           " --near <path>        : Rank, with the entries in the directory of path first\n"
+           " --at <file:line:col> : Show the entry at a position and the definitions of its identifier\n"
+           " --callers <name>     : Show the definitions of the functions that call function name\n"
+           " --callees <name>     : Show the calls made by the definitions of function name\n"
+           " --depth <n>          : Follow the callers or callees n calls deep (0 = all, default: 1)\n"
+           " --connect <socket>   : Ask the server on socket, use the index if there is none\n"
+           "\n"
+           "Server Options:\n"
+           " --serve <socket>     : Answer lookups on a Unix socket until interrupted\n"
+           " --in-memory          : Copy the index into memory when serving\n"
            "\n"
            "Config/Help Options:\n"
            " -h -? --help --usage     : print this message and exit\n"
@@ -174,8 +242,21 @@ int main(int argc, char *argv[])
    int idx;
    const char *p_arg;
    bool dump = false;
-   const char *identifier;
-   bool refs, defs, decls;
+   int jobs = 1;
+   const char *identifier, *id_from, *function, *position;
+   bool callers;
+   int depth = 1;
+   int sub_types;
+   output_format format = OF_TEXT;
+   int limit = 0;
+   const char *near;
+   bool ranked;
+   const char *serve_socket, *connect_socket, *stats_file_name;
+   bool in_memory, prune_unlisted, nul_separated;
+   const char *shard_by, *git_rev, *watch_dir, *compact_file;
+   vector<string> walk_dirs;
+   bool sharded, compact, merge;
+   unsigned int slice = 0, slices = 0;
 
    Args arg(argc, argv);
 
@@ -214,6 +295,8 @@ int main(int argc, char *argv[])
       dump = true;
    }
 
+   init_keywords();
+
    /* Load type files */
    idx = 0;
    while ((p_arg = arg.Params("-t", idx)) != NULL)
@@ -232,19 +315,146 @@ int main(int argc, char *argv[])
    }
 
    source_list = arg.Param("-F");
+   idx = 0;
+   while ((p_arg = arg.Params("-r", idx)) != NULL)
+   {
+      walk_dirs.push_back(p_arg);
+   }
    output_file = arg.Param("-o");
    index_file = arg.Param("-i");
+   sharded = shards_is_sharded(index_file);
+   compact = !sharded && compact_is_compact(index_file);
+   shard_by = arg.Param("--shard-by");
+   git_rev  = arg.Param("--git");
+   watch_dir = arg.Param("--watch");
+   compact_file = arg.Param("--compact");
+   merge = arg.Present("--merge");
+
+   if ((p_arg = arg.Param("--shard")) != NULL)
+   {
+      if ((sscanf(p_arg, "%u/%u", &slice, &slices) != 2) || (slice < 1) || (slice > slices))
+      {
+         LOG_FMT(LERR, "Unknown --shard %s, use k/n with k from 1 to n\n", p_arg);
+         return EXIT_FAILURE;
+      }
+   }
 
    identifier = arg.Param("--id");
+   id_from    = arg.Param("--id-from");
+
+   position = arg.Param("--at");
 
-   refs = arg.Present("--refs");
-   defs = arg.Present("--defs");
-   decls = arg.Present("--decls");
-   if (!(refs || defs || decls))
+   function = arg.Param("--callers");
+   callers  = (function != NULL);
+   if (!callers)
    {
-      refs = defs = decls = true;
+      function = arg.Param("--callees");
    }
 
+   if ((p_arg = arg.Param("--depth")) != NULL)
+   {
+      depth = atoi(p_arg);
+      if (depth < 0)
+      {
+         depth = 0;
+      }
+   }
+
+   if ((p_arg = arg.Param("--format")) != NULL)
+   {
+      if (!output_format_from_name(p_arg, format))
+      {
+         LOG_FMT(LWARN, "Ignoring unknown output format: %s\n", p_arg);
+      }
+   }
+
+   near   = arg.Param("--near");
+   ranked = arg.Present("--rank") || (near != NULL);
+
+   if ((p_arg = arg.Param("--limit")) != NULL)
+   {
+      limit = atoi(p_arg);
+      if (limit < 0)
+      {
+         limit = 0;
+      }
+   }
+
+   if ((p_arg = arg.Param("-j")) != NULL)
+   {
+      jobs = atoi(p_arg);
+      if (jobs <= 0)
+      {
+         jobs = std::thread::hardware_concurrency();
+      }
+      if (jobs <= 0)
+      {
+         jobs = 1;
+      }
+   }
+
+   cpd.commit_files = DEFAULT_COMMIT_FILES;
+   if ((p_arg = arg.Param("--commit-files")) != NULL)
+   {
+      cpd.commit_files = atoi(p_arg);
+   }
+
+   cpd.commit_entries = DEFAULT_COMMIT_ENTRIES;
+   if ((p_arg = arg.Param("--commit-entries")) != NULL)
+   {
+      cpd.commit_entries = atoi(p_arg);
+   }
+
+   cpd.prefetch_files = DEFAULT_PREFETCH_FILES;
+   if ((p_arg = arg.Param("--prefetch")) != NULL)
+   {
+      cpd.prefetch_files = max(atoi(p_arg), 0);
+   }
+
+   if ((p_arg = arg.Param("--max-size")) != NULL)
+   {
+      cpd.max_size = strtoull(p_arg, NULL, 10);
+   }
+
+   if ((p_arg = arg.Param("--max-chunks")) != NULL)
+   {
+      cpd.max_chunks = max(atoi(p_arg), 0);
+   }
+
+   if ((p_arg = arg.Param("--max-time")) != NULL)
+   {
+      cpd.max_time_ms = max(atoi(p_arg), 0);
+   }
+
+   cpd.wal      = arg.Present("--wal");
+   cpd.snapshot = arg.Present("--snapshot");
+   cpd.partial  = arg.Present("--partial");
+
+   sub_types = 0;
+   if (arg.Present("--refs"))
+   {
+      sub_types |= IST_MASK(IST_REFERENCE);
+   }
+   if (arg.Present("--defs"))
+   {
+      sub_types |= IST_MASK(IST_DEFINITION);
+   }
+   if (arg.Present("--decls"))
+   {
+      sub_types |= IST_MASK(IST_DECLARATION);
+   }
+   if (sub_types == 0)
+   {
+      sub_types = IST_ALL;
+   }
+
+   serve_socket = arg.Param("--serve");
+   connect_socket = arg.Param("--connect");
+   in_memory = arg.Present("--in-memory");
+   prune_unlisted = arg.Present("--prune-unlisted");
+   nul_separated = arg.Present("-0");
+   stats_file_name = arg.Param("--stats");
+
    LOG_FMT(LNOTE, "output_file = %s\n", (output_file != NULL) ? output_file : "null");
    LOG_FMT(LNOTE, "source_list = %s\n", (source_list != NULL) ? source_list : "null");
    LOG_FMT(LNOTE, "index_file = %s\n", (index_file != NULL) ? index_file : "null");
@@ -260,62 +470,268 @@ int main(int argc, char *argv[])
    idx   = 1;
    p_arg = arg.Unused(idx);
 
-   if ((source_list != NULL) || (p_arg != NULL) || (identifier != NULL))
+   if (serve_socket != NULL)
+   {
+      bool served;
+
+      if (sharded ? !shards_open(index_file) :
+          compact ? !compact_open(index_file) : !index_open(index_file, false))
+      {
+         return EXIT_FAILURE;
+      }
+      if ((sharded || compact) && in_memory)
+      {
+         LOG_FMT(LWARN, "Ignoring --in-memory for the %s index %s\n",
+                 sharded ? "sharded" : "compact", index_file);
+      }
+      served = (sharded || compact || !in_memory || index_load_into_memory()) &&
+               index_serve(serve_socket);
+      if (sharded)
+      {
+         shards_close();
+      }
+      else if (compact)
+      {
+         compact_close();
+      }
+      else
+      {
+         index_close();
+      }
+
+      if (!served)
+      {
+         return EXIT_FAILURE;
+      }
+   }
+   else if (watch_dir != NULL)
+   {
+      bool watched;
+
+      if (sharded)
+      {
+         LOG_FMT(LERR, "--watch is not supported for the sharded index %s\n", index_file);
+         return EXIT_FAILURE;
+      }
+      if (compact)
+      {
+         LOG_FMT(LERR, "%s is a compact index, it can only be looked up\n", index_file);
+         return EXIT_FAILURE;
+      }
+      if (cpd.snapshot)
+      {
+         /* The copy would only be put in place when the watch ends */
+         LOG_FMT(LWARN, "Ignoring --snapshot for --watch, use --wal\n");
+         cpd.snapshot = false;
+      }
+      if (!index_open(index_file, true))
+      {
+         return EXIT_FAILURE;
+      }
+      watched = index_watch(watch_dir, jobs, dump);
+      index_close();
+
+      if (!watched)
+      {
+         return EXIT_FAILURE;
+      }
+   }
+   else if (compact_file != NULL)
    {
-      deque<string> source_files;
+      bool exported;
+
+      if (sharded || compact)
+      {
+         LOG_FMT(LERR, "Only an index that is not sharded or compact can be exported\n");
+         return EXIT_FAILURE;
+      }
+      if (!index_open(index_file, false))
+      {
+         return EXIT_FAILURE;
+      }
+      exported = compact_export(compact_file);
+      index_close();
 
-      if (!index_open(index_file, (source_list != NULL) || (p_arg != NULL)))
+      if (!exported)
       {
          return EXIT_FAILURE;
       }
+   }
+   else if (merge)
+   {
+      bool merged = true;
 
-      if ((source_list != NULL) || (p_arg != NULL))
+      if (sharded || compact)
+      {
+         LOG_FMT(LERR, "Partial indexes can only be merged into an index that is not sharded or compact\n");
+         return EXIT_FAILURE;
+      }
+      if (p_arg == NULL)
+      {
+         usage_exit("--merge needs the partial indexes to merge", argv[0], EXIT_FAILURE);
+      }
+      if (!index_open(index_file, true))
+      {
+         return EXIT_FAILURE;
+      }
+      idx = 1;
+      while (merged && ((p_arg = arg.Unused(idx)) != NULL))
       {
-         if (index_prepare_for_analysis() && index_prune_files())
+         merged = merge_index(p_arg);
+      }
+      merged = index_end_merge() && merged;
+      index_close();
+
+      if (!merged)
+      {
+         return EXIT_FAILURE;
+      }
+   }
+   else if ((connect_socket != NULL) && (identifier != NULL) &&
+            (source_list == NULL) && walk_dirs.empty() && (p_arg == NULL) &&
+            index_query_server(connect_socket, identifier, sub_types, format, limit, ranked, near))
+   {
+      /* Answered by the server */
+   }
+   else if ((source_list != NULL) || !walk_dirs.empty() || (p_arg != NULL) ||
+            (git_rev != NULL) || (identifier != NULL) || (id_from != NULL) ||
+            (function != NULL) || (position != NULL))
+   {
+      SourceList source_files;
+      bool indexing = (source_list != NULL) || !walk_dirs.empty() || (p_arg != NULL) ||
+                      (git_rev != NULL);
+      bool indexed  = true;
+
+      if ((git_rev != NULL) &&
+          ((source_list != NULL) || !walk_dirs.empty() || (p_arg != NULL) ||
+           (slices > 0) || prune_unlisted))
+      {
+         LOG_FMT(LERR, "--git indexes the files of the commit, it takes no -F, -r, --shard, --prune-unlisted or source files\n");
+         return EXIT_FAILURE;
+      }
+
+      if (sharded && (git_rev != NULL))
+      {
+         LOG_FMT(LERR, "--git is not supported for the sharded index %s\n", index_file);
+         return EXIT_FAILURE;
+      }
+
+      if ((sharded || compact) && ((function != NULL) || (position != NULL)))
+      {
+         LOG_FMT(LERR, "--at, --callers and --callees are not supported for the %s index %s\n",
+                 sharded ? "sharded" : "compact", index_file);
+         return EXIT_FAILURE;
+      }
+
+      if (compact && indexing)
+      {
+         LOG_FMT(LERR, "%s is a compact index, it can only be looked up\n", index_file);
+         return EXIT_FAILURE;
+      }
+
+      if (!sharded && !compact && !index_open(index_file, indexing))
+      {
+         return EXIT_FAILURE;
+      }
+
+      if (indexing)
+      {
+         if ((stats_file_name == NULL) || stats_open(stats_file_name))
          {
-            /* Build a list of source files */
+            /* The files on the command line come first, the list is read
+             * while the files are processed
+             */
             if (p_arg != NULL)
             {
                idx = 1;
                while ((p_arg = arg.Unused(idx)) != NULL)
                {
-                  source_files.push_back(p_arg);
+                  source_files.Add(p_arg);
                }
             }
             if (source_list != NULL)
             {
-               (void) process_source_list(source_list, source_files);
+               (void) source_files.Open(source_list, nul_separated);
             }
-
-            size_t size = source_files.size();
-
-            for (size_t i = 0; i < size; i += 1)
+            if (!walk_dirs.empty())
+            {
+               source_files.Walk(walk_dirs, jobs);
+            }
+            if (slices > 0)
             {
-               const char *fn = source_files.at(i).c_str();
-               do_source_file(fn, dump);
+               source_files.Slice(slice - 1, slices);
             }
+            source_files.Remember(prune_unlisted);
 
-            index_end_analysis();
+            if (git_rev != NULL)
+            {
+               indexed = git_index_revision(git_rev, jobs, dump);
+            }
+            else if (sharded)
+            {
+               (void) shards_index_files(index_file, shard_by, source_files,
+                                         jobs, dump, prune_unlisted);
+            }
+            else if (index_prepare_for_analysis())
+            {
+               (void) index_source_list(source_files, jobs, dump, prune_unlisted);
+               (void) index_end_analysis();
+            }
          }
+         stats_close();
       }
 
-      if (identifier != NULL)
+      if ((identifier != NULL) && (!sharded || shards_open(index_file)) &&
+          (!compact || compact_open(index_file)))
       {
-         if (decls)
-         {
-            (void) index_lookup_identifier(identifier, IST_DECLARATION);
-         }
-         if (defs)
-         {
-            (void) index_lookup_identifier(identifier, IST_DEFINITION);
-         }
-         if (refs)
-         {
-            (void) index_lookup_identifier(identifier, IST_REFERENCE);
-         }
+         static output_sink sink;
+
+         output_sink_init(sink, stdout, format, limit);
+         (void) index_lookup_identifier(sink, identifier, sub_types, ranked, near);
       }
 
-      index_close();
+      if ((id_from != NULL) && (!sharded || shards_opened() || shards_open(index_file)) &&
+          (!compact || compact_opened() || compact_open(index_file)))
+      {
+         static output_sink sink;
+
+         output_sink_init(sink, stdout, format, limit);
+         (void) index_lookup_batch(sink, id_from, sub_types, ranked, near);
+      }
+
+      if (position != NULL)
+      {
+         static output_sink sink;
+
+         output_sink_init(sink, stdout, format, limit);
+         (void) index_lookup_at(sink, position);
+      }
+
+      if (function != NULL)
+      {
+         static output_sink sink;
+
+         output_sink_init(sink, stdout, format, limit);
+         (void) index_lookup_calls(sink, function, callers, depth);
+      }
+
+      if (sharded)
+      {
+         shards_close();
+      }
+      else if (compact)
+      {
+         compact_close();
+      }
+      else
+      {
+         index_close();
+      }
+
+      if (!indexed)
+      {
+         return EXIT_FAILURE;
+      }
    }
    else
    {
@@ -329,53 +745,188 @@ int main(int argc, char *argv[])
 }
 
 
-static bool process_source_list(const char *source_list, deque<string>& source_files)
+/**
+ * Sets up the file data for a source file and gets its stat information.
+ * Doesn't touch the index, so it can be called from any thread.
+ *
+ * @param fpd      The file data to fill in
+ * @param filename the file to process
+ * @return         false if the file doesn't exist
+ */
+bool stat_source_file(fp_data& fpd, const char *filename)
+{
+   memset(fpd.stage_ns, 0, sizeof(fpd.stage_ns));
+   fpd.chunk_count = 0;
+   fpd.filename = filename;
+   fpd.frame_count = 0;
+   fpd.frame_pp_level = 0;
+   fpd.frame_ref_no = 0;
+   fpd.limit = FL_NONE;
+
+   /* Do some simple language detection based on the filename extension */
+   fpd.lang_flags = cpd.forced_lang_flags != LANG_NONE ?
+      cpd.forced_lang_flags : language_from_filename(filename);
+
+   if (!get_file_stat(filename, fpd.stat))
+   {
+      LOG_FMT(LERR, "%s: %s\n", filename, strerror(errno));
+      return(false);
+   }
+
+   return(true);
+}
+
+
+/**
+ * Gets the stat information of a file as the index keeps it. A file whose
+ * mtime is within the timestamp granularity of now is racy: an edit of the
+ * same size right after it is read could keep the mtime.
+ *
+ * @return false with errno set if the file doesn't exist
+ */
+bool get_file_stat(const char *filename, file_stat& st)
 {
-   int from_stdin = strcmp(source_list, "-") == 0;
-   FILE *p_file = from_stdin ? stdin : fopen(source_list, "r");
+   struct stat my_stat;
+   INT64       now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
 
-   if (p_file == NULL)
+   if (stat(filename, &my_stat) < 0)
    {
-      LOG_FMT(LERR, "%s: fopen(%s) failed: %s (%d)\n",
-              __func__, source_list, strerror(errno), errno);
-      return false;
+      return(false);
    }
 
-   char linebuf[256];
-   char *fname;
-   int  line = 0;
-   int  len;
+   st.size  = my_stat.st_size;
+#if defined(WIN32)
+   st.mtime = (INT64) my_stat.st_mtime * 1000000000;
+#elif defined(__APPLE__)
+   st.mtime = (INT64) my_stat.st_mtimespec.tv_sec * 1000000000 + my_stat.st_mtimespec.tv_nsec;
+#else
+   st.mtime = (INT64) my_stat.st_mtim.tv_sec * 1000000000 + my_stat.st_mtim.tv_nsec;
+#endif
+#ifdef WIN32
+   st.inode = 0;
+#else
+   st.inode = my_stat.st_ino;
+#endif
+   st.racy = (st.mtime > now - RACY_MTIME_NS);
 
-   while (fgets(linebuf, sizeof(linebuf), p_file) != NULL)
+   return(true);
+}
+
+
+/**
+ * Reads a source file set up by stat_source_file() and calculates its digest.
+ * Doesn't touch the index, so it can be called from any thread.
+ *
+ * @param fpd      The file data
+ * @return         false if the file could not be read
+ */
+bool read_source_file(fp_data& fpd)
+{
+   UINT64 start = stage_clock();
+   UINT64 now;
+
+   /* Read in the source file */
+   if (!decode_file(fpd.data, fpd.filename, cpd.read_sources))
    {
-      line++;
-      fname = linebuf;
-      len   = strlen(fname);
-      while ((len > 0) && isspace((unsigned char) *fname))
-      {
-         fname++;
-         len--;
-      }
-      while ((len > 0) && isspace((unsigned char) fname[len - 1]))
-      {
-         len--;
-      }
-      fname[len] = 0;
+      return(false);
+   }
+   now = stage_clock();
+   fpd.stage_ns[STAGE_DECODE] += now - start;
+
+   fpd.digest = Digest::Calc(fpd.data.Data(), fpd.data.Size());
+   fpd.stage_ns[STAGE_DIGEST] += stage_clock() - now;
+
+   return(true);
+}
 
-      LOG_FMT(LFILELIST, "%3d] %s\n", line, fname);
 
-      if (fname[0] != '#')
+/**
+ * Parses a source file read by read_source_file() and collects the
+ * identifiers to be stored in the index in fpd.entries.
+ * Doesn't touch the index, so it can be called from any thread.
+ *
+ * @param fpd  The file data
+ * @param dump Dump all tokens after parsing
+ */
+void analyze_source_file(fp_data& fpd, bool dump)
+{
+   LOG_FMT(LNOTE, "Parsing: %s as language %s\n",
+           fpd.filename, language_to_string(fpd.lang_flags));
+
+   /* A file may be analyzed again, with only its window */
+   fpd.entries.clear();
+   fpd.chunk_count     = 0;
+   fpd.frame_count     = 0;
+   fpd.frame_pp_level  = 0;
+   fpd.frame_ref_no    = 0;
+
+   fpd.deadline        = (cpd.max_time_ms > 0) ?
+                         stage_clock() + (UINT64) cpd.max_time_ms * 1000000 : 0;
+   fpd.deadline_checks = 0;
+   fpd.limit           = ((cpd.max_size > 0) && (fpd.data.Size() > cpd.max_size)) ?
+                         FL_SIZE : FL_NONE;
+
+   if (fpd.limit == FL_NONE)
+   {
+      toks_start(fpd);
+
+      /* The kept regions after the window would be parsed differently */
+      if ((fpd.limit == FL_NONE) && !region_window_complete(fpd))
       {
-         source_files.push_back(fname);
+         LOG_FMT(LNOTE, "File %s changed at a region end, analyzing all of it\n", fpd.filename);
+         toks_end(fpd);
+         region_window_all(fpd);
+         fpd.frame_count     = 0;
+         fpd.frame_pp_level  = 0;
+         fpd.frame_ref_no    = 0;
+         toks_start(fpd);
       }
    }
 
-   if (!from_stdin)
+   /* A pathological file doesn't hold up the others, the whole file is
+    * analyzed again with the passes that are linear in its size
+    */
+   if (fpd.limit != FL_NONE)
+   {
+      LOG_FMT(LWARN, "%s: over the %s limit, indexing only its tokens and functions\n",
+              fpd.filename, get_limit_name(fpd.limit));
+      toks_end(fpd);
+      fpd.chunk_count = 0;
+      region_window_all(fpd);
+      toks_start_degraded(fpd);
+   }
+
+   /* Special hook for dumping parsed data for debugging */
+   if (dump)
    {
-      fclose(p_file);
+      std::lock_guard<std::mutex> guard(dump_lock);
+      output_dump_tokens(fpd);
    }
 
-   return true;
+   time_stage(fpd, STAGE_OUTPUT, output);
+
+   /* Regions need the levels of the complete analysis */
+   if (fpd.limit == FL_NONE)
+   {
+      find_regions(fpd);
+   }
+   else
+   {
+      fpd.regions.clear();
+   }
+
+   toks_end(fpd);
+
+   if (log_sev_on(LSTAGE))
+   {
+      LOG_FMT(LSTAGE, "Stages of %s:", fpd.filename);
+      for (int stage = 0; stage < STAGE_COUNT; stage++)
+      {
+         LOG_FMT(LSTAGE, " %s %.3f", get_stage_name((stage_t)stage), fpd.stage_ns[stage] / 1e6);
+      }
+      LOG_FMT(LSTAGE, " ms\n");
+   }
 }
 
 
@@ -387,54 +938,162 @@ static bool process_source_list(const char *source_list, deque<string>& source_f
 static void do_source_file(const char *filename, bool dump)
 {
    fp_data fpd;
+   bool    read = stat_source_file(fpd, filename);
 
-   fpd.filename = filename;
-   fpd.frame_count = 0;
-   fpd.frame_pp_level = 0;
+   if (read && index_file_unchanged(fpd))
+   {
+      stats_skipped();
+      return;
+   }
 
-   /* Do some simple language detection based on the filename extension */
-   fpd.lang_flags = cpd.forced_lang_flags != LANG_NONE ?
-      cpd.forced_lang_flags : language_from_filename(filename);
+   read = read && read_source_file(fpd);
+   if (read && index_prepare_for_file(fpd))
+   {
+      analyze_source_file(fpd, dump);
 
-   /* Read in the source file */
-   if (!decode_file(fpd.data, filename))
+      stats_file(fpd);
+      (void) index_insert_entries(fpd);
+   }
+   else
    {
-      return;
+      if (!read)
+      {
+         cpd.failed_files++;
+      }
+      stats_skipped();
    }
+}
 
-   /* Calculate MD5 digest */
-   MD5::Calc(&fpd.data[0], fpd.data.size(), fpd.digest);
 
-   if (index_prepare_for_file(fpd))
+/**
+ * Analyzes the source files and stores them in the open index.
+ *
+ * @return false if a file could not be read or stored
+ */
+bool index_source_files(SourceList& source_files, int jobs, bool dump)
+{
+   int  failed = cpd.failed_files;
+   bool retval = true;
+
+   if (jobs > 1)
    {
-      LOG_FMT(LNOTE, "Parsing: %s as language %s\n",
-              filename, language_to_string(fpd.lang_flags));
+      retval = index_files_parallel(source_files, jobs, dump);
+   }
+   else
+   {
+      indexed_file_map    files;
+      indexed_content_set contents;
+      FilePrefetch        prefetch(cpd.prefetch_files, PREFETCH_BUDGET);
+      string              filename;
 
-      toks_start(fpd);
+      if (cpd.prefetch_files == 0)
+      {
+         while (source_files.Next(filename))
+         {
+            do_source_file(filename.c_str(), dump);
+         }
+      }
+      else
+      {
+         /* Read the next files while one is analyzed. In a long list the
+          * unchanged ones are skipped by a snapshot of the index, which
+          * would take longer to load than a few files to read.
+          */
+         bool snapshot = !source_files.Fewer(PREFETCH_SNAPSHOT_FILES) &&
+                         index_load_files(files, contents);
+
+         prefetch.Start(source_files, snapshot ? &files : NULL);
+         while (prefetch.Next(filename))
+         {
+            do_source_file(filename.c_str(), dump);
+         }
+      }
+   }
+
+   return(retval && (cpd.failed_files == failed));
+}
+
+
+/**
+ * Analyzes the source files and stores them in the open index, after
+ * removing the files that no longer exist from it. With prune_unlisted
+ * all files that are not in the list are removed instead.
+ *
+ * @return false if a file could not be removed, read or stored
+ */
+bool index_source_list(SourceList& source_files, int jobs, bool dump, bool prune_unlisted)
+{
+   bool retval = prune_unlisted || index_prune_files(jobs, NULL);
 
-      /* Special hook for dumping parsed data for debugging */
-      if (dump)
+   if (retval)
+   {
+      retval = index_source_files(source_files, jobs, dump);
+
+      if (prune_unlisted)
       {
-         output_dump_tokens(fpd);
+         retval = index_prune_files(jobs, &source_files.Seen()) && retval;
       }
+   }
+   return(retval);
+}
+
+/* Monotonic time in nanoseconds, for the stage timers */
+UINT64 stage_clock()
+{
+   return(std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count());
+}
 
-      index_begin_file(fpd);
 
-      output(fpd);
+/* Runs one stage of a file and adds its time to fpd.stage_ns */
+static void time_stage(fp_data& fpd, stage_t stage, void (*run)(fp_data& fpd))
+{
+   UINT64 start = stage_clock();
 
-      index_end_file(fpd);
+   run(fpd);
+   fpd.stage_ns[stage] += stage_clock() - start;
+}
 
-      toks_end(fpd);
+
+/**
+ * Whether the file reached a limit and its analysis should stop, checked
+ * by the loops of the stages that run over all chunks. The clock is only
+ * read every DEADLINE_CHECK_INTERVAL calls.
+ */
+bool analysis_overdue(fp_data& fpd)
+{
+   if ((fpd.limit == FL_NONE) && (fpd.deadline != 0) &&
+       ((++fpd.deadline_checks % DEADLINE_CHECK_INTERVAL) == 0) &&
+       (stage_clock() > fpd.deadline))
+   {
+      fpd.limit = FL_TIME;
    }
+   return(fpd.limit != FL_NONE);
 }
 
 
+/* Stops at the first stage that finds the file over a limit */
 static void toks_start(fp_data& fpd)
 {
    /**
     * Parse the text into chunks
     */
-   tokenize(fpd);
+   time_stage(fpd, STAGE_TOKENIZE, tokenize);
+
+   if (cpd.max_chunks > 0)
+   {
+      int chunks = 0;
+
+      for (chunk_t *pc = chunk_get_head(fpd); pc != NULL; pc = pc->next)
+      {
+         chunks++;
+      }
+      if (chunks > cpd.max_chunks)
+      {
+         fpd.limit = FL_CHUNKS;
+         return;
+      }
+   }
 
    /**
     * Change certain token types based on simple sequence.
@@ -442,13 +1101,21 @@ static void toks_start(fp_data& fpd)
     * Note that level info is not yet available, so it is OK to do all
     * processing that doesn't need to know level info. (that's very little!)
     */
-   tokenize_cleanup(fpd);
+   time_stage(fpd, STAGE_TOKENIZE_CLEANUP, tokenize_cleanup);
+   if (analysis_overdue(fpd))
+   {
+      return;
+   }
 
    /**
     * Detect the brace and paren levels and insert virtual braces.
     * This handles all that nasty preprocessor stuff
     */
-   brace_cleanup(fpd);
+   time_stage(fpd, STAGE_BRACE_CLEANUP, brace_cleanup);
+   if (analysis_overdue(fpd))
+   {
+      return;
+   }
 
    /**
     * At this point, the level information is available and accurate.
@@ -459,32 +1126,92 @@ static void toks_start(fp_data& fpd)
       pawn_prescan(fpd);
    }
 
+   /* The passes below walk the list many times, keep it in memory order */
+   (void) chunk_compact(fpd);
+
    /**
     * Re-type chunks, combine chunks
     */
-   fix_symbols(fpd);
+   time_stage(fpd, STAGE_FIX_SYMBOLS, fix_symbols);
+   if (analysis_overdue(fpd))
+   {
+      return;
+   }
 
    /**
     * Look at all colons ':' and mark labels, :? sequences, etc.
     */
-   combine_labels(fpd);
+   time_stage(fpd, STAGE_COMBINE_LABELS, combine_labels);
+   if (analysis_overdue(fpd))
+   {
+      return;
+   }
 
    /**
     * Assign scope information
     */
-   assign_scope(fpd);
+   time_stage(fpd, STAGE_ASSIGN_SCOPE, assign_scope);
 }
 
 
-static void toks_end(fp_data& fpd)
+/* The degraded mode: the tokens, the function definitions and calls */
+static void toks_start_degraded(fp_data& fpd)
 {
-   /* Free all the memory */
-   chunk_t *pc;
+   time_stage(fpd, STAGE_TOKENIZE, tokenize);
+   time_stage(fpd, STAGE_FIX_SYMBOLS, fix_symbols_degraded);
+   time_stage(fpd, STAGE_ASSIGN_SCOPE, assign_scope_degraded);
+}
+
 
-   while ((pc = chunk_get_head(fpd)) != NULL)
+static void toks_end(fp_data& fpd)
+{
+   if (stats_enabled())
    {
-      chunk_del(fpd, pc);
+      for (chunk_t *pc = chunk_get_head(fpd); pc != NULL; pc = pc->next)
+      {
+         fpd.chunk_count++;
+      }
    }
+
+   /* Free all the memory, the chunks are owned by the arena */
+   fpd.chunk_list.Reset();
+   fpd.chunk_arena.Release();
+   fpd.text_pool.clear();
+}
+
+
+static const char *const stage_names[STAGE_COUNT] =
+{
+   "decode",
+   "digest",
+   "tokenize",
+   "tokenize_cleanup",
+   "brace_cleanup",
+   "fix_symbols",
+   "combine_labels",
+   "assign_scope",
+   "output",
+};
+
+
+const char *get_stage_name(stage_t stage)
+{
+   return(((stage >= 0) && (stage < STAGE_COUNT)) ? stage_names[stage] : "???");
+}
+
+
+static const char *const limit_names[] =
+{
+   "none",
+   "size",
+   "chunk",
+   "time",
+};
+
+
+const char *get_limit_name(file_limit limit)
+{
+   return(((limit >= 0) && (limit < (int)ARRAY_SIZE(limit_names))) ? limit_names[limit] : "???");
 }
 
 
@@ -521,19 +1248,6 @@ c_token_t find_token_name(const char *text)
 }
 
 
-static bool ends_with(const char *filename, const char *tag)
-{
-   int len1 = strlen(filename);
-   int len2 = strlen(tag);
-
-   if ((len2 <= len1) && (strcmp(&filename[len1 - len2], tag) == 0))
-   {
-      return(true);
-   }
-   return(false);
-}
-
-
 struct file_lang
 {
    const char *ext;
@@ -586,6 +1300,51 @@ const char *get_file_extension(int& idx)
 }
 
 
+/**
+ * Find the entry of languages[] for the extension of a file, through a hash
+ * of the extensions built on first use
+ *
+ * @return  The index in languages[] or -1
+ */
+static int language_index(const char *filename)
+{
+   struct extension_map : public unordered_map<string, int>
+   {
+      extension_map()
+      {
+         /* The first entry for an extension wins, as in a linear search */
+         for (int i = (int)ARRAY_SIZE(languages) - 1; i >= 0; i--)
+         {
+            (*this)[languages[i].ext] = i;
+         }
+      }
+   };
+   static const extension_map extensions;
+   const char *ext = strrchr(filename, '.');
+
+   if (ext != NULL)
+   {
+      extension_map::const_iterator it = extensions.find(ext);
+
+      if (it != extensions.end())
+      {
+         return(it->second);
+      }
+   }
+   return(-1);
+}
+
+
+/**
+ * Whether a file has one of the known source extensions, any file is taken
+ * when -l forces the language
+ */
+bool is_source_file(const char *filename)
+{
+   return((cpd.forced_lang_flags != LANG_NONE) || (language_index(filename) >= 0));
+}
+
+
 /**
  * Find the language for the file extension
  * Default to C
@@ -595,16 +1354,9 @@ const char *get_file_extension(int& idx)
  */
 static int language_from_filename(const char *filename)
 {
-   int i;
+   int i = language_index(filename);
 
-   for (i = 0; i < (int)ARRAY_SIZE(languages); i++)
-   {
-      if (ends_with(filename, languages[i].ext))
-      {
-         return(languages[i].lang);
-      }
-   }
-   return(LANG_C);
+   return((i >= 0) ? languages[i].lang : LANG_C);
 }
 
 
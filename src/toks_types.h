@@ -12,7 +12,11 @@
 #include <vector>
 #include <deque>
 #include <cstdio>
+#include <cstring>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
 using namespace std;
 
 #include "base_types.h"
@@ -21,6 +25,9 @@ using namespace std;
 #include "logger.h"
 #include "sqlite3080200.h"
 #include "ListManager.h"
+#include "Arena.h"
+#include "SourceBuffer.h"
+#include "digest.h"
 
 /**
  * Brace stage enum used in brace_cleanup
@@ -71,7 +78,11 @@ struct paren_stack_entry
    bool         non_vardef;   /**< Hit a non-vardef line */
 };
 
-/* TODO: put this on a linked list */
+/**
+ * The state of the brace parser, saved on the frame stack at #if and
+ * restored at #else and #endif. Only pse[0] to pse[pse_tos] are in use,
+ * saving and restoring a frame leaves the entries above alone.
+ */
 struct parse_frame
 {
    int                      ref_no;
@@ -198,6 +209,82 @@ static const char *pcf_names[] =
 #endif
 
 
+/**
+ * A chunk holds the levels in 16 bits, deeper nesting is kept at the
+ * deepest level, see chunk_level()
+ */
+#define CHUNK_LEVEL_MAX    INT16_MAX
+#define CHUNK_LEVEL_MIN    INT16_MIN
+
+
+/**
+ * The text of a chunk.
+ * Usually points into fp_data::data, so it is NOT NUL terminated. Use "%.*s"
+ * with chunk_t::len() and chunk_t::text() to print it.
+ * Text that doesn't exist in the file points to a literal or into
+ * fp_data::text_pool, see chunk_append_text().
+ */
+class chunk_text
+{
+protected:
+   const char *m_str;
+   int        m_len;
+
+public:
+   chunk_text() : m_str(""), m_len(0)
+   {
+   }
+
+   chunk_text(const char *str, int len) : m_str(str), m_len(len)
+   {
+   }
+
+   void assign(const char *str, int len)
+   {
+      m_str = str;
+      m_len = len;
+   }
+
+   void clear()
+   {
+      assign("", 0);
+   }
+
+   /* Only shrinking is possible */
+   void resize(int len)
+   {
+      if (len < m_len)
+      {
+         m_len = len;
+      }
+   }
+
+   int size() const
+   {
+      return(m_len);
+   }
+
+   const char *data() const
+   {
+      return(m_str);
+   }
+
+   char operator[](int idx) const
+   {
+      return(m_str[idx]);
+   }
+
+   bool operator==(const chunk_text& ref) const
+   {
+      return((m_len == ref.m_len) && (memcmp(m_str, ref.m_str, m_len) == 0));
+   }
+
+   bool operator!=(const chunk_text& ref) const
+   {
+      return(!(*this == ref));
+   }
+};
+
 /** This is the main type of this program */
 struct chunk_t
 {
@@ -209,6 +296,7 @@ struct chunk_t
    {
       next = 0;
       prev = 0;
+      match = 0;
       type = CT_NONE;
       parent_type = CT_NONE;
       orig_line = 0;
@@ -219,7 +307,7 @@ struct chunk_t
       brace_level = 0;
       pp_level = 0;
       str.clear();
-      scope.clear();
+      scope = 0;
    }
    int len()
    {
@@ -227,26 +315,26 @@ struct chunk_t
    }
    const char *text()
    {
-      return str.c_str();
-   }
-   const char *scope_text()
-   {
-      return scope.c_str();
+      return str.data();
    }
 
-   chunk_t      *next;
-   chunk_t      *prev;
+   /* Packed for a small chunk, the fields the navigation looks at come
+    * first, in the first 16 bytes
+    */
    c_token_t    type;
    c_token_t    parent_type;      /* usually CT_NONE */
+   INT16        level;            /* nest level in {, (, or [ */
+   INT16        brace_level;      /* nest level in braces only */
+   UINT64       flags;            /* see PCF_xxx */
+   chunk_t      *next;
+   chunk_t      *prev;
+   chunk_t      *match;           /* the other end of a paren/brace/square/angle, see chunk_skip_to_match() */
+   chunk_text   str;              /* the token text */
    UINT32       orig_line;
    UINT32       orig_col;
    UINT32       orig_col_end;
-   UINT64       flags;            /* see PCF_xxx */
-   int          level;            /* nest level in {, (, or [ */
-   int          brace_level;      /* nest level in braces only */
-   int          pp_level;         /* nest level in #if stuff */
-   string       str;              /* the token text */
-   string       scope;            /* the scope of the token */
+   int          scope;            /* the scope of the token, see scope_name() */
+   INT16        pp_level;         /* nest level in #if stuff */
 };
 
 enum
@@ -264,6 +352,7 @@ enum
 
    LANG_ALLC = 0x017f,
    LANG_ALL  = 0x0fff,
+   LANG_CCPP = LANG_C | LANG_CPP, /*<< most of the input, see lang_is() */
 
    FLAG_PP   = 0x8000,     /*<< only appears in a preprocessor */
 };
@@ -290,76 +379,361 @@ struct chunk_tag_t
    int        lang_flags;
 };
 
-struct lookup_entry_t
+typedef enum
 {
-   char              ch;
-   char              left_in_group;
-   UINT16            next_idx;
-   const chunk_tag_t *tag;
+   IT_IDENTIFIER,        // Unspecified identifier
+   IT_MACRO,             // preprocessor macro
+   IT_MACRO_FUNCTION,    // function like preprocessor macro
+   IT_FUNCTION,          // functions
+   IT_STRUCT,            // struct <tag>
+   IT_UNION,             // union <tag>
+   IT_ENUM,              // enum <tag>
+   IT_ENUM_VAL,          // values of an enum
+   IT_CLASS,             // class
+   IT_STRUCT_TYPE,       // typedef alias of a struct
+   IT_UNION_TYPE,        // typedef alias of a union
+   IT_ENUM_TYPE,         // typedef alias of an enum
+   IT_FUNCTION_TYPE,     // typedef of a function or function ptr
+   IT_TYPE,              // a type
+   IT_VAR,               // a variable
+   IT_NAMESPACE,         // a namespace, the last one (see INDEX_REF_TYPE_BITS)
+} id_type;
+
+typedef enum
+{
+   IST_REFERENCE,
+   IST_DEFINITION,
+   IST_DECLARATION,
+} id_sub_type;
+
+/* A set of sub types, for lookups */
+#define IST_MASK(sub_type)    (1 << (sub_type))
+#define IST_ALL               (IST_MASK(IST_REFERENCE) |  \
+                               IST_MASK(IST_DEFINITION) | \
+                               IST_MASK(IST_DECLARATION))
+
+/* How lookup results are printed */
+typedef enum
+{
+   OF_TEXT,              // file:line:column scope TYPE SUB identifier
+   OF_JSON,              // one JSON object per line
+   OF_NUL,               // the seven fields of the text, each ended by a NUL
+   OF_VIM,               // file:line:column: text, for the vim quickfix list
+} output_format;
+
+#define OUTPUT_SINK_SIZE    65536
+
+/** A lookup result kept for merging the results of shards */
+struct lookup_row
+{
+   string             filename;
+   UINT32             line;
+   UINT32             column_start;
+   string             scope;
+   id_type            type;
+   id_sub_type        sub_type;
+   string             identifier;
+   bool               near;       // in the directory ranked first
+   INT64              mtime;
+};
+
+/**
+ * Collects lookup results for one stream, see output_identifier(). At most
+ * limit results are taken, 0 means no limit. With rows set the results are
+ * kept there instead of printed. With query set every result is tagged with
+ * it, for the batches of --id-from.
+ */
+struct output_sink
+{
+   FILE               *out;
+   output_format      format;
+   int                limit;
+   int                count;
+   const char         *query;
+   vector<lookup_row> *rows;
+   int                len;
+   char               buf[OUTPUT_SINK_SIZE];
+};
+
+/* Lookup statements of an index, see index_lookup_statement() with the
+ * references by content of the limited ones, the one reading the name of a
+ * scope and those of index_read_changes()
+ */
+#define INDEX_LOOKUP_BY_CONTENT    (2 * 4 * (IST_ALL + 1))
+#define INDEX_LOOKUP_SCOPE         (INDEX_LOOKUP_BY_CONTENT + 4)
+#define INDEX_LOOKUP_CHANGES       (INDEX_LOOKUP_SCOPE + 1)
+#define INDEX_LOOKUP_STATEMENTS    (INDEX_LOOKUP_CHANGES + 3)
+
+/**
+ * The Bloom filter of the identifiers of an index, so a lookup of a name
+ * the index doesn't have returns at once. See index_bloom_may_contain().
+ */
+struct index_bloom
+{
+   index_bloom() : loaded(false), generation(0), identifiers(0), changed(false)
+   {
+   }
+
+   bool               loaded;
+   sqlite3_int64      generation;   // the last identifier row when it was loaded
+   vector<UINT8>      bits;         // empty if the index has none yet
+   sqlite3_int64      identifiers;  // that the filter is sized for, when indexing
+   bool               changed;      // identifiers were added since it was stored
+};
+
+/**
+ * An identifier found by output(), waiting to be stored in the index.
+ * Entries are collected per file so the analysis can run on a worker thread
+ * while only the index writer touches the database.
+ */
+struct index_entry
+{
+   UINT32             line;
+   UINT32             column_start;
+   UINT32             column_end; // the column after the identifier
+   id_type            type;
+   id_sub_type        sub_type;
+   int                scope;      // index into fp_data::scopes
+   string             identifier;
+   int                caller;     // for a call, the entry of the function it is in, else -1
+};
+
+/* A reference as stored in a block of the RefBlocks table */
+struct block_ref
+{
+   UINT32             line;
+   UINT32             column_start;
+   UINT32             column_end;
+   id_type            type;
+   sqlite3_int64      scope;      // rowid in the Scopes table
+};
+
+/** The stat information used to detect unchanged files without reading them */
+struct file_stat
+{
+   file_stat() : size(0), mtime(0), inode(0), racy(false)
+   {
+   }
+
+   UINT64             size;
+   INT64              mtime;      // nanoseconds since the epoch
+   UINT64             inode;      // 0 if not available
+   bool               racy;       // too recent to skip the file by, see get_file_stat()
+
+   bool operator==(const file_stat& ref) const
+   {
+      return((size == ref.size) && (mtime == ref.mtime) && (inode == ref.inode));
+   }
+};
+
+/** What the index knows about a file */
+struct indexed_file
+{
+   digest_t           digest;
+   file_stat          stat;
+};
+
+/** Every indexed file, keyed by filename */
+typedef unordered_map<string, indexed_file> indexed_file_map;
+
+/** The digest and language of every analyzed content */
+typedef set<pair<digest_t, int> > indexed_content_set;
+
+/** A top level region of a file, see regions.cpp */
+struct file_region
+{
+   int                line;       // first line
+   int                lines;
+   digest_t           digest;     // of the text of the lines
+};
+
+/**
+ * The changed lines of a file, the only ones analyzed again when the
+ * content the file had is updated in place. See region_window().
+ */
+struct file_window
+{
+   file_window() : partial(false), offset(0), size(0), line(1),
+      keep_before(0), keep_from(0), shift(0)
+   {
+   }
+
+   bool                partial;      // only the window is analyzed
+   size_t              offset;       // the bytes analyzed
+   size_t              size;
+   int                 line;         // line number at offset
+   int                 keep_before;  // entries before this line are kept
+   int                 keep_from;    // and those from this old line on, 0 for none
+   int                 shift;        // added to the lines kept from keep_from
+   vector<file_region> kept;         // the regions outside the window
+};
+
+/** The stages of indexing a file, each one is timed */
+enum stage_t
+{
+   STAGE_DECODE,
+   STAGE_DIGEST,
+   STAGE_TOKENIZE,
+   STAGE_TOKENIZE_CLEANUP,
+   STAGE_BRACE_CLEANUP,
+   STAGE_FIX_SYMBOLS,
+   STAGE_COMBINE_LABELS,
+   STAGE_ASSIGN_SCOPE,
+   STAGE_OUTPUT,
+   STAGE_COUNT
+};
+
+/**
+ * The per-file limits of --max-size, --max-chunks and --max-time. A file
+ * that reaches one is analyzed in degraded mode, see analysis_overdue().
+ */
+enum file_limit
+{
+   FL_NONE,
+   FL_SIZE,
+   FL_CHUNKS,
+   FL_TIME,
 };
 
 struct fp_data
 {
    const char         *filename;
-   vector<UINT8>      data;
-   char               digest[33];
-
-   struct parse_frame frames[16];
+   SourceBuffer       data;       // the file contents in UTF-8
+   deque<string>      text_pool;  // chunk text that isn't in data
+   digest_t           digest;
+   file_stat          stat;
+   sqlite3_int64      contentrow; // set by index_prepare_for_file()
+   file_window        window;
+   vector<file_region> regions;    // set by find_regions()
+
+   vector<parse_frame> frames;     // grows with the #if nesting, see frame_count
    int                frame_count;
    int                frame_pp_level;
+   int                frame_ref_no;
 
    int                lang_flags; // LANG_xxx
 
    ListManager<chunk_t> chunk_list;
+   Arena<chunk_t>       chunk_arena; // owns all chunks in chunk_list
+
+   /* Interned scope names, scope 0 is the empty scope. A scope is built
+    * once per scope opening and shared by all chunks inside it.
+    */
+   deque<string>              scopes;
+   unordered_map<string, int> scope_ids;
+   unordered_map<UINT64, int> scope_joins; // (scope << 32 | suffix) -> scope
+
+   vector<index_entry> entries;
+
+   UINT64             stage_ns[STAGE_COUNT]; // see time_stage()
+   int                chunk_count;           // only counted for --stats
+
+   file_limit         limit;           // the limit the file reached
+   UINT64             deadline;        // stage_clock() time for --max-time, 0 for none
+   UINT32             deadline_checks;
 };
 
+/**
+ * Whether the file is in one of the languages given. The passes that run
+ * on every chunk are compiled once for LANGS = LANG_CCPP and once for
+ * LANG_ALL, so the C and C++ variant has no branches for other languages.
+ */
+template <int LANGS>
+static inline bool lang_is(const fp_data& fpd, int lang)
+{
+   return(((LANGS & lang) != 0) && ((fpd.lang_flags & lang) != 0));
+}
+
+/**
+ * Process wide data. Only the index writer uses the index handles, the rest
+ * is set up before any file is processed and read-only afterwards.
+ */
 struct cp_data
 {
    int                forced_lang_flags; // LANG_xxx
    sqlite3            *index;
 
-   sqlite3_stmt       *stmt_insert_reference;
+   sqlite3_stmt       *stmt_insert_ref_block;
    sqlite3_stmt       *stmt_insert_definition;
    sqlite3_stmt       *stmt_insert_declaration;
+   sqlite3_stmt       *stmt_insert_definitions;  // INDEX_BATCH_ROWS at once
+   sqlite3_stmt       *stmt_insert_declarations;
 
    sqlite3_stmt       *stmt_begin;
    sqlite3_stmt       *stmt_commit;
+   sqlite3_stmt       *stmt_savepoint;
+   sqlite3_stmt       *stmt_release;
+   sqlite3_stmt       *stmt_rollback;
    sqlite3_stmt       *stmt_insert_file;
-   sqlite3_stmt       *stmt_remove_file;
    sqlite3_stmt       *stmt_prune_refs;
    sqlite3_stmt       *stmt_prune_defs;
    sqlite3_stmt       *stmt_prune_decls;
    sqlite3_stmt       *stmt_change_digest;
    sqlite3_stmt       *stmt_lookup_file;
+   sqlite3_stmt       *stmt_lookup_content;
+   sqlite3_stmt       *stmt_insert_content;
+   sqlite3_stmt       *stmt_content_used;
+   sqlite3_stmt       *stmt_delete_content;
+   sqlite3_stmt       *stmt_lookup_regions;
+   sqlite3_stmt       *stmt_insert_region;
+   sqlite3_stmt       *stmt_prune_regions;
+   sqlite3_stmt       *stmt_change_content;
+   sqlite3_stmt       *stmt_lookup_ref_blocks;
+   sqlite3_stmt       *stmt_cut_defs;
+   sqlite3_stmt       *stmt_cut_decls;
+   sqlite3_stmt       *stmt_shift_defs;
+   sqlite3_stmt       *stmt_shift_decls;
+   sqlite3_stmt       *stmt_insert_call;
+   sqlite3_stmt       *stmt_prune_calls;
+   sqlite3_stmt       *stmt_insert_change;
+   sqlite3_stmt       *stmt_trim_changes;
+   sqlite3_stmt       *stmt_cut_calls;
+   sqlite3_stmt       *stmt_shift_calls;
+   sqlite3_stmt       *stmt_lookup_scope;
+   sqlite3_stmt       *stmt_insert_scope;
+   sqlite3_stmt       *stmt_find_identifier;
+   sqlite3_stmt       *stmt_insert_identifier;
+   sqlite3_stmt       *stmt_insert_trigram;
+
+   unordered_map<string, sqlite3_int64> scope_rows;      // Scopes table cache
+   unordered_map<string, sqlite3_int64> identifier_rows; // Identifiers cache
+   index_bloom        bloom;                             // of the Identifiers
+
+   /* Lookup statements by sub type mask, (IST_ALL + 1) apart for each way
+    * of finding the identifiers, unranked and then ranked, see
+    * index_lookup_statement(). Prepared on first use.
+    */
+   sqlite3_stmt       *stmt_lookup_identifier[INDEX_LOOKUP_STATEMENTS];
+
+   /* Files are stored in one transaction until either limit is reached,
+    * 0 means no limit.
+    */
+   int                commit_files;
+   int                commit_entries;
+
+   int                prefetch_files;  // see FilePrefetch
+   bool               read_sources;    // read rather than map them, see index_watch()
+
+   /* Per-file limits of the complete analysis, 0 means no limit */
+   UINT64             max_size;
+   int                max_chunks;
+   int                max_time_ms;
+
+   bool               in_transaction;
+   int                pending_files;
+   int                pending_entries;
+   int                failed_files;    // not read or stored, see index_source_files()
+
+   bool               partial;  // the lookup indexes are left to --merge
+
+   /* How indexing keeps the index readable, see --wal and --snapshot */
+   bool               wal;
+   bool               snapshot;
+   string             index_file;     // the open index file, "" if in memory
+   UINT64             index_inode;
+   string             snapshot_file;  // written instead of index_file until closed
 };
 
 extern struct cp_data cpd;
 
-typedef enum
-{
-   IT_IDENTIFIER,        // Unspecified identifier
-   IT_MACRO,             // preprocessor macro
-   IT_MACRO_FUNCTION,    // function like preprocessor macro
-   IT_FUNCTION,          // functions
-   IT_STRUCT,            // struct <tag>
-   IT_UNION,             // union <tag>
-   IT_ENUM,              // enum <tag>
-   IT_ENUM_VAL,          // values of an enum
-   IT_CLASS,             // class
-   IT_STRUCT_TYPE,       // typedef alias of a struct
-   IT_UNION_TYPE,        // typedef alias of a union
-   IT_ENUM_TYPE,         // typedef alias of an enum
-   IT_FUNCTION_TYPE,     // typedef of a function or function ptr
-   IT_TYPE,              // a type
-   IT_VAR,               // a variable
-   IT_NAMESPACE,         // a namespace
-} id_type;
-
-typedef enum
-{
-   IST_REFERENCE,
-   IST_DEFINITION,
-   IST_DECLARATION,
-} id_sub_type;
-
 #endif   /* TOKS_TYPES_H_INCLUDED */
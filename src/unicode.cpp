@@ -15,146 +15,188 @@
 #include <sys/stat.h>
 
 
-static void encode_utf8(int ch, vector<UINT8>& res)
+#if defined(__SSE2__) || defined(_M_X64)
+#define UNICODE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+/**
+ * Store a code point as UTF-8, at most 4 bytes for those UTF-16 can encode
+ *
+ * @return  The end of the stored bytes
+ */
+static inline UINT8 *encode_utf8(int ch, UINT8 *out)
 {
-   if (ch < 0)
-   {
-      /* illegal code - do not store */
-   }
-   else if (ch < 0x80)
+   if (ch < 0x80)
    {
       /* 0xxxxxxx */
-      res.push_back(ch);
+      *out++ = ch;
    }
    else if (ch < 0x0800)
    {
       /* 110xxxxx 10xxxxxx */
-      res.push_back(0xC0 | (ch >> 6));
-      res.push_back(0x80 | (ch & 0x3f));
+      *out++ = 0xC0 | (ch >> 6);
+      *out++ = 0x80 | (ch & 0x3f);
    }
    else if (ch < 0x10000)
    {
       /* 1110xxxx 10xxxxxx 10xxxxxx */
-      res.push_back(0xE0 | (ch >> 12));
-      res.push_back(0x80 | ((ch >> 6) & 0x3f));
-      res.push_back(0x80 | (ch & 0x3f));
+      *out++ = 0xE0 | (ch >> 12);
+      *out++ = 0x80 | ((ch >> 6) & 0x3f);
+      *out++ = 0x80 | (ch & 0x3f);
    }
-   else if (ch < 0x200000)
+   else
    {
       /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */
-      res.push_back(0xF0 | (ch >> 18));
-      res.push_back(0x80 | ((ch >> 12) & 0x3f));
-      res.push_back(0x80 | ((ch >> 6) & 0x3f));
-      res.push_back(0x80 | (ch & 0x3f));
-   }
-   else if (ch < 0x4000000)
-   {
-      /* 111110xx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx */
-      res.push_back(0xF8 | (ch >> 24));
-      res.push_back(0x80 | ((ch >> 18) & 0x3f));
-      res.push_back(0x80 | ((ch >> 12) & 0x3f));
-      res.push_back(0x80 | ((ch >> 6) & 0x3f));
-      res.push_back(0x80 | (ch & 0x3f));
-   }
-   else /* (ch <= 0x7fffffff) */
-   {
-      /* 1111110x 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx */
-      res.push_back(0xFC | (ch >> 30));
-      res.push_back(0x80 | ((ch >> 24) & 0x3f));
-      res.push_back(0x80 | ((ch >> 18) & 0x3f));
-      res.push_back(0x80 | ((ch >> 12) & 0x3f));
-      res.push_back(0x80 | ((ch >> 6) & 0x3f));
-      res.push_back(0x80 | (ch & 0x3f));
+      *out++ = 0xF0 | (ch >> 18);
+      *out++ = 0x80 | ((ch >> 12) & 0x3f);
+      *out++ = 0x80 | ((ch >> 6) & 0x3f);
+      *out++ = 0x80 | (ch & 0x3f);
    }
+   return(out);
+}
+
+
+/* The code unit at idx, the caller checks the bounds */
+static inline int get_word(const UINT8 *in_data, int idx, bool be)
+{
+   const UINT8 *p = in_data + 2 * idx;
+
+   return(be ? ((p[0] << 8) | p[1]) : (p[0] | (p[1] << 8)));
 }
 
 
 /**
- * Extract 2 bytes from the stream and increment idx by 2
+ * Copy the leading code units below 0x80 to out as bytes, SSE2 takes
+ * 16 of them per step
+ *
+ * @return  The number of code units copied
  */
-static int get_word(const vector<UINT8>& in_data, int& idx, bool be)
+static inline int copy_ascii_utf16(const UINT8 *in_data, int units, bool be, UINT8 *out)
 {
-   int ch;
+   int i = 0;
 
-   if ((idx + 2) > (int)in_data.size())
-   {
-      ch = -1;
-   }
-   else if (be)
+#ifdef UNICODE_SSE2
+   const __m128i not_ascii = _mm_set1_epi16((short) 0xff80);
+
+   for ( ; i + 16 <= units; i += 16)
    {
-      ch = (in_data[idx] << 8) | in_data[idx + 1];
+      __m128i a = _mm_loadu_si128((const __m128i *) (in_data + 2 * i));
+      __m128i b = _mm_loadu_si128((const __m128i *) (in_data + 2 * i + 16));
+
+      if (be)
+      {
+         a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+         b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+      }
+
+      __m128i high = _mm_and_si128(_mm_or_si128(a, b), not_ascii);
+
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xffff)
+      {
+         break;
+      }
+      _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(a, b));
    }
-   else
+#endif
+
+   for ( ; i < units; i++)
    {
-      ch = in_data[idx] | (in_data[idx + 1] << 8);
+      int ch = get_word(in_data, i, be);
+
+      if (ch >= 0x80)
+      {
+         break;
+      }
+      out[i] = ch;
    }
-   idx += 2;
-   return ch;
+   return(i);
 }
 
 
 /**
- * Decode a UTF-16 sequence and convert to UTF-8.
+ * Decode a UTF-16 sequence and convert to UTF-8, checking the surrogate
+ * pairs on the way. The output is sized for the worst case up front, a code
+ * unit takes at most 3 bytes and a pair 4.
  */
-static bool decode_utf16_to_utf8(const vector<UINT8>& in_data, vector<UINT8>& out_data, CharEncoding enc)
+static bool decode_utf16_to_utf8(const UINT8 *in_data, int size, vector<UINT8>& out_data, CharEncoding enc)
 {
-   int idx = 0;
-
-   if (in_data.size() & 1)
+   if (size & 1)
    {
       /* can't have an odd length */
       return false;
    }
 
-   if (in_data.size() < 2)
+   if (size < 2)
    {
       /* we require at least 1 char */
       return false;
    }
 
-   bool be = (enc == ENC_UTF16_BE);
+   bool   be    = (enc == ENC_UTF16_BE);
+   int    units = size / 2;
+   int    idx   = 0;
+   bool   ok    = true;
+   size_t start = out_data.size();
+
+   out_data.resize(start + 3 * (size_t) units);
+
+   UINT8 *first = &out_data[0];
+   UINT8 *out   = first + start;
 
-   while (idx < (int)in_data.size())
+   while (idx < units)
    {
-      int ch = get_word(in_data, idx, be);
+      int ascii = copy_ascii_utf16(in_data + 2 * idx, units - idx, be, out);
+
+      idx += ascii;
+      out += ascii;
+      if (idx >= units)
+      {
+         break;
+      }
+
+      int ch = get_word(in_data, idx++, be);
       if ((ch & 0xfc00) == 0xd800)
       {
-         ch  &= 0x3ff;
-         ch <<= 10;
-         int tmp = get_word(in_data, idx, be);
+         int tmp = (idx < units) ? get_word(in_data, idx++, be) : 0;
          if ((tmp & 0xfc00) != 0xdc00)
          {
-            return false;
+            ok = false;
+            break;
          }
-         ch |= (tmp & 0x3ff);
-         ch += 0x10000;
-         encode_utf8(ch, out_data);
+         ch = (((ch & 0x3ff) << 10) | (tmp & 0x3ff)) + 0x10000;
       }
-      else if (((ch >= 0) && (ch < 0xD800)) || (ch >= 0xE000))
-      {
-         encode_utf8(ch, out_data);
-      }
-      else
+      else if ((ch & 0xfc00) == 0xdc00)
       {
          /* invalid character */
-         return false;
+         ok = false;
+         break;
       }
+      out = encode_utf8(ch, out);
+   }
+
+   if (!ok)
+   {
+      out_data.resize(start);
+      return false;
    }
+
+   out_data.resize(out - first);
    return true;
 }
 
 
 /**
  * Looks for the BOM of UTF-16 and UTF-8.
- * On return the p_file position indicator will be past any bom found.
+ * On return skip is the size of any bom found.
  */
-static CharEncoding decode_bom(FILE *p_file)
+static CharEncoding decode_bom(const UINT8 *data, size_t size, int& skip)
 {
    CharEncoding enc = ENC_UTF8;
-   unsigned char data[6];
-   int len, skip = 0;
+   int len = (size < 6) ? (int) size : 6;
 
-   len = fread(data, 1, 6, p_file);
+   skip = 0;
 
    if (len >= 2)
    {
@@ -189,70 +231,51 @@ static CharEncoding decode_bom(FILE *p_file)
       }
    }
 
-   fseek(p_file, skip, SEEK_SET);
    return enc;
 }
 
-/* Decode any supported file to UTF-8 */
-bool decode_file(vector<UINT8>& out_data, const char *filename)
+/**
+ * Decode any supported file to UTF-8.
+ * UTF-8 files are used directly from the mapped file, only UTF-16 files are
+ * converted into a copy.
+ *
+ * @param read  Read the file instead, it may be truncated while it is
+ *              analyzed, see --watch
+ */
+bool decode_file(SourceBuffer& out_data, const char *filename, bool read)
 {
-   bool retval = false;
-   struct stat my_stat;
-   FILE *p_file;
+   int skip;
 
-   /* Grab the stat info for the file and open it */
-   if ((stat(filename, &my_stat) < 0) ||
-       ((p_file = fopen(filename, "rb")) == NULL))
+   if (!(read ? out_data.Read(filename) : out_data.Map(filename)))
    {
-      LOG_FMT(LERR, "%s: %s\n",
-              filename, strerror(errno));
-      return retval;
+      return(false);
    }
 
-   if (my_stat.st_size == 0)
+   if (out_data.Size() == 0)
    {
       /* Empty file */
-      retval = true;
+      return(true);
    }
-   else
+
+   /* Determine encoding and skip any bom */
+   CharEncoding enc = decode_bom(out_data.Data(), out_data.Size(), skip);
+
+   out_data.Skip(skip);
+
+   if ((enc == ENC_UTF16_LE) || (enc == ENC_UTF16_BE))
    {
-      /* Determine encoding and skip any bom */
-      CharEncoding enc = decode_bom(p_file);
+      /* A file read is in the copy already, decode next to it */
+      vector<UINT8> utf8;
 
-      if (enc == ENC_UTF8)
-      {
-         out_data.resize(my_stat.st_size - ftell(p_file));
-         if (fread(&out_data[0], out_data.size(), 1, p_file) == 1)
-         {
-            retval = true;
-         }
-         else
-         {
-            LOG_FMT(LERR, "%s: %s\n",
-                    filename, strerror(errno));
-         }
-      }
-      else if ((enc == ENC_UTF16_LE) || (enc == ENC_UTF16_BE))
+      if (!decode_utf16_to_utf8(out_data.Data(), out_data.Size(), utf8, enc))
       {
-         vector<UINT8> in_data;
-         in_data.resize(my_stat.st_size - ftell(p_file));
-         if (fread(&in_data[0], in_data.size(), 1, p_file) == 1)
-         {
-            out_data.reserve(in_data.size());
-            retval = decode_utf16_to_utf8(in_data, out_data, enc);
-            if (!retval)
-            {
-               LOG_FMT(LERR, "%s: UTF-16 decoding error\n", filename);
-            }
-         }
-         else
-         {
-            LOG_FMT(LERR, "%s: %s\n",
-                    filename, strerror(errno));
-         }
+         LOG_FMT(LERR, "%s: UTF-16 decoding error\n", filename);
+         out_data.Release();
+         return(false);
       }
+      out_data.Copy().swap(utf8);
+      out_data.UseCopy();
    }
 
-   fclose(p_file);
-   return(retval);
+   return(true);
 }
@@ -0,0 +1,395 @@
+/**
+ * @file watch.cpp
+ * Keeps an index current while the files of a directory are edited. The
+ * directory is indexed once, then inotify reports every saved, moved and
+ * deleted file. Changes are collected until none arrived for a moment, so
+ * a burst of saves or a checkout is indexed in one batch, and a batch is
+ * stored in a single transaction (as far as --commit-files and
+ * --commit-entries allow).
+ *
+ * Files are read into memory, not mapped, as they may be truncated while
+ * they are analyzed. A file that changed while its batch was indexed is
+ * indexed again with the next batch.
+ *
+ * Hidden directories like .git are not watched.
+ *
+ * @license GPL v2+
+ */
+#include "toks_types.h"
+#include "prototypes.h"
+#include "SourceList.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#ifndef __linux__
+
+bool index_watch(const char *dir, int jobs, bool dump)
+{
+   LOG_FMT(LERR, "--watch is not supported on this platform\n");
+   return(false);
+}
+
+#else
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <map>
+#include <algorithm>
+
+/* A batch is indexed once no change arrived for this long */
+#define WATCH_QUIET_MS      250
+
+/* or at the latest this long after its first change */
+#define WATCH_MAX_DELAY_MS  2000
+
+#define WATCH_FILE_EVENTS   (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+#define WATCH_DIR_EVENTS    (IN_CREATE | IN_ONLYDIR)
+
+
+struct watch_state
+{
+   int                 fd;
+   string              root;     // prefix of the watched directory
+   map<int, string>    dirs;     // watch descriptor to directory prefix
+   map<string, bool>   pending;  // file name to changed (true) or deleted
+   bool                prune;    // a directory went away, check all files
+   UINT64              first;    // clock of the first pending change
+};
+
+static volatile sig_atomic_t watch_stop;
+
+
+static void watch_signal(int sig)
+{
+   watch_stop = 1;
+}
+
+
+/* Milliseconds since a stage_clock() time */
+static UINT64 watch_elapsed_ms(UINT64 start)
+{
+   return((stage_clock() - start) / 1000000);
+}
+
+
+/**
+ * Watch a directory and the ones below it. The source files found are
+ * added to found, or marked as changed if found is NULL.
+ *
+ * @param prefix  The directory as it starts the file names, "" or ending in /
+ */
+static void watch_directory(watch_state& ws, const string& prefix, SourceList *found)
+{
+   const char *path = prefix.empty() ? "." : prefix.c_str();
+   struct dirent *entry;
+   struct stat st;
+   DIR *dir;
+   int wd;
+
+   wd = inotify_add_watch(ws.fd, path, WATCH_FILE_EVENTS | WATCH_DIR_EVENTS);
+   if (wd < 0)
+   {
+      LOG_FMT(LWARN, "Unable to watch %s: %s (%d)\n", path, strerror(errno), errno);
+      return;
+   }
+   ws.dirs[wd] = prefix;
+
+   dir = opendir(path);
+   if (dir == NULL)
+   {
+      return;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      string name = prefix + entry->d_name;
+
+      if ((entry->d_name[0] == '.') || (lstat(name.c_str(), &st) != 0))
+      {
+         continue;
+      }
+
+      if (S_ISDIR(st.st_mode))
+      {
+         watch_directory(ws, name + "/", found);
+      }
+      else if (S_ISREG(st.st_mode) && is_source_file(name.c_str()))
+      {
+         if (found != NULL)
+         {
+            found->Add(name.c_str());
+         }
+         else
+         {
+            ws.pending[name] = true;
+         }
+      }
+   }
+   closedir(dir);
+}
+
+
+/* Record what an event tells about a file or directory */
+static void watch_event(watch_state& ws, const struct inotify_event *event)
+{
+   map<int, string>::iterator it;
+   string name;
+
+   if (event->mask & IN_Q_OVERFLOW)
+   {
+      /* Changes were lost, look at everything again */
+      LOG_FMT(LWARN, "Too many changes at once, rescanning\n");
+      watch_directory(ws, ws.root, NULL);
+      ws.prune = true;
+      return;
+   }
+
+   it = ws.dirs.find(event->wd);
+   if (it == ws.dirs.end())
+   {
+      return;
+   }
+   if (event->mask & IN_IGNORED)
+   {
+      ws.dirs.erase(it);
+      return;
+   }
+   if ((event->len == 0) || (event->name[0] == '.'))
+   {
+      return;
+   }
+
+   name = it->second + event->name;
+
+   if (event->mask & IN_ISDIR)
+   {
+      if (event->mask & (IN_CREATE | IN_MOVED_TO))
+      {
+         watch_directory(ws, name + "/", NULL);
+      }
+      else if (event->mask & IN_MOVED_FROM)
+      {
+         /* The watches stay with the moved directories, drop them */
+         string moved = name + "/";
+
+         for (it = ws.dirs.begin(); it != ws.dirs.end(); )
+         {
+            if (it->second.compare(0, moved.size(), moved) == 0)
+            {
+               (void) inotify_rm_watch(ws.fd, it->first);
+               ws.dirs.erase(it++);
+            }
+            else
+            {
+               ++it;
+            }
+         }
+         ws.prune = true;
+      }
+   }
+   else if (is_source_file(name.c_str()))
+   {
+      if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+      {
+         ws.pending[name] = true;
+      }
+      else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+      {
+         ws.pending[name] = false;
+      }
+   }
+}
+
+
+/**
+ * Index the pending changes in one batch. The changed files that have
+ * another size or time afterwards are pending again.
+ */
+static void watch_index_batch(watch_state& ws, int jobs, bool dump)
+{
+   SourceList source_files;
+   vector<string> deleted;
+   map<string, file_stat> changed;
+
+   for (map<string, bool>::iterator it = ws.pending.begin(); it != ws.pending.end(); ++it)
+   {
+      if (it->second)
+      {
+         file_stat st;
+
+         source_files.Add(it->first.c_str());
+         if (get_file_stat(it->first.c_str(), st))
+         {
+            changed[it->first] = st;
+         }
+      }
+      else
+      {
+         deleted.push_back(it->first);
+      }
+   }
+
+   LOG_FMT(LNOTE, "Indexing %d changed and %d deleted files\n",
+           (int)(ws.pending.size() - deleted.size()), (int)deleted.size());
+
+   if (index_prepare_for_analysis())
+   {
+      if ((!ws.prune || index_prune_files(jobs, NULL)) &&
+          index_remove_files(deleted))
+      {
+         (void) index_source_files(source_files, jobs, dump);
+      }
+      (void) index_end_analysis();
+   }
+
+   ws.pending.clear();
+   ws.prune = false;
+
+   for (map<string, file_stat>::iterator it = changed.begin(); it != changed.end(); ++it)
+   {
+      file_stat st;
+
+      if (get_file_stat(it->first.c_str(), st) && !(st == it->second))
+      {
+         LOG_FMT(LNOTE, "%s changed while it was indexed, indexing it again\n", it->first.c_str());
+         ws.pending[it->first] = true;
+      }
+   }
+   if (!ws.pending.empty())
+   {
+      ws.first = stage_clock();
+   }
+}
+
+
+/**
+ * Index the source files below dir and keep the open index current until
+ * interrupted.
+ */
+bool index_watch(const char *dir, int jobs, bool dump)
+{
+   alignas(struct inotify_event) char buf[65536];
+   struct sigaction action;
+   SourceList source_files;
+   watch_state ws;
+   string prefix(dir);
+
+   while ((prefix.size() > 1) && (prefix[prefix.size() - 1] == '/'))
+   {
+      prefix.erase(prefix.size() - 1);
+   }
+   if (prefix == ".")
+   {
+      prefix.clear();
+   }
+   else
+   {
+      prefix += "/";
+   }
+
+   ws.fd = inotify_init1(IN_CLOEXEC);
+   if (ws.fd < 0)
+   {
+      LOG_FMT(LERR, "%s: inotify failed: %s (%d)\n", __func__, strerror(errno), errno);
+      return(false);
+   }
+   ws.prune = false;
+   ws.first = 0;
+
+   /* Truncating a mapped file during its analysis would raise SIGBUS */
+   cpd.read_sources = true;
+
+   /* No SA_RESTART, so poll() returns when asked to stop */
+   memset(&action, 0, sizeof(action));
+   action.sa_handler = watch_signal;
+   sigemptyset(&action.sa_mask);
+   (void) sigaction(SIGINT, &action, NULL);
+   (void) sigaction(SIGTERM, &action, NULL);
+
+   /* Watch before the first pass, so no change in between is missed */
+   ws.root = prefix;
+   watch_directory(ws, prefix, &source_files);
+   if (ws.dirs.empty())
+   {
+      close(ws.fd);
+      return(false);
+   }
+
+   if (index_prepare_for_analysis())
+   {
+      (void) index_source_list(source_files, jobs, dump, false);
+      (void) index_end_analysis();
+   }
+
+   LOG_FMT(LNOTE, "Watching %d directories below %s\n", (int)ws.dirs.size(), dir);
+
+   while (!watch_stop)
+   {
+      struct pollfd pfd;
+      int timeout = -1;
+      int ready;
+
+      if (!ws.pending.empty() || ws.prune)
+      {
+         UINT64 waited = watch_elapsed_ms(ws.first);
+
+         timeout = (waited >= WATCH_MAX_DELAY_MS) ? 0 :
+                   (int)min((UINT64)WATCH_QUIET_MS, WATCH_MAX_DELAY_MS - waited);
+      }
+
+      pfd.fd     = ws.fd;
+      pfd.events = POLLIN;
+      ready      = poll(&pfd, 1, timeout);
+
+      if (ready < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         LOG_FMT(LERR, "%s: poll failed: %s (%d)\n", __func__, strerror(errno), errno);
+         break;
+      }
+
+      if (ready == 0)
+      {
+         watch_index_batch(ws, jobs, dump);
+         continue;
+      }
+
+      ssize_t len = read(ws.fd, buf, sizeof(buf));
+      bool    was_idle = ws.pending.empty() && !ws.prune;
+
+      for (ssize_t pos = 0; pos < len; )
+      {
+         const struct inotify_event *event = (const struct inotify_event *) (buf + pos);
+
+         watch_event(ws, event);
+         pos += sizeof(struct inotify_event) + event->len;
+      }
+
+      if (was_idle && (!ws.pending.empty() || ws.prune))
+      {
+         ws.first = stage_clock();
+      }
+   }
+
+   if (!ws.pending.empty() || ws.prune)
+   {
+      watch_index_batch(ws, jobs, dump);
+   }
+
+   close(ws.fd);
+
+   return(true);
+}
+
+#endif
@@ -16,6 +16,7 @@ typedef char               CHAR;
 typedef signed char        INT8;
 typedef short              INT16;
 typedef int                INT32;
+typedef long long          INT64;
 
 typedef unsigned char      UINT8;
 typedef unsigned short     UINT16;